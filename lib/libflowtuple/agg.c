@@ -0,0 +1,500 @@
+/*
+ *  agg.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "flowtuple.h"
+#include "fttypes.h"
+#include "util.h"
+
+/* slots probed at once */
+#define GROUP_SIZE 16
+#define CTRL_EMPTY 0x80
+/* slots of a new table, and of the smallest one */
+#define INITIAL_CAPACITY 4096
+/* tuples keyed and hashed in one go */
+#define CHUNK_SIZE 256
+/* tuples read at once by flowtuple_agg_read */
+#define READ_SIZE 4096
+
+static const uint8_t field_bits[FLOWTUPLE_FIELD_COUNT] = {32, 32, 16, 16, 8, 8, 8, 16};
+
+static inline uint64_t _flowtuple_agg_hash(const uint64_t *key) {
+    uint64_t h = key[0] * 0x9e3779b97f4a7c15ull ^ (key[1] + 0x632be59bd9b4e019ull) * 0xbf58476d1ce4e5b9ull;
+
+    h ^= h >> 31;
+    h *= 0x94d049bb133111ebull;
+    h ^= h >> 29;
+    return h;
+}
+
+/* bits of the slots of the group holding tag, and of its empty slots */
+static inline uint32_t _flowtuple_agg_match(const uint8_t *ctrl, uint8_t tag, uint32_t *empty) {
+#ifdef __SSE2__
+    __m128i group = _mm_loadu_si128((const __m128i*)ctrl);
+
+    *empty = (uint32_t)_mm_movemask_epi8(group);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)tag)));
+#else
+    uint32_t match = 0;
+
+    *empty = 0;
+    for (int i = 0; i < GROUP_SIZE; i++) {
+        match |= (uint32_t)(ctrl[i] == tag) << i;
+        *empty |= (uint32_t)(ctrl[i] == CTRL_EMPTY) << i;
+    }
+    return match;
+#endif
+}
+
+/* returns the entry of key, adding an empty one if missing, the table must have room */
+static flowtuple_agg_entry_t *_flowtuple_agg_find(flowtuple_agg_t *agg, const uint64_t *key, uint64_t h) {
+    size_t mask = agg->capacity / GROUP_SIZE - 1;
+    size_t group = (size_t)(h >> 7) & mask;
+    uint8_t tag = (uint8_t)(h & 0x7f);
+    flowtuple_agg_entry_t *entry;
+    uint32_t match;
+    uint32_t empty;
+    size_t slot;
+
+    /* groups are probed linearly, and as nothing is ever removed
+     * a group with an empty slot ends the probe */
+    for (;;) {
+        match = _flowtuple_agg_match(agg->ctrl + group * GROUP_SIZE, tag, &empty);
+        while (match != 0) {
+            slot = group * GROUP_SIZE + (size_t)__builtin_ctz(match);
+            entry = &(agg->entries[slot]);
+            if (entry->key[0] == key[0] && entry->key[1] == key[1]) {
+                return entry;
+            }
+            match &= match - 1;
+        }
+
+        if (empty != 0) {
+            slot = group * GROUP_SIZE + (size_t)__builtin_ctz(empty);
+            agg->ctrl[slot] = tag;
+            entry = &(agg->entries[slot]);
+            entry->key[0] = key[0];
+            entry->key[1] = key[1];
+            entry->packets = 0;
+            entry->tuples = 0;
+            agg->size++;
+            return entry;
+        }
+        group = (group + 1) & mask;
+    }
+}
+
+static int _flowtuple_agg_alloc(flowtuple_agg_t *agg, size_t capacity) {
+    MALLOC(agg->ctrl, capacity, return -1);
+    MALLOC(agg->entries, capacity * sizeof(flowtuple_agg_entry_t), FREE(agg->ctrl); return -1);
+    memset(agg->ctrl, CTRL_EMPTY, capacity);
+    agg->capacity = capacity;
+    agg->size = 0;
+    return 0;
+}
+
+static void _flowtuple_agg_clear(flowtuple_agg_t *agg) {
+    memset(agg->ctrl, CTRL_EMPTY, agg->capacity);
+    agg->size = 0;
+}
+
+static FILE *_flowtuple_agg_spill_file(flowtuple_agg_t *agg) {
+    FILE *file;
+    char *path;
+    int fd;
+
+    if (agg->spill_dir == NULL) {
+        return tmpfile();
+    }
+
+    MALLOC(path, strlen(agg->spill_dir) + 20, return NULL);
+    sprintf(path, "%s/flowagg.XXXXXX", agg->spill_dir);
+    if ((fd = mkstemp(path)) < 0) {
+        FREE(path);
+        return NULL;
+    }
+    unlink(path);
+    FREE(path);
+
+    if ((file = fdopen(fd, "w+b")) == NULL) {
+        close(fd);
+    }
+    return file;
+}
+
+/* appends every group to the partition of its hash and empties the table */
+static int _flowtuple_agg_spill(flowtuple_agg_t *agg) {
+    flowtuple_agg_entry_t *entry;
+    int part;
+
+    for (size_t i = 0; i < agg->capacity; i++) {
+        if (agg->ctrl[i] == CTRL_EMPTY) {
+            continue;
+        }
+        entry = &(agg->entries[i]);
+        part = (int)(_flowtuple_agg_hash(entry->key) >> (64 - FLOWTUPLE_AGG_PARTITION_BITS));
+        if (agg->spills[part] == NULL && (agg->spills[part] = _flowtuple_agg_spill_file(agg)) == NULL) {
+            return -1;
+        }
+        if (fwrite(entry, sizeof(flowtuple_agg_entry_t), 1, agg->spills[part]) != 1) {
+            return -1;
+        }
+    }
+
+    agg->spilled = 1;
+    _flowtuple_agg_clear(agg);
+    return 0;
+}
+
+/* makes room for one more group, growing the table up to the budget
+ * unless limited is 0, and spilling it beyond */
+static int _flowtuple_agg_reserve(flowtuple_agg_t *agg, int limited) {
+    flowtuple_agg_entry_t *entries = agg->entries;
+    uint8_t *ctrl = agg->ctrl;
+    size_t capacity = agg->capacity;
+    flowtuple_agg_entry_t *entry;
+
+    /* at most 7/8 full, so probes stay short */
+    if (agg->size < capacity - capacity / 8) {
+        return 0;
+    }
+
+    if (limited && agg->budget > 0 && capacity * 2 * (sizeof(flowtuple_agg_entry_t) + 1) > agg->budget) {
+        return _flowtuple_agg_spill(agg);
+    }
+
+    if (_flowtuple_agg_alloc(agg, capacity * 2) < 0) {
+        agg->ctrl = ctrl;
+        agg->entries = entries;
+        return -1;
+    }
+
+    for (size_t i = 0; i < capacity; i++) {
+        if (ctrl[i] != CTRL_EMPTY) {
+            entry = _flowtuple_agg_find(agg, entries[i].key, _flowtuple_agg_hash(entries[i].key));
+            entry->packets = entries[i].packets;
+            entry->tuples = entries[i].tuples;
+        }
+    }
+    FREE(ctrl);
+    FREE(entries);
+    return 0;
+}
+
+flowtuple_agg_t *flowtuple_agg_create(uint32_t fields, size_t budget) {
+    flowtuple_agg_t *agg;
+    size_t capacity = INITIAL_CAPACITY;
+    int word = 0;
+    int shift = 0;
+
+    CHECK(fields != 0 && fields < FLOWTUPLE_FIELD_MASK(FLOWTUPLE_FIELD_COUNT), return NULL);
+    CALLOC(agg, 1, sizeof(flowtuple_agg_t), return NULL);
+    agg->fields = fields;
+    agg->budget = budget;
+
+    /* fields are packed into the two key words without straddling them */
+    for (int f = 0; f < FLOWTUPLE_FIELD_COUNT; f++) {
+        agg->widths[f] = 1;
+        if (!(fields & FLOWTUPLE_FIELD_MASK(f))) {
+            continue;
+        }
+        if (shift + field_bits[f] > 64) {
+            word++;
+            shift = 0;
+        }
+        if (word > 1) {
+            FREE(agg);
+            return NULL;
+        }
+        agg->words[f] = (uint8_t)word;
+        agg->shifts[f] = (uint8_t)shift;
+        shift += field_bits[f];
+    }
+
+    /* a small budget starts with a small table */
+    while (budget > 0 && capacity > GROUP_SIZE && capacity * (sizeof(flowtuple_agg_entry_t) + 1) > budget) {
+        capacity /= 2;
+    }
+    if (_flowtuple_agg_alloc(agg, capacity) < 0) {
+        FREE(agg);
+        return NULL;
+    }
+    return agg;
+}
+
+void flowtuple_agg_free(flowtuple_agg_t *agg) {
+    CHECK(agg != NULL, return);
+
+    for (int i = 0; i < FLOWTUPLE_AGG_PARTITIONS; i++) {
+        if (agg->spills[i] != NULL) {
+            fclose(agg->spills[i]);
+        }
+    }
+    FREE(agg->spill_dir);
+    FREE(agg->ctrl);
+    FREE(agg->entries);
+    FREE(agg);
+}
+
+int flowtuple_agg_set_bucket(flowtuple_agg_t *agg, flowtuple_field_t field, uint32_t width) {
+    CHECK(agg != NULL && !agg->started && field < FLOWTUPLE_FIELD_COUNT && width > 0, return -1);
+    agg->widths[field] = width;
+    return 0;
+}
+
+int flowtuple_agg_set_spill_dir(flowtuple_agg_t *agg, const char *dir) {
+    char *copy = NULL;
+
+    CHECK(agg != NULL, return -1);
+    if (dir != NULL) {
+        MALLOC(copy, strlen(dir) + 1, return -1);
+        strcpy(copy, dir);
+    }
+    FREE(agg->spill_dir);
+    agg->spill_dir = copy;
+    return 0;
+}
+
+/* ors the bucket of a field of n tuples into their keys */
+#define PACK_FIELD(col) do { \
+        if (width == 1) { \
+            for (size_t i = 0; i < n; i++) { \
+                keys[i][word] |= (uint64_t)(col)[i] << shift; \
+            } \
+        } else { \
+            for (size_t i = 0; i < n; i++) { \
+                keys[i][word] |= (uint64_t)((col)[i] / width) << shift; \
+            } \
+        } \
+    } while (0)
+
+static void _flowtuple_agg_pack(flowtuple_agg_t *agg, const flowtuple_columns_t *cols, size_t n, uint64_t (*keys)[2]) {
+    uint32_t width;
+    int word;
+    int shift;
+
+    memset(keys, 0, n * sizeof(keys[0]));
+    for (int f = 0; f < FLOWTUPLE_FIELD_COUNT; f++) {
+        if (!(agg->fields & FLOWTUPLE_FIELD_MASK(f))) {
+            continue;
+        }
+        width = agg->widths[f];
+        word = agg->words[f];
+        shift = agg->shifts[f];
+
+        switch (f) {
+            case FLOWTUPLE_FIELD_SRC_IP:
+                PACK_FIELD(cols->src_ip);
+                break;
+            case FLOWTUPLE_FIELD_DST_IP:
+                PACK_FIELD(cols->dst_ip);
+                break;
+            case FLOWTUPLE_FIELD_SRC_PORT:
+                PACK_FIELD(cols->src_port);
+                break;
+            case FLOWTUPLE_FIELD_DST_PORT:
+                PACK_FIELD(cols->dst_port);
+                break;
+            case FLOWTUPLE_FIELD_PROTO:
+                PACK_FIELD(cols->proto);
+                break;
+            case FLOWTUPLE_FIELD_TTL:
+                PACK_FIELD(cols->ttl);
+                break;
+            case FLOWTUPLE_FIELD_TCP_FLAGS:
+                PACK_FIELD(cols->tcp_flags);
+                break;
+            case FLOWTUPLE_FIELD_IP_LEN:
+                PACK_FIELD(cols->ip_len);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+int flowtuple_agg_add_columns(flowtuple_agg_t *agg, const flowtuple_columns_t *cols, size_t n) {
+    uint64_t keys[CHUNK_SIZE][2];
+    uint64_t hashes[CHUNK_SIZE];
+    flowtuple_columns_t chunk;
+    flowtuple_agg_entry_t *entry;
+    size_t group_mask;
+    size_t m;
+
+    CHECK(agg != NULL && cols != NULL, return -1);
+    agg->started = 1;
+
+    for (size_t base = 0; base < n; base += m) {
+        m = n - base < CHUNK_SIZE ? n - base : CHUNK_SIZE;
+        chunk.src_ip = cols->src_ip + base;
+        chunk.dst_ip = cols->dst_ip + base;
+        chunk.src_port = cols->src_port + base;
+        chunk.dst_port = cols->dst_port + base;
+        chunk.proto = cols->proto + base;
+        chunk.ttl = cols->ttl + base;
+        chunk.tcp_flags = cols->tcp_flags + base;
+        chunk.ip_len = cols->ip_len + base;
+
+        _flowtuple_agg_pack(agg, &chunk, m, keys);
+        for (size_t i = 0; i < m; i++) {
+            hashes[i] = _flowtuple_agg_hash(keys[i]);
+        }
+
+        for (size_t i = 0; i < m; i++) {
+            if (_flowtuple_agg_reserve(agg, 1) < 0) {
+                return -1;
+            }
+
+            /* the groups of tuples a little further on are fetched while probing */
+            group_mask = agg->capacity / GROUP_SIZE - 1;
+            if (i + 8 < m) {
+                __builtin_prefetch(agg->ctrl + ((size_t)(hashes[i + 8] >> 7) & group_mask) * GROUP_SIZE);
+                __builtin_prefetch(agg->entries + ((size_t)(hashes[i + 8] >> 7) & group_mask) * GROUP_SIZE);
+            }
+
+            entry = _flowtuple_agg_find(agg, keys[i], hashes[i]);
+            entry->packets += cols->pkt_cnt[base + i];
+            entry->tuples++;
+        }
+    }
+    return 0;
+}
+
+long flowtuple_agg_read(flowtuple_agg_t *agg, flowtuple_handle_t *handle) {
+    flowtuple_columns_t cols;
+    flowtuple_batch_t batch;
+    uint8_t *block;
+    long total = 0;
+    long n;
+
+    CHECK(agg != NULL && handle != NULL, return -1);
+
+    /* one block for all columns, widest first */
+    MALLOC(block, READ_SIZE * (3 * sizeof(uint32_t) + 3 * sizeof(uint16_t) + 3 * sizeof(uint8_t)), return -1);
+    cols.src_ip = (uint32_t*)block;
+    cols.dst_ip = cols.src_ip + READ_SIZE;
+    cols.pkt_cnt = cols.dst_ip + READ_SIZE;
+    cols.src_port = (uint16_t*)(cols.pkt_cnt + READ_SIZE);
+    cols.dst_port = cols.src_port + READ_SIZE;
+    cols.ip_len = cols.dst_port + READ_SIZE;
+    cols.proto = (uint8_t*)(cols.ip_len + READ_SIZE);
+    cols.ttl = cols.proto + READ_SIZE;
+    cols.tcp_flags = cols.ttl + READ_SIZE;
+
+    for (;;) {
+        if ((n = flowtuple_read_columns(handle, &cols, READ_SIZE, &batch)) < 0) {
+            total = -1;
+            break;
+        } else if (n == 0 && batch.type == FLOWTUPLE_RECORD_TYPE_NULL) {
+            break;
+        }
+        if (n > 0 && flowtuple_agg_add_columns(agg, &cols, (size_t)n) < 0) {
+            total = -1;
+            break;
+        }
+        total += n;
+    }
+
+    FREE(block);
+    return total;
+}
+
+/* calls back with every group of the table and empties it */
+static long _flowtuple_agg_emit(flowtuple_agg_t *agg, flowtuple_agg_handler callback, void *args) {
+    uint32_t key[FLOWTUPLE_FIELD_COUNT];
+    flowtuple_agg_entry_t *entry;
+    uint64_t mask;
+    long count = 0;
+
+    for (size_t i = 0; i < agg->capacity; i++) {
+        if (agg->ctrl[i] == CTRL_EMPTY) {
+            continue;
+        }
+        entry = &(agg->entries[i]);
+        for (int f = 0; f < FLOWTUPLE_FIELD_COUNT; f++) {
+            key[f] = 0;
+            if (agg->fields & FLOWTUPLE_FIELD_MASK(f)) {
+                mask = (1ull << field_bits[f]) - 1;
+                key[f] = (uint32_t)((entry->key[agg->words[f]] >> agg->shifts[f]) & mask) * agg->widths[f];
+            }
+        }
+        callback(key, entry->packets, entry->tuples, args);
+        count++;
+    }
+
+    _flowtuple_agg_clear(agg);
+    return count;
+}
+
+long flowtuple_agg_finish(flowtuple_agg_t *agg, flowtuple_agg_handler callback, void *args) {
+    flowtuple_agg_entry_t spilled[CHUNK_SIZE];
+    flowtuple_agg_entry_t *entry;
+    long count = 0;
+    size_t got;
+    FILE *file;
+
+    CHECK(agg != NULL && callback != NULL, return -1);
+    agg->started = 0;
+
+    if (!agg->spilled) {
+        return _flowtuple_agg_emit(agg, callback, args);
+    }
+
+    /* a partition holds every spill of its groups, so each one
+     * is aggregated on its own, growing past the budget if need be */
+    if (_flowtuple_agg_spill(agg) < 0) {
+        return -1;
+    }
+    for (int p = 0; p < FLOWTUPLE_AGG_PARTITIONS; p++) {
+        if ((file = agg->spills[p]) == NULL) {
+            continue;
+        }
+        agg->spills[p] = NULL;
+        rewind(file);
+
+        while ((got = fread(spilled, sizeof(flowtuple_agg_entry_t), CHUNK_SIZE, file)) > 0) {
+            for (size_t i = 0; i < got; i++) {
+                if (_flowtuple_agg_reserve(agg, 0) < 0) {
+                    fclose(file);
+                    return -1;
+                }
+                entry = _flowtuple_agg_find(agg, spilled[i].key, _flowtuple_agg_hash(spilled[i].key));
+                entry->packets += spilled[i].packets;
+                entry->tuples += spilled[i].tuples;
+            }
+        }
+        if (ferror(file)) {
+            fclose(file);
+            return -1;
+        }
+        fclose(file);
+
+        count += _flowtuple_agg_emit(agg, callback, args);
+    }
+
+    agg->spilled = 0;
+    return count;
+}
@@ -0,0 +1,1146 @@
+/*
+ *  archive.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+#include "flowtuple.h"
+#include "fttypes.h"
+#include "util.h"
+#include "filter.h"
+#include "writer.h"
+#include "archive.h"
+
+/* tuples read at once by flowtuple_archive_write */
+#define READ_SIZE 4096
+/* values with a code of their own in a frequency encoded chunk */
+#define FREQ_CODES 255
+#define FREQ_ESCAPE 255
+
+#define PAD8(x) (((x) + 7) & ~(uint64_t)7)
+#define PAD2(x) (((x) + 1) & ~(uint64_t)1)
+
+/* bytes per value of each column, fields first, then the packet count */
+static const size_t _flowtuple_archive_widths[FLOWTUPLE_ARCHIVE_COLUMNS] = {
+    4, 4, 2, 2, 1, 1, 1, 2, 4,
+};
+
+static void _flowtuple_archive_columns_at(const flowtuple_columns_t *cols, size_t at, flowtuple_columns_t *dst) {
+    dst->src_ip = cols->src_ip + at;
+    dst->dst_ip = cols->dst_ip + at;
+    dst->src_port = cols->src_port + at;
+    dst->dst_port = cols->dst_port + at;
+    dst->proto = cols->proto + at;
+    dst->ttl = cols->ttl + at;
+    dst->tcp_flags = cols->tcp_flags + at;
+    dst->ip_len = cols->ip_len + at;
+    dst->pkt_cnt = cols->pkt_cnt + at;
+}
+
+/* the column of index i, in the order of the chunks of a class */
+static void *_flowtuple_archive_column(const flowtuple_columns_t *cols, int i) {
+    switch (i) {
+        case FLOWTUPLE_FIELD_SRC_IP: return cols->src_ip;
+        case FLOWTUPLE_FIELD_DST_IP: return cols->dst_ip;
+        case FLOWTUPLE_FIELD_SRC_PORT: return cols->src_port;
+        case FLOWTUPLE_FIELD_DST_PORT: return cols->dst_port;
+        case FLOWTUPLE_FIELD_PROTO: return cols->proto;
+        case FLOWTUPLE_FIELD_TTL: return cols->ttl;
+        case FLOWTUPLE_FIELD_TCP_FLAGS: return cols->tcp_flags;
+        case FLOWTUPLE_FIELD_IP_LEN: return cols->ip_len;
+        default: return cols->pkt_cnt;
+    }
+}
+
+static void _flowtuple_archive_set_column(flowtuple_columns_t *cols, int i, void *col) {
+    switch (i) {
+        case FLOWTUPLE_FIELD_SRC_IP: cols->src_ip = col; break;
+        case FLOWTUPLE_FIELD_DST_IP: cols->dst_ip = col; break;
+        case FLOWTUPLE_FIELD_SRC_PORT: cols->src_port = col; break;
+        case FLOWTUPLE_FIELD_DST_PORT: cols->dst_port = col; break;
+        case FLOWTUPLE_FIELD_PROTO: cols->proto = col; break;
+        case FLOWTUPLE_FIELD_TTL: cols->ttl = col; break;
+        case FLOWTUPLE_FIELD_TCP_FLAGS: cols->tcp_flags = col; break;
+        case FLOWTUPLE_FIELD_IP_LEN: cols->ip_len = col; break;
+        default: cols->pkt_cnt = col; break;
+    }
+}
+
+/*
+ * Writing
+ */
+
+static int _flowtuple_archive_put(flowtuple_archive_builder_t *builder, const void *buf, size_t len) {
+    if (len > 0 && fwrite(buf, 1, len, builder->file) != len) {
+        return -1;
+    }
+    builder->offset += len;
+    return 0;
+}
+
+static int _flowtuple_archive_pad(flowtuple_archive_builder_t *builder, size_t align) {
+    static const uint8_t zeros[FLOWTUPLE_ARCHIVE_ALIGN];
+
+    return _flowtuple_archive_put(builder, zeros, (align - builder->offset % align) % align);
+}
+
+static int _flowtuple_archive_grow_scratch(flowtuple_archive_builder_t *builder, size_t size) {
+    uint8_t *scratch;
+
+    if (size <= builder->scratch_size) {
+        return 0;
+    }
+    if ((scratch = realloc(builder->scratch, size)) == NULL) {
+        return -1;
+    }
+    builder->scratch = scratch;
+    builder->scratch_size = size;
+    return 0;
+}
+
+/* makes room for n tuples in the columns of the class being read */
+static int _flowtuple_archive_reserve(flowtuple_archive_builder_t *builder, size_t n) {
+    size_t capacity;
+    void *col;
+
+    if (n <= builder->capacity) {
+        return 0;
+    }
+    capacity = builder->capacity > 0 ? builder->capacity * 2 : READ_SIZE;
+    while (capacity < n) {
+        capacity *= 2;
+    }
+
+#define GROW_COLUMN(name) do { \
+        if ((col = realloc(builder->cols.name, capacity * sizeof(*(builder->cols.name)))) == NULL) { \
+            return -1; \
+        } \
+        builder->cols.name = col; \
+    } while (0)
+
+    GROW_COLUMN(src_ip);
+    GROW_COLUMN(dst_ip);
+    GROW_COLUMN(src_port);
+    GROW_COLUMN(dst_port);
+    GROW_COLUMN(proto);
+    GROW_COLUMN(ttl);
+    GROW_COLUMN(tcp_flags);
+    GROW_COLUMN(ip_len);
+    GROW_COLUMN(pkt_cnt);
+#undef GROW_COLUMN
+    builder->capacity = capacity;
+    return 0;
+}
+
+static int _flowtuple_archive_compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static int _flowtuple_archive_compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* a sorted dictionary and the smallest codes indexing it, or the values
+ * themselves when that is not smaller */
+static const void *_flowtuple_archive_encode_u32(flowtuple_archive_builder_t *builder, flowtuple_archive_column_t *col,
+                                                 const uint32_t *values, size_t n) {
+    uint32_t *dict;
+    uint8_t *codes;
+    size_t dict_size;
+    size_t count = 0;
+    size_t lo;
+    size_t hi;
+    size_t mid;
+
+    col->encoding = FLOWTUPLE_ARCHIVE_PLAIN;
+    col->size = n * sizeof(uint32_t);
+    if (n == 0 || _flowtuple_archive_grow_scratch(builder, n * sizeof(uint32_t) + 8) < 0) {
+        return values;
+    }
+
+    dict = (uint32_t*)builder->scratch;
+    memcpy(dict, values, n * sizeof(uint32_t));
+    qsort(dict, n, sizeof(uint32_t), _flowtuple_archive_compare_u32);
+    for (size_t i = 0; i < n; i++) {
+        if (count == 0 || dict[count - 1] != dict[i]) {
+            dict[count++] = dict[i];
+        }
+    }
+
+    col->width = count <= 256 ? 1 : count <= 65536 ? 2 : 4;
+    dict_size = PAD8(count * sizeof(uint32_t));
+    if (dict_size + n * col->width >= n * sizeof(uint32_t)) {
+        return values;
+    }
+
+    /* the codes go over the duplicates left behind the dictionary */
+    memset(builder->scratch + count * sizeof(uint32_t), 0, dict_size - count * sizeof(uint32_t));
+    codes = builder->scratch + dict_size;
+    for (size_t i = 0; i < n; i++) {
+        lo = 0;
+        hi = count;
+        while (hi - lo > 1) {
+            mid = lo + (hi - lo) / 2;
+            if (dict[mid] <= values[i]) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+        if (col->width == 1) {
+            codes[i] = (uint8_t)lo;
+        } else if (col->width == 2) {
+            ((uint16_t*)codes)[i] = (uint16_t)lo;
+        } else {
+            ((uint32_t*)codes)[i] = (uint32_t)lo;
+        }
+    }
+
+    col->encoding = FLOWTUPLE_ARCHIVE_DICT;
+    col->dict_count = (uint32_t)count;
+    col->size = dict_size + n * col->width;
+    return builder->scratch;
+}
+
+/* the most frequent values and a one byte code per value, the rarer ones
+ * following the codes in order, or the values themselves when that is
+ * not smaller */
+static const void *_flowtuple_archive_encode_u16(flowtuple_archive_builder_t *builder, flowtuple_archive_column_t *col,
+                                                 const uint16_t *values, size_t n) {
+    size_t distinct = n < 65536 ? n : 65536;
+    uint64_t *keys;
+    uint16_t *dict;
+    uint8_t *codes;
+    uint16_t *exceptions;
+    size_t dict_size;
+    size_t count = 0;
+    size_t coded = 0;
+    size_t size;
+    size_t k;
+
+    col->encoding = FLOWTUPLE_ARCHIVE_PLAIN;
+    col->size = n * sizeof(uint16_t);
+    if (n == 0 || _flowtuple_archive_grow_scratch(builder, distinct * sizeof(uint64_t) + n * sizeof(uint16_t) + 16) < 0) {
+        return values;
+    }
+
+    keys = (uint64_t*)builder->scratch;
+    for (size_t i = 0; i < n; i++) {
+        if (builder->counts[values[i]]++ == 0) {
+            keys[count++] = values[i];
+        }
+    }
+
+    /* most frequent first, then by value */
+    for (size_t i = 0; i < count; i++) {
+        keys[i] |= (uint64_t)(UINT32_MAX - builder->counts[keys[i]]) << 16;
+    }
+    qsort(keys, count, sizeof(uint64_t), _flowtuple_archive_compare_u64);
+    for (size_t i = 0; i < count; i++) {
+        keys[i] &= 0xffff;
+    }
+
+    k = count < FREQ_CODES ? count : FREQ_CODES;
+    for (size_t i = 0; i < k; i++) {
+        coded += builder->counts[keys[i]];
+    }
+    for (size_t i = 0; i < count; i++) {
+        builder->counts[keys[i]] = 0;
+    }
+
+    dict_size = PAD8(k * sizeof(uint16_t));
+    size = dict_size + PAD2(n) + (n - coded) * sizeof(uint16_t);
+    if (size >= n * sizeof(uint16_t)) {
+        return values;
+    }
+
+    dict = (uint16_t*)(builder->scratch + count * sizeof(uint64_t));
+    memset(dict, 0, size);
+    for (size_t i = 0; i < k; i++) {
+        dict[i] = (uint16_t)keys[i];
+        builder->codes[keys[i]] = (uint8_t)i;
+    }
+
+    codes = (uint8_t*)dict + dict_size;
+    exceptions = (uint16_t*)(codes + PAD2(n));
+    for (size_t i = 0; i < n; i++) {
+        codes[i] = builder->codes[values[i]];
+        if (codes[i] == FREQ_ESCAPE) {
+            *(exceptions++) = values[i];
+        }
+    }
+    for (size_t i = 0; i < k; i++) {
+        builder->codes[keys[i]] = FREQ_ESCAPE;
+    }
+
+    col->encoding = FLOWTUPLE_ARCHIVE_FREQ;
+    col->width = 1;
+    col->dict_count = (uint32_t)k;
+    col->size = size;
+    return dict;
+}
+
+/* the values above their minimum in as few bits as they need, or the
+ * values themselves when that is not smaller */
+static const void *_flowtuple_archive_encode_u8(flowtuple_archive_builder_t *builder, flowtuple_archive_column_t *col,
+                                                const uint8_t *values, size_t n, uint32_t min, uint32_t max) {
+    uint32_t bits = max > min ? 32 - (uint32_t)__builtin_clz(max - min) : 0;
+    uint64_t *words;
+    size_t size;
+    size_t pos;
+
+    col->encoding = FLOWTUPLE_ARCHIVE_PLAIN;
+    col->size = n;
+
+    /* a word more than needed, so unpacking may always read the next one */
+    size = ((n * bits + 63) / 64 + 1) * sizeof(uint64_t);
+    if (n == 0 || bits >= 8 || size >= n || _flowtuple_archive_grow_scratch(builder, size) < 0) {
+        return values;
+    }
+
+    words = (uint64_t*)builder->scratch;
+    memset(words, 0, size);
+    for (size_t i = 0; i < n && bits > 0; i++) {
+        pos = i * bits;
+        words[pos / 64] |= (uint64_t)(values[i] - min) << (pos % 64);
+        if (pos % 64 + bits > 64) {
+            words[pos / 64 + 1] |= (uint64_t)(values[i] - min) >> (64 - pos % 64);
+        }
+    }
+
+    col->encoding = FLOWTUPLE_ARCHIVE_BITPACK;
+    col->width = bits;
+    col->base = min;
+    col->size = size;
+    return words;
+}
+
+/* computes the statistics of the class being read and writes its chunks */
+static int _flowtuple_archive_write_class(flowtuple_archive_builder_t *builder) {
+    flowtuple_archive_class_t *cls = &(builder->classes[builder->class_count - 1]);
+    flowtuple_archive_column_t *col;
+    const void *values;
+    const void *buf;
+    size_t n = builder->count;
+    uint32_t min;
+    uint32_t max;
+    uint32_t v;
+
+    cls->count = (uint32_t)n;
+    for (int i = 0; i < FLOWTUPLE_ARCHIVE_COLUMNS; i++) {
+        col = &(cls->columns[i]);
+        values = _flowtuple_archive_column(&(builder->cols), i);
+
+        min = n > 0 ? UINT32_MAX : 0;
+        max = 0;
+        for (size_t j = 0; j < n; j++) {
+            switch (_flowtuple_archive_widths[i]) {
+                case 4: v = ((const uint32_t*)values)[j]; break;
+                case 2: v = ((const uint16_t*)values)[j]; break;
+                default: v = ((const uint8_t*)values)[j]; break;
+            }
+            min = v < min ? v : min;
+            max = v > max ? v : max;
+        }
+        if (i < FLOWTUPLE_FIELD_COUNT) {
+            cls->min[i] = min;
+            cls->max[i] = max;
+        }
+
+        switch (_flowtuple_archive_widths[i]) {
+            case 4: buf = _flowtuple_archive_encode_u32(builder, col, values, n); break;
+            case 2: buf = _flowtuple_archive_encode_u16(builder, col, values, n); break;
+            default: buf = _flowtuple_archive_encode_u8(builder, col, values, n, min, max); break;
+        }
+
+        if (_flowtuple_archive_pad(builder, FLOWTUPLE_ARCHIVE_ALIGN) < 0) {
+            return -1;
+        }
+        col->offset = builder->offset;
+        if (_flowtuple_archive_put(builder, buf, col->size) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static flowtuple_errno_t _flowtuple_archive_add_interval(flowtuple_archive_builder_t *builder,
+                                                         flowtuple_interval_t *interval) {
+    flowtuple_archive_interval_t *intervals;
+    size_t capacity;
+
+    if (builder->interval_count == builder->interval_capacity) {
+        capacity = builder->interval_capacity > 0 ? builder->interval_capacity * 2 : 64;
+        if ((intervals = realloc(builder->intervals, capacity * sizeof(flowtuple_archive_interval_t))) == NULL) {
+            return FLOWTUPLE_ERR_MEM;
+        }
+        builder->intervals = intervals;
+        builder->interval_capacity = capacity;
+    }
+
+    intervals = &(builder->intervals[builder->interval_count++]);
+    memset(intervals, 0, sizeof(flowtuple_archive_interval_t));
+    intervals->number = interval->number;
+    intervals->start = interval->time;
+    intervals->first_class = builder->class_count;
+    return FLOWTUPLE_ERR_OK;
+}
+
+static flowtuple_errno_t _flowtuple_archive_add_class(flowtuple_archive_builder_t *builder, flowtuple_class_t *ftclass) {
+    flowtuple_archive_class_t *classes;
+    size_t capacity;
+
+    if (builder->class_count == builder->class_capacity) {
+        capacity = builder->class_capacity > 0 ? builder->class_capacity * 2 : 256;
+        if ((classes = realloc(builder->classes, capacity * sizeof(flowtuple_archive_class_t))) == NULL) {
+            return FLOWTUPLE_ERR_MEM;
+        }
+        builder->classes = classes;
+        builder->class_capacity = capacity;
+    }
+
+    classes = &(builder->classes[builder->class_count++]);
+    memset(classes, 0, sizeof(flowtuple_archive_class_t));
+    classes->magic = ftclass->magic;
+    classes->class_type = ftclass->class_type;
+    builder->intervals[builder->interval_count - 1].class_count++;
+    builder->count = 0;
+    return FLOWTUPLE_ERR_OK;
+}
+
+/* reads the handle to its end, writing out the chunks of each class as it ends */
+static flowtuple_errno_t _flowtuple_archive_build(flowtuple_archive_builder_t *builder, flowtuple_handle_t *handle) {
+    flowtuple_interval_t *interval;
+    flowtuple_class_t *ftclass;
+    flowtuple_columns_t cols;
+    flowtuple_batch_t batch;
+    flowtuple_header_t *header;
+    int in_interval = 0;
+    int in_class = 0;
+    flowtuple_errno_t err;
+    long n;
+
+    for (;;) {
+        if (_flowtuple_archive_reserve(builder, builder->count + READ_SIZE) < 0) {
+            return FLOWTUPLE_ERR_MEM;
+        }
+        _flowtuple_archive_columns_at(&(builder->cols), builder->count, &cols);
+        if ((n = flowtuple_read_columns(handle, &cols, READ_SIZE, &batch)) < 0) {
+            return flowtuple_errno(handle);
+        }
+        if (n > 0) {
+            builder->count += (size_t)n;
+            continue;
+        }
+
+        switch (batch.type) {
+            case FLOWTUPLE_RECORD_TYPE_HEADER:
+                if (in_interval || builder->header_record != NULL) {
+                    return FLOWTUPLE_ERR_CORRUPT;
+                }
+                header = flowtuple_record_get_header(batch.record);
+                builder->header_len = (uint32_t)_flowtuple_writer_pack_header(header, 0, NULL);
+                MALLOC(builder->header_record, builder->header_len, return FLOWTUPLE_ERR_MEM);
+                _flowtuple_writer_pack_header(header, 0, builder->header_record);
+                break;
+            case FLOWTUPLE_RECORD_TYPE_INTERVAL:
+                interval = flowtuple_record_get_interval(batch.record);
+                if (!in_interval && (err = _flowtuple_archive_add_interval(builder, interval)) != FLOWTUPLE_ERR_OK) {
+                    return err;
+                } else if (in_interval) {
+                    builder->intervals[builder->interval_count - 1].end_number = interval->number;
+                    builder->intervals[builder->interval_count - 1].end = interval->time;
+                }
+                in_interval = !in_interval;
+                break;
+            case FLOWTUPLE_RECORD_TYPE_FLOWTUPLE_CLASS:
+                ftclass = flowtuple_record_get_class(batch.record);
+                if (ftclass->is_start && (err = _flowtuple_archive_add_class(builder, ftclass)) != FLOWTUPLE_ERR_OK) {
+                    return err;
+                } else if (!ftclass->is_start && _flowtuple_archive_write_class(builder) < 0) {
+                    return FLOWTUPLE_ERR_FILE_WRITE;
+                }
+                in_class = ftclass->is_start;
+                break;
+            case FLOWTUPLE_RECORD_TYPE_TRAILER:
+                if (in_interval || builder->trailer_record != NULL) {
+                    return FLOWTUPLE_ERR_CORRUPT;
+                }
+                builder->trailer_len = FLOWTUPLE_TRAILER_SIZE;
+                MALLOC(builder->trailer_record, FLOWTUPLE_TRAILER_SIZE, return FLOWTUPLE_ERR_MEM);
+                _flowtuple_writer_pack_trailer(flowtuple_record_get_trailer(batch.record), builder->trailer_record);
+                break;
+            case FLOWTUPLE_RECORD_TYPE_NULL:
+                /* an interval cut short is not kept */
+                return in_interval || in_class ? FLOWTUPLE_ERR_CORRUPT : FLOWTUPLE_ERR_OK;
+            default:
+                break;
+        }
+    }
+}
+
+flowtuple_errno_t flowtuple_archive_write(flowtuple_handle_t *handle, const char *filename) {
+    flowtuple_archive_builder_t builder;
+    flowtuple_archive_file_header_t header;
+    flowtuple_errno_t err;
+
+    CHECK(handle != NULL && filename != NULL, return FLOWTUPLE_ERR_FILE_OPEN);
+
+    memset(&builder, 0, sizeof(flowtuple_archive_builder_t));
+    memset(&header, 0, sizeof(flowtuple_archive_file_header_t));
+    CALLOC(builder.counts, 65536, sizeof(uint32_t), return FLOWTUPLE_ERR_MEM);
+    MALLOC(builder.codes, 65536, FREE(builder.counts); return FLOWTUPLE_ERR_MEM);
+    memset(builder.codes, FREQ_ESCAPE, 65536);
+
+    if ((builder.file = fopen(filename, "wb")) == NULL) {
+        err = FLOWTUPLE_ERR_FILE_OPEN;
+    } else if (_flowtuple_archive_put(&builder, &header, sizeof(header)) < 0) {
+        err = FLOWTUPLE_ERR_FILE_WRITE;
+    } else {
+        err = _flowtuple_archive_build(&builder, handle);
+    }
+
+    /* the footer, then the header pointing to it */
+    if (err == FLOWTUPLE_ERR_OK && _flowtuple_archive_pad(&builder, FLOWTUPLE_ARCHIVE_ALIGN) < 0) {
+        err = FLOWTUPLE_ERR_FILE_WRITE;
+    }
+    if (err == FLOWTUPLE_ERR_OK) {
+        memcpy(header.magic, FLOWTUPLE_ARCHIVE_MAGIC, 4);
+        header.version = FLOWTUPLE_ARCHIVE_VERSION;
+        header.byte_order = FLOWTUPLE_ARCHIVE_BYTE_ORDER;
+        header.interval_count = (uint32_t)builder.interval_count;
+        header.class_count = builder.class_count;
+        header.header_len = builder.header_len;
+        header.trailer_len = builder.trailer_len;
+        header.footer_offset = builder.offset;
+
+        if (_flowtuple_archive_put(&builder, builder.header_record, builder.header_len) < 0 ||
+            _flowtuple_archive_pad(&builder, 8) < 0 ||
+            _flowtuple_archive_put(&builder, builder.trailer_record, builder.trailer_len) < 0 ||
+            _flowtuple_archive_pad(&builder, 8) < 0 ||
+            _flowtuple_archive_put(&builder, builder.intervals,
+                                   builder.interval_count * sizeof(flowtuple_archive_interval_t)) < 0 ||
+            _flowtuple_archive_put(&builder, builder.classes,
+                                   builder.class_count * sizeof(flowtuple_archive_class_t)) < 0 ||
+            fseek(builder.file, 0, SEEK_SET) != 0 ||
+            fwrite(&header, sizeof(header), 1, builder.file) != 1) {
+            err = FLOWTUPLE_ERR_FILE_WRITE;
+        }
+    }
+
+    if (builder.file != NULL && fclose(builder.file) != 0 && err == FLOWTUPLE_ERR_OK) {
+        err = FLOWTUPLE_ERR_FILE_WRITE;
+    }
+    FREE(builder.header_record);
+    FREE(builder.trailer_record);
+    FREE(builder.intervals);
+    FREE(builder.classes);
+    FREE(builder.cols.src_ip);
+    FREE(builder.cols.dst_ip);
+    FREE(builder.cols.src_port);
+    FREE(builder.cols.dst_port);
+    FREE(builder.cols.proto);
+    FREE(builder.cols.ttl);
+    FREE(builder.cols.tcp_flags);
+    FREE(builder.cols.ip_len);
+    FREE(builder.cols.pkt_cnt);
+    FREE(builder.scratch);
+    FREE(builder.counts);
+    FREE(builder.codes);
+    return err;
+}
+
+/*
+ * Reading
+ */
+
+/* checks a chunk of n values of width bytes lies before the footer and is
+ * large enough for its encoding, so it can be decoded without more checks */
+static int _flowtuple_archive_check_column(const flowtuple_archive_column_t *col, uint64_t n, size_t width,
+                                           uint64_t footer_offset) {
+    uint64_t need;
+
+    if (col->offset % 8 != 0 || col->offset > footer_offset || col->size > footer_offset - col->offset) {
+        return -1;
+    }
+
+    switch (col->encoding) {
+        case FLOWTUPLE_ARCHIVE_PLAIN:
+            need = n * width;
+            break;
+        case FLOWTUPLE_ARCHIVE_DICT:
+            if (width != 4 || (col->width != 1 && col->width != 2 && col->width != 4) ||
+                (n > 0 && col->dict_count == 0)) {
+                return -1;
+            }
+            need = PAD8((uint64_t)col->dict_count * 4) + n * col->width;
+            break;
+        case FLOWTUPLE_ARCHIVE_FREQ:
+            if (width != 2 || col->width != 1 || col->dict_count > FREQ_CODES) {
+                return -1;
+            }
+            need = PAD8((uint64_t)col->dict_count * 2) + PAD2(n);
+            break;
+        case FLOWTUPLE_ARCHIVE_BITPACK:
+            if (width != 1 || col->width >= 8 || col->base + (1u << col->width) - 1 > UINT8_MAX) {
+                return -1;
+            }
+            need = ((n * col->width + 63) / 64 + 1) * sizeof(uint64_t);
+            break;
+        default:
+            return -1;
+    }
+    return col->size >= need ? 0 : -1;
+}
+
+static const uint32_t *_flowtuple_archive_decode_u32(flowtuple_archive_t *archive, const flowtuple_archive_column_t *col,
+                                                     size_t n, uint32_t *out) {
+    const uint8_t *chunk = archive->map + col->offset;
+    const uint32_t *dict = (const uint32_t*)chunk;
+    const uint8_t *codes = chunk + PAD8((uint64_t)col->dict_count * 4);
+    uint32_t max = 0;
+
+    if (col->encoding == FLOWTUPLE_ARCHIVE_PLAIN) {
+        return (const uint32_t*)chunk;
+    }
+
+    /* codes are checked before indexing the dictionary with them */
+    if (col->width == 1) {
+        for (size_t i = 0; i < n; i++) {
+            max = codes[i] > max ? codes[i] : max;
+        }
+        if (n > 0 && max >= col->dict_count) {
+            return NULL;
+        }
+        for (size_t i = 0; i < n; i++) {
+            out[i] = dict[codes[i]];
+        }
+    } else if (col->width == 2) {
+        for (size_t i = 0; i < n; i++) {
+            max = ((const uint16_t*)codes)[i] > max ? ((const uint16_t*)codes)[i] : max;
+        }
+        if (n > 0 && max >= col->dict_count) {
+            return NULL;
+        }
+        for (size_t i = 0; i < n; i++) {
+            out[i] = dict[((const uint16_t*)codes)[i]];
+        }
+    } else {
+        for (size_t i = 0; i < n; i++) {
+            max = ((const uint32_t*)codes)[i] > max ? ((const uint32_t*)codes)[i] : max;
+        }
+        if (n > 0 && max >= col->dict_count) {
+            return NULL;
+        }
+        for (size_t i = 0; i < n; i++) {
+            out[i] = dict[((const uint32_t*)codes)[i]];
+        }
+    }
+    return out;
+}
+
+static const uint16_t *_flowtuple_archive_decode_u16(flowtuple_archive_t *archive, const flowtuple_archive_column_t *col,
+                                                     size_t n, uint16_t *out) {
+    const uint8_t *chunk = archive->map + col->offset;
+    const uint16_t *dict = (const uint16_t*)chunk;
+    const uint8_t *codes = chunk + PAD8((uint64_t)col->dict_count * 2);
+    const uint16_t *exceptions = (const uint16_t*)(codes + PAD2(n));
+    size_t exception_count = (col->size - PAD8((uint64_t)col->dict_count * 2) - PAD2(n)) / 2;
+    size_t e = 0;
+
+    if (col->encoding == FLOWTUPLE_ARCHIVE_PLAIN) {
+        return (const uint16_t*)chunk;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        if (codes[i] < col->dict_count) {
+            out[i] = dict[codes[i]];
+        } else if (codes[i] == FREQ_ESCAPE && e < exception_count) {
+            out[i] = exceptions[e++];
+        } else {
+            return NULL;
+        }
+    }
+    return out;
+}
+
+static const uint8_t *_flowtuple_archive_decode_u8(flowtuple_archive_t *archive, const flowtuple_archive_column_t *col,
+                                                   size_t n, uint8_t *out) {
+    const uint8_t *chunk = archive->map + col->offset;
+    uint32_t bits = col->width;
+    uint64_t mask;
+    uint64_t word;
+    size_t pos;
+
+    if (col->encoding == FLOWTUPLE_ARCHIVE_PLAIN) {
+        return chunk;
+    }
+    mask = (1u << bits) - 1;
+
+    if (bits == 0) {
+        memset(out, (int)col->base, n);
+        return out;
+    }
+    for (size_t i = 0; i < n; i++) {
+        pos = i * bits;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        /* a value of under 8 bits lies within the 8 bytes from the one it starts
+         * in, which the word of padding after the last one keeps in the chunk */
+        memcpy(&word, chunk + pos / 8, sizeof(uint64_t));
+        word >>= pos % 8;
+#else
+        word = ((const uint64_t*)chunk)[pos / 64] >> (pos % 64);
+        if (pos % 64 + bits > 64) {
+            word |= ((const uint64_t*)chunk)[pos / 64 + 1] << (64 - pos % 64);
+        }
+#endif
+        out[i] = (uint8_t)(col->base + (word & mask));
+    }
+    return out;
+}
+
+/* decodes the chunks of a class into the columns of the archive,
+ * unless they are those of the last class decoded */
+static int _flowtuple_archive_decode(flowtuple_archive_t *archive, uint64_t index) {
+    const flowtuple_archive_class_t *cls = &(archive->classes[index]);
+    size_t n = cls->count;
+    flowtuple_columns_t out;
+    const void *col;
+    uint8_t *scratch;
+    size_t size;
+
+    if (archive->has_decoded && archive->decoded == index) {
+        return 0;
+    }
+    archive->has_decoded = 0;
+
+    /* one block for all columns, widest first */
+    size = n * (3 * sizeof(uint32_t) + 3 * sizeof(uint16_t) + 3 * sizeof(uint8_t));
+    if (size > archive->scratch_size) {
+        if ((scratch = realloc(archive->scratch, size)) == NULL) {
+            return -1;
+        }
+        archive->scratch = scratch;
+        archive->scratch_size = size;
+    }
+    out.src_ip = (uint32_t*)archive->scratch;
+    out.dst_ip = out.src_ip + n;
+    out.pkt_cnt = out.dst_ip + n;
+    out.src_port = (uint16_t*)(out.pkt_cnt + n);
+    out.dst_port = out.src_port + n;
+    out.ip_len = out.dst_port + n;
+    out.proto = (uint8_t*)(out.ip_len + n);
+    out.ttl = out.proto + n;
+    out.tcp_flags = out.ttl + n;
+
+    for (int i = 0; i < FLOWTUPLE_ARCHIVE_COLUMNS; i++) {
+        switch (_flowtuple_archive_widths[i]) {
+            case 4:
+                col = _flowtuple_archive_decode_u32(archive, &(cls->columns[i]), n, _flowtuple_archive_column(&out, i));
+                break;
+            case 2:
+                col = _flowtuple_archive_decode_u16(archive, &(cls->columns[i]), n, _flowtuple_archive_column(&out, i));
+                break;
+            default:
+                col = _flowtuple_archive_decode_u8(archive, &(cls->columns[i]), n, _flowtuple_archive_column(&out, i));
+                break;
+        }
+        if (col == NULL) {
+            return -1;
+        }
+        _flowtuple_archive_set_column(&(archive->cols), i, (void*)col);
+    }
+
+    archive->decoded = index;
+    archive->has_decoded = 1;
+    return 0;
+}
+
+static void _flowtuple_archive_add_piece(flowtuple_archive_t *archive, flowtuple_archive_piece_type_t type,
+                                         uint64_t len, uint32_t interval, uint64_t ftclass) {
+    flowtuple_archive_piece_t *piece;
+
+    /* empty classes have no tuples */
+    if (len == 0) {
+        return;
+    }
+    piece = &(archive->pieces[archive->piece_count++]);
+    piece->offset = archive->stream_size;
+    piece->len = len;
+    piece->type = type;
+    piece->interval = interval;
+    piece->ftclass = ftclass;
+    archive->stream_size += len;
+}
+
+/* checks the footer and lays out the records of the corsaro stream */
+static flowtuple_errno_t _flowtuple_archive_load(flowtuple_archive_t *archive) {
+    const flowtuple_archive_file_header_t *header = archive->header;
+    const flowtuple_archive_interval_t *interval;
+    const flowtuple_archive_class_t *cls;
+    flowtuple_class_t *ftclass;
+    uint64_t offset;
+    uint64_t first = 0;
+    size_t tuple_size;
+
+    if (memcmp(header->magic, FLOWTUPLE_ARCHIVE_MAGIC, 4) != 0) {
+        return FLOWTUPLE_ERR_WRONG_MAGIC;
+    }
+    /* written on a host of another byte order, or by a later version */
+    if (header->byte_order != FLOWTUPLE_ARCHIVE_BYTE_ORDER || header->version != FLOWTUPLE_ARCHIVE_VERSION) {
+        return FLOWTUPLE_ERR_CORRUPT;
+    }
+
+    offset = header->footer_offset;
+    if (offset % 8 != 0 || offset > archive->size ||
+        header->class_count > archive->size / sizeof(flowtuple_archive_class_t)) {
+        return FLOWTUPLE_ERR_CORRUPT;
+    }
+    archive->header_record = archive->map + offset;
+    offset += PAD8((uint64_t)header->header_len);
+    archive->trailer_record = archive->map + offset;
+    offset += PAD8((uint64_t)header->trailer_len);
+    archive->intervals = (const flowtuple_archive_interval_t*)(archive->map + offset);
+    offset += (uint64_t)header->interval_count * sizeof(flowtuple_archive_interval_t);
+    archive->classes = (const flowtuple_archive_class_t*)(archive->map + offset);
+    offset += header->class_count * sizeof(flowtuple_archive_class_t);
+    if (offset > archive->size) {
+        return FLOWTUPLE_ERR_CORRUPT;
+    }
+
+    CALLOC(archive->interval_records, (size_t)header->interval_count * 2 + 1, sizeof(flowtuple_interval_t),
+           return FLOWTUPLE_ERR_MEM);
+    CALLOC(archive->class_records, (size_t)header->class_count + 1, sizeof(flowtuple_class_t),
+           return FLOWTUPLE_ERR_MEM);
+    CALLOC(archive->pieces, 2 + (size_t)header->interval_count * 2 + (size_t)header->class_count * 3,
+           sizeof(flowtuple_archive_piece_t), return FLOWTUPLE_ERR_MEM);
+
+    _flowtuple_archive_add_piece(archive, FLOWTUPLE_ARCHIVE_PIECE_HEADER, header->header_len, 0, 0);
+    for (uint32_t i = 0; i < header->interval_count; i++) {
+        interval = &(archive->intervals[i]);
+        /* the classes of the intervals follow each other */
+        if (interval->first_class != first || interval->class_count > header->class_count - first) {
+            return FLOWTUPLE_ERR_CORRUPT;
+        }
+        archive->interval_records[2 * i].number = interval->number;
+        archive->interval_records[2 * i].time = interval->start;
+        archive->interval_records[2 * i + 1].number = interval->end_number;
+        archive->interval_records[2 * i + 1].time = interval->end;
+
+        _flowtuple_archive_add_piece(archive, FLOWTUPLE_ARCHIVE_PIECE_INTERVAL_START, FLOWTUPLE_INTERVAL_SIZE, i, 0);
+        for (uint64_t j = first; j < first + interval->class_count; j++) {
+            cls = &(archive->classes[j]);
+            if (cls->magic == FLOWTUPLE_MAGIC_SIXT) {
+                tuple_size = FLOWTUPLE_SIXT_SIZE;
+            } else if (cls->magic == FLOWTUPLE_MAGIC_SIXU) {
+                tuple_size = FLOWTUPLE_SIXU_SIZE;
+            } else {
+                return FLOWTUPLE_ERR_WRONG_MAGIC;
+            }
+            for (int k = 0; k < FLOWTUPLE_ARCHIVE_COLUMNS; k++) {
+                if (_flowtuple_archive_check_column(&(cls->columns[k]), cls->count, _flowtuple_archive_widths[k],
+                                                    header->footer_offset) < 0) {
+                    return FLOWTUPLE_ERR_CORRUPT;
+                }
+            }
+
+            ftclass = &(archive->class_records[j]);
+            ftclass->magic = cls->magic;
+            ftclass->class_type = cls->class_type;
+            ftclass->key_count = htonl(cls->count);
+            ftclass->key_count_host = cls->count;
+            ftclass->is_start = 1;
+
+            _flowtuple_archive_add_piece(archive, FLOWTUPLE_ARCHIVE_PIECE_CLASS_START, 10, i, j);
+            _flowtuple_archive_add_piece(archive, FLOWTUPLE_ARCHIVE_PIECE_TUPLES, (uint64_t)cls->count * tuple_size, i, j);
+            _flowtuple_archive_add_piece(archive, FLOWTUPLE_ARCHIVE_PIECE_CLASS_END, 6, i, j);
+        }
+        _flowtuple_archive_add_piece(archive, FLOWTUPLE_ARCHIVE_PIECE_INTERVAL_END, FLOWTUPLE_INTERVAL_SIZE, i, 0);
+        first += interval->class_count;
+    }
+    _flowtuple_archive_add_piece(archive, FLOWTUPLE_ARCHIVE_PIECE_TRAILER, header->trailer_len, 0, 0);
+
+    return first == header->class_count ? FLOWTUPLE_ERR_OK : FLOWTUPLE_ERR_CORRUPT;
+}
+
+int _flowtuple_archive_is_archive(const char *filename) {
+    uint8_t magic[4];
+    int ret = 0;
+    int fd;
+
+    if ((fd = open(filename, O_RDONLY)) < 0) {
+        return 0;
+    }
+    ret = pread(fd, magic, 4, 0) == 4 && memcmp(magic, FLOWTUPLE_ARCHIVE_MAGIC, 4) == 0;
+    close(fd);
+    return ret;
+}
+
+flowtuple_archive_t *flowtuple_archive_open(const char *filename, flowtuple_errno_t *err) {
+    flowtuple_archive_t *archive;
+    flowtuple_errno_t tmp;
+    struct stat st;
+    void *map = MAP_FAILED;
+    int fd;
+
+    if (err == NULL) {
+        err = &tmp;
+    }
+
+    *err = FLOWTUPLE_ERR_FILE_OPEN;
+    CHECK(filename != NULL, return NULL);
+    if ((fd = open(filename, O_RDONLY)) < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && (size_t)st.st_size >= sizeof(flowtuple_archive_file_header_t)) {
+        map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+
+    *err = FLOWTUPLE_ERR_MEM;
+    CALLOC(archive, 1, sizeof(flowtuple_archive_t), munmap(map, (size_t)st.st_size); return NULL);
+    archive->map = map;
+    archive->size = (size_t)st.st_size;
+    archive->header = (const flowtuple_archive_file_header_t*)map;
+
+    if ((*err = _flowtuple_archive_load(archive)) != FLOWTUPLE_ERR_OK) {
+        flowtuple_archive_close(archive);
+        return NULL;
+    }
+    return archive;
+}
+
+void flowtuple_archive_close(flowtuple_archive_t *archive) {
+    CHECK(archive != NULL, return);
+
+    munmap(archive->map, archive->size);
+    FREE(archive->interval_records);
+    FREE(archive->class_records);
+    FREE(archive->pieces);
+    FREE(archive->scratch);
+    FREE(archive);
+}
+
+/* index of the piece holding offset, which is before the end of the stream */
+static size_t _flowtuple_archive_find_piece(flowtuple_archive_t *archive, uint64_t offset) {
+    const flowtuple_archive_piece_t *piece = &(archive->pieces[archive->piece]);
+    size_t lo = 0;
+    size_t hi = archive->piece_count;
+    size_t mid;
+
+    /* records read one by one stay within the current piece */
+    if (offset >= piece->offset && offset - piece->offset < piece->len) {
+        return archive->piece;
+    }
+
+    while (hi - lo > 1) {
+        mid = lo + (hi - lo) / 2;
+        if (archive->pieces[mid].offset <= offset) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+int64_t _flowtuple_archive_read(flowtuple_archive_t *archive, uint8_t *buf, size_t len) {
+    const flowtuple_archive_piece_t *piece;
+    const flowtuple_archive_interval_t *interval;
+    const flowtuple_archive_class_t *cls;
+    flowtuple_columns_t cols;
+    uint8_t tmp[FLOWTUPLE_SIXU_SIZE];
+    uint32_t count;
+    uint64_t off;
+    size_t tuple_size;
+    size_t n;
+
+    if (archive->pos >= archive->stream_size || len == 0) {
+        return 0;
+    }
+
+    while (archive->pos >= archive->pieces[archive->piece].offset + archive->pieces[archive->piece].len) {
+        archive->piece++;
+    }
+    piece = &(archive->pieces[archive->piece]);
+    interval = &(archive->intervals[piece->interval]);
+    cls = &(archive->classes[piece->ftclass]);
+    off = archive->pos - piece->offset;
+    n = piece->len - off < len ? (size_t)(piece->len - off) : len;
+
+    switch (piece->type) {
+        case FLOWTUPLE_ARCHIVE_PIECE_HEADER:
+            memcpy(buf, archive->header_record + off, n);
+            break;
+        case FLOWTUPLE_ARCHIVE_PIECE_INTERVAL_START:
+            _flowtuple_writer_pack_interval(interval->number, interval->start, tmp);
+            memcpy(buf, tmp + off, n);
+            break;
+        case FLOWTUPLE_ARCHIVE_PIECE_INTERVAL_END:
+            _flowtuple_writer_pack_interval(interval->end_number, interval->end, tmp);
+            memcpy(buf, tmp + off, n);
+            break;
+        case FLOWTUPLE_ARCHIVE_PIECE_CLASS_START:
+        case FLOWTUPLE_ARCHIVE_PIECE_CLASS_END:
+            count = htonl(cls->count);
+            memcpy(tmp, &(cls->magic), 4);
+            memcpy(tmp + 4, &(cls->class_type), 2);
+            memcpy(tmp + 6, &count, 4);
+            memcpy(buf, tmp + off, n);
+            break;
+        case FLOWTUPLE_ARCHIVE_PIECE_TUPLES:
+            if (_flowtuple_archive_decode(archive, piece->ftclass) < 0) {
+                return -1;
+            }
+            tuple_size = cls->magic == FLOWTUPLE_MAGIC_SIXT ? FLOWTUPLE_SIXT_SIZE : FLOWTUPLE_SIXU_SIZE;
+            _flowtuple_archive_columns_at(&(archive->cols), (size_t)(off / tuple_size), &cols);
+            if (off % tuple_size != 0 || n < tuple_size) {
+                /* part of a tuple */
+                _flowtuple_writer_pack_columns(&cols, 1, cls->magic, tmp);
+                n = tuple_size - off % tuple_size < n ? tuple_size - off % tuple_size : n;
+                memcpy(buf, tmp + off % tuple_size, n);
+            } else {
+                n -= n % tuple_size;
+                _flowtuple_writer_pack_columns(&cols, n / tuple_size, cls->magic, buf);
+            }
+            break;
+        case FLOWTUPLE_ARCHIVE_PIECE_TRAILER:
+            memcpy(buf, archive->trailer_record + off, n);
+            break;
+    }
+
+    archive->pos += n;
+    return (int64_t)n;
+}
+
+int _flowtuple_archive_seek(flowtuple_archive_t *archive, uint64_t offset) {
+    if (offset > archive->stream_size) {
+        return -1;
+    }
+    archive->pos = offset;
+    archive->piece = offset < archive->stream_size ? _flowtuple_archive_find_piece(archive, offset) : 0;
+    return 0;
+}
+
+int _flowtuple_archive_columns(flowtuple_archive_t *archive, uint64_t offset, flowtuple_columns_t *cols) {
+    const flowtuple_archive_piece_t *piece;
+
+    if (offset >= archive->stream_size) {
+        return -1;
+    }
+    piece = &(archive->pieces[_flowtuple_archive_find_piece(archive, offset)]);
+    if (piece->type != FLOWTUPLE_ARCHIVE_PIECE_TUPLES || _flowtuple_archive_decode(archive, piece->ftclass) < 0) {
+        return -1;
+    }
+
+    *cols = archive->cols;
+    return 0;
+}
+
+int _flowtuple_archive_may_match(flowtuple_archive_t *archive, uint64_t offset, const flowtuple_filter_t *filter) {
+    const flowtuple_archive_piece_t *piece;
+    const flowtuple_archive_class_t *cls;
+
+    if (offset >= archive->stream_size) {
+        return 1;
+    }
+    piece = &(archive->pieces[_flowtuple_archive_find_piece(archive, offset)]);
+    if (piece->type != FLOWTUPLE_ARCHIVE_PIECE_TUPLES) {
+        return 1;
+    }
+    cls = &(archive->classes[piece->ftclass]);
+    return _flowtuple_filter_may_match(filter, cls->min, cls->max, cls->magic == FLOWTUPLE_MAGIC_SIXT);
+}
+
+/* index of a class of an interval in the archive, -1 if out of range */
+static int64_t _flowtuple_archive_class_index(flowtuple_archive_t *archive, size_t interval, size_t ftclass) {
+    if (interval >= archive->header->interval_count || ftclass >= archive->intervals[interval].class_count) {
+        return -1;
+    }
+    return (int64_t)(archive->intervals[interval].first_class + ftclass);
+}
+
+long flowtuple_archive_get_columns(flowtuple_archive_t *archive, size_t interval, size_t ftclass,
+                                   flowtuple_columns_t *cols) {
+    int64_t index;
+
+    CHECK(archive != NULL && cols != NULL, return -1);
+    if ((index = _flowtuple_archive_class_index(archive, interval, ftclass)) < 0 ||
+        _flowtuple_archive_decode(archive, (uint64_t)index) < 0) {
+        return -1;
+    }
+    *cols = archive->cols;
+    return (long)archive->classes[index].count;
+}
+
+int flowtuple_archive_get_stats(flowtuple_archive_t *archive, size_t interval, size_t ftclass,
+                                flowtuple_field_t field, uint32_t *min, uint32_t *max) {
+    int64_t index;
+
+    CHECK(archive != NULL && min != NULL && max != NULL && field < FLOWTUPLE_FIELD_COUNT, return -1);
+    if ((index = _flowtuple_archive_class_index(archive, interval, ftclass)) < 0) {
+        return -1;
+    }
+    *min = archive->classes[index].min[field];
+    *max = archive->classes[index].max[field];
+    return 0;
+}
+
+size_t flowtuple_archive_get_interval_count(flowtuple_archive_t *archive) {
+    CHECK(archive != NULL, return 0);
+    return archive->header->interval_count;
+}
+
+flowtuple_interval_t *flowtuple_archive_get_interval(flowtuple_archive_t *archive, size_t interval) {
+    CHECK(archive != NULL && interval < archive->header->interval_count, return NULL);
+    return &(archive->interval_records[2 * interval]);
+}
+
+flowtuple_interval_t *flowtuple_archive_get_interval_end(flowtuple_archive_t *archive, size_t interval) {
+    CHECK(archive != NULL && interval < archive->header->interval_count, return NULL);
+    return &(archive->interval_records[2 * interval + 1]);
+}
+
+size_t flowtuple_archive_get_class_count(flowtuple_archive_t *archive, size_t interval) {
+    CHECK(archive != NULL && interval < archive->header->interval_count, return 0);
+    return archive->intervals[interval].class_count;
+}
+
+flowtuple_class_t *flowtuple_archive_get_class(flowtuple_archive_t *archive, size_t interval, size_t ftclass) {
+    int64_t index;
+
+    CHECK(archive != NULL, return NULL);
+    if ((index = _flowtuple_archive_class_index(archive, interval, ftclass)) < 0) {
+        return NULL;
+    }
+    return &(archive->class_records[index]);
+}
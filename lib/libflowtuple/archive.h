@@ -0,0 +1,43 @@
+/*
+ *  archive.h
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stddef.h>
+#include <inttypes.h>
+
+#include "flowtuple.h"
+#include "fttypes.h"
+
+/* whether filename starts with the archive magic */
+int _flowtuple_archive_is_archive(const char *filename);
+/* reads the next bytes of the corsaro stream the archive stands for,
+ * returns the number of bytes read, 0 at its end and -1 on a corrupt chunk */
+int64_t _flowtuple_archive_read(flowtuple_archive_t *archive, uint8_t *buf, size_t len);
+/* moves to offset in the corsaro stream, -1 if past its end */
+int _flowtuple_archive_seek(flowtuple_archive_t *archive, uint64_t offset);
+/* points cols at the decoded columns of the class whose tuples hold offset in
+ * the stream, from its first tuple and valid until another class is decoded,
+ * returns -1 if offset is not within tuples or on a corrupt chunk */
+int _flowtuple_archive_columns(flowtuple_archive_t *archive, uint64_t offset, flowtuple_columns_t *cols);
+/* whether the filter may accept a tuple of the class whose tuples are at offset in the stream */
+int _flowtuple_archive_may_match(flowtuple_archive_t *archive, uint64_t offset, const flowtuple_filter_t *filter);
+
+#endif
@@ -0,0 +1,237 @@
+/*
+ *  columns.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "flowtuple.h"
+#include "fttypes.h"
+#include "util.h"
+
+#define COLUMN_ALIGN 64
+#define COLUMN_SIZE(n, width) ((((n) * (width)) + COLUMN_ALIGN - 1) & ~(size_t)(COLUMN_ALIGN - 1))
+
+/* bytes of all columns of one tuple */
+#define TUPLE_WIDTH (3 * sizeof(uint32_t) + 3 * sizeof(uint16_t) + 3 * sizeof(uint8_t))
+
+flowtuple_interval_columns_t *flowtuple_interval_columns_create(void) {
+    flowtuple_interval_columns_t *ic;
+    CALLOC(ic, 1, sizeof(flowtuple_interval_columns_t), return NULL);
+    return ic;
+}
+
+void flowtuple_interval_columns_free(flowtuple_interval_columns_t *ic) {
+    CHECK(ic != NULL, return);
+    FREE(ic->block);
+    FREE(ic->classes);
+    FREE(ic->offsets);
+    FREE(ic);
+}
+
+/* grows the columns to hold at least capacity tuples, keeping the first count */
+static int _flowtuple_interval_columns_reserve(flowtuple_interval_columns_t *ic, size_t capacity) {
+    flowtuple_columns_t cols;
+    uint8_t *block;
+    size_t size;
+
+    if (capacity <= ic->capacity) {
+        return 0;
+    }
+
+    if (capacity < ic->capacity * 2) {
+        capacity = ic->capacity * 2;
+    }
+
+    size = COLUMN_SIZE(capacity, TUPLE_WIDTH) + 9 * COLUMN_ALIGN;
+    if (posix_memalign((void**)&block, COLUMN_ALIGN, size) != 0) {
+        return -1;
+    }
+
+    cols.src_ip = (uint32_t*)block;
+    cols.dst_ip = (uint32_t*)((uint8_t*)cols.src_ip + COLUMN_SIZE(capacity, sizeof(uint32_t)));
+    cols.pkt_cnt = (uint32_t*)((uint8_t*)cols.dst_ip + COLUMN_SIZE(capacity, sizeof(uint32_t)));
+    cols.src_port = (uint16_t*)((uint8_t*)cols.pkt_cnt + COLUMN_SIZE(capacity, sizeof(uint32_t)));
+    cols.dst_port = (uint16_t*)((uint8_t*)cols.src_port + COLUMN_SIZE(capacity, sizeof(uint16_t)));
+    cols.ip_len = (uint16_t*)((uint8_t*)cols.dst_port + COLUMN_SIZE(capacity, sizeof(uint16_t)));
+    cols.proto = (uint8_t*)cols.ip_len + COLUMN_SIZE(capacity, sizeof(uint16_t));
+    cols.ttl = cols.proto + COLUMN_SIZE(capacity, sizeof(uint8_t));
+    cols.tcp_flags = cols.ttl + COLUMN_SIZE(capacity, sizeof(uint8_t));
+
+    if (ic->count > 0) {
+        memcpy(cols.src_ip, ic->cols.src_ip, ic->count * sizeof(uint32_t));
+        memcpy(cols.dst_ip, ic->cols.dst_ip, ic->count * sizeof(uint32_t));
+        memcpy(cols.pkt_cnt, ic->cols.pkt_cnt, ic->count * sizeof(uint32_t));
+        memcpy(cols.src_port, ic->cols.src_port, ic->count * sizeof(uint16_t));
+        memcpy(cols.dst_port, ic->cols.dst_port, ic->count * sizeof(uint16_t));
+        memcpy(cols.ip_len, ic->cols.ip_len, ic->count * sizeof(uint16_t));
+        memcpy(cols.proto, ic->cols.proto, ic->count * sizeof(uint8_t));
+        memcpy(cols.ttl, ic->cols.ttl, ic->count * sizeof(uint8_t));
+        memcpy(cols.tcp_flags, ic->cols.tcp_flags, ic->count * sizeof(uint8_t));
+    }
+
+    FREE(ic->block);
+    ic->block = block;
+    ic->cols = cols;
+    ic->capacity = capacity;
+    return 0;
+}
+
+static int _flowtuple_interval_columns_add_class(flowtuple_interval_columns_t *ic, flowtuple_class_t *ftclass) {
+    flowtuple_class_t *classes;
+    size_t *offsets;
+    size_t capacity;
+
+    if (ic->class_count == ic->class_capacity) {
+        capacity = ic->class_capacity > 0 ? ic->class_capacity * 2 : 4;
+        if ((classes = realloc(ic->classes, capacity * sizeof(flowtuple_class_t))) == NULL) {
+            return -1;
+        }
+        ic->classes = classes;
+        if ((offsets = realloc(ic->offsets, capacity * sizeof(size_t))) == NULL) {
+            return -1;
+        }
+        ic->offsets = offsets;
+        ic->class_capacity = capacity;
+    }
+
+    ic->classes[ic->class_count] = *ftclass;
+    ic->offsets[ic->class_count] = ic->count;
+    ic->class_count++;
+    return 0;
+}
+
+int flowtuple_read_interval_columns(flowtuple_handle_t *handle, flowtuple_interval_columns_t *ic) {
+    CHECK(handle != NULL && ic != NULL, return -1);
+    flowtuple_batch_t batch;
+    flowtuple_columns_t at;
+    flowtuple_class_t *ftclass;
+    int in_interval = 0;
+    size_t left;
+    long ret;
+
+    ic->count = 0;
+    ic->class_count = 0;
+
+    for (;;) {
+        if (handle->state == FLOWTUPLE_STATE_TUPLES) {
+            /* the rest of the class in one go */
+            left = handle->ftclass.key_count_host - handle->number;
+            if (_flowtuple_interval_columns_reserve(ic, ic->count + left) < 0) {
+                handle->errno = FLOWTUPLE_ERR_MEM;
+                return -1;
+            }
+
+            at.src_ip = ic->cols.src_ip + ic->count;
+            at.dst_ip = ic->cols.dst_ip + ic->count;
+            at.src_port = ic->cols.src_port + ic->count;
+            at.dst_port = ic->cols.dst_port + ic->count;
+            at.proto = ic->cols.proto + ic->count;
+            at.ttl = ic->cols.ttl + ic->count;
+            at.tcp_flags = ic->cols.tcp_flags + ic->count;
+            at.ip_len = ic->cols.ip_len + ic->count;
+            at.pkt_cnt = ic->cols.pkt_cnt + ic->count;
+            if ((ret = flowtuple_read_columns(handle, &at, (long)left, &batch)) < 0) {
+                return -1;
+            }
+
+            /* tuples of a class started before the interval are dropped */
+            if (in_interval) {
+                ic->count += (size_t)ret;
+            }
+            continue;
+        }
+
+        if (flowtuple_read_columns(handle, &(ic->cols), 1, &batch) < 0) {
+            return -1;
+        }
+
+        switch (batch.type) {
+            case FLOWTUPLE_RECORD_TYPE_NULL:
+                if (in_interval) {
+                    handle->errno = FLOWTUPLE_ERR_FILE_EOF;
+                    return -1;
+                }
+                return 0;
+            case FLOWTUPLE_RECORD_TYPE_INTERVAL:
+                if (in_interval) {
+                    return 1;
+                }
+                ic->interval = *flowtuple_record_get_interval(batch.record);
+                in_interval = 1;
+                break;
+            case FLOWTUPLE_RECORD_TYPE_FLOWTUPLE_CLASS:
+                ftclass = flowtuple_record_get_class(batch.record);
+                if (in_interval && ftclass->is_start &&
+                    _flowtuple_interval_columns_add_class(ic, ftclass) < 0) {
+                    handle->errno = FLOWTUPLE_ERR_MEM;
+                    return -1;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+flowtuple_interval_t *flowtuple_interval_columns_get_interval(flowtuple_interval_columns_t *ic) {
+    CHECK(ic != NULL, return NULL);
+    return &(ic->interval);
+}
+
+size_t flowtuple_interval_columns_get_count(flowtuple_interval_columns_t *ic) {
+    CHECK(ic != NULL, return 0);
+    return ic->count;
+}
+
+const flowtuple_columns_t *flowtuple_interval_columns_get_columns(flowtuple_interval_columns_t *ic) {
+    CHECK(ic != NULL, return NULL);
+    return &(ic->cols);
+}
+
+size_t flowtuple_interval_columns_get_class_count(flowtuple_interval_columns_t *ic) {
+    CHECK(ic != NULL, return 0);
+    return ic->class_count;
+}
+
+flowtuple_class_t *flowtuple_interval_columns_get_class(flowtuple_interval_columns_t *ic, size_t index) {
+    CHECK(ic != NULL && index < ic->class_count, return NULL);
+    return &(ic->classes[index]);
+}
+
+size_t flowtuple_interval_columns_get_class_offset(flowtuple_interval_columns_t *ic, size_t index) {
+    CHECK(ic != NULL && index < ic->class_count, return 0);
+    return ic->offsets[index];
+}
+
+size_t flowtuple_interval_columns_get_class_columns(flowtuple_interval_columns_t *ic, size_t index, flowtuple_columns_t *cols) {
+    CHECK(ic != NULL && cols != NULL && index < ic->class_count, return 0);
+    size_t offset = ic->offsets[index];
+    size_t end = index + 1 < ic->class_count ? ic->offsets[index + 1] : ic->count;
+
+    cols->src_ip = ic->cols.src_ip + offset;
+    cols->dst_ip = ic->cols.dst_ip + offset;
+    cols->src_port = ic->cols.src_port + offset;
+    cols->dst_port = ic->cols.dst_port + offset;
+    cols->proto = ic->cols.proto + offset;
+    cols->ttl = ic->cols.ttl + offset;
+    cols->tcp_flags = ic->cols.tcp_flags + offset;
+    cols->ip_len = ic->cols.ip_len + offset;
+    cols->pkt_cnt = ic->cols.pkt_cnt + offset;
+    return end - offset;
+}
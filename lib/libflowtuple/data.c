@@ -17,9 +17,14 @@
  *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include "flowtuple_inline.h"
 #include "fttypes.h"
 #include "util.h"
 
+/* fields after the destination of a lazy view, whose offset
+ * depends on whether the destination is /8 (SIXT) or not */
+#define RAW_TAIL(data) ((data)->raw + ((data)->has_slash_eight ? 7 : 8))
+
 flowtuple_class_t *flowtuple_data_get_class_start(flowtuple_data_t *data) {
     CHECK(data != NULL, return NULL);
     return &(data->class_start);
@@ -32,12 +37,22 @@ uint32_t flowtuple_data_get_number(flowtuple_data_t *data) {
 
 uint32_t flowtuple_data_get_src_ip(flowtuple_data_t *data) {
     CHECK(data != NULL, return 0);
+    if (data->raw != NULL) {
+        return _flowtuple_load32(data->raw);
+    }
     return data->src_ip;
 }
 
 uint32_t flowtuple_data_get_dest_ip(flowtuple_data_t *data) {
     CHECK(data != NULL, return 0);
 
+    if (data->raw != NULL) {
+        if (data->has_slash_eight) {
+            return (data->raw[4] << 16) | (data->raw[5] << 8) | data->raw[6];
+        }
+        return _flowtuple_load32(data->raw + 4);
+    }
+
     if (data->has_slash_eight) {
         return (data->dst_ip.y.b << 16) | (data->dst_ip.y.c) << 8 | data->dst_ip.y.d;
     } else {
@@ -47,39 +62,65 @@ uint32_t flowtuple_data_get_dest_ip(flowtuple_data_t *data) {
 
 uint16_t flowtuple_data_get_src_port(flowtuple_data_t *data) {
     CHECK(data != NULL, return 0);
+    if (data->raw != NULL) {
+        return _flowtuple_load16(RAW_TAIL(data));
+    }
     return data->src_port;
 }
 
 uint16_t flowtuple_data_get_dest_port(flowtuple_data_t *data) {
     CHECK(data != NULL, return 0);
+    if (data->raw != NULL) {
+        return _flowtuple_load16(RAW_TAIL(data) + 2);
+    }
     return data->dst_port;
 }
 
 uint8_t flowtuple_data_get_protocol(flowtuple_data_t *data) {
     CHECK(data != NULL, return 0);
+    if (data->raw != NULL) {
+        return *(RAW_TAIL(data) + 4);
+    }
     return data->proto;
 }
 
 uint8_t flowtuple_data_get_ttl(flowtuple_data_t *data) {
     CHECK(data != NULL, return 0);
+    if (data->raw != NULL) {
+        return *(RAW_TAIL(data) + 5);
+    }
     return data->ttl;
 }
 
 uint8_t flowtuple_data_get_tcp_flags(flowtuple_data_t *data) {
     CHECK(data != NULL, return 0);
+    if (data->raw != NULL) {
+        return *(RAW_TAIL(data) + 6);
+    }
     return data->tcp_flags;
 }
 
 uint16_t flowtuple_data_get_ip_len(flowtuple_data_t *data) {
     CHECK(data != NULL, return 0);
+    if (data->raw != NULL) {
+        return _flowtuple_load16(RAW_TAIL(data) + 7);
+    }
     return data->ip_len;
 }
 
 uint32_t flowtuple_data_get_packet_count(flowtuple_data_t *data) {
     CHECK(data != NULL, return 0);
+    if (data->raw != NULL) {
+        return _flowtuple_load32(RAW_TAIL(data) + 9);
+    }
     return data->pkt_cnt;
 }
 
+const uint8_t *flowtuple_data_get_packed(flowtuple_data_t *data) {
+    CHECK(data != NULL, return NULL);
+    return data->raw;
+}
+
 int flowtuple_data_is_slash_eight(flowtuple_data_t *data) {
     CHECK(data != NULL, return 0);
     return data->has_slash_eight;
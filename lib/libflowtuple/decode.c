@@ -0,0 +1,257 @@
+/*
+ *  decode.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+#include "flowtuple.h"
+#include "flowtuple_inline.h"
+#include "fttypes.h"
+#include "util.h"
+#include "decode.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FLOWTUPLE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+typedef void (*flowtuple_decode_fn)(const uint8_t *, size_t, size_t, uint32_t, flowtuple_columns_t *, size_t);
+
+static void _flowtuple_decode_scalar(const uint8_t *buf, size_t tuple_size, size_t n,
+                                     uint32_t octet, flowtuple_columns_t *cols, size_t i) {
+    const uint8_t *p;
+    const uint8_t *q;
+
+    for (; i < n; i++) {
+        p = buf + i * tuple_size;
+
+        cols->src_ip[i] = ntohl(_flowtuple_load32(p));
+        if (tuple_size == FLOWTUPLE_SIXT_SIZE) {
+            cols->dst_ip[i] = octet | ((uint32_t)p[4] << 16) | ((uint32_t)p[5] << 8) | p[6];
+            q = p + 7;
+        } else {
+            cols->dst_ip[i] = ntohl(_flowtuple_load32(p + 4));
+            q = p + 8;
+        }
+
+        cols->src_port[i] = ntohs(_flowtuple_load16(q));
+        cols->dst_port[i] = ntohs(_flowtuple_load16(q + 2));
+        cols->proto[i] = q[4];
+        cols->ttl[i] = q[5];
+        cols->tcp_flags[i] = q[6];
+        cols->ip_len[i] = ntohs(_flowtuple_load16(q + 7));
+        cols->pkt_cnt[i] = ntohl(_flowtuple_load32(q + 9));
+    }
+}
+
+#ifdef FLOWTUPLE_X86_SIMD
+
+/*
+ * Both kernels load every tuple twice, 16 bytes from its start and the
+ * last 16 bytes, and shuffle them into host order 32-bit lanes:
+ *
+ *   first:  src_ip | dst_ip | src_port, dst_port | proto, ttl, tcp_flags
+ *   last:   ip_len | pkt_cnt
+ *
+ * Four of those are then transposed so each register holds one field of
+ * four tuples, which is narrowed and stored into the columns.
+ */
+
+#define SHUF_FIRST_SIXT 3, 2, 1, 0, 6, 5, 4, -1, 8, 7, 10, 9, 11, 12, 13, -1
+#define SHUF_FIRST_SIXU 3, 2, 1, 0, 7, 6, 5, 4, 9, 8, 11, 10, 12, 13, 14, -1
+#define SHUF_LAST 11, 10, -1, -1, 15, 14, 13, 12, -1, -1, -1, -1, -1, -1, -1, -1
+/* low and high halves of each 32-bit lane */
+#define SHUF_PORTS 0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15
+/* bytes 0, 1 and 2 of each 32-bit lane */
+#define SHUF_MISC 0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, -1, -1, -1, -1
+
+__attribute__((target("sse4.1")))
+static void _flowtuple_decode_sse41(const uint8_t *buf, size_t tuple_size, size_t n,
+                                    uint32_t octet, flowtuple_columns_t *cols, size_t i) {
+    const __m128i first = tuple_size == FLOWTUPLE_SIXT_SIZE ?
+                          _mm_setr_epi8(SHUF_FIRST_SIXT) : _mm_setr_epi8(SHUF_FIRST_SIXU);
+    const __m128i last = _mm_setr_epi8(SHUF_LAST);
+    const __m128i ports = _mm_setr_epi8(SHUF_PORTS);
+    const __m128i misc = _mm_setr_epi8(SHUF_MISC);
+    const __m128i oct = _mm_set1_epi32(tuple_size == FLOWTUPLE_SIXT_SIZE ? (int)octet : 0);
+    const size_t tail = tuple_size - 16;
+    __m128i a[4], b[4], t[4], v;
+    const uint8_t *p;
+    uint32_t w;
+    int k;
+
+    for (; i + 4 <= n; i += 4) {
+        p = buf + i * tuple_size;
+        for (k = 0; k < 4; k++) {
+            a[k] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(p + k * tuple_size)), first);
+            b[k] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(p + k * tuple_size + tail)), last);
+        }
+
+        t[0] = _mm_unpacklo_epi32(a[0], a[1]);
+        t[1] = _mm_unpacklo_epi32(a[2], a[3]);
+        t[2] = _mm_unpackhi_epi32(a[0], a[1]);
+        t[3] = _mm_unpackhi_epi32(a[2], a[3]);
+
+        _mm_storeu_si128((__m128i*)(cols->src_ip + i), _mm_unpacklo_epi64(t[0], t[1]));
+        _mm_storeu_si128((__m128i*)(cols->dst_ip + i), _mm_or_si128(_mm_unpackhi_epi64(t[0], t[1]), oct));
+
+        v = _mm_shuffle_epi8(_mm_unpacklo_epi64(t[2], t[3]), ports);
+        _mm_storel_epi64((__m128i*)(cols->src_port + i), v);
+        _mm_storel_epi64((__m128i*)(cols->dst_port + i), _mm_srli_si128(v, 8));
+
+        v = _mm_shuffle_epi8(_mm_unpackhi_epi64(t[2], t[3]), misc);
+        w = (uint32_t)_mm_cvtsi128_si32(v);
+        memcpy(cols->proto + i, &w, sizeof(w));
+        w = (uint32_t)_mm_extract_epi32(v, 1);
+        memcpy(cols->ttl + i, &w, sizeof(w));
+        w = (uint32_t)_mm_extract_epi32(v, 2);
+        memcpy(cols->tcp_flags + i, &w, sizeof(w));
+
+        t[0] = _mm_unpacklo_epi32(b[0], b[1]);
+        t[1] = _mm_unpacklo_epi32(b[2], b[3]);
+        _mm_storel_epi64((__m128i*)(cols->ip_len + i), _mm_shuffle_epi8(_mm_unpacklo_epi64(t[0], t[1]), ports));
+        _mm_storeu_si128((__m128i*)(cols->pkt_cnt + i), _mm_unpackhi_epi64(t[0], t[1]));
+    }
+
+    _flowtuple_decode_scalar(buf, tuple_size, n, octet, cols, i);
+}
+
+/* same as the SSE4.1 kernel, with tuples i..i+3 in the low
+ * and tuples i+4..i+7 in the high 128-bit lane */
+__attribute__((target("avx2")))
+static void _flowtuple_decode_avx2(const uint8_t *buf, size_t tuple_size, size_t n,
+                                   uint32_t octet, flowtuple_columns_t *cols, size_t i) {
+    const __m256i first = tuple_size == FLOWTUPLE_SIXT_SIZE ?
+                          _mm256_setr_epi8(SHUF_FIRST_SIXT, SHUF_FIRST_SIXT) :
+                          _mm256_setr_epi8(SHUF_FIRST_SIXU, SHUF_FIRST_SIXU);
+    const __m256i last = _mm256_setr_epi8(SHUF_LAST, SHUF_LAST);
+    const __m256i ports = _mm256_setr_epi8(SHUF_PORTS, SHUF_PORTS);
+    const __m256i misc = _mm256_setr_epi8(SHUF_MISC, SHUF_MISC);
+    const __m256i lanes = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    const __m256i oct = _mm256_set1_epi32(tuple_size == FLOWTUPLE_SIXT_SIZE ? (int)octet : 0);
+    const size_t tail = tuple_size - 16;
+    __m256i a[4], b[4], t[4], v;
+    const uint8_t *p;
+    const uint8_t *q;
+    int k;
+
+    for (; i + 8 <= n; i += 8) {
+        p = buf + i * tuple_size;
+        for (k = 0; k < 4; k++) {
+            q = p + k * tuple_size;
+            a[k] = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(q))),
+                                           _mm_loadu_si128((const __m128i*)(q + 4 * tuple_size)), 1);
+            b[k] = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(q + tail))),
+                                           _mm_loadu_si128((const __m128i*)(q + 4 * tuple_size + tail)), 1);
+            a[k] = _mm256_shuffle_epi8(a[k], first);
+            b[k] = _mm256_shuffle_epi8(b[k], last);
+        }
+
+        t[0] = _mm256_unpacklo_epi32(a[0], a[1]);
+        t[1] = _mm256_unpacklo_epi32(a[2], a[3]);
+        t[2] = _mm256_unpackhi_epi32(a[0], a[1]);
+        t[3] = _mm256_unpackhi_epi32(a[2], a[3]);
+
+        _mm256_storeu_si256((__m256i*)(cols->src_ip + i), _mm256_unpacklo_epi64(t[0], t[1]));
+        _mm256_storeu_si256((__m256i*)(cols->dst_ip + i), _mm256_or_si256(_mm256_unpackhi_epi64(t[0], t[1]), oct));
+
+        v = _mm256_shuffle_epi8(_mm256_unpacklo_epi64(t[2], t[3]), ports);
+        v = _mm256_permute4x64_epi64(v, _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storeu_si128((__m128i*)(cols->src_port + i), _mm256_castsi256_si128(v));
+        _mm_storeu_si128((__m128i*)(cols->dst_port + i), _mm256_extracti128_si256(v, 1));
+
+        v = _mm256_shuffle_epi8(_mm256_unpackhi_epi64(t[2], t[3]), misc);
+        v = _mm256_permutevar8x32_epi32(v, lanes);
+        _mm_storel_epi64((__m128i*)(cols->proto + i), _mm256_castsi256_si128(v));
+        _mm_storel_epi64((__m128i*)(cols->ttl + i), _mm_srli_si128(_mm256_castsi256_si128(v), 8));
+        _mm_storel_epi64((__m128i*)(cols->tcp_flags + i), _mm256_extracti128_si256(v, 1));
+
+        t[0] = _mm256_unpacklo_epi32(b[0], b[1]);
+        t[1] = _mm256_unpacklo_epi32(b[2], b[3]);
+        v = _mm256_shuffle_epi8(_mm256_unpacklo_epi64(t[0], t[1]), ports);
+        v = _mm256_permute4x64_epi64(v, _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storeu_si128((__m128i*)(cols->ip_len + i), _mm256_castsi256_si128(v));
+        _mm256_storeu_si256((__m256i*)(cols->pkt_cnt + i), _mm256_unpackhi_epi64(t[0], t[1]));
+    }
+
+    _flowtuple_decode_sse41(buf, tuple_size, n, octet, cols, i);
+}
+
+#endif
+
+static flowtuple_decode_fn _flowtuple_decode_kernel(flowtuple_decode_kernel_t kernel) {
+    switch (kernel) {
+        case FLOWTUPLE_DECODE_SCALAR:
+            return _flowtuple_decode_scalar;
+#ifdef FLOWTUPLE_X86_SIMD
+        case FLOWTUPLE_DECODE_SSE41:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sse4.1") ? _flowtuple_decode_sse41 : NULL;
+        case FLOWTUPLE_DECODE_AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") ? _flowtuple_decode_avx2 : NULL;
+#endif
+        default:
+            return NULL;
+    }
+}
+
+static flowtuple_decode_fn _flowtuple_decode_best = _flowtuple_decode_scalar;
+static pthread_once_t _flowtuple_decode_once = PTHREAD_ONCE_INIT;
+
+static void _flowtuple_decode_resolve(void) {
+    flowtuple_decode_fn decode;
+
+    if ((decode = _flowtuple_decode_kernel(FLOWTUPLE_DECODE_AVX2)) != NULL ||
+        (decode = _flowtuple_decode_kernel(FLOWTUPLE_DECODE_SSE41)) != NULL) {
+        _flowtuple_decode_best = decode;
+    }
+}
+
+int _flowtuple_decode_columns_with(flowtuple_decode_kernel_t kernel, const uint8_t *buf, size_t n,
+                                   flowtuple_magic_t magic, uint8_t octet, flowtuple_columns_t *cols) {
+    flowtuple_decode_fn decode;
+    size_t tuple_size;
+
+    CHECK(buf != NULL && cols != NULL, return -1);
+
+    if (magic == FLOWTUPLE_MAGIC_SIXT) {
+        tuple_size = FLOWTUPLE_SIXT_SIZE;
+    } else if (magic == FLOWTUPLE_MAGIC_SIXU) {
+        tuple_size = FLOWTUPLE_SIXU_SIZE;
+    } else {
+        return -1;
+    }
+
+    if (kernel == FLOWTUPLE_DECODE_BEST) {
+        /* resolved once per process, before any thread can see it */
+        pthread_once(&_flowtuple_decode_once, _flowtuple_decode_resolve);
+        decode = _flowtuple_decode_best;
+    } else if ((decode = _flowtuple_decode_kernel(kernel)) == NULL) {
+        return -1;
+    }
+
+    decode(buf, tuple_size, n, (uint32_t)octet << 24, cols, 0);
+    return 0;
+}
+
+int flowtuple_decode_columns(const uint8_t *buf, size_t n, flowtuple_magic_t magic, uint8_t octet, flowtuple_columns_t *cols) {
+    return _flowtuple_decode_columns_with(FLOWTUPLE_DECODE_BEST, buf, n, magic, octet, cols);
+}
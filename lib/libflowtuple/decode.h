@@ -0,0 +1,41 @@
+/*
+ *  decode.h
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef DECODE_H
+#define DECODE_H
+
+#include <stddef.h>
+#include <inttypes.h>
+
+#include "flowtuple.h"
+
+/* the kernels of flowtuple_decode_columns */
+typedef enum {
+    FLOWTUPLE_DECODE_BEST,
+    FLOWTUPLE_DECODE_SCALAR,
+    FLOWTUPLE_DECODE_SSE41,
+    FLOWTUPLE_DECODE_AVX2
+} flowtuple_decode_kernel_t;
+
+/* decodes as flowtuple_decode_columns with a given kernel, returns -1 if the
+ * kernel is not built in or not supported by the cpu */
+int _flowtuple_decode_columns_with(flowtuple_decode_kernel_t kernel, const uint8_t *buf, size_t n,
+                                   flowtuple_magic_t magic, uint8_t octet, flowtuple_columns_t *cols);
+
+#endif
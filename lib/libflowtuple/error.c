@@ -46,6 +46,15 @@ const char *flowtuple_strerr(flowtuple_errno_t err) {
         case FLOWTUPLE_ERR_FILE_EOF:
             /* wandio gave EOF when it wasn't expected */
             return "unexpected EOF";
+        case FLOWTUPLE_ERR_FILE_WRITE:
+            /* wandio gave error on write */
+            return "could not write file";
+        case FLOWTUPLE_ERR_INDEX:
+            /* no index, or one of another file */
+            return "missing or mismatched index";
+        case FLOWTUPLE_ERR_UNSUPPORTED:
+            /* libflowtuple was built without a library it needs */
+            return "not supported by this build";
         case FLOWTUPLE_ERR_OK:
             /* nothing's wrong */
             return "";
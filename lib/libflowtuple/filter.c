@@ -0,0 +1,282 @@
+/*
+ *  filter.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "filter.h"
+#include "fttypes.h"
+#include "util.h"
+
+flowtuple_filter_t *flowtuple_filter_create(void) {
+    flowtuple_filter_t *filter;
+    CALLOC(filter, 1, sizeof(flowtuple_filter_t), return NULL);
+    return filter;
+}
+
+void flowtuple_filter_free(flowtuple_filter_t *filter) {
+    if (filter == NULL) {
+        return;
+    }
+
+    FREE(filter->src_nets);
+    FREE(filter->dst_nets);
+    FREE(filter);
+}
+
+int flowtuple_filter_add_proto(flowtuple_filter_t *filter, uint8_t proto) {
+    CHECK(filter != NULL, return -1);
+    filter->protos[proto >> 6] |= (uint64_t)1 << (proto & 63);
+    filter->preds |= FLOWTUPLE_FILTER_PROTO;
+    return 0;
+}
+
+int flowtuple_filter_set_src_port(flowtuple_filter_t *filter, uint16_t lo, uint16_t hi) {
+    CHECK(filter != NULL && lo <= hi, return -1);
+    filter->src_port_lo = lo;
+    filter->src_port_hi = hi;
+    filter->preds |= FLOWTUPLE_FILTER_SRC_PORT;
+    return 0;
+}
+
+int flowtuple_filter_set_dst_port(flowtuple_filter_t *filter, uint16_t lo, uint16_t hi) {
+    CHECK(filter != NULL && lo <= hi, return -1);
+    filter->dst_port_lo = lo;
+    filter->dst_port_hi = hi;
+    filter->preds |= FLOWTUPLE_FILTER_DST_PORT;
+    return 0;
+}
+
+int flowtuple_filter_set_tcp_flags(flowtuple_filter_t *filter, uint8_t mask, uint8_t value) {
+    CHECK(filter != NULL && (value & ~mask) == 0, return -1);
+    filter->tcp_flags_mask = mask;
+    filter->tcp_flags_value = value;
+    filter->preds |= FLOWTUPLE_FILTER_TCP_FLAGS;
+    return 0;
+}
+
+int flowtuple_filter_set_ttl(flowtuple_filter_t *filter, uint8_t lo, uint8_t hi) {
+    CHECK(filter != NULL && lo <= hi, return -1);
+    filter->ttl_lo = lo;
+    filter->ttl_hi = hi;
+    filter->preds |= FLOWTUPLE_FILTER_TTL;
+    return 0;
+}
+
+int flowtuple_filter_set_ip_len(flowtuple_filter_t *filter, uint16_t lo, uint16_t hi) {
+    CHECK(filter != NULL && lo <= hi, return -1);
+    filter->ip_len_lo = lo;
+    filter->ip_len_hi = hi;
+    filter->preds |= FLOWTUPLE_FILTER_IP_LEN;
+    return 0;
+}
+
+/* appends a network as an address range */
+static int _flowtuple_filter_add_net(flowtuple_net_t **nets, size_t *count, size_t *capacity,
+                                     uint32_t addr, uint8_t prefix_len) {
+    flowtuple_net_t *grown;
+    uint32_t mask;
+    size_t new_capacity;
+
+    if (*count == *capacity) {
+        new_capacity = *capacity > 0 ? *capacity * 2 : 8;
+        if ((grown = realloc(*nets, new_capacity * sizeof(flowtuple_net_t))) == NULL) {
+            return -1;
+        }
+        *nets = grown;
+        *capacity = new_capacity;
+    }
+
+    mask = prefix_len == 0 ? 0 : ~(uint32_t)0 << (32 - prefix_len);
+    (*nets)[*count].lo = addr & mask;
+    (*nets)[*count].hi = (addr & mask) | ~mask;
+    (*count)++;
+    return 0;
+}
+
+int flowtuple_filter_add_src_net(flowtuple_filter_t *filter, uint32_t addr, uint8_t prefix_len) {
+    CHECK(filter != NULL && prefix_len <= 32, return -1);
+
+    if (_flowtuple_filter_add_net(&(filter->src_nets), &(filter->src_net_count),
+                                  &(filter->src_net_capacity), addr, prefix_len) < 0) {
+        return -1;
+    }
+    filter->preds |= FLOWTUPLE_FILTER_SRC_NET;
+    return 0;
+}
+
+int flowtuple_filter_add_dst_net(flowtuple_filter_t *filter, uint32_t addr, uint8_t prefix_len) {
+    CHECK(filter != NULL && prefix_len <= 32, return -1);
+
+    if (_flowtuple_filter_add_net(&(filter->dst_nets), &(filter->dst_net_count),
+                                  &(filter->dst_net_capacity), addr, prefix_len) < 0) {
+        return -1;
+    }
+    filter->preds |= FLOWTUPLE_FILTER_DST_NET;
+    return 0;
+}
+
+int flowtuple_filter_set_octet(flowtuple_filter_t *filter, uint8_t octet) {
+    CHECK(filter != NULL, return -1);
+    filter->octet = octet;
+    return 0;
+}
+
+static int _flowtuple_net_cmp(const void *a, const void *b) {
+    const flowtuple_net_t *x = a;
+    const flowtuple_net_t *y = b;
+
+    if (x->lo != y->lo) {
+        return x->lo < y->lo ? -1 : 1;
+    }
+    return 0;
+}
+
+flowtuple_net_t *_flowtuple_filter_compile_nets(const flowtuple_net_t *nets, size_t count, size_t *out_count) {
+    flowtuple_net_t *compiled;
+    size_t i;
+    size_t n = 0;
+
+    *out_count = 0;
+    if (count == 0) {
+        return NULL;
+    }
+
+    MALLOC(compiled, count * sizeof(flowtuple_net_t), return NULL);
+    memcpy(compiled, nets, count * sizeof(flowtuple_net_t));
+    qsort(compiled, count, sizeof(flowtuple_net_t), _flowtuple_net_cmp);
+
+    for (i = 1; i < count; i++) {
+        if (compiled[n].hi == UINT32_MAX || compiled[i].lo <= compiled[n].hi + 1) {
+            if (compiled[i].hi > compiled[n].hi) {
+                compiled[n].hi = compiled[i].hi;
+            }
+        } else {
+            compiled[++n] = compiled[i];
+        }
+    }
+
+    *out_count = n + 1;
+    return compiled;
+}
+
+int flowtuple_handle_set_filter(flowtuple_handle_t *handle, flowtuple_filter_t *filter) {
+    CHECK(handle != NULL, return -1);
+    flowtuple_filter_t *compiled = NULL;
+
+    if (filter != NULL) {
+        MALLOC(compiled, sizeof(flowtuple_filter_t), goto nomem);
+        *compiled = *filter;
+        compiled->src_nets = NULL;
+        compiled->dst_nets = NULL;
+
+        if (filter->src_net_count > 0 &&
+            (compiled->src_nets = _flowtuple_filter_compile_nets(filter->src_nets, filter->src_net_count,
+                                                                 &(compiled->src_net_count))) == NULL) {
+            goto nomem;
+        }
+        if (filter->dst_net_count > 0 &&
+            (compiled->dst_nets = _flowtuple_filter_compile_nets(filter->dst_nets, filter->dst_net_count,
+                                                                 &(compiled->dst_net_count))) == NULL) {
+            goto nomem;
+        }
+        compiled->src_net_capacity = compiled->src_net_count;
+        compiled->dst_net_capacity = compiled->dst_net_count;
+
+        /* an empty filter needs no checks at all */
+        if (compiled->preds == 0) {
+            flowtuple_filter_free(compiled);
+            compiled = NULL;
+        }
+    }
+
+    flowtuple_filter_free(handle->filter);
+    handle->filter = compiled;
+    return 0;
+
+    nomem:
+    flowtuple_filter_free(compiled);
+    return -1;
+}
+
+/* whether some address from lo to hi is in sorted, disjoint ranges */
+static int _flowtuple_filter_nets_overlap(const flowtuple_net_t *nets, size_t count, uint32_t lo, uint32_t hi) {
+    size_t first = 0;
+    size_t last = count;
+    size_t mid;
+
+    /* first range ending at or after lo */
+    while (first < last) {
+        mid = first + (last - first) / 2;
+        if (nets[mid].hi < lo) {
+            first = mid + 1;
+        } else {
+            last = mid;
+        }
+    }
+    return first < count && nets[first].lo <= hi;
+}
+
+int _flowtuple_filter_may_match(const flowtuple_filter_t *filter, const uint32_t *min, const uint32_t *max, int s8) {
+    uint32_t preds = filter->preds;
+    uint32_t octet = s8 ? (uint32_t)filter->octet << 24 : 0;
+    uint32_t proto;
+
+    if (preds & FLOWTUPLE_FILTER_PROTO) {
+        proto = min[FLOWTUPLE_FIELD_PROTO];
+        while (proto <= max[FLOWTUPLE_FIELD_PROTO] && !((filter->protos[proto >> 6] >> (proto & 63)) & 1)) {
+            proto++;
+        }
+        if (proto > max[FLOWTUPLE_FIELD_PROTO]) {
+            return 0;
+        }
+    }
+    /* flags can only be ruled out when they are all the same */
+    if ((preds & FLOWTUPLE_FILTER_TCP_FLAGS) && min[FLOWTUPLE_FIELD_TCP_FLAGS] == max[FLOWTUPLE_FIELD_TCP_FLAGS] &&
+        (min[FLOWTUPLE_FIELD_TCP_FLAGS] & filter->tcp_flags_mask) != filter->tcp_flags_value) {
+        return 0;
+    }
+    if ((preds & FLOWTUPLE_FILTER_TTL) &&
+        (max[FLOWTUPLE_FIELD_TTL] < filter->ttl_lo || min[FLOWTUPLE_FIELD_TTL] > filter->ttl_hi)) {
+        return 0;
+    }
+    if ((preds & FLOWTUPLE_FILTER_SRC_PORT) &&
+        (max[FLOWTUPLE_FIELD_SRC_PORT] < filter->src_port_lo || min[FLOWTUPLE_FIELD_SRC_PORT] > filter->src_port_hi)) {
+        return 0;
+    }
+    if ((preds & FLOWTUPLE_FILTER_DST_PORT) &&
+        (max[FLOWTUPLE_FIELD_DST_PORT] < filter->dst_port_lo || min[FLOWTUPLE_FIELD_DST_PORT] > filter->dst_port_hi)) {
+        return 0;
+    }
+    if ((preds & FLOWTUPLE_FILTER_IP_LEN) &&
+        (max[FLOWTUPLE_FIELD_IP_LEN] < filter->ip_len_lo || min[FLOWTUPLE_FIELD_IP_LEN] > filter->ip_len_hi)) {
+        return 0;
+    }
+    if ((preds & FLOWTUPLE_FILTER_SRC_NET) &&
+        !_flowtuple_filter_nets_overlap(filter->src_nets, filter->src_net_count, min[FLOWTUPLE_FIELD_SRC_IP],
+                                        max[FLOWTUPLE_FIELD_SRC_IP])) {
+        return 0;
+    }
+    if ((preds & FLOWTUPLE_FILTER_DST_NET) &&
+        !_flowtuple_filter_nets_overlap(filter->dst_nets, filter->dst_net_count, octet | min[FLOWTUPLE_FIELD_DST_IP],
+                                        octet | max[FLOWTUPLE_FIELD_DST_IP])) {
+        return 0;
+    }
+    return 1;
+}
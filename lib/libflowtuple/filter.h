@@ -0,0 +1,161 @@
+/*
+ *  filter.h
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stddef.h>
+#include <inttypes.h>
+
+#include "flowtuple.h"
+#include "flowtuple_inline.h"
+#include "fttypes.h"
+
+/* copies nets sorted, with overlapping and adjacent ranges merged so they can be
+ * binary searched, NULL if there are none or out of memory */
+flowtuple_net_t *_flowtuple_filter_compile_nets(const flowtuple_net_t *nets, size_t count, size_t *out_count);
+
+/* checks the host byte order minimums and maximums of each field of a run of
+ * tuples, returns 0 if the filter rejects them all and 1 if it may not */
+int _flowtuple_filter_may_match(const flowtuple_filter_t *filter, const uint32_t *min, const uint32_t *max, int s8);
+
+/* looks ip up in sorted, disjoint ranges */
+static inline int _flowtuple_filter_nets_match(const flowtuple_net_t *nets, size_t count, uint32_t ip) {
+    size_t lo = 0;
+    size_t hi = count;
+    size_t mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (nets[mid].hi < ip) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < count && nets[lo].lo <= ip;
+}
+
+/* checks a packed tuple against a compiled filter, cheapest predicates first */
+static inline int _flowtuple_filter_match(const flowtuple_filter_t *filter, const uint8_t *p, int s8) {
+    uint32_t preds = filter->preds;
+    uint8_t proto;
+    uint16_t v;
+
+    if (preds & FLOWTUPLE_FILTER_PROTO) {
+        proto = flowtuple_packed_proto(p, s8);
+        if (!((filter->protos[proto >> 6] >> (proto & 63)) & 1)) {
+            return 0;
+        }
+    }
+    if ((preds & FLOWTUPLE_FILTER_TCP_FLAGS) &&
+        (flowtuple_packed_tcp_flags(p, s8) & filter->tcp_flags_mask) != filter->tcp_flags_value) {
+        return 0;
+    }
+    if (preds & FLOWTUPLE_FILTER_TTL) {
+        v = flowtuple_packed_ttl(p, s8);
+        if (v < filter->ttl_lo || v > filter->ttl_hi) {
+            return 0;
+        }
+    }
+    if (preds & FLOWTUPLE_FILTER_SRC_PORT) {
+        v = flowtuple_packed_src_port_host(p, s8);
+        if (v < filter->src_port_lo || v > filter->src_port_hi) {
+            return 0;
+        }
+    }
+    if (preds & FLOWTUPLE_FILTER_DST_PORT) {
+        v = flowtuple_packed_dst_port_host(p, s8);
+        if (v < filter->dst_port_lo || v > filter->dst_port_hi) {
+            return 0;
+        }
+    }
+    if (preds & FLOWTUPLE_FILTER_IP_LEN) {
+        v = flowtuple_packed_ip_len_host(p, s8);
+        if (v < filter->ip_len_lo || v > filter->ip_len_hi) {
+            return 0;
+        }
+    }
+    if ((preds & FLOWTUPLE_FILTER_SRC_NET) &&
+        !_flowtuple_filter_nets_match(filter->src_nets, filter->src_net_count, flowtuple_packed_src_ip_host(p))) {
+        return 0;
+    }
+    if ((preds & FLOWTUPLE_FILTER_DST_NET) &&
+        !_flowtuple_filter_nets_match(filter->dst_nets, filter->dst_net_count,
+                                      flowtuple_packed_dst_ip_host(p, s8, filter->octet))) {
+        return 0;
+    }
+    return 1;
+}
+
+/* checks the tuple at index i of host byte order columns against a compiled
+ * filter, as _flowtuple_filter_match, /8 destinations having a first octet of 0 */
+static inline int _flowtuple_filter_match_columns(const flowtuple_filter_t *filter, const flowtuple_columns_t *cols,
+                                                  size_t i, int s8) {
+    uint32_t preds = filter->preds;
+    uint8_t proto;
+    uint16_t v;
+
+    if (preds & FLOWTUPLE_FILTER_PROTO) {
+        proto = cols->proto[i];
+        if (!((filter->protos[proto >> 6] >> (proto & 63)) & 1)) {
+            return 0;
+        }
+    }
+    if ((preds & FLOWTUPLE_FILTER_TCP_FLAGS) &&
+        (cols->tcp_flags[i] & filter->tcp_flags_mask) != filter->tcp_flags_value) {
+        return 0;
+    }
+    if (preds & FLOWTUPLE_FILTER_TTL) {
+        v = cols->ttl[i];
+        if (v < filter->ttl_lo || v > filter->ttl_hi) {
+            return 0;
+        }
+    }
+    if (preds & FLOWTUPLE_FILTER_SRC_PORT) {
+        v = cols->src_port[i];
+        if (v < filter->src_port_lo || v > filter->src_port_hi) {
+            return 0;
+        }
+    }
+    if (preds & FLOWTUPLE_FILTER_DST_PORT) {
+        v = cols->dst_port[i];
+        if (v < filter->dst_port_lo || v > filter->dst_port_hi) {
+            return 0;
+        }
+    }
+    if (preds & FLOWTUPLE_FILTER_IP_LEN) {
+        v = cols->ip_len[i];
+        if (v < filter->ip_len_lo || v > filter->ip_len_hi) {
+            return 0;
+        }
+    }
+    if ((preds & FLOWTUPLE_FILTER_SRC_NET) &&
+        !_flowtuple_filter_nets_match(filter->src_nets, filter->src_net_count, cols->src_ip[i])) {
+        return 0;
+    }
+    if ((preds & FLOWTUPLE_FILTER_DST_NET) &&
+        !_flowtuple_filter_nets_match(filter->dst_nets, filter->dst_net_count,
+                                      cols->dst_ip[i] | (s8 ? (uint32_t)filter->octet << 24 : 0))) {
+        return 0;
+    }
+    return 1;
+}
+
+#endif
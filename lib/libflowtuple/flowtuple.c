@@ -19,13 +19,49 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #include <wandio.h>
 
 #include "flowtuple.h"
+#include "flowtuple_inline.h"
 #include "fttypes.h"
 #include "util.h"
 #include "record.h"
+#include "reader.h"
+#include "filter.h"
+#include "index.h"
+#include "pipeline.h"
+#include "archive.h"
+#include "gunzip.h"
+
+/* points the handle at filename, starting over with a clean decoder state
+ * while keeping the buffers of the previous file */
+static flowtuple_errno_t _flowtuple_open(flowtuple_handle_t *handle, const char *filename) {
+    char *uri;
+
+    /* reopening the same file keeps its uri */
+    if (filename != handle->uri) {
+        if (handle->uri == NULL || strlen(handle->uri) < strlen(filename)) {
+            if ((uri = realloc(handle->uri, strlen(filename) + 1)) == NULL) {
+                return FLOWTUPLE_ERR_MEM;
+            }
+            handle->uri = uri;
+        }
+        strcpy(handle->uri, filename);
+    }
+
+    handle->index = NULL;
+    handle->state = FLOWTUPLE_STATE_RECORD;
+    handle->in_interval = 0;
+    handle->skip_class = 0;
+    handle->number = 0;
+    handle->last_record.type = FLOWTUPLE_RECORD_TYPE_NULL;
+    _flowtuple_record_reset(&(handle->batch_record));
+
+    handle->errno = _flowtuple_reader_open(handle, filename);
+    return handle->errno;
+}
 
 flowtuple_handle_t *flowtuple_initialize(const char *filename, flowtuple_errno_t *err) {
     flowtuple_errno_t local_err = FLOWTUPLE_ERR_OK;
@@ -37,13 +73,14 @@ flowtuple_handle_t *flowtuple_initialize(const char *filename, flowtuple_errno_t
     }
 
     CALLOC(handle, 1, sizeof(flowtuple_handle_t), goto nomem);
+    handle->class_mask = FLOWTUPLE_CLASS_MASK_ALL;
+    handle->use_gunzip = _flowtuple_gunzip_is_available();
 
-    CALLOC(handle->uri, strlen(filename) + 1, sizeof(char), goto nomem);
-    strcpy(handle->uri, filename);
+    if (_flowtuple_reader_init(handle) < 0) {
+        goto nomem;
+    }
 
-    handle->io = wandio_create(filename);
-    if (handle->io == NULL) {
-        local_err = FLOWTUPLE_ERR_FILE_OPEN;
+    if ((local_err = _flowtuple_open(handle, filename)) != FLOWTUPLE_ERR_OK) {
         goto fail;
     }
 
@@ -60,73 +97,122 @@ flowtuple_handle_t *flowtuple_initialize(const char *filename, flowtuple_errno_t
     return NULL;
 }
 
+int flowtuple_reopen(flowtuple_handle_t *handle, const char *filename) {
+    CHECK(handle != NULL, return -1);
+
+    if (filename == NULL) {
+        handle->errno = FLOWTUPLE_ERR_FILE_OPEN;
+        return -1;
+    }
+
+    handle->errno = _flowtuple_open(handle, filename);
+    return handle->errno == FLOWTUPLE_ERR_OK ? 0 : -1;
+}
+
 void flowtuple_release(flowtuple_handle_t *handle) {
     if (handle == NULL) {
         return;
     }
 
-    if (handle->io != NULL) {
-        wandio_destroy(handle->io);
-    }
-
     if (handle->uri != NULL) {
         FREE(handle->uri);
     }
 
+    _flowtuple_reader_free(handle);
+    _flowtuple_record_reset(&(handle->batch_record));
+    flowtuple_filter_free(handle->filter);
+    FREE(handle->arena);
+
     FREE(handle);
 }
 
-static int _flowtuple_get_next(flowtuple_handle_t *handle, flowtuple_record_t **record) {
+/* reads the next record into record, returns 1 on success, 0 on EOF and -1 on error */
+int _flowtuple_read_record(flowtuple_handle_t *handle, flowtuple_record_t *record) {
     int type;
-    uint8_t buf[5];
-
-    if (*record == NULL) {
-        CALLOC(*record, 1, sizeof(flowtuple_record_t), return -1);
-    }
+    int prefixed = 0;
 
-    check:
-    type = _flowtuple_check_magic(handle);
-    switch (type) {
-        case 1:
-            if (wandio_read(handle->io, buf, 4) < 0) {
-                handle->errno = FLOWTUPLE_ERR_FILE_READ;
-                *record = NULL;
+    again:
+    switch (handle->state) {
+        case FLOWTUPLE_STATE_TUPLES:
+            /* the class start told us how many tuples follow,
+             * so there is no need to look for magics here */
+            if (_flowtuple_record_read_data(handle, record) == 0) {
+                /* the filter rejected the rest of the class */
+                goto again;
             }
-            goto check;
-        case 2:
-            _flowtuple_record_read_interval(handle, *record);
             break;
-        case 3:
-            _flowtuple_record_read_header(handle, *record);
-            break;
-        case 4:
-            _flowtuple_record_read_trailer(handle, *record);
-            break;
-        case 5:
-        case 6:
-            if ((handle->last_record.type == FLOWTUPLE_RECORD_TYPE_FLOWTUPLE_DATA &&
-                    handle->last_record.record.data.number < handle->last_record.record.data.class_start.key_count_host) ||
-                (handle->last_record.type == FLOWTUPLE_RECORD_TYPE_FLOWTUPLE_CLASS &&
-                    handle->last_record.record.ftclass.key_count_host > 0)) {
-                /* fixes issue #2
-                 * makes sure that we read a data record if a class
-                 * is unexpected
-                 */
-                _flowtuple_record_read_data(handle, *record);
-                break;
+        case FLOWTUPLE_STATE_CLASS_END:
+            type = _flowtuple_check_magic(handle);
+            if (type == 5 || type == 6) {
+                if (_flowtuple_record_read_class(handle, record, 0) == 0) {
+                    /* end of a skipped class */
+                    goto again;
+                }
+            } else if (type < 0 && handle->errno == FLOWTUPLE_ERR_OK) {
+                handle->errno = FLOWTUPLE_ERR_FILE_EOF;
+            } else if (type >= 0) {
+                /* more or fewer tuples than the class start claimed */
+                handle->errno = FLOWTUPLE_ERR_CORRUPT;
             }
-            _flowtuple_record_read_class(handle, *record);
-            break;
-        case 7:
-        case 0:
-            _flowtuple_record_read_data(handle, *record);
             break;
+        case FLOWTUPLE_STATE_RECORD:
         default:
-            flowtuple_record_free(*record);
-            *record = NULL;
+            check:
+            type = _flowtuple_check_magic(handle);
+            switch (type) {
+                case 1:
+                    /* skip the corsaro magic prefixing a record */
+                    _flowtuple_reader_next(handle, 4);
+                    prefixed = 1;
+                    goto check;
+                case 2:
+                    _flowtuple_record_read_interval(handle, record);
+                    break;
+                case 3:
+                    _flowtuple_record_read_header(handle, record);
+                    break;
+                case 4:
+                    _flowtuple_record_read_trailer(handle, record);
+                    break;
+                case 5:
+                case 6:
+                    if (prefixed) {
+                        handle->errno = FLOWTUPLE_ERR_CORRUPT;
+                        break;
+                    }
+                    if (_flowtuple_record_read_class(handle, record, 1) == 0) {
+                        /* the body was skipped, its end is next */
+                        goto again;
+                    }
+                    break;
+                case -1:
+                    if (prefixed && handle->errno == FLOWTUPLE_ERR_OK) {
+                        handle->errno = FLOWTUPLE_ERR_FILE_EOF;
+                    }
+                    return handle->errno != FLOWTUPLE_ERR_OK ? -1 : 0;
+                default:
+                    handle->errno = FLOWTUPLE_ERR_CORRUPT;
+                    break;
+            }
             break;
     }
 
+    if (handle->errno != FLOWTUPLE_ERR_OK) {
+        return -1;
+    }
+    return 1;
+}
+
+static int _flowtuple_get_next(flowtuple_handle_t *handle, flowtuple_record_t **record) {
+    if (*record == NULL) {
+        CALLOC(*record, 1, sizeof(flowtuple_record_t), return -1);
+    }
+
+    if (_flowtuple_read_record(handle, *record) <= 0) {
+        flowtuple_record_free(*record);
+        *record = NULL;
+    }
+
     if (handle->errno != FLOWTUPLE_ERR_OK) {
         return -1;
     }
@@ -141,15 +227,40 @@ flowtuple_record_t *flowtuple_get_next(flowtuple_handle_t *handle) {
     if (result < 0) {
         return NULL;
     }
+
+    /* the record outlives the handle's read buffer and header arena */
+    if (record != NULL) {
+        _flowtuple_record_materialize(record);
+    }
+    if (record != NULL && _flowtuple_record_own(record) < 0) {
+        handle->errno = FLOWTUPLE_ERR_MEM;
+        flowtuple_record_free(record);
+        return NULL;
+    }
     return record;
 }
 
+int flowtuple_get_next_record(flowtuple_handle_t *handle, flowtuple_record_t *record) {
+    CHECK(handle != NULL && record != NULL, return -1);
+
+    if (handle->errno != FLOWTUPLE_ERR_OK) {
+        return -1;
+    }
+
+    _flowtuple_record_reset(record);
+    return _flowtuple_read_record(handle, record);
+}
+
 long flowtuple_loop(flowtuple_handle_t *handle, long cnt, flowtuple_handler callback, void *args) {
     CHECK(handle != NULL, return 0);
     flowtuple_record_t *record_ptr = NULL;
     long ret = 0;
     int res;
 
+    if (handle->pipelined) {
+        return _flowtuple_pipeline_loop(handle, cnt, callback, args);
+    }
+
     while (cnt < 0 || ret < cnt) {
         res = _flowtuple_get_next(handle, &record_ptr);
 
@@ -165,6 +276,366 @@ long flowtuple_loop(flowtuple_handle_t *handle, long cnt, flowtuple_handler call
     return ret;
 }
 
+static void _flowtuple_data_from_tuple(flowtuple_tuple_t *tuple, flowtuple_data_t *data) {
+    data->raw = NULL;
+    data->src_ip = tuple->src_ip;
+    data->has_slash_eight = tuple->is_slash_eight;
+    if (tuple->is_slash_eight) {
+        data->dst_ip.y.b = (uint8_t)(tuple->dst_ip >> 16);
+        data->dst_ip.y.c = (uint8_t)(tuple->dst_ip >> 8);
+        data->dst_ip.y.d = (uint8_t)(tuple->dst_ip);
+    } else {
+        data->dst_ip.x = tuple->dst_ip;
+    }
+    data->src_port = tuple->src_port;
+    data->dst_port = tuple->dst_port;
+    data->proto = tuple->proto;
+    data->ttl = tuple->ttl;
+    data->tcp_flags = tuple->tcp_flags;
+    data->ip_len = tuple->ip_len;
+    data->pkt_cnt = tuple->pkt_cnt;
+}
+
+/* starts a batch, returns 1 if tuples are next and otherwise
+ * reads the structural record that is, like flowtuple_read_batch */
+static int _flowtuple_batch_begin(flowtuple_handle_t *handle, flowtuple_batch_t *batch) {
+    flowtuple_record_t *record = &(handle->batch_record);
+    int res;
+
+    batch->type = FLOWTUPLE_RECORD_TYPE_NULL;
+    batch->record = NULL;
+    batch->ftclass = &(handle->ftclass);
+    batch->interval = &(handle->interval);
+    batch->number = handle->number + 1;
+
+    if (handle->errno != FLOWTUPLE_ERR_OK) {
+        return -1;
+    }
+
+    if (handle->state == FLOWTUPLE_STATE_TUPLES) {
+        batch->type = FLOWTUPLE_RECORD_TYPE_FLOWTUPLE_DATA;
+        return 1;
+    }
+
+    _flowtuple_record_reset(record);
+    res = _flowtuple_read_record(handle, record);
+    if (res <= 0) {
+        return res;
+    }
+
+    batch->type = record->type;
+    batch->record = record;
+    return 0;
+}
+
+long flowtuple_read_batch(flowtuple_handle_t *handle, flowtuple_tuple_t *out, long max, flowtuple_batch_t *batch) {
+    CHECK(handle != NULL && out != NULL && batch != NULL && max > 0, return -1);
+    flowtuple_data_t *last_data;
+    uint32_t number = 0;
+    long ret = 0;
+    int res;
+
+    begin:
+    if ((res = _flowtuple_batch_begin(handle, batch)) <= 0) {
+        return res;
+    }
+
+    /* decode the rest of the class straight into the caller's array */
+    while (ret < max && handle->state == FLOWTUPLE_STATE_TUPLES) {
+        if ((res = _flowtuple_record_read_tuple(handle, handle->ftclass.magic, out + ret)) < 0) {
+            return -1;
+        }
+        if (res == 0) {
+            break;
+        }
+        if (ret++ == 0) {
+            batch->number = handle->number;
+        }
+        number = handle->number;
+    }
+
+    if (ret == 0) {
+        /* the filter rejected the rest of the class */
+        goto begin;
+    }
+
+    last_data = &(handle->last_record.record.data);
+    last_data->class_start = handle->ftclass;
+    last_data->number = number;
+    _flowtuple_data_from_tuple(out + ret - 1, last_data);
+    handle->last_record.type = FLOWTUPLE_RECORD_TYPE_FLOWTUPLE_DATA;
+
+    return ret;
+}
+
+/* decodes n packed tuples into cols starting at index at */
+static int _flowtuple_decode_at(const uint8_t *buf, size_t n, uint32_t magic, flowtuple_columns_t *cols, long at) {
+    flowtuple_columns_t dst;
+
+    dst.src_ip = cols->src_ip + at;
+    dst.dst_ip = cols->dst_ip + at;
+    dst.src_port = cols->src_port + at;
+    dst.dst_port = cols->dst_port + at;
+    dst.proto = cols->proto + at;
+    dst.ttl = cols->ttl + at;
+    dst.tcp_flags = cols->tcp_flags + at;
+    dst.ip_len = cols->ip_len + at;
+    dst.pkt_cnt = cols->pkt_cnt + at;
+    return flowtuple_decode_columns(buf, n, magic, 0, &dst);
+}
+
+/* copies n tuples of src from index from into cols from index at */
+static void _flowtuple_copy_at(const flowtuple_columns_t *src, size_t from, size_t n, flowtuple_columns_t *cols, long at) {
+    memcpy(cols->src_ip + at, src->src_ip + from, n * sizeof(uint32_t));
+    memcpy(cols->dst_ip + at, src->dst_ip + from, n * sizeof(uint32_t));
+    memcpy(cols->src_port + at, src->src_port + from, n * sizeof(uint16_t));
+    memcpy(cols->dst_port + at, src->dst_port + from, n * sizeof(uint16_t));
+    memcpy(cols->proto + at, src->proto + from, n);
+    memcpy(cols->ttl + at, src->ttl + from, n);
+    memcpy(cols->tcp_flags + at, src->tcp_flags + from, n);
+    memcpy(cols->ip_len + at, src->ip_len + from, n * sizeof(uint16_t));
+    memcpy(cols->pkt_cnt + at, src->pkt_cnt + from, n * sizeof(uint32_t));
+}
+
+/* reads tuples of the current class from the decoded columns of an archive,
+ * instead of from the tuples it rebuilds, returns the number of tuples
+ * consumed and adds those accepted by the filter to cols from index *ret */
+static int64_t _flowtuple_read_archived(flowtuple_handle_t *handle, flowtuple_columns_t *cols, long max,
+                                        flowtuple_batch_t *batch, long *ret) {
+    flowtuple_data_t *last_data = &(handle->last_record.record.data);
+    uint32_t magic = handle->ftclass.magic;
+    int s8 = magic == FLOWTUPLE_MAGIC_SIXT;
+    size_t first = handle->number;
+    size_t n = handle->ftclass.key_count_host - first;
+    const flowtuple_columns_t *src;
+    size_t last = 0;
+    size_t i;
+
+    if ((src = _flowtuple_record_archive_columns(handle)) == NULL) {
+        return -1;
+    }
+
+    if (handle->filter == NULL) {
+        if (n > (size_t)(max - *ret)) {
+            n = (size_t)(max - *ret);
+        }
+        _flowtuple_copy_at(src, first, n, cols, *ret);
+        *ret += (long)n;
+        last = n;
+    } else {
+        /* the filter runs on the columns, accepted tuples are copied one by one */
+        for (i = 0; i < n && *ret < max; i++) {
+            if (!_flowtuple_filter_match_columns(handle->filter, src, first + i, s8)) {
+                continue;
+            }
+            if (*ret == 0) {
+                batch->number = handle->number + (uint32_t)i + 1;
+            }
+            _flowtuple_copy_at(src, first + i, 1, cols, (*ret)++);
+            last = i + 1;
+        }
+        n = i;
+    }
+
+    if (last > 0) {
+        _flowtuple_record_data_from_columns(src, first + last - 1, magic, last_data);
+        last_data->number = handle->number + (uint32_t)last;
+        last_data->class_start = handle->ftclass;
+        handle->last_record.type = FLOWTUPLE_RECORD_TYPE_FLOWTUPLE_DATA;
+    }
+    return (int64_t)n;
+}
+
+long flowtuple_read_columns(flowtuple_handle_t *handle, flowtuple_columns_t *cols, long max, flowtuple_batch_t *batch) {
+    CHECK(handle != NULL && cols != NULL && batch != NULL && max > 0, return -1);
+    flowtuple_data_t *last_data = &(handle->last_record.record.data);
+    uint32_t magic;
+    size_t tuple_size;
+    size_t avail;
+    size_t n;
+    size_t i;
+    size_t start;
+    int64_t consumed;
+    uint8_t *buf = NULL;
+    uint8_t *last;
+    long ret = 0;
+    int res;
+
+    begin:
+    if ((res = _flowtuple_batch_begin(handle, batch)) <= 0) {
+        return res;
+    }
+
+    magic = handle->ftclass.magic;
+    tuple_size = magic == FLOWTUPLE_MAGIC_SIXT ? FLOWTUPLE_SIXT_SIZE : FLOWTUPLE_SIXU_SIZE;
+    while (ret < max && handle->state == FLOWTUPLE_STATE_TUPLES) {
+        /* archived tuples are taken from their decoded columns */
+        if (handle->archive != NULL && handle->buf_pos == handle->buf_len) {
+            if ((consumed = _flowtuple_read_archived(handle, cols, max, batch, &ret)) < 0 ||
+                _flowtuple_reader_skip(handle, (uint64_t)consumed * tuple_size) < 0) {
+                return -1;
+            }
+            handle->number += (uint32_t)consumed;
+            if (handle->number == handle->ftclass.key_count_host) {
+                handle->state = FLOWTUPLE_STATE_CLASS_END;
+            }
+            continue;
+        }
+
+        /* decode whole runs of tuples sitting in the block buffer */
+        avail = (handle->buf_len - handle->buf_pos) / tuple_size;
+        if (avail == 0) {
+            if (_flowtuple_reader_peek(handle, tuple_size) == NULL) {
+                if (handle->errno == FLOWTUPLE_ERR_OK) {
+                    handle->errno = FLOWTUPLE_ERR_FILE_EOF;
+                }
+                return -1;
+            }
+            continue;
+        }
+
+        n = handle->ftclass.key_count_host - handle->number;
+        if (n > (size_t)(max - ret)) {
+            n = (size_t)(max - ret);
+        }
+        if (n > avail) {
+            n = avail;
+        }
+
+        buf = handle->buf + handle->buf_pos;
+        last = NULL;
+        if (handle->filter == NULL) {
+            if (_flowtuple_decode_at(buf, n, magic, cols, ret) < 0) {
+                handle->errno = FLOWTUPLE_ERR_WRONG_MAGIC;
+                return -1;
+            }
+            ret += (long)n;
+            last = buf + (n - 1) * tuple_size;
+            last_data->number = handle->number + (uint32_t)n;
+        } else {
+            /* decode the spans of accepted tuples */
+            for (i = 0, start = 0; i <= n; i++) {
+                if (i < n && _flowtuple_filter_match(handle->filter, buf + i * tuple_size,
+                                                     magic == FLOWTUPLE_MAGIC_SIXT)) {
+                    continue;
+                }
+                if (i > start) {
+                    if (_flowtuple_decode_at(buf + start * tuple_size, i - start, magic, cols, ret) < 0) {
+                        handle->errno = FLOWTUPLE_ERR_WRONG_MAGIC;
+                        return -1;
+                    }
+                    if (ret == 0) {
+                        batch->number = handle->number + (uint32_t)start + 1;
+                    }
+                    ret += (long)(i - start);
+                    last = buf + (i - 1) * tuple_size;
+                    last_data->number = handle->number + (uint32_t)i;
+                }
+                start = i + 1;
+            }
+        }
+
+        /* the buffer may be refilled before the next run */
+        if (last != NULL) {
+            _flowtuple_record_decode_data(last, magic, last_data);
+            last_data->class_start = handle->ftclass;
+            handle->last_record.type = FLOWTUPLE_RECORD_TYPE_FLOWTUPLE_DATA;
+        }
+
+        handle->buf_pos += n * tuple_size;
+        handle->number += (uint32_t)n;
+        if (handle->number == handle->ftclass.key_count_host) {
+            handle->state = FLOWTUPLE_STATE_CLASS_END;
+        }
+    }
+
+    if (ret == 0) {
+        /* the filter rejected the rest of the class */
+        goto begin;
+    }
+
+    return ret;
+}
+
+/* moves the handle to the record at offset in the decompressed stream */
+int _flowtuple_seek(flowtuple_handle_t *handle, uint64_t offset) {
+    handle->errno = FLOWTUPLE_ERR_OK;
+    handle->state = FLOWTUPLE_STATE_RECORD;
+    handle->in_interval = 0;
+    handle->skip_class = 0;
+    handle->number = 0;
+
+    if (_flowtuple_reader_seek(handle, offset) < 0) {
+        if (handle->errno == FLOWTUPLE_ERR_OK) {
+            handle->errno = FLOWTUPLE_ERR_FILE_READ;
+        }
+        return -1;
+    }
+    return 0;
+}
+
+int flowtuple_seek_interval(flowtuple_handle_t *handle, uint32_t time) {
+    CHECK(handle != NULL, return -1);
+    flowtuple_index_t *index = handle->index;
+
+    if (index == NULL) {
+        handle->errno = FLOWTUPLE_ERR_INDEX;
+        return -1;
+    }
+
+    if (index->interval_count == 0) {
+        return _flowtuple_seek(handle, index->length);
+    }
+    return _flowtuple_seek(handle, index->intervals[_flowtuple_index_find_interval(index, time)].offset);
+}
+
+int flowtuple_handle_set_index(flowtuple_handle_t *handle, flowtuple_index_t *index) {
+    CHECK(handle != NULL, return -1);
+    struct stat st;
+
+    /* an index of another version of the file would seek into garbage */
+    if (index != NULL && stat(handle->uri, &st) == 0 && (uint64_t)st.st_size != index->file_size) {
+        return -1;
+    }
+
+    handle->index = index;
+    return 0;
+}
+
+int flowtuple_inline_abi_version(void) {
+    return FLOWTUPLE_INLINE_ABI_VERSION;
+}
+
+int flowtuple_handle_set_pipeline(flowtuple_handle_t *handle, int enable) {
+    CHECK(handle != NULL, return -1);
+
+    handle->pipelined = enable != 0;
+    handle->errno = _flowtuple_open(handle, handle->uri);
+    return handle->errno == FLOWTUPLE_ERR_OK ? 0 : -1;
+}
+
+int flowtuple_handle_set_gunzip(flowtuple_handle_t *handle, int enable) {
+    CHECK(handle != NULL, return -1);
+
+    if (enable && !_flowtuple_gunzip_is_available()) {
+        handle->errno = FLOWTUPLE_ERR_UNSUPPORTED;
+        return -1;
+    }
+    handle->use_gunzip = enable != 0;
+    handle->errno = _flowtuple_open(handle, handle->uri);
+    return handle->errno == FLOWTUPLE_ERR_OK ? 0 : -1;
+}
+
+void flowtuple_handle_set_class_mask(flowtuple_handle_t *handle, uint32_t mask) {
+    CHECK(handle != NULL, return);
+    handle->class_mask = mask;
+}
+
+void flowtuple_handle_set_lazy(flowtuple_handle_t *handle, int lazy) {
+    CHECK(handle != NULL, return);
+    handle->lazy = lazy;
+}
+
 const char *flowtuple_handle_get_uri(flowtuple_handle_t *handle) {
     CHECK(handle != NULL, return NULL);
     return handle->uri;
@@ -175,5 +646,15 @@ flowtuple_record_t *flowtuple_handle_get_last_record(flowtuple_handle_t *handle)
     flowtuple_record_t *ret;
     MALLOC(ret, sizeof(flowtuple_record_t), return NULL);
     memcpy(ret, &(handle->last_record), sizeof(flowtuple_record_t));
+
+    _flowtuple_record_materialize(ret);
+    if (_flowtuple_record_own(ret) < 0) {
+        FREE(ret);
+    }
     return ret;
 }
+
+flowtuple_record_t *flowtuple_handle_peek_last_record(flowtuple_handle_t *handle) {
+    CHECK(handle != NULL, return NULL);
+    return &(handle->last_record);
+}
@@ -24,6 +24,7 @@
 extern "C" {
 #endif
 
+#include <stddef.h>    /* size_t */
 #include <inttypes.h>  /* uintX_t types */
 
 /*
@@ -48,6 +49,43 @@ typedef struct _flowtuple_class_t flowtuple_class_t;
 typedef struct _flowtuple_data_t flowtuple_data_t;
 /** Flowtuple record object */
 typedef struct _flowtuple_record_t flowtuple_record_t;
+/** Flowtuple interval materialized as columns */
+typedef struct _flowtuple_interval_columns_t flowtuple_interval_columns_t;
+/** Flowtuple tuple filter */
+typedef struct _flowtuple_filter_t flowtuple_filter_t;
+/** Flowtuple interval index */
+typedef struct _flowtuple_index_t flowtuple_index_t;
+/** Time ordered merge of several flowtuple files */
+typedef struct _flowtuple_merge_t flowtuple_merge_t;
+/** Writer of flowtuple files */
+typedef struct _flowtuple_writer_t flowtuple_writer_t;
+/** Roll-up of intervals into longer ones */
+typedef struct _flowtuple_rollup_t flowtuple_rollup_t;
+/** Columnar archive of a flowtuple file */
+typedef struct _flowtuple_archive_t flowtuple_archive_t;
+/** Group by aggregation of tuples */
+typedef struct _flowtuple_agg_t flowtuple_agg_t;
+/** Top-K heavy hitter sketch */
+typedef struct _flowtuple_topk_t flowtuple_topk_t;
+/** HyperLogLog distinct count sketch */
+typedef struct _flowtuple_hll_t flowtuple_hll_t;
+
+/** Decoded flowtuple data tuple, used by the batch API.
+ * Fields hold the same values as the matching flowtuple_data_get_* getters,
+ * i.e. in network byte order.
+ */
+typedef struct _flowtuple_tuple_t {
+    uint32_t src_ip;
+    uint32_t dst_ip;
+    uint32_t pkt_cnt;
+    uint16_t src_port;
+    uint16_t dst_port;
+    uint16_t ip_len;
+    uint8_t proto;
+    uint8_t ttl;
+    uint8_t tcp_flags;
+    uint8_t is_slash_eight;
+} flowtuple_tuple_t;
 
 typedef enum _flowtuple_errno_t {
     FLOWTUPLE_ERR_OK = 0,
@@ -58,6 +96,11 @@ typedef enum _flowtuple_errno_t {
     FLOWTUPLE_ERR_FILE_OPEN,
     FLOWTUPLE_ERR_FILE_READ,
     FLOWTUPLE_ERR_FILE_EOF,
+    FLOWTUPLE_ERR_FILE_WRITE,
+    /* index */
+    FLOWTUPLE_ERR_INDEX,
+    /* build */
+    FLOWTUPLE_ERR_UNSUPPORTED,
 } flowtuple_errno_t;
 
 flowtuple_errno_t flowtuple_errno(flowtuple_handle_t *handle);
@@ -90,6 +133,28 @@ typedef enum _flowtuple_class_type_t {
     FLOWTUPLE_CLASS_TYPE_OTHER,
 } flowtuple_class_type_t;
 
+/** Bit of a class type in a class type mask */
+#define FLOWTUPLE_CLASS_MASK(type) (1u << (type))
+/** Class type mask with every class type */
+#define FLOWTUPLE_CLASS_MASK_ALL 0xffffffffu
+/** Tuple fields, to group aggregations by */
+typedef enum _flowtuple_field_t {
+    FLOWTUPLE_FIELD_SRC_IP,
+    FLOWTUPLE_FIELD_DST_IP,
+    FLOWTUPLE_FIELD_SRC_PORT,
+    FLOWTUPLE_FIELD_DST_PORT,
+    FLOWTUPLE_FIELD_PROTO,
+    FLOWTUPLE_FIELD_TTL,
+    FLOWTUPLE_FIELD_TCP_FLAGS,
+    FLOWTUPLE_FIELD_IP_LEN,
+    FLOWTUPLE_FIELD_COUNT,
+} flowtuple_field_t;
+
+/** Bit of a field in a field mask */
+#define FLOWTUPLE_FIELD_MASK(field) (1u << (field))
+/** Intervals decoded ahead of a merge, for each of its inputs */
+#define FLOWTUPLE_MERGE_DEPTH 4
+
 /*
  * Structures
  */
@@ -100,6 +165,17 @@ typedef enum _flowtuple_class_type_t {
  */
 flowtuple_handle_t *flowtuple_initialize(const char *filename, flowtuple_errno_t *err);
 
+/** Point a flowtuple handle at another file.
+ * The handle's buffers are kept, so a long running reader can go through
+ * many files without allocating. Records previously read from the handle
+ * without a copy, such as headers from flowtuple_get_next_record, become
+ * invalid.
+ * @param handle Handle to reuse
+ * @param filename Filename of input
+ * @return 0 on success, -1 on error (see flowtuple_errno)
+ */
+int flowtuple_reopen(flowtuple_handle_t *handle, const char *filename);
+
 /** Free a flowtuple handle structure.
  * @param handle Handle to be freed
  */
@@ -107,21 +183,891 @@ void flowtuple_release(flowtuple_handle_t *handle);
 
 flowtuple_record_t *flowtuple_get_next(flowtuple_handle_t *handle);
 
+/** Read the next record into a caller-owned record without allocating.
+ * Header strings and plugins point into the handle and stay valid until
+ * the next header is read or the handle is reopened or released.
+ * @param handle Flowtuple handle
+ * @param record Record from flowtuple_record_create, reused across calls
+ * @return 1 if a record was read, 0 on EOF, -1 on error
+ */
+int flowtuple_get_next_record(flowtuple_handle_t *handle, flowtuple_record_t *record);
+
 typedef void (*flowtuple_handler)(flowtuple_record_t *, void *);
 long flowtuple_loop(flowtuple_handle_t *handle, long cnt, flowtuple_handler callback, void *args);
 
+/** Host byte order tuple columns, each pointing to an array with room for
+ * as many tuples as are requested from flowtuple_decode_columns or
+ * flowtuple_read_columns.
+ */
+typedef struct _flowtuple_columns_t {
+    uint32_t *src_ip;
+    uint32_t *dst_ip;
+    uint16_t *src_port;
+    uint16_t *dst_port;
+    uint8_t *proto;
+    uint8_t *ttl;
+    uint8_t *tcp_flags;
+    uint16_t *ip_len;
+    uint32_t *pkt_cnt;
+} flowtuple_columns_t;
+
+/** Decode packed tuples into host byte order columns.
+ * Uses AVX2 or SSE4.1 when the CPU supports them.
+ * @param buf Contiguous run of 20 byte SIXT or 21 byte SIXU tuples
+ * @param n Number of tuples in buf
+ * @param magic Magic of the class the tuples belong to
+ * @param octet First octet filled into the destination of SIXT (/8) tuples
+ * @param cols Columns to write tuples 0 to n - 1 into
+ * @return 0 on success, -1 on an unknown magic
+ */
+int flowtuple_decode_columns(const uint8_t *buf, size_t n, flowtuple_magic_t magic, uint8_t octet, flowtuple_columns_t *cols);
+
+/** Batch metadata filled in by flowtuple_read_batch and flowtuple_read_columns. */
+typedef struct _flowtuple_batch_t {
+    /** FLOWTUPLE_RECORD_TYPE_FLOWTUPLE_DATA for a batch of tuples, the type of
+     * the structural record read otherwise, FLOWTUPLE_RECORD_TYPE_NULL on EOF */
+    flowtuple_record_type_t type;
+    /** Structural record read (owned by the handle, valid until the next call),
+     * NULL for a batch of tuples */
+    flowtuple_record_t *record;
+    /** Class start of the class the tuples belong to (owned by the handle) */
+    flowtuple_class_t *ftclass;
+    /** Last interval record seen (owned by the handle) */
+    flowtuple_interval_t *interval;
+    /** Number of the first tuple within its class, as in flowtuple_data_get_number */
+    uint32_t number;
+} flowtuple_batch_t;
+
+/** Read a batch of data tuples into a caller-owned array.
+ * All tuples of a batch belong to the same class. Header, interval, class and
+ * trailer records are returned one per call, with no tuples, through batch.
+ * @param handle Flowtuple handle
+ * @param out Array of at least max tuples
+ * @param max Maximum number of tuples to read
+ * @param batch Batch metadata
+ * @return Number of tuples read, 0 for a structural record or EOF, -1 on error
+ */
+long flowtuple_read_batch(flowtuple_handle_t *handle, flowtuple_tuple_t *out, long max, flowtuple_batch_t *batch);
+
+/** Read a batch of data tuples into host byte order columns.
+ * Works like flowtuple_read_batch, but tuples are decoded in bulk with
+ * flowtuple_decode_columns. /8 destinations are expanded with a first
+ * octet of 0, matching flowtuple_data_get_dest_ip.
+ * @param handle Flowtuple handle
+ * @param cols Columns with room for at least max tuples
+ * @param max Maximum number of tuples to read
+ * @param batch Batch metadata
+ * @return Number of tuples read, 0 for a structural record or EOF, -1 on error
+ */
+long flowtuple_read_columns(flowtuple_handle_t *handle, flowtuple_columns_t *cols, long max, flowtuple_batch_t *batch);
+
+/** Create an empty interval columns object, to be filled by
+ * flowtuple_read_interval_columns and reused across intervals.
+ * @return New interval columns object, NULL if out of memory
+ */
+flowtuple_interval_columns_t *flowtuple_interval_columns_create(void);
+
+/** Free an interval columns object.
+ * @param ic Interval columns to be freed
+ */
+void flowtuple_interval_columns_free(flowtuple_interval_columns_t *ic);
+
+/** Read the next whole interval into host byte order columns.
+ * Records before the interval start, such as the header, are skipped.
+ * Columns are 64 byte aligned and only grow when an interval holds more
+ * tuples than any interval read into ic before.
+ * @param handle Flowtuple handle
+ * @param ic Interval columns to fill
+ * @return 1 if an interval was read, even one without tuples (see
+ * flowtuple_interval_columns_get_count), 0 on EOF, -1 on error
+ */
+int flowtuple_read_interval_columns(flowtuple_handle_t *handle, flowtuple_interval_columns_t *ic);
+
+/** Callback of flowtuple_parallel_intervals, called with one whole interval.
+ * @param ic Interval columns, valid until the callback returns
+ * @param thread Number of the worker thread, from 0 to the number of threads - 1
+ * @param args Arguments given to flowtuple_parallel_intervals
+ */
+typedef void (*flowtuple_interval_handler)(flowtuple_interval_columns_t *ic, int thread, void *args);
+
+/** Read all intervals of a file on several threads.
+ * The intervals are split into contiguous ranges, and every worker reads
+ * whole ranges through a handle of its own, using the filter and class mask
+ * of handle, seeking once to the start of each through handle's index (see
+ * flowtuple_handle_set_index) and reading on from there. Without an index,
+ * an uncompressed file is split by scanning it for interval boundaries on
+ * every thread, validated by walking their classes, while compressed files
+ * are indexed first, which takes a full read. Gzip files are only read in
+ * parallel if the index has inflate checkpoints, and their ranges start
+ * right after one, so the file is inflated about once whatever the number
+ * of threads. Other compressed files are read by a single worker. When
+ * ordered, a worker keeps the intervals of its range until the ranges
+ * before it have been called back.
+ * @param handle Flowtuple handle, whose read position is left alone
+ * @param nthreads Number of worker threads, 0 for one per CPU
+ * @param ordered If set, callbacks are made one at a time in interval
+ * order, otherwise every worker calls back with its intervals concurrently
+ * @param callback Called with every interval
+ * @param args Passed to callback
+ * @return Number of intervals read, -1 on error (see flowtuple_errno)
+ */
+long flowtuple_parallel_intervals(flowtuple_handle_t *handle, int nthreads, int ordered,
+                                  flowtuple_interval_handler callback, void *args);
+
+/** Creates the state a worker of flowtuple_parallel_loop aggregates into.
+ * @param args Arguments given to flowtuple_parallel_loop
+ * @return State passed to the callback of every record the worker reads,
+ * NULL on error
+ */
+typedef void *(*flowtuple_state_init)(void *args);
+
+/** Merges the state of a worker of flowtuple_parallel_loop, and frees it.
+ * @param args Arguments given to flowtuple_parallel_loop
+ * @param state State of a worker, as returned by its flowtuple_state_init
+ */
+typedef void (*flowtuple_state_merge)(void *args, void *state);
+
+/** Read the records of many files on several threads.
+ * Files are dealt out to worker threads, which steal files from each other
+ * when they run out. A file with a sidecar index next to it (filename.idx,
+ * see flowtuple_index_save) that can be seeked is split into interval ranges
+ * that can be stolen too. Every worker calls back with the records it reads
+ * and its own state, made by init, so callbacks need no locking. Records are
+ * only valid until the callback returns. Once all files are read, each state
+ * is passed to merge on the calling thread, one worker at a time. Without
+ * init, args is the state and a single worker reads all files.
+ * @param paths Filenames of the inputs
+ * @param n Number of filenames
+ * @param nthreads Number of worker threads, 0 for one per CPU
+ * @param init Creates the state of a worker, NULL to pass args instead
+ * @param callback Called with every record and the state of the worker
+ * @param merge Merges the state of a worker, may be NULL, not called with args
+ * @param args Passed to init and merge
+ * @param err Set to the first error met, FLOWTUPLE_ERR_MEM if init fails,
+ * FLOWTUPLE_ERR_OK otherwise
+ * @return Number of records read, -1 on error
+ */
+long flowtuple_parallel_loop(const char **paths, size_t n, int nthreads, flowtuple_state_init init,
+                             flowtuple_handler callback, flowtuple_state_merge merge, void *args,
+                             flowtuple_errno_t *err);
+
+/** @addtogroup flowtuple_api_interval_columns Interval columns
+ * Libflowtuple interval columns getters
+ * @{
+ */
+
+/** Get interval start from interval columns object */
+flowtuple_interval_t *flowtuple_interval_columns_get_interval(flowtuple_interval_columns_t *ic);
+/** Get number of tuples from interval columns object */
+size_t flowtuple_interval_columns_get_count(flowtuple_interval_columns_t *ic);
+/** Get columns of all tuples from interval columns object */
+const flowtuple_columns_t *flowtuple_interval_columns_get_columns(flowtuple_interval_columns_t *ic);
+/** Get number of classes from interval columns object */
+size_t flowtuple_interval_columns_get_class_count(flowtuple_interval_columns_t *ic);
+/** Get class start of a class from interval columns object */
+flowtuple_class_t *flowtuple_interval_columns_get_class(flowtuple_interval_columns_t *ic, size_t index);
+/** Get index of the first tuple of a class from interval columns object */
+size_t flowtuple_interval_columns_get_class_offset(flowtuple_interval_columns_t *ic, size_t index);
+/** Get columns of the tuples of one class from interval columns object,
+ * returns the number of tuples in the class */
+size_t flowtuple_interval_columns_get_class_columns(flowtuple_interval_columns_t *ic, size_t index, flowtuple_columns_t *cols);
+
+/** @} */
+
+/** Create a filter accepting every tuple.
+ * Each predicate set narrows what the filter accepts, a tuple has to pass all
+ * of them. Predicates are checked against the packed tuples before any record
+ * is built, see flowtuple_handle_set_filter. Ports, lengths and addresses are
+ * given in host byte order, ranges are inclusive.
+ * @return New filter, NULL if out of memory
+ */
+flowtuple_filter_t *flowtuple_filter_create(void);
+
+/** Free a filter.
+ * @param filter Filter to be freed
+ */
+void flowtuple_filter_free(flowtuple_filter_t *filter);
+
+/** @addtogroup flowtuple_api_filter Filter
+ * Libflowtuple filter predicates, returning 0 on success and -1 on invalid
+ * arguments or when out of memory
+ * @{
+ */
+
+/** Accept a protocol, may be called for several protocols */
+int flowtuple_filter_add_proto(flowtuple_filter_t *filter, uint8_t proto);
+/** Accept source ports from lo to hi */
+int flowtuple_filter_set_src_port(flowtuple_filter_t *filter, uint16_t lo, uint16_t hi);
+/** Accept destination ports from lo to hi */
+int flowtuple_filter_set_dst_port(flowtuple_filter_t *filter, uint16_t lo, uint16_t hi);
+/** Accept TCP flags where (flags & mask) == value, e.g. SYN only is 0x12, 0x02 */
+int flowtuple_filter_set_tcp_flags(flowtuple_filter_t *filter, uint8_t mask, uint8_t value);
+/** Accept time to live from lo to hi */
+int flowtuple_filter_set_ttl(flowtuple_filter_t *filter, uint8_t lo, uint8_t hi);
+/** Accept IP lengths from lo to hi */
+int flowtuple_filter_set_ip_len(flowtuple_filter_t *filter, uint16_t lo, uint16_t hi);
+/** Accept a source network, may be called for several networks */
+int flowtuple_filter_add_src_net(flowtuple_filter_t *filter, uint32_t addr, uint8_t prefix_len);
+/** Accept a destination network, may be called for several networks */
+int flowtuple_filter_add_dst_net(flowtuple_filter_t *filter, uint32_t addr, uint8_t prefix_len);
+/** Set the first octet /8 destinations are matched with (0 by default,
+ * as in flowtuple_read_columns) */
+int flowtuple_filter_set_octet(flowtuple_filter_t *filter, uint8_t octet);
+
+/** @} */
+
+/** Callback of flowtuple_agg_finish, called with every group.
+ * @param key Host byte order value of each field of the group, indexed by
+ * flowtuple_field_t, the first value of the bucket for bucketed fields and
+ * 0 for fields the aggregation is not grouped by
+ * @param packets Sum of the packet counts of the tuples of the group
+ * @param tuples Number of tuples in the group
+ * @param args Arguments given to flowtuple_agg_finish
+ */
+typedef void (*flowtuple_agg_handler)(const uint32_t *key, uint64_t packets, uint64_t tuples, void *args);
+
+/** Create an aggregation grouping tuples by some of their fields.
+ * Groups live in an open addressing hash table. Once it would outgrow the
+ * memory budget, groups are spilled to temporary files partitioned by hash,
+ * which flowtuple_agg_finish aggregates one partition at a time.
+ * @param fields Mask of the fields to group by, see FLOWTUPLE_FIELD_MASK,
+ * any combination but all of them at once
+ * @param budget Bytes the hash table may take, 0 for no limit
+ * @return New aggregation, NULL on invalid fields or if out of memory
+ */
+flowtuple_agg_t *flowtuple_agg_create(uint32_t fields, size_t budget);
+
+/** Free an aggregation and its spilled groups.
+ * @param agg Aggregation to be freed
+ */
+void flowtuple_agg_free(flowtuple_agg_t *agg);
+
+/** Group a field by buckets of values instead of single values.
+ * E.g. a width of 16 for FLOWTUPLE_FIELD_TTL groups TTLs 0-15, 16-31 and
+ * so on, 256 for FLOWTUPLE_FIELD_SRC_IP groups /24 networks. Only allowed
+ * before the first tuple is added.
+ * @param agg Aggregation
+ * @param field Field to bucket
+ * @param width Values per bucket, 1 by default
+ * @return 0 on success, -1 on invalid arguments
+ */
+int flowtuple_agg_set_bucket(flowtuple_agg_t *agg, flowtuple_field_t field, uint32_t width);
+
+/** Set the directory spilled groups are written to.
+ * Spill files are deleted as soon as they are created, so nothing is left
+ * behind. Without a directory, tmpfile is used.
+ * @param agg Aggregation
+ * @param dir Directory, NULL for the default
+ * @return 0 on success, -1 if out of memory
+ */
+int flowtuple_agg_set_spill_dir(flowtuple_agg_t *agg, const char *dir);
+
+/** Add tuples in host byte order columns, as read by flowtuple_read_columns.
+ * @param agg Aggregation
+ * @param cols Columns of the tuples
+ * @param n Number of tuples
+ * @return 0 on success, -1 if out of memory or failing to spill
+ */
+int flowtuple_agg_add_columns(flowtuple_agg_t *agg, const flowtuple_columns_t *cols, size_t n);
+
+/** Add all remaining tuples of a handle, read in batches with flowtuple_read_columns.
+ * @param agg Aggregation
+ * @param handle Flowtuple handle
+ * @return Number of tuples added, -1 on error (see flowtuple_errno if the
+ * handle's errno is set, otherwise out of memory or failing to spill)
+ */
+long flowtuple_agg_read(flowtuple_agg_t *agg, flowtuple_handle_t *handle);
+
+/** Call back with every group, in no particular order, and empty the aggregation.
+ * @param agg Aggregation
+ * @param callback Called with every group
+ * @param args Passed to callback
+ * @return Number of groups, -1 if out of memory or failing to read back spills
+ */
+long flowtuple_agg_finish(flowtuple_agg_t *agg, flowtuple_agg_handler callback, void *args);
+
+/** Keys heavy hitters are counted by */
+typedef enum _flowtuple_topk_key_t {
+    FLOWTUPLE_TOPK_SRC_IP,
+    FLOWTUPLE_TOPK_DST_PORT,
+    FLOWTUPLE_TOPK_SRC_IP_DST_PORT,
+} flowtuple_topk_key_t;
+
+/** Heavy hitter reported by flowtuple_topk_get, in host byte order. */
+typedef struct _flowtuple_topk_item_t {
+    /** Source IP, 0 unless keyed by it */
+    uint32_t src_ip;
+    /** Destination port, 0 unless keyed by it */
+    uint16_t dst_port;
+    /** Estimated weight, never below the true weight */
+    uint64_t count;
+    /** Most the estimate can be above the true weight */
+    uint64_t error;
+} flowtuple_topk_item_t;
+
+/** Create a Space-Saving sketch of the heaviest keys of a tuple stream.
+ * Tuples are weighted by their packet count. The sketch keeps capacity
+ * counters in fixed memory. With W the total weight added, every key
+ * heavier than W / capacity is kept, and every count is at most
+ * W / capacity above the true weight of its key, as bounded more tightly
+ * by its error. Sketches with the same key and capacity can be merged,
+ * e.g. across intervals or threads, keeping the same bounds for the
+ * total weight of both.
+ * @param key Key to count by
+ * @param capacity Number of counters, at least the K of the top-K wanted
+ * @return New sketch, NULL on invalid arguments or if out of memory
+ */
+flowtuple_topk_t *flowtuple_topk_create(flowtuple_topk_key_t key, size_t capacity);
+
+/** Free a sketch.
+ * @param topk Sketch to be freed
+ */
+void flowtuple_topk_free(flowtuple_topk_t *topk);
+
+/** Empty a sketch, e.g. at the start of an interval.
+ * @param topk Sketch
+ */
+void flowtuple_topk_reset(flowtuple_topk_t *topk);
+
+/** Add a data record, e.g. from a flowtuple_loop callback.
+ * @param topk Sketch
+ * @param data Data record
+ */
+void flowtuple_topk_add_data(flowtuple_topk_t *topk, flowtuple_data_t *data);
+
+/** Add tuples in host byte order columns, as read by flowtuple_read_columns.
+ * @param topk Sketch
+ * @param cols Columns of the tuples
+ * @param n Number of tuples
+ */
+void flowtuple_topk_add_columns(flowtuple_topk_t *topk, const flowtuple_columns_t *cols, size_t n);
+
+/** Merge a sketch into another one.
+ * @param dst Sketch merged into
+ * @param src Sketch merged, left alone
+ * @return 0 on success, -1 if the sketches differ in key or capacity or out of memory
+ */
+int flowtuple_topk_merge(flowtuple_topk_t *dst, flowtuple_topk_t *src);
+
+/** Get the heaviest keys of a sketch, heaviest first.
+ * @param topk Sketch
+ * @param items Array of at least k items
+ * @param k Number of keys wanted
+ * @return Number of items filled in, less than k if fewer keys were seen
+ */
+size_t flowtuple_topk_get(flowtuple_topk_t *topk, flowtuple_topk_item_t *items, size_t k);
+
+/** Get total weight added to a sketch, the W of its error bound */
+uint64_t flowtuple_topk_get_total(flowtuple_topk_t *topk);
+
+/** Keys distinct counts are taken of */
+typedef enum _flowtuple_hll_key_t {
+    FLOWTUPLE_HLL_SRC_IP,
+    FLOWTUPLE_HLL_DST_IP,
+    FLOWTUPLE_HLL_SRC_IP_DST_PORT,
+} flowtuple_hll_key_t;
+
+/** Smallest and largest HyperLogLog precisions */
+#define FLOWTUPLE_HLL_MIN_PRECISION 4
+#define FLOWTUPLE_HLL_MAX_PRECISION 18
+
+/** Create a HyperLogLog sketch counting distinct keys in constant memory.
+ * Keys are hashed to 64 bits as in HLL++, so counts stay accurate far past
+ * 2^32, and estimated with Ertl's improved estimator, which is unbiased for
+ * small counts without HLL++'s empirical bias tables. The sketch takes
+ * 2^precision bytes, with a standard error of about 1.04 / sqrt(2^precision),
+ * e.g. 0.81% at precision 14.
+ * @param key Key to count
+ * @param precision Number of index bits, from FLOWTUPLE_HLL_MIN_PRECISION
+ * to FLOWTUPLE_HLL_MAX_PRECISION
+ * @return New sketch, NULL on invalid arguments or if out of memory
+ */
+flowtuple_hll_t *flowtuple_hll_create(flowtuple_hll_key_t key, int precision);
+
+/** Free a sketch.
+ * @param hll Sketch to be freed
+ */
+void flowtuple_hll_free(flowtuple_hll_t *hll);
+
+/** Empty a sketch, e.g. at the start of an interval.
+ * @param hll Sketch
+ */
+void flowtuple_hll_reset(flowtuple_hll_t *hll);
+
+/** Add the key of a data record, e.g. from a flowtuple_loop callback.
+ * @param hll Sketch
+ * @param data Data record
+ */
+void flowtuple_hll_add_data(flowtuple_hll_t *hll, flowtuple_data_t *data);
+
+/** Add the keys of tuples in host byte order columns.
+ * Keys are hashed a batch at a time before the registers are updated.
+ * @param hll Sketch
+ * @param cols Columns of the tuples
+ * @param n Number of tuples
+ */
+void flowtuple_hll_add_columns(flowtuple_hll_t *hll, const flowtuple_columns_t *cols, size_t n);
+
+/** Add the keys of the tuples of an interval, or of the classes of one type.
+ * One sketch per class type, merged with flowtuple_hll_merge, also gives
+ * the sketch of the whole interval without hashing tuples twice.
+ * @param hll Sketch
+ * @param ic Interval columns, see flowtuple_read_interval_columns
+ * @param class_type Class type whose tuples are added, -1 for all of them
+ */
+void flowtuple_hll_add_interval(flowtuple_hll_t *hll, flowtuple_interval_columns_t *ic, int class_type);
+
+/** Merge a sketch into another one, giving the sketch of the union of their keys.
+ * @param dst Sketch merged into
+ * @param src Sketch merged, left alone
+ * @return 0 on success, -1 if the sketches differ in key or precision
+ */
+int flowtuple_hll_merge(flowtuple_hll_t *dst, flowtuple_hll_t *src);
+
+/** Estimate the number of distinct keys added to a sketch */
+double flowtuple_hll_estimate(flowtuple_hll_t *hll);
+
+/** Serialize a sketch, to be read back on any host.
+ * @param hll Sketch
+ * @param buf Buffer to write to, may be NULL to get the size needed
+ * @param len Size of buf
+ * @return Size of the serialized sketch, written only if it fits in len
+ */
+size_t flowtuple_hll_serialize(flowtuple_hll_t *hll, uint8_t *buf, size_t len);
+
+/** Read back a serialized sketch.
+ * @param buf Serialized sketch
+ * @param len Size of buf
+ * @return New sketch, NULL if buf does not hold a sketch or if out of memory
+ */
+flowtuple_hll_t *flowtuple_hll_deserialize(const uint8_t *buf, size_t len);
+
+/** Build the index of a flowtuple file.
+ * The file is read once, recording where each interval and class starts in
+ * the decompressed stream. Class bodies are jumped over without decoding.
+ * Gzip files are inflated by the library itself, saving a checkpoint with
+ * the inflate window every few megabytes so reading can resume there.
+ * @param filename Filename of input
+ * @param err Set to the error when NULL is returned
+ * @return New index, NULL on error
+ */
+flowtuple_index_t *flowtuple_index_build(const char *filename, flowtuple_errno_t *err);
+
+/** Load an index from a sidecar file written by flowtuple_index_save.
+ * @param filename Filename of the sidecar
+ * @param err Set to the error when NULL is returned
+ * @return New index, NULL on error
+ */
+flowtuple_index_t *flowtuple_index_load(const char *filename, flowtuple_errno_t *err);
+
+/** Save an index to a sidecar file.
+ * Sidecars are only read back on hosts of the same byte order.
+ * @param index Index to save
+ * @param filename Filename of the sidecar
+ * @return 0 on success, -1 on error
+ */
+int flowtuple_index_save(flowtuple_index_t *index, const char *filename);
+
+/** Free an index.
+ * @param index Index to be freed
+ */
+void flowtuple_index_free(flowtuple_index_t *index);
+
+/** @addtogroup flowtuple_api_index Index
+ * Libflowtuple index getters, offsets are in the decompressed stream
+ * @{
+ */
+
+/** Get number of intervals from index object */
+size_t flowtuple_index_get_interval_count(flowtuple_index_t *index);
+/** Get interval start of an interval from index object */
+flowtuple_interval_t *flowtuple_index_get_interval(flowtuple_index_t *index, size_t i);
+/** Get offset of an interval start from index object */
+uint64_t flowtuple_index_get_interval_offset(flowtuple_index_t *index, size_t i);
+/** Get number of classes of an interval from index object */
+size_t flowtuple_index_get_class_count(flowtuple_index_t *index, size_t i);
+/** Get class start of a class of an interval from index object */
+flowtuple_class_t *flowtuple_index_get_class(flowtuple_index_t *index, size_t i, size_t j);
+/** Get offset of a class start of an interval from index object */
+uint64_t flowtuple_index_get_class_offset(flowtuple_index_t *index, size_t i, size_t j);
+/** Get number of inflate checkpoints from index object, 0 unless gzip */
+size_t flowtuple_index_get_checkpoint_count(flowtuple_index_t *index);
+
+/** @} */
+
+/** Open several files to be read interval by interval in time order.
+ * Every input is read through a handle of its own on a background thread,
+ * which decodes up to FLOWTUPLE_MERGE_DEPTH intervals ahead of the merge,
+ * so each input can hold that many intervals in memory.
+ * @param paths Filenames of the inputs, each ordered by interval time
+ * @param n Number of filenames
+ * @param err Set to the error opening an input, if any
+ * @return New merge, NULL on error
+ */
+flowtuple_merge_t *flowtuple_merge_create(const char **paths, size_t n, flowtuple_errno_t *err);
+
+/** Read the next interval of the inputs, the earliest one of all.
+ * Intervals of the same time are returned in input order.
+ * @param merge Merge
+ * @param ic Set to the interval columns, owned by merge and valid until the next call
+ * @param source Set to the number of the input the interval comes from
+ * @return 1 if an interval was read, 0 once every input is read, -1 on error
+ * (see flowtuple_merge_errno)
+ */
+int flowtuple_merge_next(flowtuple_merge_t *merge, flowtuple_interval_columns_t **ic, size_t *source);
+
+/** Free a merge and the handles of its inputs.
+ * @param merge Merge to be freed
+ */
+void flowtuple_merge_free(flowtuple_merge_t *merge);
+
+/** @addtogroup flowtuple_api_merge Merge
+ * Libflowtuple merge getters
+ * @{
+ */
+
+/** Get number of inputs from merge object */
+size_t flowtuple_merge_get_count(flowtuple_merge_t *merge);
+/** Get handle of an input from merge object, options set on it before the
+ * first flowtuple_merge_next, such as filters and class masks, apply to the merge */
+flowtuple_handle_t *flowtuple_merge_get_handle(flowtuple_merge_t *merge, size_t source);
+/** Get filename of an input from merge object */
+const char *flowtuple_merge_get_uri(flowtuple_merge_t *merge, size_t source);
+/** Get error of the last failed flowtuple_merge_next from merge object */
+flowtuple_errno_t flowtuple_merge_errno(flowtuple_merge_t *merge);
+
+/** @} */
+
+/** Create a flowtuple file, written through a wandio writer.
+ * Records are written in the same layout corsaro writes them, so copying
+ * every record of a file gives back the same bytes. Tuples are buffered
+ * per class until the end of their interval, when the class starts can be
+ * written with their tuple counts, so each interval is held in memory.
+ * @param filename Filename of the new file
+ * @param compress_type Compression, one of the WANDIO_COMPRESS_* types
+ * @param compress_level Compression level, 0 to 9
+ * @param err Set to the error creating the file, if any
+ * @return New writer, NULL on error
+ */
+flowtuple_writer_t *flowtuple_writer_create(const char *filename, int compress_type, int compress_level,
+                                            flowtuple_errno_t *err);
+
+/** Write a record read from a flowtuple file.
+ * The first interval record starts an interval and the second one ends it,
+ * class starts add their class to the interval even if none of its tuples
+ * are written, and class ends are left out, as classes end with their interval.
+ * @param writer Writer
+ * @param record Record to write
+ * @return 0 on success, -1 on error (see flowtuple_writer_errno)
+ */
+int flowtuple_writer_write_record(flowtuple_writer_t *writer, flowtuple_record_t *record);
+
+/** Write a header, which goes before the first interval.
+ * @param writer Writer
+ * @param header Header to write, with the interval length of
+ * flowtuple_writer_set_interval_length if one was set
+ * @return 0 on success, -1 on error (see flowtuple_writer_errno)
+ */
+int flowtuple_writer_write_header(flowtuple_writer_t *writer, flowtuple_header_t *header);
+
+/** Start an interval, after the end of the previous one.
+ * @param writer Writer
+ * @param number Interval number in host byte order
+ * @param time Interval start time in host byte order
+ * @return 0 on success, -1 on error (see flowtuple_writer_errno)
+ */
+int flowtuple_writer_start_interval(flowtuple_writer_t *writer, uint16_t number, uint32_t time);
+
+/** End the interval in progress, writing out its classes.
+ * @param writer Writer
+ * @param time Interval end time in host byte order
+ * @return 0 on success, -1 on error (see flowtuple_writer_errno)
+ */
+int flowtuple_writer_end_interval(flowtuple_writer_t *writer, uint32_t time);
+
+/** Add a tuple to the interval in progress, in the class of its class start.
+ * @param writer Writer
+ * @param data Tuple to add
+ * @return 0 on success, -1 on error (see flowtuple_writer_errno)
+ */
+int flowtuple_writer_write_data(flowtuple_writer_t *writer, flowtuple_data_t *data);
+
+/** Add tuples in host byte order columns to the interval in progress.
+ * Only the last 3 bytes of the destinations of SIXT (/8) classes are kept.
+ * @param writer Writer
+ * @param magic Magic of the class the tuples belong to
+ * @param class_type Type of the class the tuples belong to
+ * @param cols Columns of the tuples
+ * @param n Number of tuples
+ * @return 0 on success, -1 on error (see flowtuple_writer_errno)
+ */
+int flowtuple_writer_write_columns(flowtuple_writer_t *writer, flowtuple_magic_t magic, uint16_t class_type,
+                                   const flowtuple_columns_t *cols, size_t n);
+
+/** Write a trailer, which goes after the last interval.
+ * @param writer Writer
+ * @param trailer Trailer to write
+ * @return 0 on success, -1 on error (see flowtuple_writer_errno)
+ */
+int flowtuple_writer_write_trailer(flowtuple_writer_t *writer, flowtuple_trailer_t *trailer);
+
+/** Finish and free a writer.
+ * An interval still in progress is left out, its end time being unknown.
+ * @param writer Writer to be closed
+ * @return The first error of the writer, FLOWTUPLE_ERR_OK if the file is complete
+ */
+flowtuple_errno_t flowtuple_writer_close(flowtuple_writer_t *writer);
+
+/** @addtogroup flowtuple_api_writer Writer
+ * Libflowtuple writer getters and setters
+ * @{
+ */
+
+/** Set interval length in host byte order written in headers by writer, 0 to keep theirs */
+void flowtuple_writer_set_interval_length(flowtuple_writer_t *writer, uint16_t interval_length);
+/** Get number of tuples written by writer */
+uint64_t flowtuple_writer_get_tuple_count(flowtuple_writer_t *writer);
+/** Get first error of writer, which stops it from writing more */
+flowtuple_errno_t flowtuple_writer_errno(flowtuple_writer_t *writer);
+
+/** @} */
+
+/** Create a roll-up, which merges consecutive intervals into longer ones.
+ * Intervals are grouped by their start time rounded down to a multiple of
+ * length, so hourly roll-ups start on the hour. Tuples of a group that only
+ * differ in packet count are combined into one, with the sum of their
+ * counts, capped at UINT32_MAX. The header of the first file read is written
+ * with the new interval length, as the file is made by a roll-up of corsaro
+ * intervals, and every group of intervals is held in memory.
+ * @param writer Writer the longer intervals go to, closed by the caller after flowtuple_rollup_finish
+ * @param length Length of the new intervals in seconds
+ * @return New roll-up, NULL on invalid arguments or if out of memory
+ */
+flowtuple_rollup_t *flowtuple_rollup_create(flowtuple_writer_t *writer, uint16_t length);
+
+/** Free a roll-up, dropping the intervals not written yet.
+ * @param rollup Roll-up to be freed
+ */
+void flowtuple_rollup_free(flowtuple_rollup_t *rollup);
+
+/** Add the intervals of a file, which may be one of several consecutive ones.
+ * Options set on the handle, such as filters and class masks, apply.
+ * @param rollup Roll-up
+ * @param handle Handle of the file, read to its end
+ * @return Number of tuples read, -1 on error (see flowtuple_rollup_errno)
+ */
+long flowtuple_rollup_read(flowtuple_rollup_t *rollup, flowtuple_handle_t *handle);
+
+/** Write the last interval and a trailer summing those of the files read.
+ * @param rollup Roll-up
+ * @return 0 on success, -1 on error (see flowtuple_rollup_errno)
+ */
+int flowtuple_rollup_finish(flowtuple_rollup_t *rollup);
+
+/** @addtogroup flowtuple_api_rollup Roll-up
+ * Libflowtuple roll-up getters
+ * @{
+ */
+
+/** Get number of tuples written so far by rollup */
+uint64_t flowtuple_rollup_get_tuple_count(flowtuple_rollup_t *rollup);
+/** Get number of intervals written so far by rollup */
+uint64_t flowtuple_rollup_get_interval_count(flowtuple_rollup_t *rollup);
+/** Get first error of rollup, from its reads, its writer or memory */
+flowtuple_errno_t flowtuple_rollup_errno(flowtuple_rollup_t *rollup);
+
+/** @} */
+
+/** Convert the rest of a file into a columnar archive.
+ * Each class of each interval is stored as one chunk per field, and per
+ * packet count, in host byte order, alongside the minimum and maximum of
+ * every field. Chunks are dictionary, frequency or bit-packed encoded when
+ * that is smaller than storing the values themselves. Archives are opened
+ * with flowtuple_initialize like any other file, and read back as the
+ * records they were made of, classes ruled out by the statistics of their
+ * chunks being jumped over by filters; or mapped with flowtuple_archive_open.
+ * Archives are only read on hosts of the byte order they were written on.
+ * Options set on the handle, such as filters and class masks, apply.
+ * @param handle Handle of the file, read to its end
+ * @param filename Name of the archive to write
+ * @return FLOWTUPLE_ERR_OK on success, the error of the handle, or of the archive being written, otherwise
+ */
+flowtuple_errno_t flowtuple_archive_write(flowtuple_handle_t *handle, const char *filename);
+
+/** Map a columnar archive to read its chunks in place.
+ * @param filename Name of the archive
+ * @param err Set to the error on failure, may be NULL
+ * @return New archive, NULL on error
+ */
+flowtuple_archive_t *flowtuple_archive_open(const char *filename, flowtuple_errno_t *err);
+
+/** Unmap and free an archive, invalidating its records and columns.
+ * @param archive Archive to be closed
+ */
+void flowtuple_archive_close(flowtuple_archive_t *archive);
+
+/** Get the columns of a class of an interval.
+ * Chunks stored as plain values point into the mapped archive and must not
+ * be written to, encoded ones are decoded into a buffer of the archive.
+ * @param archive Archive
+ * @param interval Index of the interval
+ * @param ftclass Index of the class in the interval
+ * @param cols Set to the columns, valid until the next call or until the archive is closed
+ * @return Number of tuples in the columns, -1 on invalid indices, if out of memory or on a corrupt chunk
+ */
+long flowtuple_archive_get_columns(flowtuple_archive_t *archive, size_t interval, size_t ftclass,
+                                   flowtuple_columns_t *cols);
+
+/** Get the host byte order minimum and maximum of a field of a class,
+ * 0 for both if the class is empty. Destinations of SIXT (/8) classes
+ * leave out their first octet.
+ * @param archive Archive
+ * @param interval Index of the interval
+ * @param ftclass Index of the class in the interval
+ * @param field Field
+ * @param min Set to the minimum
+ * @param max Set to the maximum
+ * @return 0 on success, -1 on invalid arguments
+ */
+int flowtuple_archive_get_stats(flowtuple_archive_t *archive, size_t interval, size_t ftclass,
+                                flowtuple_field_t field, uint32_t *min, uint32_t *max);
+
+/** @addtogroup flowtuple_api_archive Archive
+ * Libflowtuple archive getters, records are owned by the archive
+ * @{
+ */
+
+/** Get number of intervals of archive */
+size_t flowtuple_archive_get_interval_count(flowtuple_archive_t *archive);
+/** Get start record of an interval of archive, NULL if out of range */
+flowtuple_interval_t *flowtuple_archive_get_interval(flowtuple_archive_t *archive, size_t interval);
+/** Get end record of an interval of archive, NULL if out of range */
+flowtuple_interval_t *flowtuple_archive_get_interval_end(flowtuple_archive_t *archive, size_t interval);
+/** Get number of classes of an interval of archive */
+size_t flowtuple_archive_get_class_count(flowtuple_archive_t *archive, size_t interval);
+/** Get start record of a class of an interval of archive, NULL if out of range */
+flowtuple_class_t *flowtuple_archive_get_class(flowtuple_archive_t *archive, size_t interval, size_t ftclass);
+
+/** @} */
+
+/** Re-encode a file as independently compressed zstd frames.
+ * Every frame holds one interval, the first one also what comes before
+ * the first interval and the last one what comes after the last, and a
+ * seek table of the frames goes in a skippable frame at the end, so the
+ * file still decompresses to the same bytes with the zstd tool. Frame files
+ * are opened with flowtuple_initialize like any other file: seeks only
+ * decompress the frame they land in, pipelined handles (see
+ * flowtuple_handle_set_pipeline) decompress the frames ahead of the one
+ * being read on several threads, and every interval is read on its own by
+ * flowtuple_parallel_intervals.
+ * @param filename Name of the file to re-encode
+ * @param index Index of the file, NULL to build one, which takes a full read
+ * @param output Name of the frame file to write
+ * @param level Zstd compression level, 0 for its default
+ * @return FLOWTUPLE_ERR_OK on success, FLOWTUPLE_ERR_UNSUPPORTED if built without libzstd
+ */
+flowtuple_errno_t flowtuple_frames_write(const char *filename, flowtuple_index_t *index, const char *output, int level);
+
+/** Move a handle to the interval holding a point in time.
+ * The handle is moved to the start of the last interval starting at or
+ * before time, or of the first interval if they all start later. Mapped
+ * files are seeked directly, gzip files resume inflating at the closest
+ * checkpoint before the interval, and other files are read up to it.
+ * @param handle Flowtuple handle with an index, see flowtuple_handle_set_index
+ * @param time Time in host byte order, unlike flowtuple_interval_get_time
+ * @return 0 on success, -1 on error (see flowtuple_errno)
+ */
+int flowtuple_seek_interval(flowtuple_handle_t *handle, uint32_t time);
+
 /** @addtogroup flowtuple_api_handle Options
- * Libflowtuple handle getters
+ * Libflowtuple handle getters and setters
  * @{
  */
 
+/** Make data records lazy views of the read buffer.
+ * Fields of a lazy data record are only decoded when their flowtuple_data_get_*
+ * getter is called. A lazy record is valid until the next record is read from
+ * the handle; flowtuple_get_next and flowtuple_handle_get_last_record return
+ * decoded copies.
+ */
+void flowtuple_handle_set_lazy(flowtuple_handle_t *handle, int lazy);
+
+/** Only read classes whose type is in a class type mask.
+ * Other classes, including their start and end records, are jumped over
+ * without decoding their tuples. The mask is FLOWTUPLE_CLASS_MASK_ALL by
+ * default, e.g. FLOWTUPLE_CLASS_MASK(FLOWTUPLE_CLASS_TYPE_BACKSCATTER) only
+ * reads backscatter.
+ */
+void flowtuple_handle_set_class_mask(flowtuple_handle_t *handle, uint32_t mask);
+
+/** Only read the tuples accepted by a filter.
+ * The filter is compiled into the handle, so it can be changed or freed
+ * afterwards. Rejected tuples are skipped by every read function and never
+ * reach flowtuple_loop callbacks; data record numbers still count them.
+ * @param handle Flowtuple handle
+ * @param filter Filter to apply, NULL to accept every tuple
+ * @return 0 on success, -1 if out of memory
+ */
+int flowtuple_handle_set_filter(flowtuple_handle_t *handle, flowtuple_filter_t *filter);
+
+/** Use an index of the handle's file for seeking.
+ * The index is not copied and has to outlive its use by the handle, which
+ * lasts until the handle is reopened.
+ * @param handle Flowtuple handle
+ * @param index Index of the file, NULL to drop the index
+ * @return 0 on success, -1 if the index was built from a file of another size
+ */
+int flowtuple_handle_set_index(flowtuple_handle_t *handle, flowtuple_index_t *index);
+
+/** Read and decode a handle on threads of their own.
+ * A gzip file is then read by one thread and inflated by another, unless
+ * it is decompressed by libdeflate (see flowtuple_handle_set_gunzip), which
+ * then runs on the reading thread, and other compressed files are read and
+ * decompressed by wandio on one thread, ahead of the decoder, through
+ * bounded single producer, single consumer rings of blocks. flowtuple_loop
+ * also decodes records on a thread of its own and calls back on the calling
+ * thread, with decoded copies, so reading, inflating, decoding and the
+ * callback overlap. Mapped files are only decoded ahead. The callback must
+ * not use the handle while it runs. Changing the mode reopens the handle at
+ * the start of its file, which drops its index.
+ * @param handle Flowtuple handle
+ * @param enable 1 to pipeline, 0 to read on the calling thread
+ * @return 0 on success, -1 on error (see flowtuple_errno)
+ */
+int flowtuple_handle_set_pipeline(flowtuple_handle_t *handle, int enable);
+
+/** Choose how gzip files are decompressed.
+ * When libflowtuple is built with libdeflate, gzip files are mapped and
+ * decompressed a whole member at a time by it, which is much faster than
+ * inflating them through wandio and lets seeks within a member skip the
+ * checkpoints of an index. This is the default. Pipelined handles do it on
+ * their reading thread. Files that are not regular, or whose first member
+ * is over a gigabyte, are still streamed by wandio, members libdeflate
+ * finds corrupt or cut short are inflated by zlib for what they hold, and
+ * bytes after the last member that do not start another are ignored, so
+ * the records read are the same either way. Changing the
+ * mode reopens the handle at the start of its file, which drops its index.
+ * @param handle Flowtuple handle
+ * @param enable 1 to decompress with libdeflate, 0 to always use wandio
+ * @return 0 on success, -1 on error, FLOWTUPLE_ERR_UNSUPPORTED if enabled
+ * without libdeflate (see flowtuple_errno)
+ */
+int flowtuple_handle_set_gunzip(flowtuple_handle_t *handle, int enable);
+
 /** Get file uri from handle object */
 const char *flowtuple_handle_get_uri(flowtuple_handle_t *handle);
 /** Get previous record retrieved (needs to be freed) */
 flowtuple_record_t *flowtuple_handle_get_last_record(flowtuple_handle_t *handle);
+/** Get previous record retrieved without a copy (owned by the handle) */
+flowtuple_record_t *flowtuple_handle_peek_last_record(flowtuple_handle_t *handle);
 
 /** @} */
 
+/** Allocate an empty record object, to be filled by flowtuple_get_next_record.
+ * @return New record, NULL if out of memory
+ */
+flowtuple_record_t *flowtuple_record_create(void);
+
 /** Free a record object.
  * @param record Record to be freed
  */
@@ -0,0 +1,198 @@
+/*
+ *  flowtuple_inline.h
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef FLOWTUPLE_INLINE_H
+#define FLOWTUPLE_INLINE_H
+
+#include <string.h>     /* memcpy */
+#include <arpa/inet.h>  /* ntohl, ntohs */
+
+#include "flowtuple.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Inline accessors
+ *
+ * Header-only accessors for the hot path, over the packed tuples of the file
+ * format (as returned by flowtuple_data_get_packed) and over flowtuple_tuple_t.
+ * Plain accessors return the same values as the matching flowtuple_data_get_*
+ * getters, _host variants return host byte order.
+ *
+ * The layout below is part of the ABI and covered by FLOWTUPLE_INLINE_ABI_VERSION,
+ * which is bumped whenever it changes. Programs built against this header
+ * should check FLOWTUPLE_INLINE_ABI_COMPATIBLE() once before using it.
+ */
+
+/** Version of the packed tuple and flowtuple_tuple_t layouts */
+#define FLOWTUPLE_INLINE_ABI_VERSION 1
+
+/** Does the library use the layout this header was built against? */
+#define FLOWTUPLE_INLINE_ABI_COMPATIBLE() \
+    (flowtuple_inline_abi_version() == FLOWTUPLE_INLINE_ABI_VERSION)
+
+/** Size of a packed SIXT (/8 destination) tuple */
+#define FLOWTUPLE_PACKED_SIXT_SIZE 20
+/** Size of a packed SIXU tuple */
+#define FLOWTUPLE_PACKED_SIXU_SIZE 21
+
+/* packed tuple offsets, fields after the destination
+ * are one byte earlier for a /8 (3 byte) destination */
+#define FLOWTUPLE_PACKED_SRC_IP 0
+#define FLOWTUPLE_PACKED_DST_IP 4
+#define FLOWTUPLE_PACKED_TAIL(s8) (8 - ((s8) != 0))
+#define FLOWTUPLE_PACKED_SRC_PORT(s8) (FLOWTUPLE_PACKED_TAIL(s8) + 0)
+#define FLOWTUPLE_PACKED_DST_PORT(s8) (FLOWTUPLE_PACKED_TAIL(s8) + 2)
+#define FLOWTUPLE_PACKED_PROTO(s8) (FLOWTUPLE_PACKED_TAIL(s8) + 4)
+#define FLOWTUPLE_PACKED_TTL(s8) (FLOWTUPLE_PACKED_TAIL(s8) + 5)
+#define FLOWTUPLE_PACKED_TCP_FLAGS(s8) (FLOWTUPLE_PACKED_TAIL(s8) + 6)
+#define FLOWTUPLE_PACKED_IP_LEN(s8) (FLOWTUPLE_PACKED_TAIL(s8) + 7)
+#define FLOWTUPLE_PACKED_PKT_CNT(s8) (FLOWTUPLE_PACKED_TAIL(s8) + 9)
+
+/** Get the packed tuple layout version of the library */
+int flowtuple_inline_abi_version(void);
+
+/** Get the packed tuple of a lazy data object (see flowtuple_handle_set_lazy).
+ * @return Packed tuple, valid until the next record is read, NULL if the data
+ * object is not a lazy view
+ */
+const uint8_t *flowtuple_data_get_packed(flowtuple_data_t *data);
+
+static inline uint64_t _flowtuple_load64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t _flowtuple_load32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint16_t _flowtuple_load16(const uint8_t *p) {
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/* Packed tuple accessors, s8 is non-zero for SIXT (/8) tuples */
+
+static inline uint32_t flowtuple_packed_src_ip(const uint8_t *p) {
+    return _flowtuple_load32(p + FLOWTUPLE_PACKED_SRC_IP);
+}
+
+static inline uint32_t flowtuple_packed_src_ip_host(const uint8_t *p) {
+    return ntohl(flowtuple_packed_src_ip(p));
+}
+
+/** Destination ip, a /8 destination is its three low octets as in
+ * flowtuple_data_get_dest_ip. The 4 byte load stays within the tuple. */
+static inline uint32_t flowtuple_packed_dst_ip(const uint8_t *p, int s8) {
+    uint32_t v = _flowtuple_load32(p + FLOWTUPLE_PACKED_DST_IP);
+    uint32_t mask = -(uint32_t)(s8 != 0);
+    return (v & ~mask) | ((ntohl(v) >> 8) & mask);
+}
+
+/** Destination ip in host byte order, octet is the first octet of a /8 destination */
+static inline uint32_t flowtuple_packed_dst_ip_host(const uint8_t *p, int s8, uint8_t octet) {
+    uint32_t v = ntohl(_flowtuple_load32(p + FLOWTUPLE_PACKED_DST_IP));
+    uint32_t mask = -(uint32_t)(s8 != 0);
+    return (v & ~mask) | (((v >> 8) | ((uint32_t)octet << 24)) & mask);
+}
+
+static inline uint16_t flowtuple_packed_src_port(const uint8_t *p, int s8) {
+    return _flowtuple_load16(p + FLOWTUPLE_PACKED_SRC_PORT(s8));
+}
+
+static inline uint16_t flowtuple_packed_src_port_host(const uint8_t *p, int s8) {
+    return ntohs(flowtuple_packed_src_port(p, s8));
+}
+
+static inline uint16_t flowtuple_packed_dst_port(const uint8_t *p, int s8) {
+    return _flowtuple_load16(p + FLOWTUPLE_PACKED_DST_PORT(s8));
+}
+
+static inline uint16_t flowtuple_packed_dst_port_host(const uint8_t *p, int s8) {
+    return ntohs(flowtuple_packed_dst_port(p, s8));
+}
+
+static inline uint8_t flowtuple_packed_proto(const uint8_t *p, int s8) {
+    return p[FLOWTUPLE_PACKED_PROTO(s8)];
+}
+
+static inline uint8_t flowtuple_packed_ttl(const uint8_t *p, int s8) {
+    return p[FLOWTUPLE_PACKED_TTL(s8)];
+}
+
+static inline uint8_t flowtuple_packed_tcp_flags(const uint8_t *p, int s8) {
+    return p[FLOWTUPLE_PACKED_TCP_FLAGS(s8)];
+}
+
+static inline uint16_t flowtuple_packed_ip_len(const uint8_t *p, int s8) {
+    return _flowtuple_load16(p + FLOWTUPLE_PACKED_IP_LEN(s8));
+}
+
+static inline uint16_t flowtuple_packed_ip_len_host(const uint8_t *p, int s8) {
+    return ntohs(flowtuple_packed_ip_len(p, s8));
+}
+
+static inline uint32_t flowtuple_packed_pkt_cnt(const uint8_t *p, int s8) {
+    return _flowtuple_load32(p + FLOWTUPLE_PACKED_PKT_CNT(s8));
+}
+
+static inline uint32_t flowtuple_packed_pkt_cnt_host(const uint8_t *p, int s8) {
+    return ntohl(flowtuple_packed_pkt_cnt(p, s8));
+}
+
+/* flowtuple_tuple_t accessors */
+
+static inline uint32_t flowtuple_tuple_src_ip_host(const flowtuple_tuple_t *t) {
+    return ntohl(t->src_ip);
+}
+
+/** Destination ip in host byte order, octet is the first octet of a /8 destination */
+static inline uint32_t flowtuple_tuple_dst_ip_host(const flowtuple_tuple_t *t, uint8_t octet) {
+    uint32_t mask = -(uint32_t)(t->is_slash_eight != 0);
+    return (ntohl(t->dst_ip) & ~mask) | ((t->dst_ip | ((uint32_t)octet << 24)) & mask);
+}
+
+static inline uint16_t flowtuple_tuple_src_port_host(const flowtuple_tuple_t *t) {
+    return ntohs(t->src_port);
+}
+
+static inline uint16_t flowtuple_tuple_dst_port_host(const flowtuple_tuple_t *t) {
+    return ntohs(t->dst_port);
+}
+
+static inline uint16_t flowtuple_tuple_ip_len_host(const flowtuple_tuple_t *t) {
+    return ntohs(t->ip_len);
+}
+
+static inline uint32_t flowtuple_tuple_pkt_cnt_host(const flowtuple_tuple_t *t) {
+    return ntohl(t->pkt_cnt);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,585 @@
+/*
+ *  frames.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <endian.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <wandio.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "flowtuple.h"
+#include "fttypes.h"
+#include "util.h"
+#include "frames.h"
+
+#ifdef HAVE_ZSTD
+
+/* bytes read at once from the end of the file being re-encoded */
+#define READ_SIZE (1 << 20)
+/* threads decompressing ahead, each with two frames in flight */
+#define MAX_THREADS 8
+
+static void _flowtuple_frames_put32(uint8_t *buf, uint32_t value) {
+    value = htole32(value);
+    memcpy(buf, &value, 4);
+}
+
+static void _flowtuple_frames_put64(uint8_t *buf, uint64_t value) {
+    value = htole64(value);
+    memcpy(buf, &value, 8);
+}
+
+static uint32_t _flowtuple_frames_get32(const uint8_t *buf) {
+    uint32_t value;
+
+    memcpy(&value, buf, 4);
+    return le32toh(value);
+}
+
+static uint64_t _flowtuple_frames_get64(const uint8_t *buf) {
+    uint64_t value;
+
+    memcpy(&value, buf, 8);
+    return le64toh(value);
+}
+
+/* reads len bytes of io, fewer only at its end */
+static int64_t _flowtuple_frames_fill(io_t *io, uint8_t *buf, size_t len) {
+    size_t done = 0;
+    int64_t n;
+
+    while (done < len) {
+        if ((n = wandio_read(io, buf + done, (int64_t)(len - done))) < 0) {
+            return -1;
+        } else if (n == 0) {
+            break;
+        }
+        done += (size_t)n;
+    }
+    return (int64_t)done;
+}
+
+static int _flowtuple_frames_grow(uint8_t **buf, size_t *size, size_t len) {
+    uint8_t *tmp;
+
+    if (len <= *size) {
+        return 0;
+    }
+    if ((tmp = realloc(*buf, len)) == NULL) {
+        return -1;
+    }
+    *buf = tmp;
+    *size = len;
+    return 0;
+}
+
+/* reads the bytes of frame i, from the end of the one before, up to the start
+ * of the next interval or to the end of the file for the last one */
+static flowtuple_errno_t _flowtuple_frames_read_frame(io_t *io, flowtuple_index_t *index, size_t i, uint64_t offset,
+                                                      uint8_t **in, size_t *in_size, size_t *len) {
+    int last = i + 1 >= index->interval_count;
+    size_t want = last ? READ_SIZE : (size_t)(index->intervals[i + 1].offset - offset);
+    int64_t n;
+
+    *len = 0;
+    do {
+        if (_flowtuple_frames_grow(in, in_size, *len + want) < 0) {
+            return FLOWTUPLE_ERR_MEM;
+        }
+        if ((n = _flowtuple_frames_fill(io, *in + *len, want)) < 0) {
+            return FLOWTUPLE_ERR_FILE_READ;
+        }
+        *len += (size_t)n;
+    } while (last && (size_t)n == want);
+
+    /* the index is of another file */
+    return last || (size_t)n == want ? FLOWTUPLE_ERR_OK : FLOWTUPLE_ERR_INDEX;
+}
+
+flowtuple_errno_t flowtuple_frames_write(const char *filename, flowtuple_index_t *index, const char *output, int level) {
+    flowtuple_errno_t err = FLOWTUPLE_ERR_OK;
+    flowtuple_index_t *built = NULL;
+    flowtuple_frame_t *frames = NULL;
+    size_t frame_count = 0;
+    ZSTD_CCtx *cctx = NULL;
+    io_t *io = NULL;
+    FILE *file = NULL;
+    uint8_t *in = NULL;
+    uint8_t *out = NULL;
+    size_t in_size = 0;
+    size_t out_size = 0;
+    uint8_t buf[FLOWTUPLE_FRAMES_HEADER_SIZE > FLOWTUPLE_FRAMES_ENTRY_SIZE ? FLOWTUPLE_FRAMES_HEADER_SIZE
+                                                                         : FLOWTUPLE_FRAMES_ENTRY_SIZE];
+    uint64_t offset = 0;
+    uint64_t file_offset = FLOWTUPLE_FRAMES_HEADER_SIZE;
+    struct stat st;
+    size_t len;
+    size_t n;
+
+    CHECK(filename != NULL && output != NULL, return FLOWTUPLE_ERR_FILE_OPEN);
+
+    if (index == NULL && (index = built = flowtuple_index_build(filename, &err)) == NULL) {
+        return err;
+    }
+    if (stat(filename, &st) != 0 || (index->file_size != 0 && index->file_size != (uint64_t)st.st_size)) {
+        flowtuple_index_free(built);
+        return FLOWTUPLE_ERR_INDEX;
+    }
+
+    CALLOC(frames, index->interval_count + 1, sizeof(flowtuple_frame_t), err = FLOWTUPLE_ERR_MEM; goto done);
+    if ((cctx = ZSTD_createCCtx()) == NULL) {
+        err = FLOWTUPLE_ERR_MEM;
+        goto done;
+    }
+    if ((io = wandio_create(filename)) == NULL || (file = fopen(output, "wb")) == NULL) {
+        err = FLOWTUPLE_ERR_FILE_OPEN;
+        goto done;
+    }
+
+    _flowtuple_frames_put32(buf, FLOWTUPLE_FRAMES_SKIPPABLE);
+    _flowtuple_frames_put32(buf + 4, 8);
+    memcpy(buf + 8, FLOWTUPLE_FRAMES_MAGIC, 4);
+    _flowtuple_frames_put32(buf + 12, FLOWTUPLE_FRAMES_VERSION);
+    if (fwrite(buf, FLOWTUPLE_FRAMES_HEADER_SIZE, 1, file) != 1) {
+        err = FLOWTUPLE_ERR_FILE_WRITE;
+        goto done;
+    }
+
+    /* one frame per interval, the first one starting with the header */
+    do {
+        if ((err = _flowtuple_frames_read_frame(io, index, frame_count, offset, &in, &in_size, &len)) !=
+            FLOWTUPLE_ERR_OK) {
+            goto done;
+        }
+        if (_flowtuple_frames_grow(&out, &out_size, ZSTD_compressBound(len)) < 0) {
+            err = FLOWTUPLE_ERR_MEM;
+            goto done;
+        }
+        n = ZSTD_compressCCtx(cctx, out, out_size, in, len, level);
+        if (ZSTD_isError(n)) {
+            err = FLOWTUPLE_ERR_MEM;
+            goto done;
+        }
+        if (fwrite(out, 1, n, file) != n) {
+            err = FLOWTUPLE_ERR_FILE_WRITE;
+            goto done;
+        }
+
+        frames[frame_count].offset = offset;
+        frames[frame_count].size = len;
+        frames[frame_count].file_offset = file_offset;
+        frames[frame_count].file_size = n;
+        offset += len;
+        file_offset += n;
+    } while (++frame_count < index->interval_count);
+
+    /* the seek table, ending with the frame count so it is found from the end */
+    _flowtuple_frames_put32(buf, FLOWTUPLE_FRAMES_SKIPPABLE);
+    _flowtuple_frames_put32(buf + 4, (uint32_t)(frame_count * FLOWTUPLE_FRAMES_ENTRY_SIZE + FLOWTUPLE_FRAMES_FOOTER_SIZE));
+    if (fwrite(buf, 8, 1, file) != 1) {
+        err = FLOWTUPLE_ERR_FILE_WRITE;
+        goto done;
+    }
+    for (size_t i = 0; i < frame_count; i++) {
+        _flowtuple_frames_put64(buf, frames[i].offset);
+        _flowtuple_frames_put64(buf + 8, frames[i].size);
+        _flowtuple_frames_put64(buf + 16, frames[i].file_offset);
+        _flowtuple_frames_put64(buf + 24, frames[i].file_size);
+        if (fwrite(buf, FLOWTUPLE_FRAMES_ENTRY_SIZE, 1, file) != 1) {
+            err = FLOWTUPLE_ERR_FILE_WRITE;
+            goto done;
+        }
+    }
+    _flowtuple_frames_put32(buf, (uint32_t)frame_count);
+    _flowtuple_frames_put32(buf + 4, 0);
+    memcpy(buf + 8, FLOWTUPLE_FRAMES_MAGIC, 4);
+    if (fwrite(buf, FLOWTUPLE_FRAMES_FOOTER_SIZE, 1, file) != 1) {
+        err = FLOWTUPLE_ERR_FILE_WRITE;
+    }
+
+    done:
+    if (file != NULL && fclose(file) != 0 && err == FLOWTUPLE_ERR_OK) {
+        err = FLOWTUPLE_ERR_FILE_WRITE;
+    }
+    if (io != NULL) {
+        wandio_destroy(io);
+    }
+    ZSTD_freeCCtx(cctx);
+    FREE(in);
+    FREE(out);
+    FREE(frames);
+    flowtuple_index_free(built);
+    return err;
+}
+
+static int _flowtuple_frames_decompress(flowtuple_frames_t *frames, ZSTD_DCtx *dctx, size_t i, uint8_t *buf) {
+    const flowtuple_frame_t *frame = &(frames->frames[i]);
+    size_t n;
+
+    if (frame->size == 0) {
+        return 0;
+    }
+    n = ZSTD_decompressDCtx(dctx, buf, frame->size, frames->map + frame->file_offset, frame->file_size);
+    return ZSTD_isError(n) || n != frame->size ? -1 : 0;
+}
+
+static void *_flowtuple_frames_work(void *arg) {
+    flowtuple_frames_t *frames = (flowtuple_frames_t*)arg;
+    ZSTD_DCtx *dctx = ZSTD_createDCtx();
+    flowtuple_frame_slot_t *slot;
+    size_t i;
+    int ok;
+
+    pthread_mutex_lock(&(frames->lock));
+    for (;;) {
+        /* only frames whose slot is no longer read, nor still written */
+        while (!frames->stop && (frames->next >= frames->frame_count ||
+                                 frames->next >= frames->frame + frames->slot_count ||
+                                 frames->slots[frames->next % frames->slot_count].state == FLOWTUPLE_FRAME_BUSY)) {
+            pthread_cond_wait(&(frames->cond), &(frames->lock));
+        }
+        if (frames->stop) {
+            break;
+        }
+
+        i = frames->next++;
+        slot = &(frames->slots[i % frames->slot_count]);
+        /* still there from before a seek */
+        if (slot->frame == i && slot->state == FLOWTUPLE_FRAME_DONE) {
+            continue;
+        }
+        slot->frame = i;
+        slot->state = FLOWTUPLE_FRAME_BUSY;
+        pthread_mutex_unlock(&(frames->lock));
+
+        ok = dctx != NULL && _flowtuple_frames_grow(&(slot->data), &(slot->capacity), frames->frames[i].size) == 0 &&
+             _flowtuple_frames_decompress(frames, dctx, i, slot->data) == 0;
+
+        pthread_mutex_lock(&(frames->lock));
+        slot->state = ok ? FLOWTUPLE_FRAME_DONE : FLOWTUPLE_FRAME_FAILED;
+        pthread_cond_broadcast(&(frames->cond));
+    }
+    pthread_mutex_unlock(&(frames->lock));
+
+    ZSTD_freeDCtx(dctx);
+    return NULL;
+}
+
+/* checks the header and the seek table, which is read into frames */
+static flowtuple_errno_t _flowtuple_frames_load(flowtuple_frames_t *frames) {
+    const uint8_t *map = frames->map;
+    const uint8_t *entry;
+    flowtuple_frame_t *frame;
+    uint64_t table;
+    uint64_t end;
+    uint64_t offset = 0;
+    size_t count;
+
+    if (frames->size < FLOWTUPLE_FRAMES_HEADER_SIZE + 8 + FLOWTUPLE_FRAMES_FOOTER_SIZE ||
+        _flowtuple_frames_get32(map) != FLOWTUPLE_FRAMES_SKIPPABLE || _flowtuple_frames_get32(map + 4) != 8 ||
+        memcmp(map + 8, FLOWTUPLE_FRAMES_MAGIC, 4) != 0 ||
+        memcmp(map + frames->size - 4, FLOWTUPLE_FRAMES_MAGIC, 4) != 0) {
+        return FLOWTUPLE_ERR_WRONG_MAGIC;
+    }
+    if (_flowtuple_frames_get32(map + 12) != FLOWTUPLE_FRAMES_VERSION) {
+        return FLOWTUPLE_ERR_CORRUPT;
+    }
+
+    count = _flowtuple_frames_get32(map + frames->size - FLOWTUPLE_FRAMES_FOOTER_SIZE);
+    table = (uint64_t)count * FLOWTUPLE_FRAMES_ENTRY_SIZE + FLOWTUPLE_FRAMES_FOOTER_SIZE;
+    if (table + 8 > frames->size - FLOWTUPLE_FRAMES_HEADER_SIZE) {
+        return FLOWTUPLE_ERR_CORRUPT;
+    }
+    end = frames->size - table - 8;
+    if (_flowtuple_frames_get32(map + end) != FLOWTUPLE_FRAMES_SKIPPABLE ||
+        _flowtuple_frames_get32(map + end + 4) != table) {
+        return FLOWTUPLE_ERR_CORRUPT;
+    }
+
+    CALLOC(frames->frames, count + 1, sizeof(flowtuple_frame_t), return FLOWTUPLE_ERR_MEM);
+    frames->frame_count = count;
+    for (size_t i = 0; i < count; i++) {
+        entry = map + end + 8 + i * FLOWTUPLE_FRAMES_ENTRY_SIZE;
+        frame = &(frames->frames[i]);
+        frame->offset = _flowtuple_frames_get64(entry);
+        frame->size = _flowtuple_frames_get64(entry + 8);
+        frame->file_offset = _flowtuple_frames_get64(entry + 16);
+        frame->file_size = _flowtuple_frames_get64(entry + 24);
+
+        /* frames follow each other in both the file and the stream */
+        if (frame->offset != offset || frame->size > SIZE_MAX / 2 || frame->file_offset < FLOWTUPLE_FRAMES_HEADER_SIZE ||
+            frame->file_offset > end || frame->file_size > end - frame->file_offset) {
+            return FLOWTUPLE_ERR_CORRUPT;
+        }
+        offset += frame->size;
+    }
+    return FLOWTUPLE_ERR_OK;
+}
+
+int _flowtuple_frames_is_frames(const char *filename) {
+    uint8_t header[12];
+    int ret;
+    int fd;
+
+    if ((fd = open(filename, O_RDONLY)) < 0) {
+        return 0;
+    }
+    ret = pread(fd, header, 12, 0) == 12 && _flowtuple_frames_get32(header) == FLOWTUPLE_FRAMES_SKIPPABLE &&
+          memcmp(header + 8, FLOWTUPLE_FRAMES_MAGIC, 4) == 0;
+    close(fd);
+    return ret;
+}
+
+flowtuple_frames_t *_flowtuple_frames_open(const char *filename, int threaded, flowtuple_errno_t *err) {
+    flowtuple_frames_t *frames;
+    struct stat st;
+    void *map = MAP_FAILED;
+    long cpus;
+    int fd;
+
+    *err = FLOWTUPLE_ERR_FILE_OPEN;
+    if ((fd = open(filename, O_RDONLY)) < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+
+    *err = FLOWTUPLE_ERR_MEM;
+    CALLOC(frames, 1, sizeof(flowtuple_frames_t), munmap(map, (size_t)st.st_size); return NULL);
+    frames->map = map;
+    frames->size = (size_t)st.st_size;
+    frames->buf_frame = SIZE_MAX;
+
+    if ((*err = _flowtuple_frames_load(frames)) != FLOWTUPLE_ERR_OK) {
+        _flowtuple_frames_close(frames);
+        return NULL;
+    }
+    if ((frames->dctx = ZSTD_createDCtx()) == NULL) {
+        *err = FLOWTUPLE_ERR_MEM;
+        _flowtuple_frames_close(frames);
+        return NULL;
+    }
+
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (!threaded || frames->frame_count < 2 || cpus < 2) {
+        return frames;
+    }
+
+    /* read on one thread if the others cannot be started */
+    frames->slot_count = 2 * (size_t)(cpus < MAX_THREADS ? cpus : MAX_THREADS);
+    CALLOC(frames->tids, frames->slot_count / 2, sizeof(pthread_t), return frames);
+    CALLOC(frames->slots, frames->slot_count, sizeof(flowtuple_frame_slot_t), FREE(frames->tids); return frames);
+    for (size_t i = 0; i < frames->slot_count; i++) {
+        frames->slots[i].frame = SIZE_MAX;
+    }
+    pthread_mutex_init(&(frames->lock), NULL);
+    pthread_cond_init(&(frames->cond), NULL);
+    for (frames->threads = 0; (size_t)frames->threads < frames->slot_count / 2; frames->threads++) {
+        if (pthread_create(&(frames->tids[frames->threads]), NULL, _flowtuple_frames_work, frames) != 0) {
+            break;
+        }
+    }
+    if (frames->threads == 0) {
+        pthread_cond_destroy(&(frames->cond));
+        pthread_mutex_destroy(&(frames->lock));
+        FREE(frames->tids);
+        FREE(frames->slots);
+    }
+    return frames;
+}
+
+void _flowtuple_frames_close(flowtuple_frames_t *frames) {
+    if (frames->threads > 0) {
+        pthread_mutex_lock(&(frames->lock));
+        frames->stop = 1;
+        pthread_cond_broadcast(&(frames->cond));
+        pthread_mutex_unlock(&(frames->lock));
+        for (int i = 0; i < frames->threads; i++) {
+            pthread_join(frames->tids[i], NULL);
+        }
+        pthread_cond_destroy(&(frames->cond));
+        pthread_mutex_destroy(&(frames->lock));
+        for (size_t i = 0; i < frames->slot_count; i++) {
+            FREE(frames->slots[i].data);
+        }
+        FREE(frames->slots);
+        FREE(frames->tids);
+    }
+
+    munmap(frames->map, frames->size);
+    ZSTD_freeDCtx(frames->dctx);
+    FREE(frames->frames);
+    FREE(frames->buf);
+    FREE(frames);
+}
+
+/* moves on to frame i, letting the threads decompress the frames after it */
+static void _flowtuple_frames_move(flowtuple_frames_t *frames, size_t i) {
+    if (frames->threads == 0) {
+        frames->frame = i;
+        return;
+    }
+
+    pthread_mutex_lock(&(frames->lock));
+    /* frames the threads have taken are kept when going forward among them */
+    if (i < frames->frame || i > frames->next) {
+        frames->next = i;
+    }
+    frames->frame = i;
+    pthread_cond_broadcast(&(frames->cond));
+    pthread_mutex_unlock(&(frames->lock));
+}
+
+/* returns the frame being read, NULL if it is corrupt */
+static const uint8_t *_flowtuple_frames_get(flowtuple_frames_t *frames) {
+    flowtuple_frame_slot_t *slot;
+    size_t i = frames->frame;
+
+    if (frames->threads > 0) {
+        slot = &(frames->slots[i % frames->slot_count]);
+        pthread_mutex_lock(&(frames->lock));
+        while (slot->frame != i || (slot->state != FLOWTUPLE_FRAME_DONE && slot->state != FLOWTUPLE_FRAME_FAILED)) {
+            pthread_cond_wait(&(frames->cond), &(frames->lock));
+        }
+        pthread_mutex_unlock(&(frames->lock));
+        return slot->state == FLOWTUPLE_FRAME_DONE ? slot->data : NULL;
+    }
+
+    if (frames->buf_frame != i) {
+        frames->buf_frame = SIZE_MAX;
+        if (_flowtuple_frames_grow(&(frames->buf), &(frames->buf_size), frames->frames[i].size) < 0 ||
+            _flowtuple_frames_decompress(frames, frames->dctx, i, frames->buf) < 0) {
+            return NULL;
+        }
+        frames->buf_frame = i;
+    }
+    return frames->buf;
+}
+
+int64_t _flowtuple_frames_read(flowtuple_frames_t *frames, uint8_t *buf, size_t len) {
+    const flowtuple_frame_t *frame;
+    const uint8_t *data;
+    size_t n;
+
+    while (frames->frame < frames->frame_count && frames->pos == frames->frames[frames->frame].size) {
+        frames->pos = 0;
+        _flowtuple_frames_move(frames, frames->frame + 1);
+    }
+    if (frames->frame >= frames->frame_count || len == 0) {
+        return 0;
+    }
+    frame = &(frames->frames[frames->frame]);
+
+    /* a whole frame goes straight into buf */
+    if (frames->threads == 0 && frames->pos == 0 && len >= frame->size) {
+        if (_flowtuple_frames_decompress(frames, frames->dctx, frames->frame, buf) < 0) {
+            return -1;
+        }
+        frames->pos = (size_t)frame->size;
+        return (int64_t)frame->size;
+    }
+
+    if ((data = _flowtuple_frames_get(frames)) == NULL) {
+        return -1;
+    }
+    n = frame->size - frames->pos < len ? (size_t)(frame->size - frames->pos) : len;
+    memcpy(buf, data + frames->pos, n);
+    frames->pos += n;
+    return (int64_t)n;
+}
+
+int _flowtuple_frames_seek(flowtuple_frames_t *frames, uint64_t offset) {
+    size_t lo = 0;
+    size_t hi = frames->frame_count;
+    size_t mid;
+
+    /* the last frame holding offset, or the end of the stream */
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (frames->frames[mid].offset + frames->frames[mid].size <= offset) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == frames->frame_count &&
+        (lo == 0 ? offset > 0 : offset > frames->frames[lo - 1].offset + frames->frames[lo - 1].size)) {
+        return -1;
+    }
+
+    frames->pos = lo < frames->frame_count ? (size_t)(offset - frames->frames[lo].offset) : 0;
+    if (lo != frames->frame) {
+        _flowtuple_frames_move(frames, lo);
+    }
+    return 0;
+}
+
+#else
+
+int _flowtuple_frames_is_frames(const char *filename) {
+    /* left to wandio, which reads zstd streams if it was built with libzstd */
+    (void)filename;
+    return 0;
+}
+
+flowtuple_frames_t *_flowtuple_frames_open(const char *filename, int threaded, flowtuple_errno_t *err) {
+    (void)filename;
+    (void)threaded;
+    *err = FLOWTUPLE_ERR_UNSUPPORTED;
+    return NULL;
+}
+
+void _flowtuple_frames_close(flowtuple_frames_t *frames) {
+    (void)frames;
+}
+
+int64_t _flowtuple_frames_read(flowtuple_frames_t *frames, uint8_t *buf, size_t len) {
+    (void)frames;
+    (void)buf;
+    (void)len;
+    return -1;
+}
+
+int _flowtuple_frames_seek(flowtuple_frames_t *frames, uint64_t offset) {
+    (void)frames;
+    (void)offset;
+    return -1;
+}
+
+flowtuple_errno_t flowtuple_frames_write(const char *filename, flowtuple_index_t *index, const char *output, int level) {
+    (void)filename;
+    (void)index;
+    (void)output;
+    (void)level;
+    return FLOWTUPLE_ERR_UNSUPPORTED;
+}
+
+#endif
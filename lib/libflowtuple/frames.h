@@ -0,0 +1,40 @@
+/*
+ *  frames.h
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef FRAMES_H
+#define FRAMES_H
+
+#include <stddef.h>
+#include <inttypes.h>
+
+#include "flowtuple.h"
+#include "fttypes.h"
+
+/* whether filename is a frame file this build can read */
+int _flowtuple_frames_is_frames(const char *filename);
+/* maps a frame file, decompressing ahead on threads if threaded */
+flowtuple_frames_t *_flowtuple_frames_open(const char *filename, int threaded, flowtuple_errno_t *err);
+void _flowtuple_frames_close(flowtuple_frames_t *frames);
+/* reads the next bytes of the decompressed stream, returns the number
+ * of bytes read, 0 at its end and -1 on a corrupt frame */
+int64_t _flowtuple_frames_read(flowtuple_frames_t *frames, uint8_t *buf, size_t len);
+/* moves to offset in the decompressed stream, -1 if past its end */
+int _flowtuple_frames_seek(flowtuple_frames_t *frames, uint64_t offset);
+
+#endif
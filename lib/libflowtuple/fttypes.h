@@ -20,12 +20,19 @@
 #ifndef FTTYPES_H
 #define FTTYPES_H
 
+#include <stdio.h>
 #include <inttypes.h>
+#include <pthread.h>
 
 #include <wandio.h>
+#include <zlib.h>
 
 #include "flowtuple.h"
 
+/* Sizes of the packed tuples following a class start. */
+#define FLOWTUPLE_SIXT_SIZE 20
+#define FLOWTUPLE_SIXU_SIZE 21
+
 /* Slash eight structure. */
 typedef struct _flowtuple_slash_eight_t {
     uint8_t b;
@@ -42,6 +49,10 @@ struct _flowtuple_header_t {
     uint8_t *traceuri;
     uint16_t plugin_cnt;
     uint32_t *plugins;
+
+    /* traceuri and plugins are heap copies owned by the record,
+     * rather than pointers into the handle's header arena */
+    int is_owned;
 };
 
 struct _flowtuple_trailer_t {
@@ -76,6 +87,10 @@ struct _flowtuple_data_t {
     struct _flowtuple_class_t class_start;
     uint32_t number;
 
+    /* when set, this is a lazy view of the packed tuple in
+     * the read buffer and only has_slash_eight is decoded */
+    const uint8_t *raw;
+
     uint32_t src_ip;
 
     int has_slash_eight;
@@ -104,11 +119,661 @@ struct _flowtuple_record_t {
     } record;
 };
 
+struct _flowtuple_interval_columns_t {
+    flowtuple_interval_t interval;
+
+    /* all columns share one aligned block */
+    void *block;
+    size_t capacity;
+    size_t count;
+    flowtuple_columns_t cols;
+
+    flowtuple_class_t *classes;
+    size_t *offsets;
+    size_t class_capacity;
+    size_t class_count;
+};
+
+/* Predicates set in a filter */
+#define FLOWTUPLE_FILTER_PROTO     0x01
+#define FLOWTUPLE_FILTER_SRC_PORT  0x02
+#define FLOWTUPLE_FILTER_DST_PORT  0x04
+#define FLOWTUPLE_FILTER_TCP_FLAGS 0x08
+#define FLOWTUPLE_FILTER_TTL       0x10
+#define FLOWTUPLE_FILTER_IP_LEN    0x20
+#define FLOWTUPLE_FILTER_SRC_NET   0x40
+#define FLOWTUPLE_FILTER_DST_NET   0x80
+
+/* inclusive address range, host byte order */
+typedef struct _flowtuple_net_t {
+    uint32_t lo;
+    uint32_t hi;
+} flowtuple_net_t;
+
+struct _flowtuple_filter_t {
+    uint32_t preds;
+
+    /* bitmap of accepted protocols */
+    uint64_t protos[4];
+    /* inclusive ranges, host byte order */
+    uint16_t src_port_lo;
+    uint16_t src_port_hi;
+    uint16_t dst_port_lo;
+    uint16_t dst_port_hi;
+    uint16_t ip_len_lo;
+    uint16_t ip_len_hi;
+    uint8_t ttl_lo;
+    uint8_t ttl_hi;
+    uint8_t tcp_flags_mask;
+    uint8_t tcp_flags_value;
+    /* first octet of /8 destinations */
+    uint8_t octet;
+
+    /* once compiled, sorted and disjoint */
+    flowtuple_net_t *src_nets;
+    size_t src_net_count;
+    size_t src_net_capacity;
+    flowtuple_net_t *dst_nets;
+    size_t dst_net_count;
+    size_t dst_net_capacity;
+};
+
+/* size of the inflate window saved with a checkpoint */
+#define FLOWTUPLE_WINDOW_SIZE 32768
+
+/* point a gzip file can be inflated from, zran style */
+typedef struct _flowtuple_checkpoint_t {
+    /* offset in the decompressed stream */
+    uint64_t out;
+    /* offset in the file of the first full byte of input */
+    uint64_t in;
+    /* bits of the byte before in that are still to be inflated */
+    int bits;
+    uint8_t window[FLOWTUPLE_WINDOW_SIZE];
+} flowtuple_checkpoint_t;
+
+/* slot of a pipeline ring, len is 0 at the end of the stream and -1 on error */
+typedef struct _flowtuple_ring_slot_t {
+    uint8_t *data;
+    int64_t len;
+} flowtuple_ring_slot_t;
+
+/* bounded single producer, single consumer ring of slots */
+typedef struct _flowtuple_ring_t {
+    flowtuple_ring_slot_t *slots;
+    size_t count;
+    /* set when the consumer or producer is going away */
+    int *stop;
+
+    /* a side finding the ring full or empty for long blocks on cond,
+     * and the other side only signals it when there are waiters */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int waiters;
+
+    /* slots pushed and popped so far, kept on separate cache lines */
+    uint64_t tail __attribute__((aligned(64)));
+    uint64_t head __attribute__((aligned(64)));
+} flowtuple_ring_t;
+
+/* gzip reader used instead of wandio once a checkpoint is needed */
+typedef struct _flowtuple_inflate_t {
+    int fd;
+    /* pipeline ring the compressed chunks come from instead of fd */
+    flowtuple_ring_t *source;
+    z_stream strm;
+    /* inflating a raw deflate stream, as resumed from a checkpoint */
+    int raw;
+    /* gzip trailer bytes still to be dropped after a raw stream */
+    size_t trailer;
+    /* a member just ended, and input not starting another one
+     * is padding that ends the stream */
+    int between;
+    int ended;
+
+    uint8_t *in;
+    /* chunk being inflated, in or a slot of source */
+    const uint8_t *chunk;
+    /* file offset of chunk[0] */
+    uint64_t in_offset;
+    /* decompressed bytes so far */
+    uint64_t out_offset;
+
+    /* checkpoints are added to this index while building it */
+    flowtuple_index_t *index;
+    uint64_t last_checkpoint;
+} flowtuple_inflate_t;
+
+/* gzip file decompressed a whole member at a time, instead of io */
+typedef struct _flowtuple_gunzip_t {
+    uint8_t *map;
+    size_t size;
+    /* offset in map of the next member */
+    size_t in_pos;
+    /* libdeflate decompressor */
+    void *dec;
+
+    /* last member decompressed, and the position in it */
+    uint8_t *out;
+    size_t out_size;
+    size_t out_len;
+    size_t out_pos;
+    /* offset of out[0] in the decompressed stream */
+    uint64_t out_offset;
+    /* out holds what zlib made of a bad member, the last one read */
+    int failed;
+} flowtuple_gunzip_t;
+
+/* background reading and inflating of a handle's file */
+typedef struct _flowtuple_pipeline_t {
+    /* gzip file read by the read stage and inflated by the inflate stage */
+    int fd;
+    flowtuple_inflate_t *inflate;
+    /* other files, read and decompressed by the read stage alone, with
+     * libdeflate for gzip files it can take, wandio for the rest */
+    flowtuple_gunzip_t *gunzip;
+    io_t *io;
+    char *path;
+
+    /* compressed chunks and decompressed blocks between the stages */
+    flowtuple_ring_t chunks;
+    flowtuple_ring_t blocks;
+    pthread_t reader;
+    pthread_t inflater;
+    int threads;
+    int stop;
+
+    /* block being copied into the handle's buffer */
+    flowtuple_ring_slot_t *slot;
+    size_t slot_pos;
+} flowtuple_pipeline_t;
+
+/* Frame files are zstd streams, every frame holding whole intervals of a
+ * flowtuple file, between skippable frames identifying the file and
+ * giving the offsets of the frames, all little endian. */
+#define FLOWTUPLE_FRAMES_MAGIC "FTZS"
+#define FLOWTUPLE_FRAMES_VERSION 1
+#define FLOWTUPLE_FRAMES_SKIPPABLE 0x184d2a5eu
+/* skippable frame header, then the magic and version */
+#define FLOWTUPLE_FRAMES_HEADER_SIZE 16
+/* frame count, reserved and magic, at the very end of the seek table */
+#define FLOWTUPLE_FRAMES_FOOTER_SIZE 12
+#define FLOWTUPLE_FRAMES_ENTRY_SIZE 32
+
+/* entry of the seek table */
+typedef struct _flowtuple_frame_t {
+    /* offset and size in the decompressed stream */
+    uint64_t offset;
+    uint64_t size;
+    /* offset and size in the file */
+    uint64_t file_offset;
+    uint64_t file_size;
+} flowtuple_frame_t;
+
+typedef enum _flowtuple_frame_state_t {
+    FLOWTUPLE_FRAME_EMPTY,
+    FLOWTUPLE_FRAME_BUSY,
+    FLOWTUPLE_FRAME_DONE,
+    FLOWTUPLE_FRAME_FAILED,
+} flowtuple_frame_state_t;
+
+/* frame decompressed ahead, the slot of frame i is i modulo the slot count */
+typedef struct _flowtuple_frame_slot_t {
+    uint8_t *data;
+    size_t capacity;
+    size_t frame;
+    flowtuple_frame_state_t state;
+} flowtuple_frame_slot_t;
+
+/* reader of a frame file, mapped and decompressed a frame at a time */
+typedef struct _flowtuple_frames_t {
+    uint8_t *map;
+    size_t size;
+    flowtuple_frame_t *frames;
+    size_t frame_count;
+
+    /* frame being read, and the position in it */
+    size_t frame;
+    size_t pos;
+    /* frame decompressed by the reader itself, when it has no threads */
+    void *dctx;
+    uint8_t *buf;
+    size_t buf_size;
+    size_t buf_frame;
+
+    /* threads decompressing the frames after the one being read */
+    pthread_t *tids;
+    int threads;
+    flowtuple_frame_slot_t *slots;
+    size_t slot_count;
+    /* next frame for a thread to take */
+    size_t next;
+    int stop;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} flowtuple_frames_t;
+
+typedef struct _flowtuple_index_interval_t {
+    /* interval start record, and the end of the interval end record */
+    uint64_t offset;
+    uint64_t end;
+    flowtuple_interval_t interval;
+    /* classes of the interval in the index's classes */
+    size_t first_class;
+    size_t class_count;
+} flowtuple_index_interval_t;
+
+typedef struct _flowtuple_index_class_t {
+    uint64_t offset;
+    flowtuple_class_t ftclass;
+} flowtuple_index_class_t;
+
+struct _flowtuple_index_t {
+    /* size of the indexed file and of its decompressed stream */
+    uint64_t file_size;
+    uint64_t length;
+
+    /* all offsets are in the decompressed stream */
+    flowtuple_index_interval_t *intervals;
+    size_t interval_count;
+    size_t interval_capacity;
+    flowtuple_index_class_t *classes;
+    size_t class_count;
+    size_t class_capacity;
+    /* only for gzip files, ordered by offset */
+    flowtuple_checkpoint_t *checkpoints;
+    size_t checkpoint_count;
+    size_t checkpoint_capacity;
+};
+
+/* input of a merge, decoded ahead into a ring of interval columns */
+typedef struct _flowtuple_merge_input_t {
+    flowtuple_handle_t *handle;
+    flowtuple_ring_t ring;
+    pthread_t tid;
+} flowtuple_merge_input_t;
+
+struct _flowtuple_merge_t {
+    flowtuple_merge_input_t *inputs;
+    size_t count;
+    int started;
+    size_t threads;
+    int stop;
+
+    /* inputs with an interval ready, a min-heap on its time */
+    size_t *heap;
+    size_t heap_size;
+    /* input of the interval returned last, popped on the next call */
+    size_t current;
+    int has_current;
+
+    flowtuple_errno_t errno;
+};
+
+/* partitions groups are spilled to by the top bits of their hash */
+#define FLOWTUPLE_AGG_PARTITION_BITS 4
+#define FLOWTUPLE_AGG_PARTITIONS (1 << FLOWTUPLE_AGG_PARTITION_BITS)
+
+/* group of an aggregation, keyed on the packed values of its fields */
+typedef struct _flowtuple_agg_entry_t {
+    uint64_t key[2];
+    uint64_t packets;
+    uint64_t tuples;
+} flowtuple_agg_entry_t;
+
+struct _flowtuple_agg_t {
+    uint32_t fields;
+    uint32_t widths[FLOWTUPLE_FIELD_COUNT];
+    /* where each field is packed into the key */
+    uint8_t words[FLOWTUPLE_FIELD_COUNT];
+    uint8_t shifts[FLOWTUPLE_FIELD_COUNT];
+    int started;
+
+    /* open addressing in groups of 16 slots, each control byte is
+     * empty or holds 7 bits of the hash of the slot's entry */
+    uint8_t *ctrl;
+    flowtuple_agg_entry_t *entries;
+    size_t capacity;
+    size_t size;
+    size_t budget;
+
+    FILE *spills[FLOWTUPLE_AGG_PARTITIONS];
+    int spilled;
+    char *spill_dir;
+};
+
+/* counter of a top-K sketch, in a min-heap on count */
+typedef struct _flowtuple_topk_counter_t {
+    uint64_t key;
+    uint64_t count;
+    uint64_t error;
+    /* slot of the key in the map */
+    uint32_t slot;
+} flowtuple_topk_counter_t;
+
+/* map slot of a key, pointing at its counter */
+typedef struct _flowtuple_topk_slot_t {
+    uint64_t key;
+    uint32_t pos;
+} flowtuple_topk_slot_t;
+
+struct _flowtuple_topk_t {
+    flowtuple_topk_key_t type;
+    flowtuple_topk_counter_t *heap;
+    size_t size;
+    size_t capacity;
+    /* open addressing with linear probing, twice the capacity at least */
+    flowtuple_topk_slot_t *map;
+    size_t map_mask;
+    int map_shift;
+    uint64_t total;
+};
+
+struct _flowtuple_hll_t {
+    flowtuple_hll_key_t type;
+    int precision;
+    /* one byte per register, the highest rank seen by its index */
+    uint8_t *registers;
+};
+
+/* tuples of a class buffered until the end of the interval */
+typedef struct _flowtuple_writer_class_t {
+    /* as in the class start, network byte order */
+    uint32_t magic;
+    uint16_t class_type;
+    uint32_t count;
+
+    uint8_t *buf;
+    size_t len;
+    size_t capacity;
+} flowtuple_writer_class_t;
+
+struct _flowtuple_writer_t {
+    iow_t *iow;
+    flowtuple_errno_t errno;
+
+    /* network byte order, 0 to keep the one of the header */
+    uint16_t interval_length;
+    int in_interval;
+    uint16_t number;
+    uint64_t tuple_count;
+
+    /* classes in order of their first tuple or class start,
+     * their buffers are kept from one interval to the next */
+    flowtuple_writer_class_t *classes;
+    size_t class_count;
+    size_t class_capacity;
+};
+
+/* tuple of a roll-up, everything but the packet count packed into
+ * the key, with the packet count summed in the class columns */
+typedef struct _flowtuple_rollup_entry_t {
+    uint64_t key[2];
+    uint32_t index;
+    uint8_t tcp_flags;
+} flowtuple_rollup_entry_t;
+
+/* combined tuples of a class, in order of their first appearance */
+typedef struct _flowtuple_rollup_class_t {
+    flowtuple_magic_t magic;
+    /* host byte order */
+    uint16_t class_type;
+
+    /* open addressing in groups of 16 slots, as in aggregations */
+    uint8_t *ctrl;
+    flowtuple_rollup_entry_t *entries;
+    size_t capacity;
+
+    flowtuple_columns_t cols;
+    size_t count;
+    size_t cols_capacity;
+} flowtuple_rollup_class_t;
+
+struct _flowtuple_rollup_t {
+    flowtuple_writer_t *writer;
+    uint32_t length;
+    flowtuple_errno_t errno;
+
+    int has_header;
+    /* host byte order sums of the trailers read */
+    int has_trailer;
+    uint64_t packet_cnt;
+    uint64_t accepted_cnt;
+    uint64_t dropped_cnt;
+    uint32_t first_packet_time;
+    uint32_t last_packet_time;
+    uint32_t local_final_time;
+    uint32_t runtime;
+
+    /* interval being rolled up, host byte order */
+    int in_interval;
+    uint32_t bucket;
+    uint32_t start;
+    uint32_t end;
+    uint64_t interval_count;
+    uint64_t tuple_count;
+
+    /* classes are kept from one interval to the next */
+    flowtuple_rollup_class_t *classes;
+    size_t class_count;
+    size_t class_capacity;
+};
+
+/* Columnar archives are written in host byte order, to be mapped and read
+ * in place on the host that wrote them, apart from the corsaro records they
+ * keep as they were, in network byte order. */
+#define FLOWTUPLE_ARCHIVE_MAGIC "FTCA"
+#define FLOWTUPLE_ARCHIVE_VERSION 1
+#define FLOWTUPLE_ARCHIVE_BYTE_ORDER 0x01020304u
+/* every field, then the packet count */
+#define FLOWTUPLE_ARCHIVE_COLUMNS (FLOWTUPLE_FIELD_COUNT + 1)
+/* alignment of column chunks and of the footer */
+#define FLOWTUPLE_ARCHIVE_ALIGN 64
+
+typedef enum _flowtuple_archive_encoding_t {
+    /* the values themselves */
+    FLOWTUPLE_ARCHIVE_PLAIN,
+    /* sorted dictionary, then a code of width bytes per value */
+    FLOWTUPLE_ARCHIVE_DICT,
+    /* the 255 most frequent values, most frequent first, then a one byte code
+     * per value, 255 standing for the next of the rarer values that follow */
+    FLOWTUPLE_ARCHIVE_FREQ,
+    /* width bits per value above base, in 64 bit words */
+    FLOWTUPLE_ARCHIVE_BITPACK,
+} flowtuple_archive_encoding_t;
+
+typedef struct _flowtuple_archive_file_header_t {
+    char magic[4];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t interval_count;
+    uint64_t class_count;
+    uint64_t footer_offset;
+    /* header and trailer records as read, 0 if missing */
+    uint32_t header_len;
+    uint32_t trailer_len;
+    uint8_t reserved[24];
+} flowtuple_archive_file_header_t;
+
+typedef struct _flowtuple_archive_interval_t {
+    /* as in the interval start and end records, network byte order */
+    uint16_t number;
+    uint16_t end_number;
+    uint32_t start;
+    uint32_t end;
+    uint32_t class_count;
+    uint64_t first_class;
+} flowtuple_archive_interval_t;
+
+typedef struct _flowtuple_archive_column_t {
+    uint64_t offset;
+    uint64_t size;
+    uint32_t encoding;
+    /* bytes per code, or bits per value */
+    uint32_t width;
+    /* values in the dictionary */
+    uint32_t dict_count;
+    uint32_t base;
+} flowtuple_archive_column_t;
+
+typedef struct _flowtuple_archive_class_t {
+    /* as in the class start, network byte order */
+    uint32_t magic;
+    uint16_t class_type;
+    uint16_t reserved;
+    uint32_t count;
+    uint32_t reserved2;
+    /* per field statistics, host byte order */
+    uint32_t min[FLOWTUPLE_FIELD_COUNT];
+    uint32_t max[FLOWTUPLE_FIELD_COUNT];
+    flowtuple_archive_column_t columns[FLOWTUPLE_ARCHIVE_COLUMNS];
+} flowtuple_archive_class_t;
+
+/* state of an archive being written */
+typedef struct _flowtuple_archive_builder_t {
+    FILE *file;
+    uint64_t offset;
+
+    uint8_t *header_record;
+    uint32_t header_len;
+    uint8_t *trailer_record;
+    uint32_t trailer_len;
+
+    flowtuple_archive_interval_t *intervals;
+    size_t interval_count;
+    size_t interval_capacity;
+    flowtuple_archive_class_t *classes;
+    size_t class_count;
+    size_t class_capacity;
+
+    /* tuples of the class being read */
+    flowtuple_columns_t cols;
+    size_t count;
+    size_t capacity;
+
+    /* encoded columns, and a count and a code for every 16 bit value */
+    uint8_t *scratch;
+    size_t scratch_size;
+    uint32_t *counts;
+    uint8_t *codes;
+} flowtuple_archive_builder_t;
+
+/* span of the corsaro stream an archive is read back as */
+typedef enum _flowtuple_archive_piece_type_t {
+    FLOWTUPLE_ARCHIVE_PIECE_HEADER,
+    FLOWTUPLE_ARCHIVE_PIECE_INTERVAL_START,
+    FLOWTUPLE_ARCHIVE_PIECE_CLASS_START,
+    FLOWTUPLE_ARCHIVE_PIECE_TUPLES,
+    FLOWTUPLE_ARCHIVE_PIECE_CLASS_END,
+    FLOWTUPLE_ARCHIVE_PIECE_INTERVAL_END,
+    FLOWTUPLE_ARCHIVE_PIECE_TRAILER,
+} flowtuple_archive_piece_type_t;
+
+typedef struct _flowtuple_archive_piece_t {
+    uint64_t offset;
+    uint64_t len;
+    flowtuple_archive_piece_type_t type;
+    uint32_t interval;
+    uint64_t ftclass;
+} flowtuple_archive_piece_t;
+
+struct _flowtuple_archive_t {
+    uint8_t *map;
+    size_t size;
+    const flowtuple_archive_file_header_t *header;
+    const uint8_t *header_record;
+    const uint8_t *trailer_record;
+    const flowtuple_archive_interval_t *intervals;
+    const flowtuple_archive_class_t *classes;
+
+    /* records handed out by the getters, the start and the end of each interval */
+    flowtuple_interval_t *interval_records;
+    flowtuple_class_t *class_records;
+
+    /* columns of the last class decoded, pointing into the map where stored
+     * plain, and into scratch otherwise */
+    uint8_t *scratch;
+    size_t scratch_size;
+    flowtuple_columns_t cols;
+    uint64_t decoded;
+    int has_decoded;
+
+    /* the corsaro stream, and the position it is read from */
+    flowtuple_archive_piece_t *pieces;
+    size_t piece_count;
+    size_t piece;
+    uint64_t pos;
+    uint64_t stream_size;
+};
+
+/* Decoder states, magics are only checked outside of class bodies. */
+typedef enum _flowtuple_state_t {
+    FLOWTUPLE_STATE_RECORD,    /* header, interval, trailer or class start */
+    FLOWTUPLE_STATE_TUPLES,    /* tuples of the current class */
+    FLOWTUPLE_STATE_CLASS_END, /* end of the current class */
+} flowtuple_state_t;
+
 struct _flowtuple_handle_t {
     char *uri;
     io_t *io;
+
+    /* header arena, reused by every header read */
+    uint8_t *arena;
+    size_t arena_size;
+
+    /* bytes the records are parsed from, either the block
+     * filled from io or the whole file when it is mapped */
+    uint8_t *buf;
+    size_t buf_size;
+    size_t buf_len;
+    size_t buf_pos;
+    uint8_t *block;
+    size_t block_size;
+    uint8_t *map;
+    /* gzip reader when resumed from a checkpoint, instead of io */
+    flowtuple_inflate_t *inflate;
+    /* columnar archive the records are read from, instead of io */
+    flowtuple_archive_t *archive;
+    /* decoded columns of the archived class being read, from its
+     * first tuple, looked up again once the next class starts */
+    flowtuple_columns_t archive_cols;
+    int has_archive_cols;
+    /* zstd frame file, instead of io */
+    flowtuple_frames_t *frames;
+    /* gzip file decompressed by libdeflate, instead of io, and
+     * whether gzip files are to be read that way */
+    flowtuple_gunzip_t *gunzip;
+    int use_gunzip;
+    /* offset of buf[0] in the decompressed stream */
+    uint64_t buf_offset;
+    /* index of the file, not owned */
+    flowtuple_index_t *index;
+    /* read and decode on threads of their own, and the
+     * threads reading and inflating the file if it is compressed */
+    int pipelined;
+    flowtuple_pipeline_t *pipeline;
+
     flowtuple_record_t last_record;
     flowtuple_errno_t errno;
+
+    /* decoder state */
+    flowtuple_state_t state;
+    int lazy;
+    /* compiled copy of the filter, NULL to accept every tuple */
+    flowtuple_filter_t *filter;
+    /* bits of the class types to read, and whether
+     * the current class is being skipped */
+    uint32_t class_mask;
+    int skip_class;
+    int in_interval;
+    /* tuples read from the current class */
+    uint32_t number;
+
+    /* current class start and interval */
+    flowtuple_class_t ftclass;
+    flowtuple_interval_t interval;
+    /* structural record handed out by flowtuple_read_batch */
+    flowtuple_record_t batch_record;
 };
 
 #endif
@@ -0,0 +1,286 @@
+/*
+ *  gunzip.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <limits.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <endian.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_LIBDEFLATE
+#include <zlib.h>
+#include <libdeflate.h>
+#endif
+
+#include "flowtuple.h"
+#include "fttypes.h"
+#include "util.h"
+#include "gunzip.h"
+
+#ifdef HAVE_LIBDEFLATE
+
+/* smallest buffer a member is decompressed into */
+#define MIN_MEMBER (1 << 20)
+/* most deflate can expand its input */
+#define MAX_RATIO 1032
+
+int _flowtuple_gunzip_is_available(void) {
+    return 1;
+}
+
+flowtuple_gunzip_t *_flowtuple_gunzip_open(const char *filename) {
+    flowtuple_gunzip_t *gz;
+    struct stat st;
+    void *map = MAP_FAILED;
+    uint32_t isize;
+    size_t size;
+    int fd;
+
+    if ((fd = open(filename, O_RDONLY)) < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 18) {
+        map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+    size = (size_t)st.st_size;
+
+    if (((uint8_t*)map)[0] != 0x1f || ((uint8_t*)map)[1] != 0x8b) {
+        munmap(map, size);
+        return NULL;
+    }
+
+    CALLOC(gz, 1, sizeof(flowtuple_gunzip_t), munmap(map, size); return NULL);
+    gz->map = map;
+    gz->size = size;
+    if ((gz->dec = libdeflate_alloc_decompressor()) == NULL) {
+        _flowtuple_gunzip_close(gz);
+        return NULL;
+    }
+    madvise(map, size, MADV_SEQUENTIAL);
+
+    /* the trailer of the last member gives its size, modulo 2^32, and
+     * most files have only the one member, so the buffer is sized for it
+     * unless that is more than its input could ever inflate to */
+    memcpy(&isize, gz->map + size - 4, 4);
+    gz->out_size = le32toh(isize);
+    if (gz->out_size / MAX_RATIO > size) {
+        gz->out_size = size * MAX_RATIO;
+    }
+    if (gz->out_size < MIN_MEMBER) {
+        gz->out_size = MIN_MEMBER;
+    }
+    if (gz->out_size > FLOWTUPLE_GUNZIP_MAX_MEMBER) {
+        _flowtuple_gunzip_close(gz);
+        return NULL;
+    }
+    return gz;
+}
+
+void _flowtuple_gunzip_close(flowtuple_gunzip_t *gz) {
+    if (gz == NULL) {
+        return;
+    }
+
+    if (gz->dec != NULL) {
+        libdeflate_free_decompressor(gz->dec);
+    }
+    munmap(gz->map, gz->size);
+    FREE(gz->out);
+    FREE(gz);
+}
+
+/* whether the members are all read, bytes after the last one that do
+ * not start another member being padding, as zlib takes them */
+static int _flowtuple_gunzip_at_end(flowtuple_gunzip_t *gz) {
+    return gz->size - gz->in_pos < 2 || gz->map[gz->in_pos] != 0x1f || gz->map[gz->in_pos + 1] != 0x8b;
+}
+
+/* inflates a member libdeflate gave up on with zlib instead, keeping what
+ * comes before the point it is corrupt or cut short, as wandio reads it,
+ * returns -1 if nothing can be had of it */
+static int _flowtuple_gunzip_salvage(flowtuple_gunzip_t *gz) {
+    z_stream strm;
+    uint8_t *out;
+    size_t avail = gz->size - gz->in_pos;
+    int ret;
+
+    memset(&strm, 0, sizeof(z_stream));
+    if (inflateInit2(&strm, 31) != Z_OK) {
+        return -1;
+    }
+    strm.next_in = gz->map + gz->in_pos;
+    strm.avail_in = avail < UINT_MAX ? (uInt)avail : UINT_MAX;
+
+    for (;;) {
+        strm.next_out = gz->out + strm.total_out;
+        strm.avail_out = (uInt)(gz->out_size - strm.total_out < UINT_MAX ? gz->out_size - strm.total_out : UINT_MAX);
+        ret = inflate(&strm, Z_NO_FLUSH);
+        if (ret != Z_OK || strm.avail_out > 0 || gz->out_size >= FLOWTUPLE_GUNZIP_MAX_MEMBER) {
+            break;
+        }
+        if ((out = realloc(gz->out, gz->out_size * 2)) == NULL) {
+            break;
+        }
+        gz->out = out;
+        gz->out_size *= 2;
+    }
+
+    gz->out_len = strm.total_out;
+    gz->in_pos = gz->size;
+    gz->failed = 1;
+    inflateEnd(&strm);
+    return gz->out_len > 0 ? 0 : -1;
+}
+
+/* decompresses the next member into out, growing it until the member
+ * fits, returns -1 if the member is corrupt or too big */
+static int _flowtuple_gunzip_member(flowtuple_gunzip_t *gz) {
+    enum libdeflate_result res;
+    size_t in_len;
+    size_t out_len;
+
+    gz->out_offset += gz->out_len;
+    gz->out_len = 0;
+    gz->out_pos = 0;
+
+    for (;;) {
+        /* allocated on first use, so an index build that
+         * inflates the file itself never pays for it */
+        if (gz->out == NULL) {
+            MALLOC(gz->out, gz->out_size, return -1);
+        }
+
+        res = libdeflate_gzip_decompress_ex(gz->dec, gz->map + gz->in_pos, gz->size - gz->in_pos, gz->out,
+                                            gz->out_size, &in_len, &out_len);
+        if (res == LIBDEFLATE_SUCCESS) {
+            break;
+        } else if (res != LIBDEFLATE_INSUFFICIENT_SPACE || gz->out_size >= FLOWTUPLE_GUNZIP_MAX_MEMBER) {
+            return _flowtuple_gunzip_salvage(gz);
+        }
+
+        /* what was decompressed is of no use, so it is not copied */
+        FREE(gz->out);
+        gz->out_size *= 2;
+        if (gz->out_size > FLOWTUPLE_GUNZIP_MAX_MEMBER) {
+            gz->out_size = FLOWTUPLE_GUNZIP_MAX_MEMBER;
+        }
+    }
+
+    gz->in_pos += in_len;
+    gz->out_len = out_len;
+    return 0;
+}
+
+int64_t _flowtuple_gunzip_read(flowtuple_gunzip_t *gz, uint8_t *buf, size_t len) {
+    size_t done = 0;
+    size_t n;
+
+    while (done < len) {
+        if (gz->out_pos == gz->out_len) {
+            /* what was read before a bad member is returned
+             * first, and the error on the next call */
+            if (gz->failed) {
+                return done > 0 ? (int64_t)done : -1;
+            }
+            if (_flowtuple_gunzip_at_end(gz)) {
+                break;
+            }
+            if (_flowtuple_gunzip_member(gz) < 0) {
+                return done > 0 ? (int64_t)done : -1;
+            }
+            continue;
+        }
+
+        n = gz->out_len - gz->out_pos;
+        if (n > len - done) {
+            n = len - done;
+        }
+        memcpy(buf + done, gz->out + gz->out_pos, n);
+        gz->out_pos += n;
+        done += n;
+    }
+
+    return (int64_t)done;
+}
+
+int _flowtuple_gunzip_holds(flowtuple_gunzip_t *gz, uint64_t offset) {
+    return gz->out_len > 0 && offset >= gz->out_offset && offset - gz->out_offset <= gz->out_len;
+}
+
+int _flowtuple_gunzip_seek(flowtuple_gunzip_t *gz, uint64_t offset) {
+    /* members before the last one decompressed are gone */
+    if (offset < gz->out_offset) {
+        gz->failed = 0;
+        gz->in_pos = 0;
+        gz->out_offset = 0;
+        gz->out_len = 0;
+    }
+
+    while (offset > gz->out_offset + gz->out_len) {
+        if (gz->failed || _flowtuple_gunzip_at_end(gz) || _flowtuple_gunzip_member(gz) < 0) {
+            return -1;
+        }
+    }
+
+    gz->out_pos = (size_t)(offset - gz->out_offset);
+    return 0;
+}
+
+#else
+
+int _flowtuple_gunzip_is_available(void) {
+    return 0;
+}
+
+flowtuple_gunzip_t *_flowtuple_gunzip_open(const char *filename) {
+    /* left to wandio */
+    (void)filename;
+    return NULL;
+}
+
+void _flowtuple_gunzip_close(flowtuple_gunzip_t *gz) {
+    (void)gz;
+}
+
+int64_t _flowtuple_gunzip_read(flowtuple_gunzip_t *gz, uint8_t *buf, size_t len) {
+    (void)gz;
+    (void)buf;
+    (void)len;
+    return -1;
+}
+
+int _flowtuple_gunzip_holds(flowtuple_gunzip_t *gz, uint64_t offset) {
+    (void)gz;
+    (void)offset;
+    return 0;
+}
+
+int _flowtuple_gunzip_seek(flowtuple_gunzip_t *gz, uint64_t offset) {
+    (void)gz;
+    (void)offset;
+    return -1;
+}
+
+#endif
@@ -0,0 +1,45 @@
+/*
+ *  gunzip.h
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef GUNZIP_H
+#define GUNZIP_H
+
+#include <stddef.h>
+#include <inttypes.h>
+
+#include "flowtuple.h"
+#include "fttypes.h"
+
+/* largest member decompressed at once, bigger ones are left to wandio */
+#define FLOWTUPLE_GUNZIP_MAX_MEMBER ((size_t)1 << 30)
+
+/* whether this build decompresses gzip files with libdeflate */
+int _flowtuple_gunzip_is_available(void);
+/* maps a gzip file, NULL if it is to be left to wandio */
+flowtuple_gunzip_t *_flowtuple_gunzip_open(const char *filename);
+void _flowtuple_gunzip_close(flowtuple_gunzip_t *gz);
+/* reads the next bytes of the decompressed stream, returns the number
+ * of bytes read, 0 at its end and -1 on a corrupt or oversized member */
+int64_t _flowtuple_gunzip_read(flowtuple_gunzip_t *gz, uint8_t *buf, size_t len);
+/* whether offset is in the member decompressed last */
+int _flowtuple_gunzip_holds(flowtuple_gunzip_t *gz, uint64_t offset);
+/* moves to offset in the decompressed stream, -1 if past its end */
+int _flowtuple_gunzip_seek(flowtuple_gunzip_t *gz, uint64_t offset);
+
+#endif
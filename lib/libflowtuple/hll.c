@@ -0,0 +1,285 @@
+/*
+ *  hll.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <math.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "flowtuple.h"
+#include "fttypes.h"
+#include "util.h"
+
+/* keys hashed in one go */
+#define CHUNK_SIZE 256
+/* serialized header, magic, version, precision and key */
+#define HLL_MAGIC "FHLL"
+#define HLL_VERSION 1
+#define HLL_HEADER_SIZE 7
+
+static inline uint64_t _flowtuple_hll_hash(uint64_t x) {
+    /* splitmix64 finalizer */
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+static inline uint64_t _flowtuple_hll_key(flowtuple_hll_key_t type, uint32_t src_ip, uint32_t dst_ip, uint16_t dst_port) {
+    switch (type) {
+        case FLOWTUPLE_HLL_SRC_IP:
+            return src_ip;
+        case FLOWTUPLE_HLL_DST_IP:
+            return dst_ip;
+        default:
+            return (uint64_t)src_ip << 16 | dst_port;
+    }
+}
+
+/* the top bits of the hash pick the register, the rank
+ * of the rest is the number of leading zeros plus one */
+static inline void _flowtuple_hll_update(flowtuple_hll_t *hll, uint64_t hash) {
+    int p = hll->precision;
+    uint64_t w = hash << p;
+    uint8_t rank = w == 0 ? (uint8_t)(64 - p + 1) : (uint8_t)(__builtin_clzll(w) + 1);
+    uint8_t *reg = &(hll->registers[hash >> (64 - p)]);
+
+    if (rank > *reg) {
+        *reg = rank;
+    }
+}
+
+flowtuple_hll_t *flowtuple_hll_create(flowtuple_hll_key_t key, int precision) {
+    flowtuple_hll_t *hll;
+
+    CHECK(key <= FLOWTUPLE_HLL_SRC_IP_DST_PORT && precision >= FLOWTUPLE_HLL_MIN_PRECISION &&
+          precision <= FLOWTUPLE_HLL_MAX_PRECISION, return NULL);
+
+    CALLOC(hll, 1, sizeof(flowtuple_hll_t), return NULL);
+    hll->type = key;
+    hll->precision = precision;
+    CALLOC(hll->registers, (size_t)1 << precision, sizeof(uint8_t), FREE(hll); return NULL);
+    return hll;
+}
+
+void flowtuple_hll_free(flowtuple_hll_t *hll) {
+    CHECK(hll != NULL, return);
+    FREE(hll->registers);
+    FREE(hll);
+}
+
+void flowtuple_hll_reset(flowtuple_hll_t *hll) {
+    CHECK(hll != NULL, return);
+    memset(hll->registers, 0, (size_t)1 << hll->precision);
+}
+
+void flowtuple_hll_add_data(flowtuple_hll_t *hll, flowtuple_data_t *data) {
+    uint32_t dst_ip;
+
+    CHECK(hll != NULL && data != NULL, return);
+
+    /* data getters are in network byte order, but for /8 destinations,
+     * which are their three low octets in host byte order as in columns */
+    dst_ip = flowtuple_data_get_dest_ip(data);
+    if (!flowtuple_data_is_slash_eight(data)) {
+        dst_ip = ntohl(dst_ip);
+    }
+    _flowtuple_hll_update(hll, _flowtuple_hll_hash(_flowtuple_hll_key(hll->type, ntohl(flowtuple_data_get_src_ip(data)),
+                                                                       dst_ip, ntohs(flowtuple_data_get_dest_port(data)))));
+}
+
+void flowtuple_hll_add_columns(flowtuple_hll_t *hll, const flowtuple_columns_t *cols, size_t n) {
+    uint64_t hashes[CHUNK_SIZE];
+    size_t m;
+
+    CHECK(hll != NULL && cols != NULL, return);
+
+    /* keys are built and hashed in branch free loops over one column
+     * or two, which vectorize, before the scattered register updates */
+    for (size_t base = 0; base < n; base += m) {
+        m = n - base < CHUNK_SIZE ? n - base : CHUNK_SIZE;
+        switch (hll->type) {
+            case FLOWTUPLE_HLL_SRC_IP:
+                for (size_t i = 0; i < m; i++) {
+                    hashes[i] = cols->src_ip[base + i];
+                }
+                break;
+            case FLOWTUPLE_HLL_DST_IP:
+                for (size_t i = 0; i < m; i++) {
+                    hashes[i] = cols->dst_ip[base + i];
+                }
+                break;
+            default:
+                for (size_t i = 0; i < m; i++) {
+                    hashes[i] = (uint64_t)cols->src_ip[base + i] << 16 | cols->dst_port[base + i];
+                }
+        }
+        for (size_t i = 0; i < m; i++) {
+            hashes[i] = _flowtuple_hll_hash(hashes[i]);
+        }
+        for (size_t i = 0; i < m; i++) {
+            _flowtuple_hll_update(hll, hashes[i]);
+        }
+    }
+}
+
+void flowtuple_hll_add_interval(flowtuple_hll_t *hll, flowtuple_interval_columns_t *ic, int class_type) {
+    flowtuple_columns_t cols;
+    size_t n;
+
+    CHECK(hll != NULL && ic != NULL, return);
+
+    if (class_type < 0) {
+        flowtuple_hll_add_columns(hll, flowtuple_interval_columns_get_columns(ic), flowtuple_interval_columns_get_count(ic));
+        return;
+    }
+
+    for (size_t i = 0; i < flowtuple_interval_columns_get_class_count(ic); i++) {
+        if ((int)flowtuple_class_get_class_type(flowtuple_interval_columns_get_class(ic, i)) == class_type) {
+            n = flowtuple_interval_columns_get_class_columns(ic, i, &cols);
+            flowtuple_hll_add_columns(hll, &cols, n);
+        }
+    }
+}
+
+int flowtuple_hll_merge(flowtuple_hll_t *dst, flowtuple_hll_t *src) {
+    size_t m;
+    size_t i = 0;
+
+    CHECK(dst != NULL && src != NULL && dst->type == src->type && dst->precision == src->precision, return -1);
+    m = (size_t)1 << dst->precision;
+
+#ifdef __SSE2__
+    for (; i + 16 <= m; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(dst->registers + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(src->registers + i));
+        _mm_storeu_si128((__m128i*)(dst->registers + i), _mm_max_epu8(a, b));
+    }
+#endif
+    for (; i < m; i++) {
+        if (src->registers[i] > dst->registers[i]) {
+            dst->registers[i] = src->registers[i];
+        }
+    }
+    return 0;
+}
+
+/* sigma and tau of Ertl, New cardinality estimation algorithms for HyperLogLog sketches */
+static double _flowtuple_hll_sigma(double x) {
+    double y = 1.0;
+    double z = x;
+    double last;
+
+    if (x == 1.0) {
+        return INFINITY;
+    }
+    do {
+        x *= x;
+        last = z;
+        z += x * y;
+        y += y;
+    } while (z != last);
+    return z;
+}
+
+static double _flowtuple_hll_tau(double x) {
+    double y = 1.0;
+    double z;
+    double last;
+
+    if (x == 0.0 || x == 1.0) {
+        return 0.0;
+    }
+    z = 1.0 - x;
+    do {
+        x = sqrt(x);
+        last = z;
+        y *= 0.5;
+        z -= (1.0 - x) * (1.0 - x) * y;
+    } while (z != last);
+    return z / 3.0;
+}
+
+double flowtuple_hll_estimate(flowtuple_hll_t *hll) {
+    uint32_t counts[66] = {0};
+    double m;
+    double z;
+    int q;
+
+    CHECK(hll != NULL, return 0.0);
+    m = (double)((size_t)1 << hll->precision);
+    q = 64 - hll->precision;
+
+    for (size_t i = 0; i < ((size_t)1 << hll->precision); i++) {
+        counts[hll->registers[i]]++;
+    }
+
+    z = m * _flowtuple_hll_tau(1.0 - counts[q + 1] / m);
+    for (int k = q; k >= 1; k--) {
+        z = 0.5 * (z + counts[k]);
+    }
+    z += m * _flowtuple_hll_sigma(counts[0] / m);
+
+    return m * m / (2.0 * log(2.0) * z);
+}
+
+size_t flowtuple_hll_serialize(flowtuple_hll_t *hll, uint8_t *buf, size_t len) {
+    size_t size;
+
+    CHECK(hll != NULL, return 0);
+    size = HLL_HEADER_SIZE + ((size_t)1 << hll->precision);
+
+    if (buf != NULL && len >= size) {
+        memcpy(buf, HLL_MAGIC, 4);
+        buf[4] = HLL_VERSION;
+        buf[5] = (uint8_t)hll->precision;
+        buf[6] = (uint8_t)hll->type;
+        memcpy(buf + HLL_HEADER_SIZE, hll->registers, (size_t)1 << hll->precision);
+    }
+    return size;
+}
+
+flowtuple_hll_t *flowtuple_hll_deserialize(const uint8_t *buf, size_t len) {
+    flowtuple_hll_t *hll;
+
+    CHECK(buf != NULL && len >= HLL_HEADER_SIZE && memcmp(buf, HLL_MAGIC, 4) == 0 && buf[4] == HLL_VERSION, return NULL);
+
+    if ((hll = flowtuple_hll_create((flowtuple_hll_key_t)buf[6], buf[5])) == NULL) {
+        return NULL;
+    }
+    if (len < HLL_HEADER_SIZE + ((size_t)1 << hll->precision)) {
+        flowtuple_hll_free(hll);
+        return NULL;
+    }
+    memcpy(hll->registers, buf + HLL_HEADER_SIZE, (size_t)1 << hll->precision);
+
+    /* a rank past the end of the hash would overflow the estimator */
+    for (size_t i = 0; i < ((size_t)1 << hll->precision); i++) {
+        if (hll->registers[i] > 64 - hll->precision + 1) {
+            flowtuple_hll_free(hll);
+            return NULL;
+        }
+    }
+    return hll;
+}
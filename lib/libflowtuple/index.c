@@ -0,0 +1,415 @@
+/*
+ *  index.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+#include "flowtuple.h"
+#include "fttypes.h"
+#include "util.h"
+#include "record.h"
+#include "reader.h"
+#include "inflate.h"
+#include "index.h"
+
+/* sidecar files start with this magic and version, both in host byte
+ * order, so a sidecar written on a host of another byte order is refused */
+#define INDEX_MAGIC 0x58495446
+#define INDEX_VERSION 1
+
+/* makes room for one more element of size bytes in an array */
+static int _flowtuple_index_grow(void **array, size_t *capacity, size_t count, size_t size) {
+    void *tmp;
+    size_t n;
+
+    if (count < *capacity) {
+        return 0;
+    }
+
+    n = *capacity > 0 ? *capacity * 2 : 16;
+    if ((tmp = realloc(*array, n * size)) == NULL) {
+        return -1;
+    }
+    *array = tmp;
+    *capacity = n;
+    return 0;
+}
+
+flowtuple_checkpoint_t *_flowtuple_index_add_checkpoint(flowtuple_index_t *index) {
+    if (_flowtuple_index_grow((void**)&(index->checkpoints), &(index->checkpoint_capacity),
+                              index->checkpoint_count, sizeof(flowtuple_checkpoint_t)) < 0) {
+        return NULL;
+    }
+    return &(index->checkpoints[index->checkpoint_count++]);
+}
+
+int _flowtuple_index_add_interval(flowtuple_index_t *index, uint64_t offset, flowtuple_interval_t *interval) {
+    flowtuple_index_interval_t *ii;
+
+    if (_flowtuple_index_grow((void**)&(index->intervals), &(index->interval_capacity),
+                              index->interval_count, sizeof(flowtuple_index_interval_t)) < 0) {
+        return -1;
+    }
+
+    ii = &(index->intervals[index->interval_count++]);
+    ii->offset = offset;
+    ii->end = offset;
+    ii->interval = *interval;
+    ii->first_class = index->class_count;
+    ii->class_count = 0;
+    return 0;
+}
+
+int _flowtuple_index_add_class(flowtuple_index_t *index, uint64_t offset, flowtuple_class_t *ftclass) {
+    flowtuple_index_class_t *ic;
+
+    if (_flowtuple_index_grow((void**)&(index->classes), &(index->class_capacity),
+                              index->class_count, sizeof(flowtuple_index_class_t)) < 0) {
+        return -1;
+    }
+
+    ic = &(index->classes[index->class_count++]);
+    ic->offset = offset;
+    ic->ftclass = *ftclass;
+    index->intervals[index->interval_count - 1].class_count++;
+    return 0;
+}
+
+const flowtuple_checkpoint_t *_flowtuple_index_find_checkpoint(flowtuple_index_t *index, uint64_t offset) {
+    size_t lo = 0;
+    size_t hi = index->checkpoint_count;
+    size_t mid;
+
+    /* last checkpoint at or before offset */
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (index->checkpoints[mid].out <= offset) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo > 0 ? &(index->checkpoints[lo - 1]) : NULL;
+}
+
+size_t _flowtuple_index_find_interval(flowtuple_index_t *index, uint32_t time) {
+    size_t lo = 0;
+    size_t hi = index->interval_count;
+    size_t mid;
+
+    /* last interval starting at or before time, or the first one */
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (ntohl(index->intervals[mid].interval.time) <= time) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo > 0 ? lo - 1 : 0;
+}
+
+flowtuple_index_t *flowtuple_index_build(const char *filename, flowtuple_errno_t *err) {
+    flowtuple_errno_t local_err = FLOWTUPLE_ERR_OK;
+    flowtuple_handle_t *handle = NULL;
+    flowtuple_index_t *index = NULL;
+    flowtuple_record_t record;
+    struct stat st;
+    uint64_t offset;
+    int res;
+
+    if ((handle = flowtuple_initialize(filename, &local_err)) == NULL) {
+        goto fail;
+    }
+
+    CALLOC(index, 1, sizeof(flowtuple_index_t), goto nomem);
+    if (stat(filename, &st) == 0) {
+        index->file_size = (uint64_t)st.st_size;
+    }
+
+    /* gzip files are inflated here, leaving checkpoints on the way */
+    if (handle->map == NULL && _flowtuple_inflate_is_gzip(filename)) {
+        if ((local_err = _flowtuple_reader_resume(handle, NULL)) != FLOWTUPLE_ERR_OK) {
+            goto fail;
+        }
+        handle->inflate->index = index;
+    }
+
+    memset(&record, 0, sizeof(flowtuple_record_t));
+    for (;;) {
+        offset = handle->buf_offset + handle->buf_pos;
+        if ((res = _flowtuple_read_record(handle, &record)) <= 0) {
+            break;
+        }
+
+        if (record.type == FLOWTUPLE_RECORD_TYPE_INTERVAL) {
+            if (handle->in_interval) {
+                res = _flowtuple_index_add_interval(index, offset, &(record.record.interval));
+            } else if (index->interval_count > 0) {
+                index->intervals[index->interval_count - 1].end = handle->buf_offset + handle->buf_pos;
+            }
+        } else if (record.type == FLOWTUPLE_RECORD_TYPE_FLOWTUPLE_CLASS && record.record.ftclass.is_start) {
+            /* only the class start is needed, its tuples are jumped over */
+            res = _flowtuple_index_add_class(index, offset, &(record.record.ftclass));
+            if (res == 0 && handle->state == FLOWTUPLE_STATE_TUPLES) {
+                res = _flowtuple_record_skip_class(handle);
+            }
+        }
+
+        if (res < 0) {
+            if (handle->errno == FLOWTUPLE_ERR_OK) {
+                goto nomem;
+            }
+            break;
+        }
+    }
+
+    if (res < 0) {
+        local_err = handle->errno;
+        goto fail;
+    }
+    index->length = offset;
+
+    flowtuple_release(handle);
+    *err = FLOWTUPLE_ERR_OK;
+    return index;
+
+    nomem:
+    local_err = FLOWTUPLE_ERR_MEM;
+
+    fail:
+    *err = local_err;
+    flowtuple_release(handle);
+    flowtuple_index_free(index);
+    return NULL;
+}
+
+void flowtuple_index_free(flowtuple_index_t *index) {
+    if (index == NULL) {
+        return;
+    }
+
+    FREE(index->intervals);
+    FREE(index->classes);
+    FREE(index->checkpoints);
+    FREE(index);
+}
+
+/* writes or reads one field, keeping the first error */
+#define INDEX_WRITE(fp, p, size, ok) do { if ((ok) && fwrite((p), (size), 1, (fp)) != 1) { (ok) = 0; } } while(0)
+#define INDEX_READ(fp, p, size, ok) do { if ((ok) && fread((p), (size), 1, (fp)) != 1) { (ok) = 0; } } while(0)
+
+int flowtuple_index_save(flowtuple_index_t *index, const char *filename) {
+    CHECK(index != NULL && filename != NULL, return -1);
+    flowtuple_index_interval_t *ii;
+    flowtuple_index_class_t *ic;
+    flowtuple_checkpoint_t *point;
+    uint32_t magic = INDEX_MAGIC;
+    uint32_t version = INDEX_VERSION;
+    uint64_t count;
+    int32_t bits;
+    int ok = 1;
+    FILE *fp;
+
+    if ((fp = fopen(filename, "wb")) == NULL) {
+        return -1;
+    }
+
+    INDEX_WRITE(fp, &magic, 4, ok);
+    INDEX_WRITE(fp, &version, 4, ok);
+    INDEX_WRITE(fp, &(index->file_size), 8, ok);
+    INDEX_WRITE(fp, &(index->length), 8, ok);
+    count = index->interval_count;
+    INDEX_WRITE(fp, &count, 8, ok);
+    count = index->class_count;
+    INDEX_WRITE(fp, &count, 8, ok);
+    count = index->checkpoint_count;
+    INDEX_WRITE(fp, &count, 8, ok);
+
+    /* intervals and classes keep the byte order of their records */
+    for (size_t i = 0; i < index->interval_count; i++) {
+        ii = &(index->intervals[i]);
+        INDEX_WRITE(fp, &(ii->offset), 8, ok);
+        INDEX_WRITE(fp, &(ii->end), 8, ok);
+        INDEX_WRITE(fp, &(ii->interval.number), 2, ok);
+        INDEX_WRITE(fp, &(ii->interval.time), 4, ok);
+        count = ii->first_class;
+        INDEX_WRITE(fp, &count, 8, ok);
+        count = ii->class_count;
+        INDEX_WRITE(fp, &count, 8, ok);
+    }
+
+    for (size_t i = 0; i < index->class_count; i++) {
+        ic = &(index->classes[i]);
+        INDEX_WRITE(fp, &(ic->offset), 8, ok);
+        INDEX_WRITE(fp, &(ic->ftclass.magic), 4, ok);
+        INDEX_WRITE(fp, &(ic->ftclass.class_type), 2, ok);
+        INDEX_WRITE(fp, &(ic->ftclass.key_count), 4, ok);
+    }
+
+    for (size_t i = 0; i < index->checkpoint_count; i++) {
+        point = &(index->checkpoints[i]);
+        bits = point->bits;
+        INDEX_WRITE(fp, &(point->out), 8, ok);
+        INDEX_WRITE(fp, &(point->in), 8, ok);
+        INDEX_WRITE(fp, &bits, 4, ok);
+        INDEX_WRITE(fp, point->window, FLOWTUPLE_WINDOW_SIZE, ok);
+    }
+
+    if (fclose(fp) != 0) {
+        ok = 0;
+    }
+    return ok ? 0 : -1;
+}
+
+flowtuple_index_t *flowtuple_index_load(const char *filename, flowtuple_errno_t *err) {
+    flowtuple_index_t *index = NULL;
+    flowtuple_index_interval_t *ii;
+    flowtuple_index_class_t *ic;
+    flowtuple_checkpoint_t *point;
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    uint64_t counts[3];
+    uint64_t first;
+    uint64_t count;
+    int32_t bits;
+    int ok = 1;
+    FILE *fp;
+
+    if (filename == NULL || (fp = fopen(filename, "rb")) == NULL) {
+        *err = FLOWTUPLE_ERR_FILE_OPEN;
+        return NULL;
+    }
+
+    *err = FLOWTUPLE_ERR_MEM;
+    CALLOC(index, 1, sizeof(flowtuple_index_t), goto fail);
+
+    INDEX_READ(fp, &magic, 4, ok);
+    INDEX_READ(fp, &version, 4, ok);
+    if (!ok || magic != INDEX_MAGIC || version != INDEX_VERSION) {
+        *err = FLOWTUPLE_ERR_WRONG_MAGIC;
+        goto fail;
+    }
+
+    INDEX_READ(fp, &(index->file_size), 8, ok);
+    INDEX_READ(fp, &(index->length), 8, ok);
+    INDEX_READ(fp, counts, sizeof(counts), ok);
+    if (!ok) {
+        *err = FLOWTUPLE_ERR_FILE_EOF;
+        goto fail;
+    }
+
+    if ((counts[0] > 0 && (index->intervals = calloc(counts[0], sizeof(flowtuple_index_interval_t))) == NULL) ||
+        (counts[1] > 0 && (index->classes = calloc(counts[1], sizeof(flowtuple_index_class_t))) == NULL) ||
+        (counts[2] > 0 && (index->checkpoints = calloc(counts[2], sizeof(flowtuple_checkpoint_t))) == NULL)) {
+        goto fail;
+    }
+    index->interval_capacity = index->interval_count = counts[0];
+    index->class_capacity = index->class_count = counts[1];
+    index->checkpoint_capacity = index->checkpoint_count = counts[2];
+
+    for (size_t i = 0; i < index->interval_count && ok; i++) {
+        ii = &(index->intervals[i]);
+        INDEX_READ(fp, &(ii->offset), 8, ok);
+        INDEX_READ(fp, &(ii->end), 8, ok);
+        INDEX_READ(fp, &(ii->interval.number), 2, ok);
+        INDEX_READ(fp, &(ii->interval.time), 4, ok);
+        INDEX_READ(fp, &first, 8, ok);
+        INDEX_READ(fp, &count, 8, ok);
+        if (first > index->class_count || count > index->class_count - first) {
+            ok = 0;
+        }
+        ii->first_class = first;
+        ii->class_count = count;
+    }
+
+    for (size_t i = 0; i < index->class_count && ok; i++) {
+        ic = &(index->classes[i]);
+        INDEX_READ(fp, &(ic->offset), 8, ok);
+        INDEX_READ(fp, &(ic->ftclass.magic), 4, ok);
+        INDEX_READ(fp, &(ic->ftclass.class_type), 2, ok);
+        INDEX_READ(fp, &(ic->ftclass.key_count), 4, ok);
+        ic->ftclass.key_count_host = ntohl(ic->ftclass.key_count);
+        ic->ftclass.is_start = 1;
+    }
+
+    for (size_t i = 0; i < index->checkpoint_count && ok; i++) {
+        point = &(index->checkpoints[i]);
+        INDEX_READ(fp, &(point->out), 8, ok);
+        INDEX_READ(fp, &(point->in), 8, ok);
+        INDEX_READ(fp, &bits, 4, ok);
+        INDEX_READ(fp, point->window, FLOWTUPLE_WINDOW_SIZE, ok);
+        if (bits < 0 || bits > 7 || (i > 0 && point->out <= index->checkpoints[i - 1].out)) {
+            ok = 0;
+        }
+        point->bits = bits;
+    }
+
+    if (!ok) {
+        *err = FLOWTUPLE_ERR_CORRUPT;
+        goto fail;
+    }
+
+    fclose(fp);
+    *err = FLOWTUPLE_ERR_OK;
+    return index;
+
+    fail:
+    fclose(fp);
+    flowtuple_index_free(index);
+    return NULL;
+}
+
+size_t flowtuple_index_get_interval_count(flowtuple_index_t *index) {
+    CHECK(index != NULL, return 0);
+    return index->interval_count;
+}
+
+flowtuple_interval_t *flowtuple_index_get_interval(flowtuple_index_t *index, size_t i) {
+    CHECK(index != NULL && i < index->interval_count, return NULL);
+    return &(index->intervals[i].interval);
+}
+
+uint64_t flowtuple_index_get_interval_offset(flowtuple_index_t *index, size_t i) {
+    CHECK(index != NULL && i < index->interval_count, return 0);
+    return index->intervals[i].offset;
+}
+
+size_t flowtuple_index_get_class_count(flowtuple_index_t *index, size_t i) {
+    CHECK(index != NULL && i < index->interval_count, return 0);
+    return index->intervals[i].class_count;
+}
+
+flowtuple_class_t *flowtuple_index_get_class(flowtuple_index_t *index, size_t i, size_t j) {
+    CHECK(index != NULL && i < index->interval_count && j < index->intervals[i].class_count, return NULL);
+    return &(index->classes[index->intervals[i].first_class + j].ftclass);
+}
+
+uint64_t flowtuple_index_get_class_offset(flowtuple_index_t *index, size_t i, size_t j) {
+    CHECK(index != NULL && i < index->interval_count && j < index->intervals[i].class_count, return 0);
+    return index->classes[index->intervals[i].first_class + j].offset;
+}
+
+size_t flowtuple_index_get_checkpoint_count(flowtuple_index_t *index) {
+    CHECK(index != NULL, return 0);
+    return index->checkpoint_count;
+}
@@ -0,0 +1,36 @@
+/*
+ *  index.h
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <stddef.h>
+#include <inttypes.h>
+
+#include "flowtuple.h"
+#include "fttypes.h"
+
+int _flowtuple_index_add_interval(flowtuple_index_t *index, uint64_t offset, flowtuple_interval_t *interval);
+int _flowtuple_index_add_class(flowtuple_index_t *index, uint64_t offset, flowtuple_class_t *ftclass);
+flowtuple_checkpoint_t *_flowtuple_index_add_checkpoint(flowtuple_index_t *index);
+const flowtuple_checkpoint_t *_flowtuple_index_find_checkpoint(flowtuple_index_t *index, uint64_t offset);
+size_t _flowtuple_index_find_interval(flowtuple_index_t *index, uint32_t time);
+flowtuple_index_t *_flowtuple_index_scan(const uint8_t *map, uint64_t size, int nthreads, flowtuple_errno_t *err);
+
+#endif
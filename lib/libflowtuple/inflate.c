@@ -0,0 +1,269 @@
+/*
+ *  inflate.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <zlib.h>
+
+#include "fttypes.h"
+#include "util.h"
+#include "inflate.h"
+#include "index.h"
+#include "pipeline.h"
+
+/* size of the gzip member trailer, crc and length */
+#define GZIP_TRAILER_SIZE 8
+
+int _flowtuple_inflate_is_gzip(const char *filename) {
+    uint8_t magic[2];
+    int ret = 0;
+    int fd;
+
+    if ((fd = open(filename, O_RDONLY)) < 0) {
+        return 0;
+    }
+    if (pread(fd, magic, 2, 0) == 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+        ret = 1;
+    }
+    close(fd);
+    return ret;
+}
+
+/* reads the next chunk of compressed input, returns its size, 0 on EOF and -1 on error */
+static ssize_t _flowtuple_inflate_fill(flowtuple_inflate_t *inf) {
+    flowtuple_ring_slot_t *slot;
+    ssize_t got;
+
+    if (inf->chunk != NULL) {
+        inf->in_offset += (uint64_t)(inf->strm.next_in - inf->chunk);
+    }
+
+    if (inf->source != NULL) {
+        /* hand the inflated chunk back to the read stage, the
+         * end of the stream is left in the ring for later calls */
+        if (inf->chunk != NULL) {
+            _flowtuple_ring_pop(inf->source);
+            inf->chunk = NULL;
+        }
+        if ((slot = _flowtuple_ring_peek(inf->source)) == NULL || slot->len < 0) {
+            return -1;
+        } else if (slot->len == 0) {
+            return 0;
+        }
+        inf->chunk = slot->data;
+        got = (ssize_t)slot->len;
+    } else {
+        if ((got = read(inf->fd, inf->in, FLOWTUPLE_INFLATE_CHUNK)) < 0) {
+            return -1;
+        }
+        inf->chunk = inf->in;
+    }
+
+    inf->strm.next_in = (uint8_t*)inf->chunk;
+    inf->strm.avail_in = (uInt)got;
+    return got;
+}
+
+flowtuple_inflate_t *_flowtuple_inflate_stream(flowtuple_ring_t *source, flowtuple_errno_t *err) {
+    flowtuple_inflate_t *inf;
+
+    *err = FLOWTUPLE_ERR_MEM;
+    CALLOC(inf, 1, sizeof(flowtuple_inflate_t), return NULL);
+    inf->fd = -1;
+    inf->source = source;
+    if (inflateInit2(&(inf->strm), 31) != Z_OK) {
+        FREE(inf);
+        return NULL;
+    }
+
+    *err = FLOWTUPLE_ERR_OK;
+    return inf;
+}
+
+flowtuple_inflate_t *_flowtuple_inflate_open(const char *filename, const flowtuple_checkpoint_t *point, flowtuple_errno_t *err) {
+    flowtuple_inflate_t *inf;
+    uint8_t byte;
+    int ret;
+
+    *err = FLOWTUPLE_ERR_MEM;
+    CALLOC(inf, 1, sizeof(flowtuple_inflate_t), return NULL);
+    inf->fd = -1;
+    MALLOC(inf->in, FLOWTUPLE_INFLATE_CHUNK, goto fail);
+
+    /* a gzip stream from the start, or the raw deflate
+     * stream it wraps when resuming at a checkpoint */
+    inf->raw = point != NULL;
+    if (inflateInit2(&(inf->strm), inf->raw ? -15 : 31) != Z_OK) {
+        FREE(inf->in);
+        FREE(inf);
+        return NULL;
+    }
+
+    *err = FLOWTUPLE_ERR_FILE_OPEN;
+    if ((inf->fd = open(filename, O_RDONLY)) < 0) {
+        goto fail;
+    }
+
+    if (point == NULL) {
+        *err = FLOWTUPLE_ERR_OK;
+        return inf;
+    }
+
+    /* a checkpoint may start in the middle of a byte */
+    *err = FLOWTUPLE_ERR_FILE_READ;
+    inf->in_offset = point->in - (point->bits ? 1 : 0);
+    if (lseek(inf->fd, (off_t)inf->in_offset, SEEK_SET) < 0) {
+        goto fail;
+    }
+    if (point->bits) {
+        if (read(inf->fd, &byte, 1) != 1) {
+            goto fail;
+        }
+        inf->in_offset++;
+        ret = inflatePrime(&(inf->strm), point->bits, byte >> (8 - point->bits));
+        if (ret != Z_OK) {
+            goto fail;
+        }
+    }
+
+    if (inflateSetDictionary(&(inf->strm), point->window, FLOWTUPLE_WINDOW_SIZE) != Z_OK) {
+        goto fail;
+    }
+    inf->out_offset = point->out;
+
+    *err = FLOWTUPLE_ERR_OK;
+    return inf;
+
+    fail:
+    _flowtuple_inflate_close(inf);
+    return NULL;
+}
+
+/* adds a checkpoint to the index being built if the inflater sits at a
+ * block boundary far enough past the last one, returns -1 if out of memory */
+static int _flowtuple_inflate_checkpoint(flowtuple_inflate_t *inf, uint64_t out) {
+    flowtuple_checkpoint_t *point;
+    uInt have = FLOWTUPLE_WINDOW_SIZE;
+
+    /* bit 7 is set at the end of a block, bit 6 for the last one */
+    if ((inf->strm.data_type & 192) != 128 || out < inf->last_checkpoint + FLOWTUPLE_CHECKPOINT_SPAN) {
+        return 0;
+    }
+
+    if ((point = _flowtuple_index_add_checkpoint(inf->index)) == NULL) {
+        return -1;
+    }
+
+    /* the first window of a member can be short, try again later */
+    if (inflateGetDictionary(&(inf->strm), point->window, &have) != Z_OK || have < FLOWTUPLE_WINDOW_SIZE) {
+        inf->index->checkpoint_count--;
+        return 0;
+    }
+
+    point->out = out;
+    point->in = inf->in_offset + (uint64_t)(inf->strm.next_in - inf->chunk);
+    point->bits = inf->strm.data_type & 7;
+    inf->last_checkpoint = out;
+    return 0;
+}
+
+int64_t _flowtuple_inflate_read(flowtuple_inflate_t *inf, uint8_t *buf, size_t len) {
+    int flush = inf->index != NULL ? Z_BLOCK : Z_NO_FLUSH;
+    ssize_t got;
+    size_t n;
+    int ret;
+
+    inf->strm.next_out = buf;
+    inf->strm.avail_out = (uInt)len;
+
+    while (inf->strm.avail_out > 0 && !inf->ended) {
+        if (inf->strm.avail_in == 0) {
+            if ((got = _flowtuple_inflate_fill(inf)) < 0) {
+                return -1;
+            } else if (got == 0) {
+                /* a truncated stream is left to the decoder */
+                break;
+            }
+        }
+
+        /* after a raw stream its member trailer still has to go,
+         * before the next member is read as gzip again */
+        if (inf->trailer > 0) {
+            n = inf->trailer < inf->strm.avail_in ? inf->trailer : inf->strm.avail_in;
+            inf->strm.next_in += n;
+            inf->strm.avail_in -= (uInt)n;
+            inf->trailer -= n;
+            if (inf->trailer == 0) {
+                if (inflateReset2(&(inf->strm), 31) != Z_OK) {
+                    return -1;
+                }
+                inf->raw = 0;
+                inf->between = 1;
+            }
+            continue;
+        }
+
+        if (inf->between) {
+            if (inf->strm.next_in[0] != 0x1f ||
+                (inf->strm.avail_in > 1 && inf->strm.next_in[1] != 0x8b)) {
+                inf->ended = 1;
+                break;
+            }
+            inf->between = 0;
+        }
+
+        ret = inflate(&(inf->strm), flush);
+        if (ret == Z_STREAM_END) {
+            if (inf->raw) {
+                inf->trailer = GZIP_TRAILER_SIZE;
+            } else if (inflateReset(&(inf->strm)) != Z_OK) {
+                return -1;
+            } else {
+                inf->between = 1;
+            }
+            continue;
+        } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            return -1;
+        }
+
+        if (inf->index != NULL &&
+            _flowtuple_inflate_checkpoint(inf, inf->out_offset + (len - inf->strm.avail_out)) < 0) {
+            return -1;
+        }
+    }
+
+    n = len - inf->strm.avail_out;
+    inf->out_offset += n;
+    return (int64_t)n;
+}
+
+void _flowtuple_inflate_close(flowtuple_inflate_t *inf) {
+    if (inf == NULL) {
+        return;
+    }
+
+    if (inf->fd >= 0) {
+        close(inf->fd);
+    }
+    inflateEnd(&(inf->strm));
+    FREE(inf->in);
+    FREE(inf);
+}
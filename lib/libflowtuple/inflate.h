@@ -0,0 +1,40 @@
+/*
+ *  inflate.h
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef INFLATE_H
+#define INFLATE_H
+
+#include <stddef.h>
+#include <inttypes.h>
+
+#include "flowtuple.h"
+#include "fttypes.h"
+
+/* size of the compressed chunks read from the file */
+#define FLOWTUPLE_INFLATE_CHUNK (1 << 18)
+/* decompressed bytes between two checkpoints of an index */
+#define FLOWTUPLE_CHECKPOINT_SPAN (1 << 22)
+
+int _flowtuple_inflate_is_gzip(const char *filename);
+flowtuple_inflate_t *_flowtuple_inflate_open(const char *filename, const flowtuple_checkpoint_t *point, flowtuple_errno_t *err);
+flowtuple_inflate_t *_flowtuple_inflate_stream(flowtuple_ring_t *source, flowtuple_errno_t *err);
+int64_t _flowtuple_inflate_read(flowtuple_inflate_t *inf, uint8_t *buf, size_t len);
+void _flowtuple_inflate_close(flowtuple_inflate_t *inf);
+
+#endif
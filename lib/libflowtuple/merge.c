@@ -0,0 +1,243 @@
+/*
+ *  merge.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+#include "flowtuple.h"
+#include "fttypes.h"
+#include "util.h"
+#include "pipeline.h"
+
+/* decodes the intervals of an input into its ring, ending it with a slot of len 0 or -1 */
+static void *_flowtuple_merge_read(void *arg) {
+    flowtuple_merge_input_t *input = (flowtuple_merge_input_t*)arg;
+    flowtuple_ring_slot_t *slot;
+    int res;
+
+    do {
+        if ((slot = _flowtuple_ring_claim(&(input->ring))) == NULL) {
+            break;
+        }
+        res = flowtuple_read_interval_columns(input->handle, (flowtuple_interval_columns_t*)slot->data);
+        slot->len = res;
+        _flowtuple_ring_push(&(input->ring));
+    } while (res > 0);
+
+    return NULL;
+}
+
+/* earlier intervals first, ties go to the first input */
+static int _flowtuple_merge_less(flowtuple_merge_t *merge, size_t a, size_t b) {
+    flowtuple_interval_columns_t *ica = (flowtuple_interval_columns_t*)_flowtuple_ring_peek(&(merge->inputs[a].ring))->data;
+    flowtuple_interval_columns_t *icb = (flowtuple_interval_columns_t*)_flowtuple_ring_peek(&(merge->inputs[b].ring))->data;
+    uint32_t ta = ntohl(ica->interval.time);
+    uint32_t tb = ntohl(icb->interval.time);
+
+    return ta < tb || (ta == tb && a < b);
+}
+
+static void _flowtuple_merge_sift_down(flowtuple_merge_t *merge, size_t i) {
+    size_t *heap = merge->heap;
+    size_t child;
+    size_t tmp;
+
+    while ((child = 2 * i + 1) < merge->heap_size) {
+        if (child + 1 < merge->heap_size && _flowtuple_merge_less(merge, heap[child + 1], heap[child])) {
+            child++;
+        }
+        if (!_flowtuple_merge_less(merge, heap[child], heap[i])) {
+            break;
+        }
+        tmp = heap[i];
+        heap[i] = heap[child];
+        heap[child] = tmp;
+        i = child;
+    }
+}
+
+static void _flowtuple_merge_sift_up(flowtuple_merge_t *merge, size_t i) {
+    size_t *heap = merge->heap;
+    size_t parent;
+    size_t tmp;
+
+    while (i > 0 && _flowtuple_merge_less(merge, heap[i], heap[parent = (i - 1) / 2])) {
+        tmp = heap[i];
+        heap[i] = heap[parent];
+        heap[parent] = tmp;
+        i = parent;
+    }
+}
+
+/* waits for the next interval of an input and adds it to the heap, returns -1 on error */
+static int _flowtuple_merge_push(flowtuple_merge_t *merge, size_t source) {
+    flowtuple_ring_slot_t *slot = _flowtuple_ring_peek(&(merge->inputs[source].ring));
+
+    if (slot->len < 0) {
+        merge->errno = flowtuple_errno(merge->inputs[source].handle);
+        return -1;
+    } else if (slot->len > 0) {
+        merge->heap[merge->heap_size++] = source;
+        _flowtuple_merge_sift_up(merge, merge->heap_size - 1);
+    }
+    return 0;
+}
+
+flowtuple_merge_t *flowtuple_merge_create(const char **paths, size_t n, flowtuple_errno_t *err) {
+    flowtuple_merge_t *merge;
+
+    *err = FLOWTUPLE_ERR_MEM;
+    CALLOC(merge, 1, sizeof(flowtuple_merge_t), return NULL);
+    CALLOC(merge->inputs, n > 0 ? n : 1, sizeof(flowtuple_merge_input_t), goto fail);
+    CALLOC(merge->heap, n > 0 ? n : 1, sizeof(size_t), goto fail);
+    merge->count = n;
+
+    for (size_t i = 0; i < n; i++) {
+        /* the slots hold the interval columns themselves */
+        if (_flowtuple_ring_init(&(merge->inputs[i].ring), FLOWTUPLE_MERGE_DEPTH,
+                                 sizeof(flowtuple_interval_columns_t), &(merge->stop)) < 0) {
+            *err = FLOWTUPLE_ERR_MEM;
+            goto fail;
+        }
+        if ((merge->inputs[i].handle = flowtuple_initialize(paths[i], err)) == NULL) {
+            goto fail;
+        }
+    }
+
+    *err = FLOWTUPLE_ERR_OK;
+    return merge;
+
+    fail:
+    flowtuple_merge_free(merge);
+    return NULL;
+}
+
+/* starts the readers and waits for the first interval of every input */
+static int _flowtuple_merge_start(flowtuple_merge_t *merge) {
+    size_t i;
+
+    merge->started = 1;
+    for (i = 0; i < merge->count; i++) {
+        if (pthread_create(&(merge->inputs[i].tid), NULL, _flowtuple_merge_read, &(merge->inputs[i])) != 0) {
+            break;
+        }
+    }
+    /* threads started so far are joined on free */
+    merge->threads = i;
+    if (i < merge->count) {
+        merge->errno = FLOWTUPLE_ERR_MEM;
+        return -1;
+    }
+
+    for (i = 0; i < merge->count; i++) {
+        if (_flowtuple_merge_push(merge, i) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int flowtuple_merge_next(flowtuple_merge_t *merge, flowtuple_interval_columns_t **ic, size_t *source) {
+    CHECK(merge != NULL && ic != NULL && source != NULL, return -1);
+
+    if (merge->errno != FLOWTUPLE_ERR_OK) {
+        return -1;
+    }
+
+    if (!merge->started) {
+        if (_flowtuple_merge_start(merge) < 0) {
+            return -1;
+        }
+    } else if (merge->has_current) {
+        /* the last interval returned is done with, its input moves on */
+        _flowtuple_ring_pop(&(merge->inputs[merge->current].ring));
+        merge->has_current = 0;
+        merge->heap[0] = merge->heap[--merge->heap_size];
+        _flowtuple_merge_sift_down(merge, 0);
+        if (_flowtuple_merge_push(merge, merge->current) < 0) {
+            return -1;
+        }
+    }
+
+    if (merge->heap_size == 0) {
+        return 0;
+    }
+
+    merge->current = merge->heap[0];
+    merge->has_current = 1;
+    *source = merge->current;
+    *ic = (flowtuple_interval_columns_t*)_flowtuple_ring_peek(&(merge->inputs[merge->current].ring))->data;
+    return 1;
+}
+
+void flowtuple_merge_free(flowtuple_merge_t *merge) {
+    flowtuple_interval_columns_t *ic;
+    flowtuple_merge_input_t *input;
+
+    if (merge == NULL) {
+        return;
+    }
+
+    /* readers blocked on a full ring give up */
+    for (size_t i = 0; merge->inputs != NULL && i < merge->count; i++) {
+        _flowtuple_ring_stop(&(merge->inputs[i].ring));
+    }
+    for (size_t i = 0; i < merge->threads; i++) {
+        pthread_join(merge->inputs[i].tid, NULL);
+    }
+
+    for (size_t i = 0; merge->inputs != NULL && i < merge->count; i++) {
+        input = &(merge->inputs[i]);
+        for (size_t j = 0; input->ring.slots != NULL && j < input->ring.count; j++) {
+            ic = (flowtuple_interval_columns_t*)input->ring.slots[j].data;
+            if (ic != NULL) {
+                FREE(ic->block);
+                FREE(ic->classes);
+                FREE(ic->offsets);
+            }
+        }
+        _flowtuple_ring_free(&(input->ring));
+        flowtuple_release(input->handle);
+    }
+
+    FREE(merge->inputs);
+    FREE(merge->heap);
+    FREE(merge);
+}
+
+size_t flowtuple_merge_get_count(flowtuple_merge_t *merge) {
+    CHECK(merge != NULL, return 0);
+    return merge->count;
+}
+
+flowtuple_handle_t *flowtuple_merge_get_handle(flowtuple_merge_t *merge, size_t source) {
+    CHECK(merge != NULL && source < merge->count, return NULL);
+    return merge->inputs[source].handle;
+}
+
+const char *flowtuple_merge_get_uri(flowtuple_merge_t *merge, size_t source) {
+    CHECK(merge != NULL && source < merge->count, return NULL);
+    return flowtuple_handle_get_uri(merge->inputs[source].handle);
+}
+
+flowtuple_errno_t flowtuple_merge_errno(flowtuple_merge_t *merge) {
+    CHECK(merge != NULL, return FLOWTUPLE_ERR_OK);
+    return merge->errno;
+}
@@ -0,0 +1,705 @@
+/*
+ *  parallel.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "flowtuple.h"
+#include "fttypes.h"
+#include "util.h"
+#include "record.h"
+#include "index.h"
+#include "reader.h"
+#include "archive.h"
+#include "frames.h"
+
+/* largest range of intervals handed to a worker at once, which also
+ * bounds what a worker keeps of its range while waiting for its turn */
+#define RANGE_SIZE ((uint64_t)1 << 26)
+/* ranges per worker, so the ones done first take more */
+#define RANGES_PER_THREAD 4
+
+/* state shared by the workers of one parallel read */
+typedef struct _flowtuple_parallel_t {
+    flowtuple_handle_t *handle;
+    flowtuple_index_t *index;
+    flowtuple_interval_handler callback;
+    void *args;
+    int ordered;
+    int threads;
+
+    /* range r holds the intervals from ranges[r] up to ranges[r + 1] */
+    size_t *ranges;
+    size_t range_count;
+
+    pthread_mutex_t lock;
+    pthread_cond_t turn;
+    /* next range to hand out, and to call back with when ordered */
+    size_t next;
+    size_t delivered;
+    flowtuple_errno_t err;
+} flowtuple_parallel_t;
+
+typedef struct _flowtuple_worker_t {
+    flowtuple_parallel_t *par;
+    int thread;
+    pthread_t tid;
+    /* intervals of the range being read, kept until its turn when ordered */
+    flowtuple_interval_columns_t **ics;
+    size_t ic_count;
+} flowtuple_worker_t;
+
+/* splits the intervals of index into contiguous ranges of about target bytes,
+ * each starting where a worker can seek to without decompressing much of what
+ * another one reads: at any interval of a file read from anywhere, and at the
+ * first interval after an inflate checkpoint of a gzip file, returns NULL if
+ * out of memory */
+static size_t *_flowtuple_parallel_ranges(flowtuple_index_t *index, int seekable, uint64_t target, size_t *count) {
+    const flowtuple_checkpoint_t *point;
+    size_t *ranges;
+    size_t n = 0;
+    int split;
+
+    MALLOC(ranges, (index->interval_count + 1) * sizeof(size_t), return NULL);
+    ranges[n++] = 0;
+    for (size_t i = 1; i < index->interval_count; i++) {
+        if (seekable) {
+            split = 1;
+        } else {
+            point = _flowtuple_index_find_checkpoint(index, index->intervals[i].offset);
+            split = point != NULL && point->out > index->intervals[i - 1].offset;
+        }
+        if (split && index->intervals[i].offset - index->intervals[ranges[n - 1]].offset >= target) {
+            ranges[n++] = i;
+        }
+    }
+    ranges[n] = index->interval_count;
+    *count = index->interval_count > 0 ? n : 0;
+    return ranges;
+}
+
+/* opens a handle reading the same file the same way as the parallel read's handle */
+static flowtuple_handle_t *_flowtuple_parallel_open(flowtuple_parallel_t *par, flowtuple_errno_t *err) {
+    flowtuple_handle_t *handle;
+
+    if ((handle = flowtuple_initialize(par->handle->uri, err)) == NULL) {
+        return NULL;
+    }
+
+    /* libdeflate would have every worker decompress a whole member to reach
+     * its range, where zlib resumes at the checkpoint the range starts after */
+    if (par->threads > 1 && par->index->checkpoint_count > 0 && handle->gunzip != NULL &&
+        flowtuple_handle_set_gunzip(handle, 0) < 0) {
+        *err = handle->errno;
+        flowtuple_release(handle);
+        return NULL;
+    }
+
+    if (flowtuple_handle_set_filter(handle, par->handle->filter) < 0) {
+        *err = FLOWTUPLE_ERR_MEM;
+        flowtuple_release(handle);
+        return NULL;
+    }
+    handle->class_mask = par->handle->class_mask;
+    handle->index = par->index;
+    return handle;
+}
+
+static void _flowtuple_parallel_fail(flowtuple_parallel_t *par, flowtuple_errno_t err) {
+    pthread_mutex_lock(&(par->lock));
+    if (par->err == FLOWTUPLE_ERR_OK) {
+        par->err = err;
+    }
+    pthread_cond_broadcast(&(par->turn));
+    pthread_mutex_unlock(&(par->lock));
+}
+
+/* interval columns to read the next interval of a range into, returns NULL if out of memory */
+static flowtuple_interval_columns_t *_flowtuple_parallel_slot(flowtuple_worker_t *worker, size_t kept) {
+    flowtuple_interval_columns_t **ics;
+
+    if (kept == worker->ic_count) {
+        if ((ics = realloc(worker->ics, (kept + 1) * sizeof(flowtuple_interval_columns_t*))) == NULL) {
+            return NULL;
+        }
+        worker->ics = ics;
+        if ((ics[kept] = flowtuple_interval_columns_create()) == NULL) {
+            return NULL;
+        }
+        worker->ic_count++;
+    }
+    return worker->ics[kept];
+}
+
+/* calls back with the intervals kept of a range whose turn it is */
+static void _flowtuple_parallel_deliver(flowtuple_worker_t *worker, size_t kept) {
+    for (size_t k = 0; k < kept; k++) {
+        worker->par->callback(worker->ics[k], worker->thread, worker->par->args);
+    }
+}
+
+static void *_flowtuple_parallel_work(void *arg) {
+    flowtuple_worker_t *worker = (flowtuple_worker_t*)arg;
+    flowtuple_parallel_t *par = worker->par;
+    flowtuple_interval_columns_t *ic;
+    flowtuple_handle_t *handle;
+    flowtuple_errno_t err;
+    size_t kept;
+    size_t r;
+    int turn;
+
+    if ((handle = _flowtuple_parallel_open(par, &err)) == NULL) {
+        _flowtuple_parallel_fail(par, err);
+        return NULL;
+    }
+
+    for (;;) {
+        pthread_mutex_lock(&(par->lock));
+        r = par->err == FLOWTUPLE_ERR_OK ? par->next++ : par->range_count;
+        pthread_mutex_unlock(&(par->lock));
+        if (r >= par->range_count) {
+            break;
+        }
+
+        /* a range is read front to back after one seek, gzip
+         * resuming at the checkpoint it starts after */
+        if (_flowtuple_seek(handle, par->index->intervals[par->ranges[r]].offset) < 0) {
+            _flowtuple_parallel_fail(par, handle->errno);
+            break;
+        }
+
+        kept = 0;
+        for (size_t i = par->ranges[r]; i < par->ranges[r + 1]; i++) {
+            if ((ic = _flowtuple_parallel_slot(worker, par->ordered ? kept : 0)) == NULL) {
+                _flowtuple_parallel_fail(par, FLOWTUPLE_ERR_MEM);
+                goto done;
+            }
+            if (flowtuple_read_interval_columns(handle, ic) != 1) {
+                _flowtuple_parallel_fail(par, handle->errno != FLOWTUPLE_ERR_OK ? handle->errno : FLOWTUPLE_ERR_CORRUPT);
+                goto done;
+            }
+
+            if (!par->ordered) {
+                par->callback(ic, worker->thread, par->args);
+                continue;
+            }
+
+            /* the range called back next hands its intervals over as they
+             * are read, the others keep them until the ranges before are done */
+            kept++;
+            pthread_mutex_lock(&(par->lock));
+            turn = par->delivered == r && par->err == FLOWTUPLE_ERR_OK;
+            pthread_mutex_unlock(&(par->lock));
+            if (turn) {
+                _flowtuple_parallel_deliver(worker, kept);
+                kept = 0;
+            }
+        }
+
+        if (!par->ordered) {
+            continue;
+        }
+        pthread_mutex_lock(&(par->lock));
+        while (par->delivered != r && par->err == FLOWTUPLE_ERR_OK) {
+            pthread_cond_wait(&(par->turn), &(par->lock));
+        }
+        turn = par->err == FLOWTUPLE_ERR_OK;
+        pthread_mutex_unlock(&(par->lock));
+        if (!turn) {
+            break;
+        }
+
+        _flowtuple_parallel_deliver(worker, kept);
+        pthread_mutex_lock(&(par->lock));
+        par->delivered++;
+        pthread_cond_broadcast(&(par->turn));
+        pthread_mutex_unlock(&(par->lock));
+    }
+
+    done:
+    for (size_t k = 0; k < worker->ic_count; k++) {
+        flowtuple_interval_columns_free(worker->ics[k]);
+    }
+    FREE(worker->ics);
+    flowtuple_release(handle);
+    return NULL;
+}
+
+long flowtuple_parallel_intervals(flowtuple_handle_t *handle, int nthreads, int ordered,
+                                  flowtuple_interval_handler callback, void *args) {
+    CHECK(handle != NULL && callback != NULL, return -1);
+    flowtuple_parallel_t par;
+    flowtuple_worker_t *workers = NULL;
+    flowtuple_index_t *built = NULL;
+    flowtuple_errno_t err;
+    uint64_t target;
+    long count;
+    int started = 0;
+
+    if (nthreads <= 0) {
+        nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (nthreads < 1) {
+        nthreads = 1;
+    }
+
+    /* a mapped file is split at interval boundaries found by scanning it
+     * on every thread, anything else is indexed by reading it through */
+    if (handle->index == NULL) {
+        if (handle->map != NULL) {
+            built = _flowtuple_index_scan(handle->map, handle->buf_size, nthreads, &err);
+        } else {
+            built = flowtuple_index_build(handle->uri, &err);
+        }
+        if (built == NULL) {
+            handle->errno = err;
+            return -1;
+        }
+    }
+
+    par.handle = handle;
+    par.index = built != NULL ? built : handle->index;
+    par.callback = callback;
+    par.args = args;
+    par.ordered = ordered;
+    par.next = 0;
+    par.delivered = 0;
+    par.err = FLOWTUPLE_ERR_OK;
+
+    /* without checkpoints a compressed file is a single range, read from its start */
+    target = par.index->length / ((uint64_t)nthreads * RANGES_PER_THREAD);
+    if (target > RANGE_SIZE) {
+        target = RANGE_SIZE;
+    }
+    par.ranges = _flowtuple_parallel_ranges(par.index, _flowtuple_reader_is_seekable(handle), target, &(par.range_count));
+    if (par.ranges == NULL) {
+        goto nomem;
+    }
+    if ((size_t)nthreads > par.range_count && par.range_count > 0) {
+        nthreads = (int)par.range_count;
+    }
+
+    par.threads = nthreads;
+
+    CALLOC(workers, (size_t)nthreads, sizeof(flowtuple_worker_t), goto nomem);
+    pthread_mutex_init(&(par.lock), NULL);
+    pthread_cond_init(&(par.turn), NULL);
+
+    for (started = 0; started < nthreads; started++) {
+        workers[started].par = &par;
+        workers[started].thread = started;
+        if (pthread_create(&(workers[started].tid), NULL, _flowtuple_parallel_work, &(workers[started])) != 0) {
+            /* the threads already running do all the work */
+            if (started == 0) {
+                par.err = FLOWTUPLE_ERR_MEM;
+            }
+            break;
+        }
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i].tid, NULL);
+    }
+
+    pthread_cond_destroy(&(par.turn));
+    pthread_mutex_destroy(&(par.lock));
+    FREE(workers);
+    FREE(par.ranges);
+    count = (long)par.index->interval_count;
+    flowtuple_index_free(built);
+
+    if (par.err != FLOWTUPLE_ERR_OK) {
+        handle->errno = par.err;
+        return -1;
+    }
+    return count;
+
+    nomem:
+    FREE(par.ranges);
+    flowtuple_index_free(built);
+    handle->errno = FLOWTUPLE_ERR_MEM;
+    return -1;
+}
+
+/* file of a parallel loop, with the index its ranges are read through */
+typedef struct _flowtuple_loop_file_t {
+    const char *path;
+    flowtuple_index_t *index;
+    /* ranges of the file still queued or being read */
+    size_t pending;
+} flowtuple_loop_file_t;
+
+/* a whole file, or a range of its decompressed stream
+ * from one interval start to another */
+typedef struct _flowtuple_task_t {
+    size_t file;
+    int whole;
+    uint64_t start;
+    uint64_t end;
+} flowtuple_task_t;
+
+/* tasks of one worker, taken from the tail by their
+ * worker and stolen from the head by the others */
+typedef struct _flowtuple_deque_t {
+    pthread_mutex_t lock;
+    flowtuple_task_t *tasks;
+    size_t head;
+    size_t tail;
+    size_t capacity;
+} flowtuple_deque_t;
+
+typedef struct _flowtuple_loop_t {
+    flowtuple_loop_file_t *files;
+    flowtuple_deque_t *deques;
+    int nthreads;
+    flowtuple_handler callback;
+    void *args;
+
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    /* tasks queued, and queued or being read */
+    size_t queued;
+    size_t outstanding;
+    flowtuple_errno_t err;
+} flowtuple_loop_t;
+
+typedef struct _flowtuple_loop_worker_t {
+    flowtuple_loop_t *loop;
+    int thread;
+    pthread_t tid;
+    void *state;
+    long count;
+} flowtuple_loop_worker_t;
+
+static int _flowtuple_deque_push(flowtuple_loop_t *loop, int thread, flowtuple_task_t *task) {
+    flowtuple_deque_t *deque = &(loop->deques[thread]);
+    flowtuple_task_t *tasks;
+    size_t capacity;
+
+    pthread_mutex_lock(&(deque->lock));
+    if (deque->tail == deque->capacity) {
+        /* reuse the room left by stolen tasks before growing */
+        if (deque->head > 0) {
+            memmove(deque->tasks, deque->tasks + deque->head, (deque->tail - deque->head) * sizeof(flowtuple_task_t));
+            deque->tail -= deque->head;
+            deque->head = 0;
+        } else {
+            capacity = deque->capacity > 0 ? deque->capacity * 2 : 16;
+            if ((tasks = realloc(deque->tasks, capacity * sizeof(flowtuple_task_t))) == NULL) {
+                pthread_mutex_unlock(&(deque->lock));
+                return -1;
+            }
+            deque->tasks = tasks;
+            deque->capacity = capacity;
+        }
+    }
+    deque->tasks[deque->tail++] = *task;
+    pthread_mutex_unlock(&(deque->lock));
+
+    pthread_mutex_lock(&(loop->lock));
+    loop->queued++;
+    loop->outstanding++;
+    pthread_cond_signal(&(loop->work));
+    pthread_mutex_unlock(&(loop->lock));
+    return 0;
+}
+
+/* takes a task of the worker's own deque, or steals one, returns 0 if there is none */
+static int _flowtuple_deque_take(flowtuple_loop_t *loop, int thread, flowtuple_task_t *task) {
+    flowtuple_deque_t *deque;
+    int found = 0;
+
+    for (int i = 0; i < loop->nthreads && !found; i++) {
+        deque = &(loop->deques[(thread + i) % loop->nthreads]);
+        pthread_mutex_lock(&(deque->lock));
+        if (deque->head < deque->tail) {
+            *task = i == 0 ? deque->tasks[--deque->tail] : deque->tasks[deque->head++];
+            found = 1;
+        }
+        pthread_mutex_unlock(&(deque->lock));
+    }
+
+    if (found) {
+        pthread_mutex_lock(&(loop->lock));
+        loop->queued--;
+        pthread_mutex_unlock(&(loop->lock));
+    }
+    return found;
+}
+
+static void _flowtuple_loop_fail(flowtuple_loop_t *loop, flowtuple_errno_t err) {
+    pthread_mutex_lock(&(loop->lock));
+    if (loop->err == FLOWTUPLE_ERR_OK) {
+        loop->err = err;
+    }
+    pthread_cond_broadcast(&(loop->work));
+    pthread_mutex_unlock(&(loop->lock));
+}
+
+/* splits a whole file into interval ranges queued on the worker's own deque, if
+ * the file has a sidecar index it can seek with, returns -1 if out of memory */
+static int _flowtuple_loop_split(flowtuple_loop_t *loop, int thread, flowtuple_task_t *task) {
+    flowtuple_loop_file_t *file = &(loop->files[task->file]);
+    flowtuple_index_t *index;
+    flowtuple_task_t range;
+    flowtuple_errno_t err;
+    struct stat st;
+    char *sidecar;
+    size_t parts;
+    size_t first;
+    size_t next;
+
+    MALLOC(sidecar, strlen(file->path) + 5, return -1);
+    sprintf(sidecar, "%s.idx", file->path);
+    index = flowtuple_index_load(sidecar, &err);
+    FREE(sidecar);
+
+    /* a compressed file is only split if it has checkpoints, or is an archive or a frame file */
+    if (index == NULL || stat(file->path, &st) != 0 || (uint64_t)st.st_size != index->file_size ||
+        (index->checkpoint_count == 0 && index->length != index->file_size &&
+         !_flowtuple_archive_is_archive(file->path) && !_flowtuple_frames_is_frames(file->path)) ||
+        index->interval_count < 2) {
+        flowtuple_index_free(index);
+        return 0;
+    }
+
+    parts = index->interval_count < (size_t)loop->nthreads ? index->interval_count : (size_t)loop->nthreads;
+    file->index = index;
+    pthread_mutex_lock(&(loop->lock));
+    file->pending = parts;
+    pthread_mutex_unlock(&(loop->lock));
+
+    /* the first range keeps the header, the last one the trailer, and
+     * the first is queued last so this worker takes it right away */
+    for (size_t i = parts; i-- > 0;) {
+        first = index->interval_count * i / parts;
+        next = index->interval_count * (i + 1) / parts;
+        range.file = task->file;
+        range.whole = 0;
+        range.start = i == 0 ? 0 : index->intervals[first].offset;
+        range.end = next < index->interval_count ? index->intervals[next].offset : UINT64_MAX;
+        if (_flowtuple_deque_push(loop, thread, &range) < 0) {
+            return -1;
+        }
+    }
+    return 1;
+}
+
+/* reads the records of a task into the worker's state */
+static flowtuple_errno_t _flowtuple_loop_run(flowtuple_loop_worker_t *worker, flowtuple_handle_t **handle,
+                                             flowtuple_record_t *record, flowtuple_task_t *task) {
+    flowtuple_loop_t *loop = worker->loop;
+    flowtuple_loop_file_t *file = &(loop->files[task->file]);
+    flowtuple_errno_t err = FLOWTUPLE_ERR_OK;
+    int res;
+
+    /* one handle per worker goes through all of its files */
+    if (*handle == NULL) {
+        if ((*handle = flowtuple_initialize(file->path, &err)) == NULL) {
+            return err;
+        }
+    } else if (flowtuple_reopen(*handle, file->path) < 0) {
+        return flowtuple_errno(*handle);
+    }
+
+    /* the index of a previous range may be gone already */
+    (*handle)->index = file->index;
+    if (!task->whole) {
+        if (task->start > 0 && _flowtuple_seek(*handle, task->start) < 0) {
+            return flowtuple_errno(*handle);
+        }
+    }
+
+    while (task->whole || (*handle)->state != FLOWTUPLE_STATE_RECORD ||
+           (*handle)->buf_offset + (*handle)->buf_pos < task->end) {
+        if ((res = flowtuple_get_next_record(*handle, record)) <= 0) {
+            return res < 0 ? flowtuple_errno(*handle) : FLOWTUPLE_ERR_OK;
+        }
+        loop->callback(record, worker->state);
+        worker->count++;
+    }
+    return FLOWTUPLE_ERR_OK;
+}
+
+static void *_flowtuple_loop_work(void *arg) {
+    flowtuple_loop_worker_t *worker = (flowtuple_loop_worker_t*)arg;
+    flowtuple_loop_t *loop = worker->loop;
+    flowtuple_handle_t *handle = NULL;
+    flowtuple_record_t *record;
+    flowtuple_loop_file_t *file;
+    flowtuple_task_t task;
+    flowtuple_errno_t err;
+    int res;
+
+    memset(&task, 0, sizeof(flowtuple_task_t));
+    if ((record = flowtuple_record_create()) == NULL) {
+        _flowtuple_loop_fail(loop, FLOWTUPLE_ERR_MEM);
+        return NULL;
+    }
+
+    for (;;) {
+        if (!_flowtuple_deque_take(loop, worker->thread, &task)) {
+            /* wait for tasks, or for the last one to be done */
+            pthread_mutex_lock(&(loop->lock));
+            while (loop->queued == 0 && loop->outstanding > 0 && loop->err == FLOWTUPLE_ERR_OK) {
+                pthread_cond_wait(&(loop->work), &(loop->lock));
+            }
+            res = loop->outstanding == 0 || loop->err != FLOWTUPLE_ERR_OK;
+            pthread_mutex_unlock(&(loop->lock));
+            if (res) {
+                break;
+            }
+            continue;
+        }
+
+        file = &(loop->files[task.file]);
+        err = FLOWTUPLE_ERR_OK;
+        if (loop->err != FLOWTUPLE_ERR_OK) {
+            /* drain the queues */
+        } else if (task.whole && (res = _flowtuple_loop_split(loop, worker->thread, &task)) != 0) {
+            err = res < 0 ? FLOWTUPLE_ERR_MEM : FLOWTUPLE_ERR_OK;
+        } else {
+            err = _flowtuple_loop_run(worker, &handle, record, &task);
+        }
+        if (err != FLOWTUPLE_ERR_OK) {
+            _flowtuple_loop_fail(loop, err);
+        }
+
+        pthread_mutex_lock(&(loop->lock));
+        /* the index goes with the last range of its file */
+        if (!task.whole && --file->pending == 0) {
+            flowtuple_index_free(file->index);
+            file->index = NULL;
+        }
+        if (--loop->outstanding == 0) {
+            pthread_cond_broadcast(&(loop->work));
+        }
+        pthread_mutex_unlock(&(loop->lock));
+    }
+
+    flowtuple_record_free(record);
+    flowtuple_release(handle);
+    return NULL;
+}
+
+long flowtuple_parallel_loop(const char **paths, size_t n, int nthreads, flowtuple_state_init init,
+                             flowtuple_handler callback, flowtuple_state_merge merge, void *args,
+                             flowtuple_errno_t *err) {
+    flowtuple_loop_worker_t *workers = NULL;
+    flowtuple_loop_t loop;
+    flowtuple_task_t task;
+    long count = 0;
+    int started = 0;
+    int states = 0;
+    int i;
+
+    *err = FLOWTUPLE_ERR_OK;
+    CHECK(paths != NULL && callback != NULL, *err = FLOWTUPLE_ERR_FILE_OPEN; return -1);
+
+    if (nthreads <= 0) {
+        nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (nthreads < 1 || init == NULL) {
+        /* without init, args is the only state and one worker owns it */
+        nthreads = 1;
+    }
+
+    memset(&loop, 0, sizeof(flowtuple_loop_t));
+    loop.nthreads = nthreads;
+    loop.callback = callback;
+    loop.args = args;
+    pthread_mutex_init(&(loop.lock), NULL);
+    pthread_cond_init(&(loop.work), NULL);
+
+    CALLOC(loop.files, n > 0 ? n : 1, sizeof(flowtuple_loop_file_t), goto nomem);
+    CALLOC(loop.deques, (size_t)nthreads, sizeof(flowtuple_deque_t), goto nomem);
+    CALLOC(workers, (size_t)nthreads, sizeof(flowtuple_loop_worker_t), goto nomem);
+    for (i = 0; i < nthreads; i++) {
+        pthread_mutex_init(&(loop.deques[i].lock), NULL);
+    }
+
+    /* files are dealt out round robin, idle workers steal the rest */
+    for (size_t f = 0; f < n; f++) {
+        loop.files[f].path = paths[f];
+        task.file = f;
+        task.whole = 1;
+        task.start = 0;
+        task.end = UINT64_MAX;
+        if (_flowtuple_deque_push(&loop, (int)(f % (size_t)nthreads), &task) < 0) {
+            goto nomem;
+        }
+    }
+
+    for (states = 0; states < nthreads; states++) {
+        workers[states].loop = &loop;
+        workers[states].thread = states;
+        workers[states].state = init != NULL ? init(args) : args;
+        if (workers[states].state == NULL) {
+            goto nomem;
+        }
+    }
+
+    for (started = 0; started < nthreads; started++) {
+        if (pthread_create(&(workers[started].tid), NULL, _flowtuple_loop_work, &(workers[started])) != 0) {
+            break;
+        }
+    }
+    if (started == 0) {
+        /* the calling thread does all the work */
+        _flowtuple_loop_work(&(workers[0]));
+    }
+    for (i = 0; i < started; i++) {
+        pthread_join(workers[i].tid, NULL);
+    }
+
+    for (i = 0; i < nthreads; i++) {
+        count += workers[i].count;
+    }
+    *err = loop.err;
+    goto done;
+
+    nomem:
+    *err = FLOWTUPLE_ERR_MEM;
+
+    done:
+    /* the states are merged in thread order on the calling thread,
+     * those made before a failed init only to be freed */
+    for (i = 0; merge != NULL && i < states; i++) {
+        if (workers[i].state != args) {
+            merge(args, workers[i].state);
+        }
+    }
+    for (i = 0; loop.deques != NULL && i < nthreads; i++) {
+        pthread_mutex_destroy(&(loop.deques[i].lock));
+        FREE(loop.deques[i].tasks);
+    }
+    for (size_t f = 0; loop.files != NULL && f < n; f++) {
+        flowtuple_index_free(loop.files[f].index);
+    }
+    FREE(loop.deques);
+    FREE(loop.files);
+    FREE(workers);
+    pthread_cond_destroy(&(loop.work));
+    pthread_mutex_destroy(&(loop.lock));
+
+    return *err == FLOWTUPLE_ERR_OK ? count : -1;
+}
@@ -0,0 +1,414 @@
+/*
+ *  pipeline.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include <wandio.h>
+
+#include "fttypes.h"
+#include "util.h"
+#include "record.h"
+#include "reader.h"
+#include "inflate.h"
+#include "gunzip.h"
+#include "pipeline.h"
+
+/* records decoded ahead of the callback of a pipelined loop */
+typedef struct _flowtuple_decoder_t {
+    flowtuple_handle_t *handle;
+    flowtuple_ring_t records;
+    long cnt;
+    int stop;
+} flowtuple_decoder_t;
+
+/* yields before blocking, as the other side is often about to catch up */
+#define RING_SPINS 16
+
+int _flowtuple_ring_init(flowtuple_ring_t *ring, size_t count, size_t slot_size, int *stop) {
+    memset(ring, 0, sizeof(flowtuple_ring_t));
+    ring->count = count;
+    ring->stop = stop;
+
+    /* a ring with slots has its lock too */
+    CALLOC(ring->slots, count, sizeof(flowtuple_ring_slot_t), return -1);
+    pthread_mutex_init(&(ring->lock), NULL);
+    pthread_cond_init(&(ring->cond), NULL);
+    for (size_t i = 0; i < count; i++) {
+        CALLOC(ring->slots[i].data, 1, slot_size, goto nomem);
+    }
+    return 0;
+
+    nomem:
+    _flowtuple_ring_free(ring);
+    return -1;
+}
+
+void _flowtuple_ring_free(flowtuple_ring_t *ring) {
+    if (ring->slots == NULL) {
+        return;
+    }
+
+    for (size_t i = 0; i < ring->count; i++) {
+        FREE(ring->slots[i].data);
+    }
+    FREE(ring->slots);
+    pthread_cond_destroy(&(ring->cond));
+    pthread_mutex_destroy(&(ring->lock));
+}
+
+/* whether the producer has a free slot to claim, or the consumer a filled one to peek */
+static int _flowtuple_ring_ready(flowtuple_ring_t *ring, int producer) {
+    uint64_t tail = __atomic_load_n(&(ring->tail), __ATOMIC_SEQ_CST);
+    uint64_t head = __atomic_load_n(&(ring->head), __ATOMIC_SEQ_CST);
+
+    return producer ? tail - head < ring->count : tail != head;
+}
+
+/* waits for the ring to be ready for one side, yielding a few times and
+ * then blocking until the other side moves, returns -1 if stopped */
+static int _flowtuple_ring_wait(flowtuple_ring_t *ring, int producer) {
+    unsigned spins = 0;
+
+    while (!_flowtuple_ring_ready(ring, producer)) {
+        if (__atomic_load_n(ring->stop, __ATOMIC_ACQUIRE)) {
+            return -1;
+        }
+        if (spins < RING_SPINS) {
+            spins++;
+            sched_yield();
+            continue;
+        }
+
+        /* waiters is raised before checking again, and the other
+         * side moves before reading it, so no wakeup is missed */
+        pthread_mutex_lock(&(ring->lock));
+        __atomic_add_fetch(&(ring->waiters), 1, __ATOMIC_SEQ_CST);
+        while (!_flowtuple_ring_ready(ring, producer) && !__atomic_load_n(ring->stop, __ATOMIC_ACQUIRE)) {
+            pthread_cond_wait(&(ring->cond), &(ring->lock));
+        }
+        __atomic_sub_fetch(&(ring->waiters), 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&(ring->lock));
+    }
+    return 0;
+}
+
+/* wakes the other side if it is blocked on the ring */
+static void _flowtuple_ring_wake(flowtuple_ring_t *ring) {
+    if (__atomic_load_n(&(ring->waiters), __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&(ring->lock));
+        pthread_cond_broadcast(&(ring->cond));
+        pthread_mutex_unlock(&(ring->lock));
+    }
+}
+
+void _flowtuple_ring_stop(flowtuple_ring_t *ring) {
+    /* a ring never set up has no one waiting on it */
+    if (ring->slots == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&(ring->lock));
+    __atomic_store_n(ring->stop, 1, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&(ring->cond));
+    pthread_mutex_unlock(&(ring->lock));
+}
+
+/* returns the next free slot for the producer to fill, NULL if stopped */
+flowtuple_ring_slot_t *_flowtuple_ring_claim(flowtuple_ring_t *ring) {
+    if (_flowtuple_ring_wait(ring, 1) < 0) {
+        return NULL;
+    }
+    return &(ring->slots[__atomic_load_n(&(ring->tail), __ATOMIC_RELAXED) % ring->count]);
+}
+
+/* hands the claimed slot over to the consumer */
+void _flowtuple_ring_push(flowtuple_ring_t *ring) {
+    __atomic_store_n(&(ring->tail), __atomic_load_n(&(ring->tail), __ATOMIC_RELAXED) + 1, __ATOMIC_SEQ_CST);
+    _flowtuple_ring_wake(ring);
+}
+
+/* returns the oldest filled slot, NULL if stopped */
+flowtuple_ring_slot_t *_flowtuple_ring_peek(flowtuple_ring_t *ring) {
+    if (_flowtuple_ring_wait(ring, 0) < 0) {
+        return NULL;
+    }
+    return &(ring->slots[__atomic_load_n(&(ring->head), __ATOMIC_RELAXED) % ring->count]);
+}
+
+/* hands the peeked slot back to the producer */
+void _flowtuple_ring_pop(flowtuple_ring_t *ring) {
+    __atomic_store_n(&(ring->head), __atomic_load_n(&(ring->head), __ATOMIC_RELAXED) + 1, __ATOMIC_SEQ_CST);
+    _flowtuple_ring_wake(ring);
+}
+
+/* decompresses the next block of a gzip file with libdeflate, or with wandio
+ * from the start of the file when libdeflate cannot take its first member */
+static int64_t _flowtuple_pipeline_gunzip(flowtuple_pipeline_t *pipeline, uint8_t *buf) {
+    flowtuple_gunzip_t *gz = pipeline->gunzip;
+    int64_t got;
+
+    if ((got = _flowtuple_gunzip_read(gz, buf, FLOWTUPLE_BLOCK_SIZE)) >= 0 || gz->out_offset + gz->out_pos > 0) {
+        return got;
+    }
+
+    _flowtuple_gunzip_close(gz);
+    pipeline->gunzip = NULL;
+    if ((pipeline->io = wandio_create(pipeline->path)) == NULL) {
+        return -1;
+    }
+    return wandio_read(pipeline->io, buf, FLOWTUPLE_BLOCK_SIZE);
+}
+
+/* reads compressed chunks of a gzip file, or decompressed blocks of anything else */
+static void *_flowtuple_pipeline_read_stage(void *arg) {
+    flowtuple_pipeline_t *pipeline = (flowtuple_pipeline_t*)arg;
+    flowtuple_ring_t *ring = pipeline->inflate != NULL ? &(pipeline->chunks) : &(pipeline->blocks);
+    flowtuple_ring_slot_t *slot;
+    int64_t got;
+
+    do {
+        if ((slot = _flowtuple_ring_claim(ring)) == NULL) {
+            break;
+        }
+        if (pipeline->inflate != NULL) {
+            got = read(pipeline->fd, slot->data, FLOWTUPLE_INFLATE_CHUNK);
+        } else if (pipeline->gunzip != NULL) {
+            got = _flowtuple_pipeline_gunzip(pipeline, slot->data);
+        } else {
+            got = wandio_read(pipeline->io, slot->data, FLOWTUPLE_BLOCK_SIZE);
+        }
+        slot->len = got < 0 ? -1 : got;
+        _flowtuple_ring_push(ring);
+    } while (got > 0);
+
+    return NULL;
+}
+
+static void *_flowtuple_pipeline_inflate_stage(void *arg) {
+    flowtuple_pipeline_t *pipeline = (flowtuple_pipeline_t*)arg;
+    flowtuple_ring_slot_t *slot;
+    int64_t got;
+
+    do {
+        if ((slot = _flowtuple_ring_claim(&(pipeline->blocks))) == NULL) {
+            break;
+        }
+        got = _flowtuple_inflate_read(pipeline->inflate, slot->data, FLOWTUPLE_BLOCK_SIZE);
+        slot->len = got;
+        _flowtuple_ring_push(&(pipeline->blocks));
+    } while (got > 0);
+
+    return NULL;
+}
+
+flowtuple_pipeline_t *_flowtuple_pipeline_open(const char *filename, int use_gunzip, flowtuple_errno_t *err) {
+    flowtuple_pipeline_t *pipeline;
+
+    *err = FLOWTUPLE_ERR_MEM;
+    CALLOC(pipeline, 1, sizeof(flowtuple_pipeline_t), return NULL);
+    pipeline->fd = -1;
+
+    if (_flowtuple_ring_init(&(pipeline->blocks), FLOWTUPLE_RING_SLOTS, FLOWTUPLE_BLOCK_SIZE, &(pipeline->stop)) < 0) {
+        goto fail;
+    }
+
+    /* libdeflate is fast enough for the read stage to decompress alone */
+    if (use_gunzip && (pipeline->gunzip = _flowtuple_gunzip_open(filename)) != NULL) {
+        MALLOC(pipeline->path, strlen(filename) + 1, goto fail);
+        strcpy(pipeline->path, filename);
+    /* wandio inflates on the thread that reads, so only gzip gets a stage of its own */
+    } else if (_flowtuple_inflate_is_gzip(filename)) {
+        if (_flowtuple_ring_init(&(pipeline->chunks), FLOWTUPLE_RING_SLOTS, FLOWTUPLE_INFLATE_CHUNK, &(pipeline->stop)) < 0) {
+            goto fail;
+        }
+        if ((pipeline->inflate = _flowtuple_inflate_stream(&(pipeline->chunks), err)) == NULL) {
+            goto fail;
+        }
+        if ((pipeline->fd = open(filename, O_RDONLY)) < 0) {
+            *err = FLOWTUPLE_ERR_FILE_OPEN;
+            goto fail;
+        }
+    } else if ((pipeline->io = wandio_create(filename)) == NULL) {
+        *err = FLOWTUPLE_ERR_FILE_OPEN;
+        goto fail;
+    }
+
+    *err = FLOWTUPLE_ERR_MEM;
+    if (pthread_create(&(pipeline->reader), NULL, _flowtuple_pipeline_read_stage, pipeline) != 0) {
+        goto fail;
+    }
+    pipeline->threads++;
+    if (pipeline->inflate != NULL) {
+        if (pthread_create(&(pipeline->inflater), NULL, _flowtuple_pipeline_inflate_stage, pipeline) != 0) {
+            goto fail;
+        }
+        pipeline->threads++;
+    }
+
+    *err = FLOWTUPLE_ERR_OK;
+    return pipeline;
+
+    fail:
+    _flowtuple_pipeline_close(pipeline);
+    return NULL;
+}
+
+int64_t _flowtuple_pipeline_read(flowtuple_pipeline_t *pipeline, uint8_t *buf, size_t len) {
+    flowtuple_ring_slot_t *slot;
+    size_t done = 0;
+    size_t n;
+
+    while (done < len) {
+        if (pipeline->slot == NULL) {
+            /* the end of the stream stays in the ring for later reads */
+            if ((slot = _flowtuple_ring_peek(&(pipeline->blocks))) == NULL || slot->len < 0) {
+                return -1;
+            } else if (slot->len == 0) {
+                break;
+            }
+            pipeline->slot = slot;
+            pipeline->slot_pos = 0;
+        }
+
+        slot = pipeline->slot;
+        n = (size_t)slot->len - pipeline->slot_pos;
+        if (n > len - done) {
+            n = len - done;
+        }
+        memcpy(buf + done, slot->data + pipeline->slot_pos, n);
+        pipeline->slot_pos += n;
+        done += n;
+
+        if (pipeline->slot_pos == (size_t)slot->len) {
+            _flowtuple_ring_pop(&(pipeline->blocks));
+            pipeline->slot = NULL;
+        }
+    }
+
+    return (int64_t)done;
+}
+
+void _flowtuple_pipeline_close(flowtuple_pipeline_t *pipeline) {
+    if (pipeline == NULL) {
+        return;
+    }
+
+    /* stages blocked on a full or empty ring give up */
+    _flowtuple_ring_stop(&(pipeline->chunks));
+    _flowtuple_ring_stop(&(pipeline->blocks));
+    if (pipeline->threads > 0) {
+        pthread_join(pipeline->reader, NULL);
+    }
+    if (pipeline->threads > 1) {
+        pthread_join(pipeline->inflater, NULL);
+    }
+
+    if (pipeline->fd >= 0) {
+        close(pipeline->fd);
+    }
+    if (pipeline->io != NULL) {
+        wandio_destroy(pipeline->io);
+    }
+    _flowtuple_inflate_close(pipeline->inflate);
+    _flowtuple_gunzip_close(pipeline->gunzip);
+    FREE(pipeline->path);
+    _flowtuple_ring_free(&(pipeline->chunks));
+    _flowtuple_ring_free(&(pipeline->blocks));
+    FREE(pipeline);
+}
+
+/* decodes records of the handle into the record ring, ending it with an empty slot */
+static void *_flowtuple_pipeline_decode_stage(void *arg) {
+    flowtuple_decoder_t *decoder = (flowtuple_decoder_t*)arg;
+    flowtuple_handle_t *handle = decoder->handle;
+    flowtuple_ring_slot_t *slot;
+    flowtuple_record_t *records;
+    long total = 0;
+    int done = 0;
+    int64_t n;
+
+    do {
+        if ((slot = _flowtuple_ring_claim(&(decoder->records))) == NULL) {
+            break;
+        }
+        records = (flowtuple_record_t*)slot->data;
+
+        for (n = 0; !done && n < FLOWTUPLE_PIPELINE_RECORDS; n++) {
+            if ((decoder->cnt >= 0 && total >= decoder->cnt) || _flowtuple_read_record(handle, &(records[n])) <= 0) {
+                done = 1;
+                break;
+            }
+
+            /* the record outlives the read buffer and the header arena */
+            _flowtuple_record_materialize(&(records[n]));
+            if (_flowtuple_record_own(&(records[n])) < 0) {
+                handle->errno = FLOWTUPLE_ERR_MEM;
+                done = 1;
+                break;
+            }
+            total++;
+        }
+
+        slot->len = n;
+        _flowtuple_ring_push(&(decoder->records));
+    } while (n > 0);
+
+    return NULL;
+}
+
+long _flowtuple_pipeline_loop(flowtuple_handle_t *handle, long cnt, flowtuple_handler callback, void *args) {
+    flowtuple_ring_slot_t *slot;
+    flowtuple_record_t *records;
+    flowtuple_decoder_t decoder;
+    pthread_t tid;
+    long ret = 0;
+
+    memset(&decoder, 0, sizeof(flowtuple_decoder_t));
+    decoder.handle = handle;
+    decoder.cnt = cnt;
+    if (_flowtuple_ring_init(&(decoder.records), FLOWTUPLE_RING_SLOTS,
+                             FLOWTUPLE_PIPELINE_RECORDS * sizeof(flowtuple_record_t), &(decoder.stop)) < 0) {
+        handle->errno = FLOWTUPLE_ERR_MEM;
+        return 0;
+    }
+    if (pthread_create(&tid, NULL, _flowtuple_pipeline_decode_stage, &decoder) != 0) {
+        _flowtuple_ring_free(&(decoder.records));
+        handle->errno = FLOWTUPLE_ERR_MEM;
+        return 0;
+    }
+
+    /* the handle belongs to the decode stage until it is joined */
+    while ((slot = _flowtuple_ring_peek(&(decoder.records)))->len > 0) {
+        records = (flowtuple_record_t*)slot->data;
+        for (int64_t i = 0; i < slot->len; i++) {
+            callback(&(records[i]), args);
+            _flowtuple_record_reset(&(records[i]));
+        }
+        ret += (long)slot->len;
+        _flowtuple_ring_pop(&(decoder.records));
+    }
+
+    pthread_join(tid, NULL);
+    _flowtuple_ring_free(&(decoder.records));
+    return ret;
+}
@@ -0,0 +1,48 @@
+/*
+ *  pipeline.h
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stddef.h>
+#include <inttypes.h>
+
+#include "flowtuple.h"
+#include "fttypes.h"
+
+/* slots of the rings between the read, inflate and decode stages */
+#define FLOWTUPLE_RING_SLOTS 8
+/* records decoded into each slot of the record ring */
+#define FLOWTUPLE_PIPELINE_RECORDS 1024
+
+int _flowtuple_ring_init(flowtuple_ring_t *ring, size_t count, size_t slot_size, int *stop);
+void _flowtuple_ring_free(flowtuple_ring_t *ring);
+flowtuple_ring_slot_t *_flowtuple_ring_claim(flowtuple_ring_t *ring);
+void _flowtuple_ring_push(flowtuple_ring_t *ring);
+flowtuple_ring_slot_t *_flowtuple_ring_peek(flowtuple_ring_t *ring);
+void _flowtuple_ring_pop(flowtuple_ring_t *ring);
+/* sets the stop flag of the ring and wakes both sides */
+void _flowtuple_ring_stop(flowtuple_ring_t *ring);
+
+flowtuple_pipeline_t *_flowtuple_pipeline_open(const char *filename, int use_gunzip, flowtuple_errno_t *err);
+int64_t _flowtuple_pipeline_read(flowtuple_pipeline_t *pipeline, uint8_t *buf, size_t len);
+void _flowtuple_pipeline_close(flowtuple_pipeline_t *pipeline);
+long _flowtuple_pipeline_loop(flowtuple_handle_t *handle, long cnt, flowtuple_handler callback, void *args);
+
+#endif
@@ -0,0 +1,359 @@
+/*
+ *  reader.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <wandio.h>
+
+#include "fttypes.h"
+#include "util.h"
+#include "reader.h"
+#include "inflate.h"
+#include "index.h"
+#include "pipeline.h"
+#include "archive.h"
+#include "frames.h"
+#include "gunzip.h"
+
+int _flowtuple_reader_init(flowtuple_handle_t *handle) {
+    CALLOC(handle->block, FLOWTUPLE_BLOCK_SIZE, sizeof(uint8_t), return -1);
+    handle->block_size = FLOWTUPLE_BLOCK_SIZE;
+    handle->buf = handle->block;
+    handle->buf_size = handle->block_size;
+    handle->buf_len = 0;
+    handle->buf_pos = 0;
+    return 0;
+}
+
+void _flowtuple_reader_free(flowtuple_handle_t *handle) {
+    _flowtuple_reader_close(handle);
+    FREE(handle->block);
+    handle->block_size = 0;
+    handle->buf = NULL;
+    handle->buf_size = 0;
+}
+
+/* maps filename if it is an uncompressed flowtuple file, which
+ * unlike every compressed format starts with the corsaro magic */
+static int _flowtuple_reader_map(flowtuple_handle_t *handle, const char *filename) {
+    struct stat st;
+    uint8_t magic[4];
+    void *map = MAP_FAILED;
+    int fd;
+
+    if ((fd = open(filename, O_RDONLY)) < 0) {
+        return -1;
+    }
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size >= 4 &&
+        pread(fd, magic, 4, 0) == 4 && memcmp(magic, "EDGR", 4) == 0) {
+        map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+    madvise(map, (size_t)st.st_size, MADV_HUGEPAGE);
+#endif
+
+    handle->map = map;
+    handle->buf = map;
+    handle->buf_size = (size_t)st.st_size;
+    handle->buf_len = (size_t)st.st_size;
+    handle->buf_pos = 0;
+    return 0;
+}
+
+/* opens a file for reading front to back, through wandio */
+static flowtuple_errno_t _flowtuple_reader_stream(flowtuple_handle_t *handle, const char *filename) {
+    flowtuple_errno_t err;
+
+    if (handle->pipelined) {
+        handle->pipeline = _flowtuple_pipeline_open(filename, handle->use_gunzip, &err);
+        return err;
+    }
+
+    handle->io = wandio_create(filename);
+    if (handle->io == NULL) {
+        return FLOWTUPLE_ERR_FILE_OPEN;
+    }
+    return FLOWTUPLE_ERR_OK;
+}
+
+flowtuple_errno_t _flowtuple_reader_open(flowtuple_handle_t *handle, const char *filename) {
+    flowtuple_errno_t err;
+
+    _flowtuple_reader_close(handle);
+
+    if (_flowtuple_reader_map(handle, filename) == 0) {
+        return FLOWTUPLE_ERR_OK;
+    }
+
+    /* records are read from the chunks of an archive */
+    if (_flowtuple_archive_is_archive(filename)) {
+        handle->archive = flowtuple_archive_open(filename, &err);
+        return err;
+    }
+
+    /* zstd frames are decompressed on threads of their own when pipelined */
+    if (_flowtuple_frames_is_frames(filename)) {
+        handle->frames = _flowtuple_frames_open(filename, handle->pipelined, &err);
+        return err;
+    }
+
+    /* gzip files are decompressed a whole member at a time by libdeflate,
+     * on the read thread of the pipeline when pipelined */
+    if (!handle->pipelined && handle->use_gunzip && (handle->gunzip = _flowtuple_gunzip_open(filename)) != NULL) {
+        return FLOWTUPLE_ERR_OK;
+    }
+
+    /* compressed or not a regular file */
+    return _flowtuple_reader_stream(handle, filename);
+}
+
+void _flowtuple_reader_close(flowtuple_handle_t *handle) {
+    if (handle->map != NULL) {
+        munmap(handle->map, handle->buf_size);
+        handle->map = NULL;
+    }
+
+    if (handle->io != NULL) {
+        wandio_destroy(handle->io);
+        handle->io = NULL;
+    }
+
+    if (handle->inflate != NULL) {
+        _flowtuple_inflate_close(handle->inflate);
+        handle->inflate = NULL;
+    }
+
+    if (handle->pipeline != NULL) {
+        _flowtuple_pipeline_close(handle->pipeline);
+        handle->pipeline = NULL;
+    }
+
+    if (handle->archive != NULL) {
+        flowtuple_archive_close(handle->archive);
+        handle->archive = NULL;
+    }
+
+    if (handle->frames != NULL) {
+        _flowtuple_frames_close(handle->frames);
+        handle->frames = NULL;
+    }
+
+    if (handle->gunzip != NULL) {
+        _flowtuple_gunzip_close(handle->gunzip);
+        handle->gunzip = NULL;
+    }
+
+    handle->buf = handle->block;
+    handle->buf_size = handle->block_size;
+    handle->buf_len = 0;
+    handle->buf_pos = 0;
+    handle->buf_offset = 0;
+}
+
+flowtuple_errno_t _flowtuple_reader_resume(flowtuple_handle_t *handle, const flowtuple_checkpoint_t *point) {
+    flowtuple_inflate_t *inflate;
+    flowtuple_errno_t err;
+
+    if ((inflate = _flowtuple_inflate_open(handle->uri, point, &err)) == NULL) {
+        return err;
+    }
+
+    _flowtuple_reader_close(handle);
+    handle->inflate = inflate;
+    handle->buf_offset = point != NULL ? point->out : 0;
+    return FLOWTUPLE_ERR_OK;
+}
+
+int _flowtuple_reader_is_seekable(flowtuple_handle_t *handle) {
+    return handle->map != NULL || handle->archive != NULL || handle->frames != NULL;
+}
+
+/* moves an archive, a frame file or a gzip file decompressed by libdeflate
+ * to offset in the stream it stands for, dropping what is buffered */
+static int _flowtuple_reader_jump(flowtuple_handle_t *handle, uint64_t offset) {
+    int ret;
+
+    if (handle->archive != NULL) {
+        ret = _flowtuple_archive_seek(handle->archive, offset);
+    } else if (handle->frames != NULL) {
+        ret = _flowtuple_frames_seek(handle->frames, offset);
+    } else {
+        ret = _flowtuple_gunzip_seek(handle->gunzip, offset);
+    }
+    if (ret < 0) {
+        handle->errno = FLOWTUPLE_ERR_FILE_EOF;
+        return -1;
+    }
+    handle->buf_offset = offset;
+    handle->buf_len = 0;
+    handle->buf_pos = 0;
+    return 0;
+}
+
+int _flowtuple_reader_seek(flowtuple_handle_t *handle, uint64_t offset) {
+    const flowtuple_checkpoint_t *point = NULL;
+    uint64_t pos = handle->buf_offset + handle->buf_pos;
+
+    /* still buffered, which a mapped file always is */
+    if (offset >= handle->buf_offset && offset - handle->buf_offset <= handle->buf_len) {
+        handle->buf_pos = (size_t)(offset - handle->buf_offset);
+        return 0;
+    }
+
+    /* archives and frame files are read from anywhere */
+    if (handle->archive != NULL || handle->frames != NULL) {
+        return _flowtuple_reader_jump(handle, offset);
+    }
+
+    if (handle->index != NULL) {
+        point = _flowtuple_index_find_checkpoint(handle->index, offset);
+    }
+
+    /* libdeflate keeps the member it decompressed last around, anywhere
+     * else a checkpoint is cheaper than decompressing whole members */
+    if (handle->gunzip != NULL && (point == NULL || _flowtuple_gunzip_holds(handle->gunzip, offset))) {
+        return _flowtuple_reader_jump(handle, offset);
+    }
+
+    /* going back, or a checkpoint is closer than reading on */
+    if (offset < pos || (point != NULL && point->out > pos)) {
+        if (point != NULL) {
+            handle->errno = _flowtuple_reader_resume(handle, point);
+        } else {
+            handle->errno = _flowtuple_reader_open(handle, handle->uri);
+        }
+        if (handle->errno != FLOWTUPLE_ERR_OK) {
+            return -1;
+        }
+        pos = handle->buf_offset;
+    }
+
+    return _flowtuple_reader_skip(handle, offset - pos);
+}
+
+int64_t _flowtuple_reader_fill(flowtuple_handle_t *handle, size_t len) {
+    size_t left = handle->buf_len - handle->buf_pos;
+    uint8_t *tmp;
+    int64_t wand;
+
+    /* the whole file is already there */
+    if (handle->map != NULL) {
+        return (int64_t)left;
+    }
+
+    /* move the unread tail to the front so records
+     * straddling two blocks stay contiguous */
+    if (handle->buf_pos > 0) {
+        memmove(handle->buf, handle->buf + handle->buf_pos, left);
+        handle->buf_offset += handle->buf_pos;
+        handle->buf_len = left;
+        handle->buf_pos = 0;
+    }
+
+    /* only a huge header can outgrow a block */
+    if (len > handle->buf_size) {
+        tmp = realloc(handle->block, len);
+        if (tmp == NULL) {
+            handle->errno = FLOWTUPLE_ERR_MEM;
+            return -1;
+        }
+        handle->block = tmp;
+        handle->block_size = len;
+        handle->buf = tmp;
+        handle->buf_size = len;
+    }
+
+    while (handle->buf_len < len) {
+        if (handle->pipeline != NULL) {
+            wand = _flowtuple_pipeline_read(handle->pipeline, handle->buf + handle->buf_len, handle->buf_size - handle->buf_len);
+        } else if (handle->archive != NULL) {
+            wand = _flowtuple_archive_read(handle->archive, handle->buf + handle->buf_len, handle->buf_size - handle->buf_len);
+        } else if (handle->frames != NULL) {
+            wand = _flowtuple_frames_read(handle->frames, handle->buf + handle->buf_len, handle->buf_size - handle->buf_len);
+        } else if (handle->gunzip != NULL) {
+            wand = _flowtuple_gunzip_read(handle->gunzip, handle->buf + handle->buf_len, handle->buf_size - handle->buf_len);
+        } else if (handle->inflate != NULL) {
+            wand = _flowtuple_inflate_read(handle->inflate, handle->buf + handle->buf_len, handle->buf_size - handle->buf_len);
+        } else {
+            wand = wandio_read(handle->io, handle->buf + handle->buf_len, (int64_t)(handle->buf_size - handle->buf_len));
+        }
+
+        /* a file libdeflate cannot take from its start, truncated or
+         * with a huge member, is streamed by wandio from the start instead */
+        if (wand < 0 && handle->gunzip != NULL && handle->buf_offset + handle->buf_len == 0) {
+            _flowtuple_gunzip_close(handle->gunzip);
+            handle->gunzip = NULL;
+            if ((handle->errno = _flowtuple_reader_stream(handle, handle->uri)) != FLOWTUPLE_ERR_OK) {
+                return -1;
+            }
+            continue;
+        }
+        if (wand < 0) {
+            handle->errno = FLOWTUPLE_ERR_FILE_READ;
+            return -1;
+        } else if (wand == 0) {
+            break;
+        }
+        handle->buf_len += (size_t)wand;
+    }
+
+    return (int64_t)handle->buf_len;
+}
+
+int _flowtuple_reader_skip(flowtuple_handle_t *handle, uint64_t len) {
+    size_t left;
+
+    for (;;) {
+        left = handle->buf_len - handle->buf_pos;
+        if (len <= left) {
+            handle->buf_pos += (size_t)len;
+            return 0;
+        }
+
+        /* the classes of an archive are jumped over without being
+         * rebuilt, frame files only decompress the frame landed in
+         * and libdeflate skips within the member it holds */
+        if (handle->archive != NULL || handle->frames != NULL || handle->gunzip != NULL) {
+            return _flowtuple_reader_jump(handle, handle->buf_offset + handle->buf_pos + len);
+        }
+
+        /* drop what is buffered and pull the next block, a mapped
+         * file is skipped over without touching its pages */
+        handle->buf_pos = handle->buf_len;
+        len -= left;
+        if (_flowtuple_reader_fill(handle, 1) < 1) {
+            if (handle->errno == FLOWTUPLE_ERR_OK) {
+                handle->errno = FLOWTUPLE_ERR_FILE_EOF;
+            }
+            return -1;
+        }
+    }
+}
@@ -0,0 +1,69 @@
+/*
+ *  reader.h
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef READER_H
+#define READER_H
+
+#include <stddef.h>
+#include <inttypes.h>
+
+#include "flowtuple.h"
+#include "fttypes.h"
+
+/* size of the blocks pulled from wandio */
+#define FLOWTUPLE_BLOCK_SIZE (1 << 20)
+
+int _flowtuple_reader_init(flowtuple_handle_t *handle);
+void _flowtuple_reader_free(flowtuple_handle_t *handle);
+flowtuple_errno_t _flowtuple_reader_open(flowtuple_handle_t *handle, const char *filename);
+void _flowtuple_reader_close(flowtuple_handle_t *handle);
+int64_t _flowtuple_reader_fill(flowtuple_handle_t *handle, size_t len);
+int _flowtuple_reader_skip(flowtuple_handle_t *handle, uint64_t len);
+flowtuple_errno_t _flowtuple_reader_resume(flowtuple_handle_t *handle, const flowtuple_checkpoint_t *point);
+int _flowtuple_reader_seek(flowtuple_handle_t *handle, uint64_t offset);
+/* whether the handle reads its file from anywhere, without checkpoints */
+int _flowtuple_reader_is_seekable(flowtuple_handle_t *handle);
+
+/* returns a pointer to the next len bytes without consuming them,
+ * NULL if fewer than len bytes are left */
+static inline uint8_t *_flowtuple_reader_peek(flowtuple_handle_t *handle, size_t len) {
+    if (handle->buf_len - handle->buf_pos < len && _flowtuple_reader_fill(handle, len) < (int64_t)len) {
+        return NULL;
+    }
+    return handle->buf + handle->buf_pos;
+}
+
+/* returns a pointer to the next len bytes and consumes them,
+ * sets the handle errno and returns NULL if fewer than len bytes are left */
+static inline uint8_t *_flowtuple_reader_next(flowtuple_handle_t *handle, size_t len) {
+    uint8_t *p;
+
+    if (handle->buf_len - handle->buf_pos < len && _flowtuple_reader_fill(handle, len) < (int64_t)len) {
+        if (handle->errno == FLOWTUPLE_ERR_OK) {
+            handle->errno = FLOWTUPLE_ERR_FILE_EOF;
+        }
+        return NULL;
+    }
+
+    p = handle->buf + handle->buf_pos;
+    handle->buf_pos += len;
+    return p;
+}
+
+#endif
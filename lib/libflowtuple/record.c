@@ -21,19 +21,70 @@
 #include <arpa/inet.h>
 
 #include "flowtuple.h"
+#include "flowtuple_inline.h"
 #include "fttypes.h"
 #include "util.h"
 #include "record.h"
+#include "filter.h"
+#include "reader.h"
+#include "archive.h"
+
+flowtuple_record_t *flowtuple_record_create(void) {
+    flowtuple_record_t *record;
+    CALLOC(record, 1, sizeof(flowtuple_record_t), return NULL);
+    return record;
+}
 
 void flowtuple_record_free(flowtuple_record_t *record) {
     CHECK(record != NULL, return);
+    _flowtuple_record_reset(record);
+    FREE(record);
+}
 
-    if (record->type == FLOWTUPLE_RECORD_TYPE_HEADER) {
+void _flowtuple_record_reset(flowtuple_record_t *record) {
+    if (record->type == FLOWTUPLE_RECORD_TYPE_HEADER && record->record.header.is_owned) {
         FREE(record->record.header.traceuri);
         FREE(record->record.header.plugins);
     }
 
-    FREE(record);
+    record->type = FLOWTUPLE_RECORD_TYPE_NULL;
+}
+
+void _flowtuple_record_materialize(flowtuple_record_t *record) {
+    flowtuple_data_t *data = &(record->record.data);
+
+    if (record->type == FLOWTUPLE_RECORD_TYPE_FLOWTUPLE_DATA && data->raw != NULL) {
+        _flowtuple_record_decode_data(data->raw, data->class_start.magic, data);
+    }
+}
+
+int _flowtuple_record_own(flowtuple_record_t *record) {
+    flowtuple_header_t *header = &(record->record.header);
+    uint8_t *traceuri = NULL;
+    uint32_t *plugins = NULL;
+
+    if (record->type != FLOWTUPLE_RECORD_TYPE_HEADER || header->is_owned) {
+        return 0;
+    }
+
+    if (header->traceuri != NULL) {
+        MALLOC(traceuri, ntohs(header->traceuri_len) + 1, goto nomem);
+        memcpy(traceuri, header->traceuri, ntohs(header->traceuri_len) + 1);
+    }
+
+    if (header->plugin_cnt > 0) {
+        MALLOC(plugins, header->plugin_cnt * sizeof(uint32_t), goto nomem);
+        memcpy(plugins, header->plugins, header->plugin_cnt * sizeof(uint32_t));
+    }
+
+    header->traceuri = traceuri;
+    header->plugins = plugins;
+    header->is_owned = 1;
+    return 0;
+
+    nomem:
+    FREE(traceuri);
+    return -1;
 }
 
 flowtuple_record_type_t flowtuple_record_get_type(flowtuple_record_t *record) {
@@ -67,142 +118,144 @@ flowtuple_data_t *flowtuple_record_get_data(flowtuple_record_t *record) {
 }
 
 void _flowtuple_record_read_header(flowtuple_handle_t *handle, flowtuple_record_t *record) {
-    /* we may later want to remove usage of the heap in this
-     * function as well, but this is the only structure where
-     * we don't know the maximum sizes of the buffer */
-    uint8_t *buf = NULL;
+    uint8_t *buf;
+    uint8_t *tmp;
     flowtuple_header_t header;
-    int64_t wand;
     uint16_t trace_uri_len_host;
+    size_t plugins_size;
+    size_t size;
 
-    CALLOC(buf, 26, sizeof(uint8_t), goto nomem);
+    /* peek far enough to size the whole header, then decode it
+     * into the handle's arena, which only grows for bigger headers */
+    if ((buf = _flowtuple_reader_peek(handle, 14)) == NULL) {
+        goto eof;
+    }
+    trace_uri_len_host = ntohs(_flowtuple_load16(buf + 12));
 
-    wand = wandio_read(handle->io, buf, 14);
-    if (wand == 0) {
-        handle->errno = FLOWTUPLE_ERR_FILE_EOF;
-        goto fail;
-    } else if (wand < 0) {
-        handle->errno = FLOWTUPLE_ERR_FILE_READ;
-        goto fail;
+    if ((buf = _flowtuple_reader_peek(handle, 16 + (size_t)trace_uri_len_host)) == NULL) {
+        goto eof;
+    }
+    header.plugin_cnt = ntohs(_flowtuple_load16(buf + 14 + trace_uri_len_host));
+    plugins_size = (size_t)header.plugin_cnt * 4;
+
+    size = plugins_size + trace_uri_len_host + 1;
+    if (size > handle->arena_size) {
+        if ((tmp = realloc(handle->arena, size)) == NULL) {
+            handle->errno = FLOWTUPLE_ERR_MEM;
+            return;
+        }
+        handle->arena = tmp;
+        handle->arena_size = size;
+    }
+
+    if ((buf = _flowtuple_reader_next(handle, 16 + trace_uri_len_host + plugins_size)) == NULL) {
+        return;
     }
 
     header.version_major = *(buf + 4);
     header.version_minor = *(buf + 5);
-    header.local_init_time = *(uint32_t*)(buf + 6);
-    header.interval_length = *(uint16_t*)(buf + 10);
+    header.local_init_time = _flowtuple_load32(buf + 6);
+    header.interval_length = _flowtuple_load16(buf + 10);
+    header.traceuri_len = _flowtuple_load16(buf + 12);
+    header.is_owned = 0;
+
+    /* plugins go first to keep them aligned */
+    header.plugins = (uint32_t*)(handle->arena);
+    for (size_t i = 0; i < header.plugin_cnt; i++) {
+        header.plugins[i] = _flowtuple_load32(buf + 16 + trace_uri_len_host + (4 * i));
+    }
 
-    header.traceuri_len = *(uint16_t*)(buf + 12);
-    trace_uri_len_host = ntohs(header.traceuri_len);
-    FREE(buf);
     if (trace_uri_len_host != 0) {
-        CALLOC(buf, trace_uri_len_host + 1, sizeof(uint8_t), goto nomem);
-        CALLOC(header.traceuri, trace_uri_len_host + 1, sizeof(uint8_t), goto nomem);
-        wandio_read(handle->io, buf, trace_uri_len_host);
-        memcpy(header.traceuri, buf, trace_uri_len_host * sizeof(uint8_t));
-        FREE(buf);
+        header.traceuri = handle->arena + plugins_size;
+        memcpy(header.traceuri, buf + 14, trace_uri_len_host * sizeof(uint8_t));
+        header.traceuri[trace_uri_len_host] = '\0';
     } else {
         header.traceuri = NULL;
     }
 
-    CALLOC(buf, 2, sizeof(uint8_t), return);
-    wandio_read(handle->io, buf, 2);
-    header.plugin_cnt = ntohs(*(uint16_t*)(buf));
-    FREE(buf);
-
-    CALLOC(buf, (size_t)header.plugin_cnt * 4, sizeof(uint8_t), goto nomem);
-    CALLOC(header.plugins, header.plugin_cnt, sizeof(uint32_t), goto nomem);
-
-    wandio_read(handle->io, buf, header.plugin_cnt * 4);
-    for (size_t i = 0; i < header.plugin_cnt; i++) {
-        header.plugins[i] = *(uint32_t*)(buf + (4 * i));
-    }
-
     record->type = FLOWTUPLE_RECORD_TYPE_HEADER;
     record->record.header = header;
     handle->last_record = *record;
-
-    FREE(buf);
     return;
 
-    nomem:
-    handle->errno = FLOWTUPLE_ERR_MEM;
-
-    fail:
-    FREE(buf);
+    eof:
+    if (handle->errno == FLOWTUPLE_ERR_OK) {
+        handle->errno = FLOWTUPLE_ERR_FILE_EOF;
+    }
 }
 
 void _flowtuple_record_read_interval(flowtuple_handle_t *handle, flowtuple_record_t *record) {
-    uint8_t buf[10];
+    uint8_t *buf;
     flowtuple_interval_t interval;
-    int64_t wand;
 
-    wand = wandio_read(handle->io, buf, 10);
-    if (wand == 0) {
-        handle->errno = FLOWTUPLE_ERR_FILE_EOF;
-    } else if (wand < 0) {
-        handle->errno = FLOWTUPLE_ERR_FILE_READ;
+    if ((buf = _flowtuple_reader_next(handle, 10)) == NULL) {
+        return;
     }
 
-    interval.number = *(uint16_t*)(buf + 4);
-    interval.time = *(uint32_t*)(buf + 6);
+    interval.number = _flowtuple_load16(buf + 4);
+    interval.time = _flowtuple_load32(buf + 6);
+
+    /* intervals come in start/end pairs with the same number */
+    if (handle->in_interval && interval.number != handle->interval.number) {
+        handle->errno = FLOWTUPLE_ERR_CORRUPT;
+        return;
+    }
+    handle->in_interval = !handle->in_interval;
 
     record->type = FLOWTUPLE_RECORD_TYPE_INTERVAL;
     record->record.interval = interval;
     handle->last_record = *record;
+    handle->interval = interval;
 }
 
 void _flowtuple_record_read_trailer(flowtuple_handle_t *handle, flowtuple_record_t *record) {
-    uint8_t buf[44];
+    uint8_t *buf;
     flowtuple_trailer_t trailer;
-    int64_t wand;
 
-    wand = wandio_read(handle->io, buf, 44);
-    if (wand == 0) {
-        handle->errno = FLOWTUPLE_ERR_FILE_EOF;
-    } else if (wand < 0) {
-        handle->errno = FLOWTUPLE_ERR_FILE_READ;
+    if ((buf = _flowtuple_reader_next(handle, 44)) == NULL) {
+        return;
     }
 
-    trailer.packet_cnt = *(uint64_t*)(buf + 4);
-    trailer.accepted_cnt = *(uint64_t*)(buf + 12);
-    trailer.dropped_cnt = *(uint64_t*)(buf + 20);
-    trailer.first_packet_time = *(uint32_t*)(buf + 28);
-    trailer.last_packet_time = *(uint32_t*)(buf + 32);
-    trailer.local_final_time = *(uint32_t*)(buf + 36);
-    trailer.runtime = *(uint32_t*)(buf + 40);
+    trailer.packet_cnt = _flowtuple_load64(buf + 4);
+    trailer.accepted_cnt = _flowtuple_load64(buf + 12);
+    trailer.dropped_cnt = _flowtuple_load64(buf + 20);
+    trailer.first_packet_time = _flowtuple_load32(buf + 28);
+    trailer.last_packet_time = _flowtuple_load32(buf + 32);
+    trailer.local_final_time = _flowtuple_load32(buf + 36);
+    trailer.runtime = _flowtuple_load32(buf + 40);
 
     record->type = FLOWTUPLE_RECORD_TYPE_TRAILER;
     record->record.trailer = trailer;
     handle->last_record = *record;
 }
 
-void _flowtuple_record_read_class(flowtuple_handle_t *handle, flowtuple_record_t *record) {
-    flowtuple_class_t ftclass;
-    int is_start;
-    int64_t wand;
-    uint8_t buf[10];
-
-    if (handle->last_record.type == FLOWTUPLE_RECORD_TYPE_FLOWTUPLE_DATA ||
-        (handle->last_record.type == FLOWTUPLE_RECORD_TYPE_FLOWTUPLE_CLASS &&
-         handle->last_record.record.ftclass.is_start)) {
-        is_start = 0;
-        wand = wandio_read(handle->io, buf, 6);
-    } else {
-        is_start = 1;
-        wand = wandio_read(handle->io, buf, 10);
+/* jumps over the tuples left in the current class */
+int _flowtuple_record_skip_class(flowtuple_handle_t *handle) {
+    size_t tuple_size;
+
+    tuple_size = handle->ftclass.magic == FLOWTUPLE_MAGIC_SIXT ? FLOWTUPLE_SIXT_SIZE : FLOWTUPLE_SIXU_SIZE;
+    if (_flowtuple_reader_skip(handle, (uint64_t)(handle->ftclass.key_count_host - handle->number) * tuple_size) < 0) {
+        return -1;
     }
+    handle->number = handle->ftclass.key_count_host;
+    handle->state = FLOWTUPLE_STATE_CLASS_END;
+    return 0;
+}
 
-    if (wand == 0) {
-        handle->errno = FLOWTUPLE_ERR_FILE_EOF;
-    } else if (wand < 0) {
-        handle->errno = FLOWTUPLE_ERR_FILE_READ;
+int _flowtuple_record_read_class(flowtuple_handle_t *handle, flowtuple_record_t *record, int is_start) {
+    flowtuple_class_t ftclass;
+    uint8_t *buf;
+    uint16_t class_type;
+
+    if ((buf = _flowtuple_reader_next(handle, is_start ? 10 : 6)) == NULL) {
+        return -1;
     }
 
-    ftclass.magic = *(uint32_t*)(buf);
-    ftclass.class_type = *(uint16_t*)(buf + 4);
+    ftclass.magic = _flowtuple_load32(buf);
+    ftclass.class_type = _flowtuple_load16(buf + 4);
 
     if (is_start) {
-        ftclass.key_count = *(uint32_t*)(buf + 6);
+        ftclass.key_count = _flowtuple_load32(buf + 6);
     } else {
         ftclass.key_count = 0;
     }
@@ -210,67 +263,235 @@ void _flowtuple_record_read_class(flowtuple_handle_t *handle, flowtuple_record_t
     ftclass.key_count_host = ntohl(ftclass.key_count);
     ftclass.is_start = is_start;
 
+    if (is_start) {
+        if (!handle->in_interval) {
+            handle->errno = FLOWTUPLE_ERR_CORRUPT;
+            return -1;
+        }
+        handle->ftclass = ftclass;
+        handle->number = 0;
+        handle->has_archive_cols = 0;
+        handle->state = ftclass.key_count_host > 0 ? FLOWTUPLE_STATE_TUPLES : FLOWTUPLE_STATE_CLASS_END;
+
+        /* jump over the body of an unwanted class, whose
+         * size is known from its tuple count and magic */
+        class_type = ntohs(ftclass.class_type);
+        handle->skip_class = class_type < 32 && ((handle->class_mask >> class_type) & 1) == 0;
+        if (handle->skip_class) {
+            return _flowtuple_record_skip_class(handle) < 0 ? -1 : 0;
+        }
+
+        /* the statistics of an archived class may rule out all of its tuples */
+        if (handle->archive != NULL && handle->filter != NULL && handle->state == FLOWTUPLE_STATE_TUPLES &&
+            !_flowtuple_archive_may_match(handle->archive, handle->buf_offset + handle->buf_pos, handle->filter) &&
+            _flowtuple_record_skip_class(handle) < 0) {
+            return -1;
+        }
+    } else {
+        /* the class end has to match the class start */
+        if (ftclass.magic != handle->ftclass.magic || ftclass.class_type != handle->ftclass.class_type) {
+            handle->errno = FLOWTUPLE_ERR_CORRUPT;
+            return -1;
+        }
+        handle->state = FLOWTUPLE_STATE_RECORD;
+
+        if (handle->skip_class) {
+            handle->skip_class = 0;
+            return 0;
+        }
+    }
+
     record->type = FLOWTUPLE_RECORD_TYPE_FLOWTUPLE_CLASS;
     record->record.ftclass = ftclass;
     handle->last_record = *record;
+    return 1;
 }
 
-void _flowtuple_record_read_data(flowtuple_handle_t *handle, flowtuple_record_t *record) {
-    uint8_t buf[21];
-    uint32_t magic;
+void _flowtuple_record_decode_data(const uint8_t *buf, uint32_t magic, flowtuple_data_t *data) {
     size_t offset;
-    flowtuple_data_t data;
-    flowtuple_record_t last_record;
-
-    last_record = handle->last_record;
-    if (last_record.type == FLOWTUPLE_RECORD_TYPE_FLOWTUPLE_CLASS) {
-        data.class_start = last_record.record.ftclass;
-        data.number = 1;
-    } else if (last_record.type == FLOWTUPLE_RECORD_TYPE_FLOWTUPLE_DATA) {
-        data.class_start = last_record.record.data.class_start;
-        data.number = last_record.record.data.number + 1;
+
+    data->raw = NULL;
+    data->src_ip = _flowtuple_load32(buf);
+
+    offset = 4;
+    if (magic == FLOWTUPLE_MAGIC_SIXT) {
+        data->has_slash_eight = 1;
+        data->dst_ip.y.b = *(buf + offset);
+        data->dst_ip.y.c = *(buf + offset + 1);
+        data->dst_ip.y.d = *(buf + offset + 2);
+        offset += 3;
     } else {
-        /* this shouldn't happen */
-        handle->errno = FLOWTUPLE_ERR_CORRUPT;
+        data->has_slash_eight = 0;
+        data->dst_ip.x = _flowtuple_load32(buf + offset);
+        offset += 4;
     }
 
-    magic = last_record.record.ftclass.magic;
+    data->src_port = _flowtuple_load16(buf + offset);
+    data->dst_port = _flowtuple_load16(buf + offset + 2);
+    data->proto = *(buf + offset + 4);
+    data->ttl = *(buf + offset + 5);
+    data->tcp_flags = *(buf + offset + 6);
+    data->ip_len = _flowtuple_load16(buf + offset + 7);
+    data->pkt_cnt = _flowtuple_load32(buf + offset + 9);
+}
+
+void _flowtuple_record_data_from_columns(const flowtuple_columns_t *cols, size_t i, uint32_t magic, flowtuple_data_t *data) {
+    data->raw = NULL;
+    data->src_ip = htonl(cols->src_ip[i]);
 
-    if (magic == 0x54584953) {
-        /* SIXT */
-        wandio_read(handle->io, buf, 20);
-    } else if (magic == 0x55584953) {
-        /* SIXU */
-        wandio_read(handle->io, buf, 21);
+    if (magic == FLOWTUPLE_MAGIC_SIXT) {
+        data->has_slash_eight = 1;
+        data->dst_ip.y.b = (uint8_t)(cols->dst_ip[i] >> 16);
+        data->dst_ip.y.c = (uint8_t)(cols->dst_ip[i] >> 8);
+        data->dst_ip.y.d = (uint8_t)(cols->dst_ip[i]);
+    } else {
+        data->has_slash_eight = 0;
+        data->dst_ip.x = htonl(cols->dst_ip[i]);
+    }
+
+    data->src_port = htons(cols->src_port[i]);
+    data->dst_port = htons(cols->dst_port[i]);
+    data->proto = cols->proto[i];
+    data->ttl = cols->ttl[i];
+    data->tcp_flags = cols->tcp_flags[i];
+    data->ip_len = htons(cols->ip_len[i]);
+    data->pkt_cnt = htonl(cols->pkt_cnt[i]);
+}
+
+const flowtuple_columns_t *_flowtuple_record_archive_columns(flowtuple_handle_t *handle) {
+    if (!handle->has_archive_cols) {
+        if (_flowtuple_archive_columns(handle->archive, handle->buf_offset + handle->buf_pos, &(handle->archive_cols)) < 0) {
+            handle->errno = FLOWTUPLE_ERR_CORRUPT;
+            return NULL;
+        }
+        handle->has_archive_cols = 1;
+    }
+    return &(handle->archive_cols);
+}
+
+/* takes the next tuple accepted by the handle's filter straight from the
+ * decoded columns of an archive, instead of from the tuples it rebuilds */
+static int _flowtuple_record_read_archived(flowtuple_handle_t *handle, uint32_t magic, flowtuple_data_t *data) {
+    const flowtuple_columns_t *cols;
+    int s8 = magic == FLOWTUPLE_MAGIC_SIXT;
+    size_t tuple_size = s8 ? FLOWTUPLE_SIXT_SIZE : FLOWTUPLE_SIXU_SIZE;
+    size_t i = handle->number;
+    int found = 0;
+
+    if ((cols = _flowtuple_record_archive_columns(handle)) == NULL) {
+        return -1;
+    }
+
+    while (i < handle->ftclass.key_count_host && !found) {
+        found = handle->filter == NULL || _flowtuple_filter_match_columns(handle->filter, cols, i, s8);
+        i++;
+    }
+    if (found) {
+        _flowtuple_record_data_from_columns(cols, i - 1, magic, data);
+    }
+
+    if (_flowtuple_reader_skip(handle, (i - handle->number) * tuple_size) < 0) {
+        return -1;
+    }
+    handle->number = (uint32_t)i;
+    if (handle->number == handle->ftclass.key_count_host) {
+        handle->state = FLOWTUPLE_STATE_CLASS_END;
+    }
+    return found;
+}
+
+/* consumes tuples up to the next one accepted by the handle's filter and returns it,
+ * returns NULL when the rest of the class was rejected or with the errno set on error */
+static uint8_t *_flowtuple_record_next_tuple(flowtuple_handle_t *handle, uint32_t magic) {
+    size_t tuple_size;
+    uint8_t *buf;
+
+    if (magic == FLOWTUPLE_MAGIC_SIXT) {
+        tuple_size = FLOWTUPLE_SIXT_SIZE;
+    } else if (magic == FLOWTUPLE_MAGIC_SIXU) {
+        tuple_size = FLOWTUPLE_SIXU_SIZE;
     } else {
         /* something's wrong */
         handle->errno = FLOWTUPLE_ERR_WRONG_MAGIC;
+        return NULL;
     }
 
-    data.src_ip = *(uint32_t*)(buf);
+    do {
+        if ((buf = _flowtuple_reader_next(handle, tuple_size)) == NULL) {
+            return NULL;
+        }
 
-    offset = 4;
-    if (magic == 0x54584953) {
-        data.has_slash_eight = 1;
-        data.dst_ip.y.b = *(buf + offset);
-        data.dst_ip.y.c = *(buf + offset + 1);
-        data.dst_ip.y.d = *(buf + offset + 2);
-        offset += 3;
+        if (++handle->number == handle->ftclass.key_count_host) {
+            handle->state = FLOWTUPLE_STATE_CLASS_END;
+        }
+
+        if (handle->filter == NULL ||
+            _flowtuple_filter_match(handle->filter, buf, magic == FLOWTUPLE_MAGIC_SIXT)) {
+            return buf;
+        }
+    } while (handle->state == FLOWTUPLE_STATE_TUPLES);
+
+    return NULL;
+}
+
+int _flowtuple_record_read_data(flowtuple_handle_t *handle, flowtuple_record_t *record) {
+    uint8_t *buf;
+    uint32_t magic;
+    flowtuple_data_t data;
+    int res;
+
+    data.class_start = handle->ftclass;
+    magic = handle->ftclass.magic;
+
+    if (handle->archive != NULL && handle->buf_pos == handle->buf_len) {
+        if ((res = _flowtuple_record_read_archived(handle, magic, &data)) <= 0) {
+            return res;
+        }
+    } else if ((buf = _flowtuple_record_next_tuple(handle, magic)) == NULL) {
+        return handle->errno == FLOWTUPLE_ERR_OK ? 0 : -1;
+    } else if (handle->lazy) {
+        data.raw = buf;
+        data.has_slash_eight = magic == FLOWTUPLE_MAGIC_SIXT;
     } else {
-        data.has_slash_eight = 0;
-        data.dst_ip.x = *(uint32_t*)(buf + offset);
-        offset += 4;
+        _flowtuple_record_decode_data(buf, magic, &data);
     }
 
-    data.src_port = *(uint16_t*)(buf + offset);
-    data.dst_port = *(uint16_t*)(buf + offset + 2);
-    data.proto = *(buf + offset + 4);
-    data.ttl = *(buf + offset + 5);
-    data.tcp_flags = *(buf + offset + 6);
-    data.ip_len = *(uint16_t*)(buf + offset + 7);
-    data.pkt_cnt = *(uint32_t*)(buf + offset + 9);
+    data.number = handle->number;
 
     record->type = FLOWTUPLE_RECORD_TYPE_FLOWTUPLE_DATA;
     record->record.data = data;
     handle->last_record = *record;
+    return 1;
+}
+
+int _flowtuple_record_read_tuple(flowtuple_handle_t *handle, uint32_t magic, flowtuple_tuple_t *tuple) {
+    uint8_t *buf;
+    size_t offset;
+
+    if ((buf = _flowtuple_record_next_tuple(handle, magic)) == NULL) {
+        return handle->errno == FLOWTUPLE_ERR_OK ? 0 : -1;
+    }
+
+    tuple->src_ip = _flowtuple_load32(buf);
+
+    offset = 4;
+    if (magic == FLOWTUPLE_MAGIC_SIXT) {
+        /* same value as flowtuple_data_get_dest_ip */
+        tuple->is_slash_eight = 1;
+        tuple->dst_ip = (buf[offset] << 16) | (buf[offset + 1] << 8) | buf[offset + 2];
+        offset += 3;
+    } else {
+        tuple->is_slash_eight = 0;
+        tuple->dst_ip = _flowtuple_load32(buf + offset);
+        offset += 4;
+    }
+
+    tuple->src_port = _flowtuple_load16(buf + offset);
+    tuple->dst_port = _flowtuple_load16(buf + offset + 2);
+    tuple->proto = *(buf + offset + 4);
+    tuple->ttl = *(buf + offset + 5);
+    tuple->tcp_flags = *(buf + offset + 6);
+    tuple->ip_len = _flowtuple_load16(buf + offset + 7);
+    tuple->pkt_cnt = _flowtuple_load32(buf + offset + 9);
+    return 1;
 }
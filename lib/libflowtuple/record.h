@@ -26,7 +26,20 @@
 void _flowtuple_record_read_interval(flowtuple_handle_t *handle, flowtuple_record_t *record);
 void _flowtuple_record_read_header(flowtuple_handle_t *handle, flowtuple_record_t *record);
 void _flowtuple_record_read_trailer(flowtuple_handle_t *handle, flowtuple_record_t *record);
-void _flowtuple_record_read_class(flowtuple_handle_t *handle, flowtuple_record_t *record);
-void _flowtuple_record_read_data(flowtuple_handle_t *handle, flowtuple_record_t *record);
+int _flowtuple_record_read_class(flowtuple_handle_t *handle, flowtuple_record_t *record, int is_start);
+int _flowtuple_record_skip_class(flowtuple_handle_t *handle);
+int _flowtuple_record_read_data(flowtuple_handle_t *handle, flowtuple_record_t *record);
+void _flowtuple_record_decode_data(const uint8_t *buf, uint32_t magic, flowtuple_data_t *data);
+/* decoded columns of the archived class being read, from its first
+ * tuple, NULL with the errno set if they cannot be decoded */
+const flowtuple_columns_t *_flowtuple_record_archive_columns(flowtuple_handle_t *handle);
+/* fills data with the tuple at index i of host byte order columns */
+void _flowtuple_record_data_from_columns(const flowtuple_columns_t *cols, size_t i, uint32_t magic, flowtuple_data_t *data);
+int _flowtuple_record_read_tuple(flowtuple_handle_t *handle, uint32_t magic, flowtuple_tuple_t *tuple);
+void _flowtuple_record_reset(flowtuple_record_t *record);
+int _flowtuple_record_own(flowtuple_record_t *record);
+void _flowtuple_record_materialize(flowtuple_record_t *record);
+int _flowtuple_read_record(flowtuple_handle_t *handle, flowtuple_record_t *record);
+int _flowtuple_seek(flowtuple_handle_t *handle, uint64_t offset);
 
 #endif
@@ -0,0 +1,503 @@
+/*
+ *  rollup.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+#include <endian.h>
+#include <arpa/inet.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "flowtuple.h"
+#include "fttypes.h"
+#include "util.h"
+
+/* slots probed at once */
+#define GROUP_SIZE 16
+#define CTRL_EMPTY 0x80
+/* slots of a new table */
+#define INITIAL_CAPACITY 4096
+/* tuples keyed and hashed in one go */
+#define CHUNK_SIZE 256
+/* tuples read at once by flowtuple_rollup_read */
+#define READ_SIZE 4096
+
+static inline uint64_t _flowtuple_rollup_hash(const uint64_t *key, uint8_t tcp_flags) {
+    uint64_t h = key[0] * 0x9e3779b97f4a7c15ull ^ (key[1] + 0x632be59bd9b4e019ull) * 0xbf58476d1ce4e5b9ull;
+
+    h ^= (uint64_t)tcp_flags * 0xd6e8feb86659fd93ull;
+    h ^= h >> 31;
+    h *= 0x94d049bb133111ebull;
+    h ^= h >> 29;
+    return h;
+}
+
+/* bits of the slots of the group holding tag, and of its empty slots */
+static inline uint32_t _flowtuple_rollup_match(const uint8_t *ctrl, uint8_t tag, uint32_t *empty) {
+#ifdef __SSE2__
+    __m128i group = _mm_loadu_si128((const __m128i*)ctrl);
+
+    *empty = (uint32_t)_mm_movemask_epi8(group);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)tag)));
+#else
+    uint32_t match = 0;
+
+    *empty = 0;
+    for (int i = 0; i < GROUP_SIZE; i++) {
+        match |= (uint32_t)(ctrl[i] == tag) << i;
+        *empty |= (uint32_t)(ctrl[i] == CTRL_EMPTY) << i;
+    }
+    return match;
+#endif
+}
+
+/* returns the entry of a tuple, or the empty slot it goes in with its
+ * control byte set, the table must have room */
+static flowtuple_rollup_entry_t *_flowtuple_rollup_find(flowtuple_rollup_class_t *cls, const uint64_t *key,
+                                                        uint8_t tcp_flags, uint64_t h, int *found) {
+    size_t mask = cls->capacity / GROUP_SIZE - 1;
+    size_t group = (size_t)(h >> 7) & mask;
+    uint8_t tag = (uint8_t)(h & 0x7f);
+    flowtuple_rollup_entry_t *entry;
+    uint32_t match;
+    uint32_t empty;
+    size_t slot;
+
+    for (;;) {
+        match = _flowtuple_rollup_match(cls->ctrl + group * GROUP_SIZE, tag, &empty);
+        while (match != 0) {
+            slot = group * GROUP_SIZE + (size_t)__builtin_ctz(match);
+            entry = &(cls->entries[slot]);
+            if (entry->key[0] == key[0] && entry->key[1] == key[1] && entry->tcp_flags == tcp_flags) {
+                *found = 1;
+                return entry;
+            }
+            match &= match - 1;
+        }
+
+        if (empty != 0) {
+            slot = group * GROUP_SIZE + (size_t)__builtin_ctz(empty);
+            cls->ctrl[slot] = tag;
+            *found = 0;
+            return &(cls->entries[slot]);
+        }
+        group = (group + 1) & mask;
+    }
+}
+
+static int _flowtuple_rollup_alloc(flowtuple_rollup_class_t *cls, size_t capacity) {
+    MALLOC(cls->ctrl, capacity, return -1);
+    MALLOC(cls->entries, capacity * sizeof(flowtuple_rollup_entry_t), FREE(cls->ctrl); return -1);
+    memset(cls->ctrl, CTRL_EMPTY, capacity);
+    cls->capacity = capacity;
+    return 0;
+}
+
+/* makes room for n more tuples in the table and the columns of a class */
+static int _flowtuple_rollup_reserve(flowtuple_rollup_class_t *cls, size_t n) {
+    flowtuple_rollup_entry_t *entries = cls->entries;
+    uint8_t *ctrl = cls->ctrl;
+    size_t old = cls->capacity;
+    flowtuple_rollup_entry_t *entry;
+    size_t capacity;
+    void *col;
+    int found;
+
+    if (cls->count + n > cls->cols_capacity) {
+        capacity = cls->cols_capacity > 0 ? cls->cols_capacity * 2 : INITIAL_CAPACITY;
+        while (capacity < cls->count + n) {
+            capacity *= 2;
+        }
+
+#define GROW_COLUMN(name) do { \
+            if ((col = realloc(cls->cols.name, capacity * sizeof(*(cls->cols.name)))) == NULL) { \
+                return -1; \
+            } \
+            cls->cols.name = col; \
+        } while (0)
+
+        GROW_COLUMN(src_ip);
+        GROW_COLUMN(dst_ip);
+        GROW_COLUMN(src_port);
+        GROW_COLUMN(dst_port);
+        GROW_COLUMN(proto);
+        GROW_COLUMN(ttl);
+        GROW_COLUMN(tcp_flags);
+        GROW_COLUMN(ip_len);
+        GROW_COLUMN(pkt_cnt);
+#undef GROW_COLUMN
+        cls->cols_capacity = capacity;
+    }
+
+    /* at most 7/8 full, so probes stay short */
+    if (cls->count + n < old - old / 8) {
+        return 0;
+    }
+    capacity = old * 2;
+    while (cls->count + n >= capacity - capacity / 8) {
+        capacity *= 2;
+    }
+
+    if (_flowtuple_rollup_alloc(cls, capacity) < 0) {
+        cls->ctrl = ctrl;
+        cls->entries = entries;
+        cls->capacity = old;
+        return -1;
+    }
+
+    for (size_t i = 0; i < old; i++) {
+        if (ctrl[i] != CTRL_EMPTY) {
+            entry = _flowtuple_rollup_find(cls, entries[i].key, entries[i].tcp_flags,
+                                           _flowtuple_rollup_hash(entries[i].key, entries[i].tcp_flags), &found);
+            *entry = entries[i];
+        }
+    }
+    FREE(ctrl);
+    FREE(entries);
+    return 0;
+}
+
+/* finds the class of the interval being rolled up, adding it if it has not been seen yet */
+static flowtuple_rollup_class_t *_flowtuple_rollup_class(flowtuple_rollup_t *rollup, flowtuple_class_t *ftclass) {
+    flowtuple_magic_t magic = flowtuple_class_get_magic(ftclass);
+    uint16_t class_type = (uint16_t)flowtuple_class_get_class_type(ftclass);
+    flowtuple_rollup_class_t *classes;
+    flowtuple_rollup_class_t *cls;
+    size_t capacity;
+
+    for (size_t i = 0; i < rollup->class_count; i++) {
+        if (rollup->classes[i].magic == magic && rollup->classes[i].class_type == class_type) {
+            return &(rollup->classes[i]);
+        }
+    }
+
+    if (rollup->class_count == rollup->class_capacity) {
+        capacity = rollup->class_capacity > 0 ? rollup->class_capacity * 2 : 4;
+        if ((classes = realloc(rollup->classes, capacity * sizeof(flowtuple_rollup_class_t))) == NULL) {
+            rollup->errno = FLOWTUPLE_ERR_MEM;
+            return NULL;
+        }
+        memset(classes + rollup->class_capacity, 0,
+               (capacity - rollup->class_capacity) * sizeof(flowtuple_rollup_class_t));
+        rollup->classes = classes;
+        rollup->class_capacity = capacity;
+    }
+
+    /* the table and columns of a class of an earlier interval are reused */
+    cls = &(rollup->classes[rollup->class_count]);
+    if (cls->ctrl == NULL && _flowtuple_rollup_alloc(cls, INITIAL_CAPACITY) < 0) {
+        rollup->errno = FLOWTUPLE_ERR_MEM;
+        return NULL;
+    }
+    cls->magic = magic;
+    cls->class_type = class_type;
+    cls->count = 0;
+    rollup->class_count++;
+    return cls;
+}
+
+static int _flowtuple_rollup_add_columns(flowtuple_rollup_t *rollup, flowtuple_rollup_class_t *cls,
+                                         const flowtuple_columns_t *cols, size_t n) {
+    uint64_t keys[CHUNK_SIZE][2];
+    uint64_t hashes[CHUNK_SIZE];
+    flowtuple_rollup_entry_t *entry;
+    size_t group_mask;
+    uint32_t *pkt_cnt;
+    size_t index;
+    size_t m;
+    int found;
+
+    if (_flowtuple_rollup_reserve(cls, n) < 0) {
+        rollup->errno = FLOWTUPLE_ERR_MEM;
+        return -1;
+    }
+    group_mask = cls->capacity / GROUP_SIZE - 1;
+
+    for (size_t base = 0; base < n; base += m) {
+        m = n - base < CHUNK_SIZE ? n - base : CHUNK_SIZE;
+        for (size_t i = 0; i < m; i++) {
+            keys[i][0] = (uint64_t)cols->src_ip[base + i] << 32 | cols->dst_ip[base + i];
+            keys[i][1] = (uint64_t)cols->src_port[base + i] << 48 | (uint64_t)cols->dst_port[base + i] << 32 |
+                         (uint64_t)cols->ip_len[base + i] << 16 | (uint64_t)cols->proto[base + i] << 8 |
+                         cols->ttl[base + i];
+        }
+        for (size_t i = 0; i < m; i++) {
+            hashes[i] = _flowtuple_rollup_hash(keys[i], cols->tcp_flags[base + i]);
+        }
+
+        for (size_t i = 0; i < m; i++) {
+            /* the groups of tuples a little further on are fetched while probing */
+            if (i + 8 < m) {
+                __builtin_prefetch(cls->ctrl + ((size_t)(hashes[i + 8] >> 7) & group_mask) * GROUP_SIZE);
+                __builtin_prefetch(cls->entries + ((size_t)(hashes[i + 8] >> 7) & group_mask) * GROUP_SIZE);
+            }
+
+            entry = _flowtuple_rollup_find(cls, keys[i], cols->tcp_flags[base + i], hashes[i], &found);
+            if (found) {
+                pkt_cnt = &(cls->cols.pkt_cnt[entry->index]);
+                *pkt_cnt = *pkt_cnt > UINT32_MAX - cols->pkt_cnt[base + i] ? UINT32_MAX
+                                                                            : *pkt_cnt + cols->pkt_cnt[base + i];
+                continue;
+            }
+
+            index = cls->count++;
+            entry->key[0] = keys[i][0];
+            entry->key[1] = keys[i][1];
+            entry->tcp_flags = cols->tcp_flags[base + i];
+            entry->index = (uint32_t)index;
+            cls->cols.src_ip[index] = cols->src_ip[base + i];
+            cls->cols.dst_ip[index] = cols->dst_ip[base + i];
+            cls->cols.src_port[index] = cols->src_port[base + i];
+            cls->cols.dst_port[index] = cols->dst_port[base + i];
+            cls->cols.proto[index] = cols->proto[base + i];
+            cls->cols.ttl[index] = cols->ttl[base + i];
+            cls->cols.tcp_flags[index] = cols->tcp_flags[base + i];
+            cls->cols.ip_len[index] = cols->ip_len[base + i];
+            cls->cols.pkt_cnt[index] = cols->pkt_cnt[base + i];
+        }
+    }
+    return 0;
+}
+
+/* writes out the interval being rolled up and empties its classes */
+static int _flowtuple_rollup_flush(flowtuple_rollup_t *rollup) {
+    flowtuple_rollup_class_t *cls;
+    int ret = 0;
+
+    if (!rollup->in_interval) {
+        return 0;
+    }
+
+    if (flowtuple_writer_start_interval(rollup->writer, (uint16_t)rollup->interval_count, rollup->start) < 0) {
+        ret = -1;
+    }
+    for (size_t i = 0; i < rollup->class_count && ret == 0; i++) {
+        cls = &(rollup->classes[i]);
+        if (flowtuple_writer_write_columns(rollup->writer, cls->magic, cls->class_type, &(cls->cols), cls->count) < 0) {
+            ret = -1;
+        }
+        rollup->tuple_count += cls->count;
+    }
+    if (ret == 0 && flowtuple_writer_end_interval(rollup->writer, rollup->end) < 0) {
+        ret = -1;
+    }
+    if (ret < 0) {
+        rollup->errno = flowtuple_writer_errno(rollup->writer);
+        return -1;
+    }
+
+    for (size_t i = 0; i < rollup->class_count; i++) {
+        cls = &(rollup->classes[i]);
+        memset(cls->ctrl, CTRL_EMPTY, cls->capacity);
+        cls->count = 0;
+    }
+    rollup->class_count = 0;
+    rollup->in_interval = 0;
+    rollup->interval_count++;
+    return 0;
+}
+
+/* starts or ends an interval of the file being read */
+static int _flowtuple_rollup_interval(flowtuple_rollup_t *rollup, flowtuple_interval_t *interval, int is_start) {
+    uint32_t time = ntohl(flowtuple_interval_get_time(interval));
+
+    if (!is_start) {
+        rollup->end = time;
+        return 0;
+    }
+
+    if (rollup->in_interval && time - time % rollup->length != rollup->bucket &&
+        _flowtuple_rollup_flush(rollup) < 0) {
+        return -1;
+    }
+    if (!rollup->in_interval) {
+        rollup->in_interval = 1;
+        rollup->bucket = time - time % rollup->length;
+        rollup->start = time;
+    }
+    rollup->end = time;
+    return 0;
+}
+
+static void _flowtuple_rollup_trailer(flowtuple_rollup_t *rollup, flowtuple_trailer_t *trailer) {
+    rollup->packet_cnt += be64toh(flowtuple_trailer_get_packet_count(trailer));
+    rollup->accepted_cnt += be64toh(flowtuple_trailer_get_accepted_count(trailer));
+    rollup->dropped_cnt += be64toh(flowtuple_trailer_get_dropped_count(trailer));
+    if (!rollup->has_trailer) {
+        rollup->first_packet_time = ntohl(flowtuple_trailer_get_first_packet_time(trailer));
+    }
+    rollup->last_packet_time = ntohl(flowtuple_trailer_get_last_packet_time(trailer));
+    rollup->local_final_time = ntohl(flowtuple_trailer_get_local_final_time(trailer));
+    rollup->runtime += ntohl(flowtuple_trailer_get_runtime(trailer));
+    rollup->has_trailer = 1;
+}
+
+flowtuple_rollup_t *flowtuple_rollup_create(flowtuple_writer_t *writer, uint16_t length) {
+    flowtuple_rollup_t *rollup;
+
+    CHECK(writer != NULL && length > 0, return NULL);
+
+    CALLOC(rollup, 1, sizeof(flowtuple_rollup_t), return NULL);
+    rollup->writer = writer;
+    rollup->length = length;
+    flowtuple_writer_set_interval_length(writer, length);
+    return rollup;
+}
+
+void flowtuple_rollup_free(flowtuple_rollup_t *rollup) {
+    CHECK(rollup != NULL, return);
+
+    for (size_t i = 0; i < rollup->class_capacity; i++) {
+        FREE(rollup->classes[i].ctrl);
+        FREE(rollup->classes[i].entries);
+        FREE(rollup->classes[i].cols.src_ip);
+        FREE(rollup->classes[i].cols.dst_ip);
+        FREE(rollup->classes[i].cols.src_port);
+        FREE(rollup->classes[i].cols.dst_port);
+        FREE(rollup->classes[i].cols.proto);
+        FREE(rollup->classes[i].cols.ttl);
+        FREE(rollup->classes[i].cols.tcp_flags);
+        FREE(rollup->classes[i].cols.ip_len);
+        FREE(rollup->classes[i].cols.pkt_cnt);
+    }
+    FREE(rollup->classes);
+    FREE(rollup);
+}
+
+long flowtuple_rollup_read(flowtuple_rollup_t *rollup, flowtuple_handle_t *handle) {
+    flowtuple_rollup_class_t *cls;
+    flowtuple_columns_t cols;
+    flowtuple_batch_t batch;
+    flowtuple_class_t *ftclass;
+    int in_interval = 0;
+    uint8_t *block;
+    long total = 0;
+    long n;
+
+    CHECK(rollup != NULL && handle != NULL, return -1);
+    if (rollup->errno != FLOWTUPLE_ERR_OK) {
+        return -1;
+    }
+
+    /* one block for all columns, widest first */
+    MALLOC(block, READ_SIZE * (3 * sizeof(uint32_t) + 3 * sizeof(uint16_t) + 3 * sizeof(uint8_t)),
+           rollup->errno = FLOWTUPLE_ERR_MEM; return -1);
+    cols.src_ip = (uint32_t*)block;
+    cols.dst_ip = cols.src_ip + READ_SIZE;
+    cols.pkt_cnt = cols.dst_ip + READ_SIZE;
+    cols.src_port = (uint16_t*)(cols.pkt_cnt + READ_SIZE);
+    cols.dst_port = cols.src_port + READ_SIZE;
+    cols.ip_len = cols.dst_port + READ_SIZE;
+    cols.proto = (uint8_t*)(cols.ip_len + READ_SIZE);
+    cols.ttl = cols.proto + READ_SIZE;
+    cols.tcp_flags = cols.ttl + READ_SIZE;
+
+    for (;;) {
+        if ((n = flowtuple_read_columns(handle, &cols, READ_SIZE, &batch)) < 0) {
+            rollup->errno = flowtuple_errno(handle);
+            break;
+        }
+
+        if (n > 0) {
+            /* tuples of a class started before the interval are dropped */
+            if (in_interval && ((cls = _flowtuple_rollup_class(rollup, batch.ftclass)) == NULL ||
+                                _flowtuple_rollup_add_columns(rollup, cls, &cols, (size_t)n) < 0)) {
+                break;
+            }
+            total += n;
+            continue;
+        }
+
+        switch (batch.type) {
+            case FLOWTUPLE_RECORD_TYPE_HEADER:
+                /* the first file gives the header of the roll-up */
+                if (!rollup->has_header) {
+                    if (flowtuple_writer_write_header(rollup->writer, flowtuple_record_get_header(batch.record)) < 0) {
+                        rollup->errno = flowtuple_writer_errno(rollup->writer);
+                    }
+                    rollup->has_header = 1;
+                }
+                break;
+            case FLOWTUPLE_RECORD_TYPE_INTERVAL:
+                in_interval = !in_interval;
+                _flowtuple_rollup_interval(rollup, flowtuple_record_get_interval(batch.record), in_interval);
+                break;
+            case FLOWTUPLE_RECORD_TYPE_FLOWTUPLE_CLASS:
+                /* empty classes are kept */
+                ftclass = flowtuple_record_get_class(batch.record);
+                if (in_interval && ftclass->is_start) {
+                    _flowtuple_rollup_class(rollup, ftclass);
+                }
+                break;
+            case FLOWTUPLE_RECORD_TYPE_TRAILER:
+                _flowtuple_rollup_trailer(rollup, flowtuple_record_get_trailer(batch.record));
+                break;
+            default:
+                break;
+        }
+
+        if (batch.type == FLOWTUPLE_RECORD_TYPE_NULL || rollup->errno != FLOWTUPLE_ERR_OK) {
+            break;
+        }
+    }
+
+    FREE(block);
+    return rollup->errno == FLOWTUPLE_ERR_OK ? total : -1;
+}
+
+int flowtuple_rollup_finish(flowtuple_rollup_t *rollup) {
+    flowtuple_trailer_t trailer;
+
+    CHECK(rollup != NULL, return -1);
+    if (rollup->errno != FLOWTUPLE_ERR_OK || _flowtuple_rollup_flush(rollup) < 0) {
+        return -1;
+    }
+
+    if (rollup->has_trailer) {
+        trailer.packet_cnt = htobe64(rollup->packet_cnt);
+        trailer.accepted_cnt = htobe64(rollup->accepted_cnt);
+        trailer.dropped_cnt = htobe64(rollup->dropped_cnt);
+        trailer.first_packet_time = htonl(rollup->first_packet_time);
+        trailer.last_packet_time = htonl(rollup->last_packet_time);
+        trailer.local_final_time = htonl(rollup->local_final_time);
+        trailer.runtime = htonl(rollup->runtime);
+        if (flowtuple_writer_write_trailer(rollup->writer, &trailer) < 0) {
+            rollup->errno = flowtuple_writer_errno(rollup->writer);
+            return -1;
+        }
+        rollup->has_trailer = 0;
+    }
+    return 0;
+}
+
+uint64_t flowtuple_rollup_get_tuple_count(flowtuple_rollup_t *rollup) {
+    CHECK(rollup != NULL, return 0);
+    return rollup->tuple_count;
+}
+
+uint64_t flowtuple_rollup_get_interval_count(flowtuple_rollup_t *rollup) {
+    CHECK(rollup != NULL, return 0);
+    return rollup->interval_count;
+}
+
+flowtuple_errno_t flowtuple_rollup_errno(flowtuple_rollup_t *rollup) {
+    CHECK(rollup != NULL, return FLOWTUPLE_ERR_OK);
+    return rollup->errno;
+}
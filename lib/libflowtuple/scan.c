@@ -0,0 +1,352 @@
+/*
+ *  scan.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define _GNU_SOURCE /* memmem */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+#include "flowtuple.h"
+#include "flowtuple_inline.h"
+#include "fttypes.h"
+#include "util.h"
+#include "index.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FLOWTUPLE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+/* intervals are written with the corsaro magic in front */
+#define SCAN_MAGIC "EDGRINTR"
+#define SCAN_MAGIC_SIZE 8
+/* prefixed interval record */
+#define SCAN_INTERVAL_SIZE 14
+
+typedef const uint8_t *(*flowtuple_scan_fn)(const uint8_t *, const uint8_t *);
+
+/* part of the file scanned by one thread */
+typedef struct _flowtuple_scan_part_t {
+    const uint8_t *map;
+    uint64_t size;
+    /* intervals starting from lo up to hi are indexed */
+    uint64_t lo;
+    uint64_t hi;
+    /* where the chain of intervals left the part */
+    uint64_t stop;
+    flowtuple_index_t index;
+    flowtuple_errno_t err;
+    pthread_t tid;
+} flowtuple_scan_part_t;
+
+static const uint8_t *_flowtuple_scan_find_scalar(const uint8_t *p, const uint8_t *end) {
+    if (p >= end) {
+        return NULL;
+    }
+    return memmem(p, (size_t)(end - p), SCAN_MAGIC, SCAN_MAGIC_SIZE);
+}
+
+#ifdef FLOWTUPLE_X86_SIMD
+
+/*
+ * Both kernels compare the first and the last byte of the magic with
+ * two loads, 7 bytes apart, and only check the full magic at positions
+ * where both match, which inside tuples is rare.
+ */
+
+__attribute__((target("sse2")))
+static const uint8_t *_flowtuple_scan_find_sse2(const uint8_t *p, const uint8_t *end) {
+    const __m128i first = _mm_set1_epi8(SCAN_MAGIC[0]);
+    const __m128i last = _mm_set1_epi8(SCAN_MAGIC[SCAN_MAGIC_SIZE - 1]);
+    __m128i a;
+    __m128i b;
+    unsigned mask;
+
+    for (; p + 16 + SCAN_MAGIC_SIZE - 1 <= end; p += 16) {
+        a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p), first);
+        b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p + SCAN_MAGIC_SIZE - 1)), last);
+        mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(a, b));
+        while (mask != 0) {
+            if (memcmp(p + __builtin_ctz(mask), SCAN_MAGIC, SCAN_MAGIC_SIZE) == 0) {
+                return p + __builtin_ctz(mask);
+            }
+            mask &= mask - 1;
+        }
+    }
+    return _flowtuple_scan_find_scalar(p, end);
+}
+
+__attribute__((target("avx2")))
+static const uint8_t *_flowtuple_scan_find_avx2(const uint8_t *p, const uint8_t *end) {
+    const __m256i first = _mm256_set1_epi8(SCAN_MAGIC[0]);
+    const __m256i last = _mm256_set1_epi8(SCAN_MAGIC[SCAN_MAGIC_SIZE - 1]);
+    __m256i a;
+    __m256i b;
+    unsigned mask;
+
+    for (; p + 32 + SCAN_MAGIC_SIZE - 1 <= end; p += 32) {
+        a = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)p), first);
+        b = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(p + SCAN_MAGIC_SIZE - 1)), last);
+        mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(a, b));
+        while (mask != 0) {
+            if (memcmp(p + __builtin_ctz(mask), SCAN_MAGIC, SCAN_MAGIC_SIZE) == 0) {
+                return p + __builtin_ctz(mask);
+            }
+            mask &= mask - 1;
+        }
+    }
+    return _flowtuple_scan_find_scalar(p, end);
+}
+
+#endif
+
+static flowtuple_scan_fn _flowtuple_scan_resolve(void) {
+#ifdef FLOWTUPLE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return _flowtuple_scan_find_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        return _flowtuple_scan_find_sse2;
+    }
+#endif
+    return _flowtuple_scan_find_scalar;
+}
+
+/* returns the first interval magic from p to end, NULL if there is none */
+static const uint8_t *_flowtuple_scan_find(const uint8_t *p, const uint8_t *end) {
+    /* resolved once, racing threads store the same pointer */
+    static flowtuple_scan_fn find = NULL;
+
+    if (find == NULL) {
+        find = _flowtuple_scan_resolve();
+    }
+    return find(p, end);
+}
+
+/* walks the interval at offset from class to class by their key counts, adding it
+ * to index unless index is NULL, returns 1 and sets end past the interval end if
+ * it is valid, 0 if it is not, -1 if out of memory */
+static int _flowtuple_scan_interval(const uint8_t *map, uint64_t size, uint64_t offset,
+                                    flowtuple_index_t *index, uint64_t *end) {
+    flowtuple_interval_t interval;
+    flowtuple_class_t ftclass;
+    const uint8_t *p;
+    uint64_t pos = offset + SCAN_INTERVAL_SIZE;
+    uint64_t body;
+
+    if (pos > size || memcmp(map + offset, SCAN_MAGIC, SCAN_MAGIC_SIZE) != 0) {
+        return 0;
+    }
+    interval.number = _flowtuple_load16(map + offset + 8);
+    interval.time = _flowtuple_load32(map + offset + 10);
+
+    if (index != NULL && _flowtuple_index_add_interval(index, offset, &interval) < 0) {
+        return -1;
+    }
+
+    for (;;) {
+        /* the interval end, with the same number */
+        if (pos + SCAN_INTERVAL_SIZE <= size && memcmp(map + pos, SCAN_MAGIC, SCAN_MAGIC_SIZE) == 0) {
+            if (_flowtuple_load16(map + pos + 8) != interval.number) {
+                return 0;
+            }
+            *end = pos + SCAN_INTERVAL_SIZE;
+            if (index != NULL) {
+                index->intervals[index->interval_count - 1].end = *end;
+            }
+            return 1;
+        }
+
+        if (pos + 10 > size) {
+            return 0;
+        }
+        p = map + pos;
+        ftclass.magic = _flowtuple_load32(p);
+        ftclass.class_type = _flowtuple_load16(p + 4);
+        ftclass.key_count = _flowtuple_load32(p + 6);
+        ftclass.key_count_host = ntohl(ftclass.key_count);
+        ftclass.is_start = 1;
+
+        if (ftclass.magic == FLOWTUPLE_MAGIC_SIXT) {
+            body = (uint64_t)ftclass.key_count_host * FLOWTUPLE_SIXT_SIZE;
+        } else if (ftclass.magic == FLOWTUPLE_MAGIC_SIXU) {
+            body = (uint64_t)ftclass.key_count_host * FLOWTUPLE_SIXU_SIZE;
+        } else {
+            return 0;
+        }
+
+        /* the class end repeats the magic and class type */
+        if (pos + 10 + body + 6 > size || memcmp(map + pos + 10 + body, p, 6) != 0) {
+            return 0;
+        }
+
+        if (index != NULL && _flowtuple_index_add_class(index, pos, &ftclass) < 0) {
+            return -1;
+        }
+        pos += 10 + body + 6;
+    }
+}
+
+static void *_flowtuple_scan_part(void *arg) {
+    flowtuple_scan_part_t *part = (flowtuple_scan_part_t*)arg;
+    const uint8_t *map = part->map;
+    const uint8_t *limit;
+    const uint8_t *p = map + part->lo;
+    uint64_t pos = part->hi;
+    uint64_t end;
+    int res;
+
+    /* a candidate only counts when its classes add up */
+    limit = map + (part->hi + SCAN_MAGIC_SIZE - 1 < part->size ? part->hi + SCAN_MAGIC_SIZE - 1 : part->size);
+    while ((p = _flowtuple_scan_find(p, limit)) != NULL) {
+        if (_flowtuple_scan_interval(map, part->size, (uint64_t)(p - map), NULL, &end) > 0) {
+            pos = (uint64_t)(p - map);
+            break;
+        }
+        p++;
+    }
+
+    /* from there on, intervals follow one another */
+    while (pos < part->hi && pos + SCAN_MAGIC_SIZE <= part->size &&
+           memcmp(map + pos, SCAN_MAGIC, SCAN_MAGIC_SIZE) == 0) {
+        if ((res = _flowtuple_scan_interval(map, part->size, pos, &(part->index), &end)) <= 0) {
+            part->err = res < 0 ? FLOWTUPLE_ERR_MEM : FLOWTUPLE_ERR_CORRUPT;
+            break;
+        }
+        pos = end;
+    }
+
+    part->stop = pos;
+    return NULL;
+}
+
+/* appends the intervals and classes of part to index */
+static int _flowtuple_scan_merge(flowtuple_index_t *index, flowtuple_index_t *part) {
+    flowtuple_index_interval_t *intervals;
+    flowtuple_index_class_t *classes;
+    size_t first = index->class_count;
+
+    if (part->interval_count == 0) {
+        return 0;
+    }
+
+    intervals = realloc(index->intervals, (index->interval_count + part->interval_count) * sizeof(flowtuple_index_interval_t));
+    if (intervals == NULL) {
+        return -1;
+    }
+    index->intervals = intervals;
+    index->interval_capacity = index->interval_count + part->interval_count;
+
+    if (part->class_count > 0) {
+        classes = realloc(index->classes, (index->class_count + part->class_count) * sizeof(flowtuple_index_class_t));
+        if (classes == NULL) {
+            return -1;
+        }
+        index->classes = classes;
+        index->class_capacity = index->class_count + part->class_count;
+        memcpy(index->classes + index->class_count, part->classes, part->class_count * sizeof(flowtuple_index_class_t));
+        index->class_count += part->class_count;
+    }
+
+    for (size_t i = 0; i < part->interval_count; i++) {
+        intervals[index->interval_count] = part->intervals[i];
+        intervals[index->interval_count].first_class += first;
+        index->interval_count++;
+    }
+    return 0;
+}
+
+flowtuple_index_t *_flowtuple_index_scan(const uint8_t *map, uint64_t size, int nthreads, flowtuple_errno_t *err) {
+    flowtuple_scan_part_t *parts = NULL;
+    flowtuple_index_t *index = NULL;
+    uint64_t stop = 0;
+    int have_stop = 0;
+    int started;
+    int i;
+
+    if (nthreads < 1) {
+        nthreads = 1;
+    }
+
+    *err = FLOWTUPLE_ERR_MEM;
+    CALLOC(index, 1, sizeof(flowtuple_index_t), return NULL);
+    CALLOC(parts, (size_t)nthreads, sizeof(flowtuple_scan_part_t), goto fail);
+    index->file_size = size;
+    index->length = size;
+
+    for (started = 0; started < nthreads; started++) {
+        parts[started].map = map;
+        parts[started].size = size;
+        parts[started].lo = size * (uint64_t)started / (uint64_t)nthreads;
+        parts[started].hi = size * (uint64_t)(started + 1) / (uint64_t)nthreads;
+        if (pthread_create(&(parts[started].tid), NULL, _flowtuple_scan_part, &(parts[started])) != 0) {
+            break;
+        }
+    }
+    /* parts no thread could be started for are scanned here */
+    for (i = started; i < nthreads; i++) {
+        parts[i].map = map;
+        parts[i].size = size;
+        parts[i].lo = size * (uint64_t)i / (uint64_t)nthreads;
+        parts[i].hi = size * (uint64_t)(i + 1) / (uint64_t)nthreads;
+        _flowtuple_scan_part(&(parts[i]));
+    }
+    for (i = 0; i < started; i++) {
+        pthread_join(parts[i].tid, NULL);
+    }
+
+    *err = FLOWTUPLE_ERR_OK;
+    for (i = 0; i < nthreads; i++) {
+        if (parts[i].err != FLOWTUPLE_ERR_OK && *err == FLOWTUPLE_ERR_OK) {
+            *err = parts[i].err;
+        }
+        if (parts[i].index.interval_count == 0) {
+            continue;
+        }
+
+        /* the chain of the part before has to end where this one starts */
+        if (have_stop && stop != parts[i].index.intervals[0].offset && *err == FLOWTUPLE_ERR_OK) {
+            *err = FLOWTUPLE_ERR_CORRUPT;
+        }
+        stop = parts[i].stop;
+        have_stop = 1;
+
+        if (*err == FLOWTUPLE_ERR_OK && _flowtuple_scan_merge(index, &(parts[i].index)) < 0) {
+            *err = FLOWTUPLE_ERR_MEM;
+        }
+    }
+
+    for (i = 0; i < nthreads; i++) {
+        FREE(parts[i].index.intervals);
+        FREE(parts[i].index.classes);
+    }
+    FREE(parts);
+
+    if (*err != FLOWTUPLE_ERR_OK) {
+        flowtuple_index_free(index);
+        return NULL;
+    }
+    return index;
+
+    fail:
+    flowtuple_index_free(index);
+    return NULL;
+}
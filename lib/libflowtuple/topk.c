@@ -0,0 +1,321 @@
+/*
+ *  topk.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "flowtuple.h"
+#include "fttypes.h"
+#include "util.h"
+
+#define SLOT_EMPTY UINT32_MAX
+
+static inline uint64_t _flowtuple_topk_key(flowtuple_topk_key_t type, uint32_t src_ip, uint16_t dst_port) {
+    switch (type) {
+        case FLOWTUPLE_TOPK_SRC_IP:
+            return src_ip;
+        case FLOWTUPLE_TOPK_DST_PORT:
+            return dst_port;
+        default:
+            return (uint64_t)src_ip << 16 | dst_port;
+    }
+}
+
+static inline size_t _flowtuple_topk_ideal(flowtuple_topk_t *topk, uint64_t key) {
+    return (size_t)((key * 0x9e3779b97f4a7c15ull) >> topk->map_shift);
+}
+
+/* returns the map slot of key, or of the empty slot it would go to */
+static inline size_t _flowtuple_topk_lookup(flowtuple_topk_t *topk, uint64_t key) {
+    size_t slot = _flowtuple_topk_ideal(topk, key);
+
+    while (topk->map[slot].pos != SLOT_EMPTY && topk->map[slot].key != key) {
+        slot = (slot + 1) & topk->map_mask;
+    }
+    return slot;
+}
+
+/* empties a map slot, shifting back the keys probed past it */
+static void _flowtuple_topk_unmap(flowtuple_topk_t *topk, size_t hole) {
+    size_t slot = hole;
+    size_t ideal;
+
+    for (;;) {
+        slot = (slot + 1) & topk->map_mask;
+        if (topk->map[slot].pos == SLOT_EMPTY) {
+            break;
+        }
+        /* a key may only move back if the hole is not before its ideal slot */
+        ideal = _flowtuple_topk_ideal(topk, topk->map[slot].key);
+        if (((slot - ideal) & topk->map_mask) >= ((slot - hole) & topk->map_mask)) {
+            topk->map[hole] = topk->map[slot];
+            topk->heap[topk->map[hole].pos].slot = (uint32_t)hole;
+            hole = slot;
+        }
+    }
+    topk->map[hole].pos = SLOT_EMPTY;
+}
+
+static inline void _flowtuple_topk_swap(flowtuple_topk_t *topk, size_t a, size_t b) {
+    flowtuple_topk_counter_t tmp = topk->heap[a];
+
+    topk->heap[a] = topk->heap[b];
+    topk->heap[b] = tmp;
+    topk->map[topk->heap[a].slot].pos = (uint32_t)a;
+    topk->map[topk->heap[b].slot].pos = (uint32_t)b;
+}
+
+static void _flowtuple_topk_sift_down(flowtuple_topk_t *topk, size_t i) {
+    flowtuple_topk_counter_t *heap = topk->heap;
+    size_t child;
+
+    while ((child = 2 * i + 1) < topk->size) {
+        if (child + 1 < topk->size && heap[child + 1].count < heap[child].count) {
+            child++;
+        }
+        if (heap[child].count >= heap[i].count) {
+            break;
+        }
+        _flowtuple_topk_swap(topk, i, child);
+        i = child;
+    }
+}
+
+static void _flowtuple_topk_sift_up(flowtuple_topk_t *topk, size_t i) {
+    size_t parent;
+
+    while (i > 0 && topk->heap[i].count < topk->heap[parent = (i - 1) / 2].count) {
+        _flowtuple_topk_swap(topk, i, parent);
+        i = parent;
+    }
+}
+
+/* adds a counter for a key missing from the sketch */
+static void _flowtuple_topk_push(flowtuple_topk_t *topk, uint64_t key, uint64_t count, uint64_t error, size_t slot) {
+    size_t pos = topk->size++;
+
+    topk->map[slot].key = key;
+    topk->map[slot].pos = (uint32_t)pos;
+    topk->heap[pos].key = key;
+    topk->heap[pos].count = count;
+    topk->heap[pos].error = error;
+    topk->heap[pos].slot = (uint32_t)slot;
+    _flowtuple_topk_sift_up(topk, pos);
+}
+
+static inline void _flowtuple_topk_update(flowtuple_topk_t *topk, uint64_t key, uint64_t weight) {
+    flowtuple_topk_counter_t *min;
+    size_t slot = _flowtuple_topk_lookup(topk, key);
+    size_t pos;
+
+    topk->total += weight;
+
+    if (topk->map[slot].pos != SLOT_EMPTY) {
+        pos = topk->map[slot].pos;
+        topk->heap[pos].count += weight;
+        _flowtuple_topk_sift_down(topk, pos);
+        return;
+    }
+
+    if (topk->size < topk->capacity) {
+        _flowtuple_topk_push(topk, key, weight, 0, slot);
+        return;
+    }
+
+    /* the key takes over the smallest counter, which bounds how
+     * much weight it may have had before, and the key it held
+     * leaves the map, which can move the slot of the new one */
+    min = &(topk->heap[0]);
+    _flowtuple_topk_unmap(topk, min->slot);
+    slot = _flowtuple_topk_lookup(topk, key);
+    topk->map[slot].key = key;
+    topk->map[slot].pos = 0;
+    min->key = key;
+    min->error = min->count;
+    min->count += weight;
+    min->slot = (uint32_t)slot;
+    _flowtuple_topk_sift_down(topk, 0);
+}
+
+flowtuple_topk_t *flowtuple_topk_create(flowtuple_topk_key_t key, size_t capacity) {
+    flowtuple_topk_t *topk;
+    size_t map_size = 1;
+    int bits = 0;
+
+    CHECK(key <= FLOWTUPLE_TOPK_SRC_IP_DST_PORT && capacity > 0 && capacity < SLOT_EMPTY / 2, return NULL);
+
+    while (map_size < capacity * 2) {
+        map_size *= 2;
+        bits++;
+    }
+
+    CALLOC(topk, 1, sizeof(flowtuple_topk_t), return NULL);
+    topk->type = key;
+    topk->capacity = capacity;
+    topk->map_mask = map_size - 1;
+    /* the top bits of the multiplied key pick the slot */
+    topk->map_shift = 64 - (bits > 0 ? bits : 1);
+    CALLOC(topk->heap, capacity, sizeof(flowtuple_topk_counter_t), goto nomem);
+    MALLOC(topk->map, map_size * sizeof(flowtuple_topk_slot_t), goto nomem);
+    flowtuple_topk_reset(topk);
+    return topk;
+
+    nomem:
+    flowtuple_topk_free(topk);
+    return NULL;
+}
+
+void flowtuple_topk_free(flowtuple_topk_t *topk) {
+    CHECK(topk != NULL, return);
+    FREE(topk->heap);
+    FREE(topk->map);
+    FREE(topk);
+}
+
+void flowtuple_topk_reset(flowtuple_topk_t *topk) {
+    CHECK(topk != NULL, return);
+
+    for (size_t i = 0; i <= topk->map_mask; i++) {
+        topk->map[i].pos = SLOT_EMPTY;
+    }
+    topk->size = 0;
+    topk->total = 0;
+}
+
+void flowtuple_topk_add_data(flowtuple_topk_t *topk, flowtuple_data_t *data) {
+    CHECK(topk != NULL && data != NULL, return);
+
+    /* data getters are in network byte order */
+    _flowtuple_topk_update(topk, _flowtuple_topk_key(topk->type, ntohl(flowtuple_data_get_src_ip(data)),
+                                                     ntohs(flowtuple_data_get_dest_port(data))),
+                           ntohl(flowtuple_data_get_packet_count(data)));
+}
+
+void flowtuple_topk_add_columns(flowtuple_topk_t *topk, const flowtuple_columns_t *cols, size_t n) {
+    CHECK(topk != NULL && cols != NULL, return);
+
+    for (size_t i = 0; i < n; i++) {
+        _flowtuple_topk_update(topk, _flowtuple_topk_key(topk->type, cols->src_ip[i], cols->dst_port[i]), cols->pkt_cnt[i]);
+    }
+}
+
+static int _flowtuple_topk_cmp(const void *a, const void *b) {
+    const flowtuple_topk_counter_t *ca = (const flowtuple_topk_counter_t*)a;
+    const flowtuple_topk_counter_t *cb = (const flowtuple_topk_counter_t*)b;
+
+    if (ca->count != cb->count) {
+        return ca->count < cb->count ? 1 : -1;
+    }
+    return ca->key < cb->key ? -1 : ca->key > cb->key;
+}
+
+int flowtuple_topk_merge(flowtuple_topk_t *dst, flowtuple_topk_t *src) {
+    flowtuple_topk_counter_t *merged;
+    uint64_t dst_min;
+    uint64_t src_min;
+    size_t count = 0;
+    size_t slot;
+    size_t pos;
+
+    CHECK(dst != NULL && src != NULL && dst != src && dst->type == src->type && dst->capacity == src->capacity, return -1);
+    MALLOC(merged, (dst->size + src->size) * sizeof(flowtuple_topk_counter_t) + 1, return -1);
+
+    /* a key missing from a full sketch may have had up to its smallest count */
+    dst_min = dst->size == dst->capacity ? dst->heap[0].count : 0;
+    src_min = src->size == src->capacity ? src->heap[0].count : 0;
+
+    for (size_t i = 0; i < dst->size; i++) {
+        merged[count] = dst->heap[i];
+        slot = _flowtuple_topk_lookup(src, dst->heap[i].key);
+        if (src->map[slot].pos != SLOT_EMPTY) {
+            pos = src->map[slot].pos;
+            merged[count].count += src->heap[pos].count;
+            merged[count].error += src->heap[pos].error;
+        } else {
+            merged[count].count += src_min;
+            merged[count].error += src_min;
+        }
+        count++;
+    }
+    for (size_t i = 0; i < src->size; i++) {
+        slot = _flowtuple_topk_lookup(dst, src->heap[i].key);
+        if (dst->map[slot].pos == SLOT_EMPTY) {
+            merged[count] = src->heap[i];
+            merged[count].count += dst_min;
+            merged[count].error += dst_min;
+            count++;
+        }
+    }
+
+    /* the heaviest counters are kept */
+    qsort(merged, count, sizeof(flowtuple_topk_counter_t), _flowtuple_topk_cmp);
+    if (count > dst->capacity) {
+        count = dst->capacity;
+    }
+
+    for (size_t i = 0; i <= dst->map_mask; i++) {
+        dst->map[i].pos = SLOT_EMPTY;
+    }
+    dst->size = 0;
+    for (size_t i = 0; i < count; i++) {
+        _flowtuple_topk_push(dst, merged[i].key, merged[i].count, merged[i].error,
+                             _flowtuple_topk_lookup(dst, merged[i].key));
+    }
+    dst->total += src->total;
+
+    FREE(merged);
+    return 0;
+}
+
+size_t flowtuple_topk_get(flowtuple_topk_t *topk, flowtuple_topk_item_t *items, size_t k) {
+    flowtuple_topk_counter_t *sorted;
+    size_t n;
+
+    CHECK(topk != NULL && items != NULL, return 0);
+    MALLOC(sorted, topk->size * sizeof(flowtuple_topk_counter_t) + 1, return 0);
+    memcpy(sorted, topk->heap, topk->size * sizeof(flowtuple_topk_counter_t));
+    qsort(sorted, topk->size, sizeof(flowtuple_topk_counter_t), _flowtuple_topk_cmp);
+
+    n = k < topk->size ? k : topk->size;
+    for (size_t i = 0; i < n; i++) {
+        items[i].src_ip = 0;
+        items[i].dst_port = 0;
+        switch (topk->type) {
+            case FLOWTUPLE_TOPK_SRC_IP:
+                items[i].src_ip = (uint32_t)sorted[i].key;
+                break;
+            case FLOWTUPLE_TOPK_DST_PORT:
+                items[i].dst_port = (uint16_t)sorted[i].key;
+                break;
+            default:
+                items[i].src_ip = (uint32_t)(sorted[i].key >> 16);
+                items[i].dst_port = (uint16_t)sorted[i].key;
+        }
+        items[i].count = sorted[i].count;
+        items[i].error = sorted[i].error;
+    }
+
+    FREE(sorted);
+    return n;
+}
+
+uint64_t flowtuple_topk_get_total(flowtuple_topk_t *topk) {
+    CHECK(topk != NULL, return 0);
+    return topk->total;
+}
@@ -19,35 +19,29 @@
 
 #include <string.h>
 
-#include <wandio.h>
-
 #include "util.h"
 #include "fttypes.h"
+#include "reader.h"
 
 int _flowtuple_check_magic(flowtuple_handle_t *handle) {
-    char buf[5];
+    uint8_t *buf;
     int ret;
-    int64_t peek;
 
-    buf[4] = '\0';
-    if ((peek = wandio_peek(handle->io, buf, 4)) == 0) {
-        ret = -1; /* EOF */
-    } else if (peek < 0) {
-        handle->errno = FLOWTUPLE_ERR_FILE_READ;
-        ret = -1;
-    } else if (strcmp(buf, "EDGR") == 0) {
+    if ((buf = _flowtuple_reader_peek(handle, 4)) == NULL) {
+        ret = -1; /* EOF or read error */
+    } else if (memcmp(buf, "EDGR", 4) == 0) {
         ret = 1;
-    } else if (strcmp(buf, "INTR") == 0) {
+    } else if (memcmp(buf, "INTR", 4) == 0) {
         ret = 2;
-    } else if (strcmp(buf, "HEAD") == 0) {
+    } else if (memcmp(buf, "HEAD", 4) == 0) {
         ret = 3;
-    } else if (strcmp(buf, "FOOT") == 0) {
+    } else if (memcmp(buf, "FOOT", 4) == 0) {
         ret = 4;
-    } else if (strcmp(buf, "SIXT") == 0) {
+    } else if (memcmp(buf, "SIXT", 4) == 0) {
         ret = 5;
-    } else if (strcmp(buf, "SIXU") == 0) {
+    } else if (memcmp(buf, "SIXU", 4) == 0) {
         ret = 6;
-    } else if (strcmp(buf, "DATA") == 0) {
+    } else if (memcmp(buf, "DATA", 4) == 0) {
         ret = 7;
     } else {
         ret = 0;
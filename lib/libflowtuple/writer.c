@@ -0,0 +1,453 @@
+/*
+ *  writer.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+#include <arpa/inet.h>
+
+#include <wandio.h>
+
+#include "flowtuple.h"
+#include "fttypes.h"
+#include "util.h"
+#include "writer.h"
+
+/* corsaro magics, as written in the file */
+#define MAGIC_EDGR "EDGR"
+#define MAGIC_HEAD "HEAD"
+#define MAGIC_INTR "INTR"
+#define MAGIC_FOOT "FOOT"
+
+/* size of the buffer of a class the first time it is used */
+#define CLASS_BUFFER_SIZE 65536
+
+static int _flowtuple_writer_write(flowtuple_writer_t *writer, const void *buf, size_t len) {
+    if (writer->errno != FLOWTUPLE_ERR_OK) {
+        return -1;
+    }
+
+    if (len > 0 && wandio_wwrite(writer->iow, buf, (int64_t)len) != (int64_t)len) {
+        writer->errno = FLOWTUPLE_ERR_FILE_WRITE;
+        return -1;
+    }
+    return 0;
+}
+
+/* fails with FLOWTUPLE_ERR_CORRUPT unless the writer is in or out of an interval as expected */
+static int _flowtuple_writer_expect(flowtuple_writer_t *writer, int in_interval) {
+    if (writer->errno != FLOWTUPLE_ERR_OK) {
+        return -1;
+    }
+
+    if (writer->in_interval != in_interval) {
+        writer->errno = FLOWTUPLE_ERR_CORRUPT;
+        return -1;
+    }
+    return 0;
+}
+
+flowtuple_writer_t *flowtuple_writer_create(const char *filename, int compress_type, int compress_level,
+                                            flowtuple_errno_t *err) {
+    flowtuple_writer_t *writer;
+
+    *err = FLOWTUPLE_ERR_FILE_OPEN;
+    CHECK(filename != NULL, return NULL);
+
+    *err = FLOWTUPLE_ERR_MEM;
+    CALLOC(writer, 1, sizeof(flowtuple_writer_t), return NULL);
+
+    if ((writer->iow = wandio_wcreate(filename, compress_type, compress_level, 0)) == NULL) {
+        *err = FLOWTUPLE_ERR_FILE_OPEN;
+        FREE(writer);
+        return NULL;
+    }
+
+    *err = FLOWTUPLE_ERR_OK;
+    return writer;
+}
+
+/* finds the class of an interval, adding it if it has not been seen yet */
+static flowtuple_writer_class_t *_flowtuple_writer_class(flowtuple_writer_t *writer, uint32_t magic,
+                                                         uint16_t class_type) {
+    flowtuple_writer_class_t *classes;
+    flowtuple_writer_class_t *cls;
+    size_t capacity;
+
+    if (magic != FLOWTUPLE_MAGIC_SIXT && magic != FLOWTUPLE_MAGIC_SIXU) {
+        writer->errno = FLOWTUPLE_ERR_WRONG_MAGIC;
+        return NULL;
+    }
+
+    for (size_t i = 0; i < writer->class_count; i++) {
+        if (writer->classes[i].magic == magic && writer->classes[i].class_type == class_type) {
+            return &(writer->classes[i]);
+        }
+    }
+
+    if (writer->class_count == writer->class_capacity) {
+        capacity = writer->class_capacity > 0 ? writer->class_capacity * 2 : 4;
+        if ((classes = realloc(writer->classes, capacity * sizeof(flowtuple_writer_class_t))) == NULL) {
+            writer->errno = FLOWTUPLE_ERR_MEM;
+            return NULL;
+        }
+        memset(classes + writer->class_capacity, 0,
+               (capacity - writer->class_capacity) * sizeof(flowtuple_writer_class_t));
+        writer->classes = classes;
+        writer->class_capacity = capacity;
+    }
+
+    /* the buffer of a class of an earlier interval is reused */
+    cls = &(writer->classes[writer->class_count++]);
+    cls->magic = magic;
+    cls->class_type = class_type;
+    cls->count = 0;
+    cls->len = 0;
+    return cls;
+}
+
+/* returns room for n more tuples at the end of a class buffer */
+static uint8_t *_flowtuple_writer_reserve(flowtuple_writer_t *writer, flowtuple_writer_class_t *cls, size_t n) {
+    size_t tuple_size = cls->magic == FLOWTUPLE_MAGIC_SIXT ? FLOWTUPLE_SIXT_SIZE : FLOWTUPLE_SIXU_SIZE;
+    size_t capacity;
+    uint8_t *buf;
+
+    if ((uint64_t)cls->count + n > UINT32_MAX) {
+        /* too many tuples for the count of a class start */
+        writer->errno = FLOWTUPLE_ERR_CORRUPT;
+        return NULL;
+    }
+
+    if (cls->len + n * tuple_size > cls->capacity) {
+        capacity = cls->capacity > 0 ? cls->capacity : CLASS_BUFFER_SIZE;
+        while (capacity < cls->len + n * tuple_size) {
+            capacity *= 2;
+        }
+        if ((buf = realloc(cls->buf, capacity)) == NULL) {
+            writer->errno = FLOWTUPLE_ERR_MEM;
+            return NULL;
+        }
+        cls->buf = buf;
+        cls->capacity = capacity;
+    }
+
+    buf = cls->buf + cls->len;
+    cls->len += n * tuple_size;
+    cls->count += (uint32_t)n;
+    writer->tuple_count += n;
+    return buf;
+}
+
+size_t _flowtuple_writer_pack_header(flowtuple_header_t *header, uint16_t interval_length, uint8_t *buf) {
+    size_t traceuri_len = header->traceuri != NULL ? ntohs(header->traceuri_len) : 0;
+    size_t size = 20 + traceuri_len + (size_t)header->plugin_cnt * 4;
+    uint16_t plugin_cnt;
+
+    if (buf == NULL) {
+        return size;
+    }
+
+    memcpy(buf, MAGIC_EDGR, 4);
+    memcpy(buf + 4, MAGIC_HEAD, 4);
+    buf[8] = header->version_major;
+    buf[9] = header->version_minor;
+    memcpy(buf + 10, &(header->local_init_time), 4);
+    memcpy(buf + 14, interval_length != 0 ? &interval_length : &(header->interval_length), 2);
+
+    /* the trace uri goes without its terminator */
+    memcpy(buf + 16, &(header->traceuri_len), 2);
+    if (traceuri_len > 0) {
+        memcpy(buf + 18, header->traceuri, traceuri_len);
+    }
+
+    plugin_cnt = htons(header->plugin_cnt);
+    memcpy(buf + 18 + traceuri_len, &plugin_cnt, 2);
+    if (header->plugin_cnt > 0) {
+        memcpy(buf + 20 + traceuri_len, header->plugins, (size_t)header->plugin_cnt * 4);
+    }
+    return size;
+}
+
+int flowtuple_writer_write_header(flowtuple_writer_t *writer, flowtuple_header_t *header) {
+    uint8_t *buf;
+    size_t size;
+    int ret;
+
+    CHECK(writer != NULL && header != NULL, return -1);
+    if (_flowtuple_writer_expect(writer, 0) < 0) {
+        return -1;
+    }
+
+    size = _flowtuple_writer_pack_header(header, writer->interval_length, NULL);
+    MALLOC(buf, size, writer->errno = FLOWTUPLE_ERR_MEM; return -1);
+    _flowtuple_writer_pack_header(header, writer->interval_length, buf);
+    ret = _flowtuple_writer_write(writer, buf, size);
+    FREE(buf);
+    return ret;
+}
+
+void _flowtuple_writer_pack_interval(uint16_t number, uint32_t time, uint8_t *buf) {
+    memcpy(buf, MAGIC_EDGR, 4);
+    memcpy(buf + 4, MAGIC_INTR, 4);
+    memcpy(buf + 8, &number, 2);
+    memcpy(buf + 10, &time, 4);
+}
+
+/* writes an interval record with values in network byte order */
+static int _flowtuple_writer_write_interval(flowtuple_writer_t *writer, uint16_t number, uint32_t time) {
+    uint8_t buf[FLOWTUPLE_INTERVAL_SIZE];
+
+    _flowtuple_writer_pack_interval(number, time, buf);
+    return _flowtuple_writer_write(writer, buf, FLOWTUPLE_INTERVAL_SIZE);
+}
+
+static int _flowtuple_writer_start_interval(flowtuple_writer_t *writer, uint16_t number, uint32_t time) {
+    if (_flowtuple_writer_expect(writer, 0) < 0 || _flowtuple_writer_write_interval(writer, number, time) < 0) {
+        return -1;
+    }
+
+    writer->in_interval = 1;
+    writer->number = number;
+    writer->class_count = 0;
+    return 0;
+}
+
+static int _flowtuple_writer_end_interval(flowtuple_writer_t *writer, uint32_t time) {
+    flowtuple_writer_class_t *cls;
+    uint8_t buf[10];
+    uint32_t count;
+
+    if (_flowtuple_writer_expect(writer, 1) < 0) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < writer->class_count; i++) {
+        cls = &(writer->classes[i]);
+        count = htonl(cls->count);
+        memcpy(buf, &(cls->magic), 4);
+        memcpy(buf + 4, &(cls->class_type), 2);
+        memcpy(buf + 6, &count, 4);
+
+        /* the class end is the class start without its count */
+        if (_flowtuple_writer_write(writer, buf, 10) < 0 || _flowtuple_writer_write(writer, cls->buf, cls->len) < 0 ||
+            _flowtuple_writer_write(writer, buf, 6) < 0) {
+            return -1;
+        }
+    }
+
+    if (_flowtuple_writer_write_interval(writer, writer->number, time) < 0) {
+        return -1;
+    }
+    writer->in_interval = 0;
+    writer->class_count = 0;
+    return 0;
+}
+
+int flowtuple_writer_start_interval(flowtuple_writer_t *writer, uint16_t number, uint32_t time) {
+    CHECK(writer != NULL, return -1);
+    return _flowtuple_writer_start_interval(writer, htons(number), htonl(time));
+}
+
+int flowtuple_writer_end_interval(flowtuple_writer_t *writer, uint32_t time) {
+    CHECK(writer != NULL, return -1);
+    return _flowtuple_writer_end_interval(writer, htonl(time));
+}
+
+int flowtuple_writer_write_data(flowtuple_writer_t *writer, flowtuple_data_t *data) {
+    flowtuple_writer_class_t *cls;
+    uint8_t *buf;
+    size_t offset;
+
+    CHECK(writer != NULL && data != NULL, return -1);
+    if (_flowtuple_writer_expect(writer, 1) < 0 ||
+        (cls = _flowtuple_writer_class(writer, data->class_start.magic, data->class_start.class_type)) == NULL ||
+        (buf = _flowtuple_writer_reserve(writer, cls, 1)) == NULL) {
+        return -1;
+    }
+
+    /* a lazy tuple is still packed */
+    if (data->raw != NULL) {
+        memcpy(buf, data->raw, cls->magic == FLOWTUPLE_MAGIC_SIXT ? FLOWTUPLE_SIXT_SIZE : FLOWTUPLE_SIXU_SIZE);
+        return 0;
+    }
+
+    memcpy(buf, &(data->src_ip), 4);
+    offset = 4;
+    if (cls->magic == FLOWTUPLE_MAGIC_SIXT) {
+        buf[offset] = data->dst_ip.y.b;
+        buf[offset + 1] = data->dst_ip.y.c;
+        buf[offset + 2] = data->dst_ip.y.d;
+        offset += 3;
+    } else {
+        memcpy(buf + offset, &(data->dst_ip.x), 4);
+        offset += 4;
+    }
+
+    memcpy(buf + offset, &(data->src_port), 2);
+    memcpy(buf + offset + 2, &(data->dst_port), 2);
+    buf[offset + 4] = data->proto;
+    buf[offset + 5] = data->ttl;
+    buf[offset + 6] = data->tcp_flags;
+    memcpy(buf + offset + 7, &(data->ip_len), 2);
+    memcpy(buf + offset + 9, &(data->pkt_cnt), 4);
+    return 0;
+}
+
+static inline void _flowtuple_writer_put16(uint8_t *buf, uint16_t v) {
+    buf[0] = (uint8_t)(v >> 8);
+    buf[1] = (uint8_t)v;
+}
+
+static inline void _flowtuple_writer_put32(uint8_t *buf, uint32_t v) {
+    buf[0] = (uint8_t)(v >> 24);
+    buf[1] = (uint8_t)(v >> 16);
+    buf[2] = (uint8_t)(v >> 8);
+    buf[3] = (uint8_t)v;
+}
+
+void _flowtuple_writer_pack_columns(const flowtuple_columns_t *cols, size_t n, uint32_t magic, uint8_t *buf) {
+    size_t tuple_size = magic == FLOWTUPLE_MAGIC_SIXT ? FLOWTUPLE_SIXT_SIZE : FLOWTUPLE_SIXU_SIZE;
+    size_t offset;
+
+    for (size_t i = 0; i < n; i++, buf += tuple_size) {
+        _flowtuple_writer_put32(buf, cols->src_ip[i]);
+        if (magic == FLOWTUPLE_MAGIC_SIXT) {
+            buf[4] = (uint8_t)(cols->dst_ip[i] >> 16);
+            buf[5] = (uint8_t)(cols->dst_ip[i] >> 8);
+            buf[6] = (uint8_t)cols->dst_ip[i];
+            offset = 7;
+        } else {
+            _flowtuple_writer_put32(buf + 4, cols->dst_ip[i]);
+            offset = 8;
+        }
+
+        _flowtuple_writer_put16(buf + offset, cols->src_port[i]);
+        _flowtuple_writer_put16(buf + offset + 2, cols->dst_port[i]);
+        buf[offset + 4] = cols->proto[i];
+        buf[offset + 5] = cols->ttl[i];
+        buf[offset + 6] = cols->tcp_flags[i];
+        _flowtuple_writer_put16(buf + offset + 7, cols->ip_len[i]);
+        _flowtuple_writer_put32(buf + offset + 9, cols->pkt_cnt[i]);
+    }
+}
+
+int flowtuple_writer_write_columns(flowtuple_writer_t *writer, flowtuple_magic_t magic, uint16_t class_type,
+                                   const flowtuple_columns_t *cols, size_t n) {
+    flowtuple_writer_class_t *cls;
+    uint8_t *buf;
+
+    CHECK(writer != NULL && cols != NULL, return -1);
+    if (_flowtuple_writer_expect(writer, 1) < 0 ||
+        (cls = _flowtuple_writer_class(writer, (uint32_t)magic, htons(class_type))) == NULL ||
+        (buf = _flowtuple_writer_reserve(writer, cls, n)) == NULL) {
+        return -1;
+    }
+
+    _flowtuple_writer_pack_columns(cols, n, (uint32_t)magic, buf);
+    return 0;
+}
+
+void _flowtuple_writer_pack_trailer(flowtuple_trailer_t *trailer, uint8_t *buf) {
+    memcpy(buf, MAGIC_EDGR, 4);
+    memcpy(buf + 4, MAGIC_FOOT, 4);
+    memcpy(buf + 8, &(trailer->packet_cnt), 8);
+    memcpy(buf + 16, &(trailer->accepted_cnt), 8);
+    memcpy(buf + 24, &(trailer->dropped_cnt), 8);
+    memcpy(buf + 32, &(trailer->first_packet_time), 4);
+    memcpy(buf + 36, &(trailer->last_packet_time), 4);
+    memcpy(buf + 40, &(trailer->local_final_time), 4);
+    memcpy(buf + 44, &(trailer->runtime), 4);
+}
+
+int flowtuple_writer_write_trailer(flowtuple_writer_t *writer, flowtuple_trailer_t *trailer) {
+    uint8_t buf[FLOWTUPLE_TRAILER_SIZE];
+
+    CHECK(writer != NULL && trailer != NULL, return -1);
+    if (_flowtuple_writer_expect(writer, 0) < 0) {
+        return -1;
+    }
+
+    _flowtuple_writer_pack_trailer(trailer, buf);
+    return _flowtuple_writer_write(writer, buf, FLOWTUPLE_TRAILER_SIZE);
+}
+
+int flowtuple_writer_write_record(flowtuple_writer_t *writer, flowtuple_record_t *record) {
+    flowtuple_class_t *ftclass;
+
+    CHECK(writer != NULL && record != NULL, return -1);
+
+    switch (record->type) {
+        case FLOWTUPLE_RECORD_TYPE_HEADER:
+            return flowtuple_writer_write_header(writer, &(record->record.header));
+        case FLOWTUPLE_RECORD_TYPE_INTERVAL:
+            if (writer->in_interval) {
+                return _flowtuple_writer_end_interval(writer, record->record.interval.time);
+            }
+            return _flowtuple_writer_start_interval(writer, record->record.interval.number,
+                                                    record->record.interval.time);
+        case FLOWTUPLE_RECORD_TYPE_TRAILER:
+            return flowtuple_writer_write_trailer(writer, &(record->record.trailer));
+        case FLOWTUPLE_RECORD_TYPE_FLOWTUPLE_CLASS:
+            ftclass = &(record->record.ftclass);
+            if (_flowtuple_writer_expect(writer, 1) < 0 ||
+                (ftclass->is_start && _flowtuple_writer_class(writer, ftclass->magic, ftclass->class_type) == NULL)) {
+                return -1;
+            }
+            return 0;
+        case FLOWTUPLE_RECORD_TYPE_FLOWTUPLE_DATA:
+            return flowtuple_writer_write_data(writer, &(record->record.data));
+        default:
+            if (writer->errno == FLOWTUPLE_ERR_OK) {
+                writer->errno = FLOWTUPLE_ERR_CORRUPT;
+            }
+            return -1;
+    }
+}
+
+flowtuple_errno_t flowtuple_writer_close(flowtuple_writer_t *writer) {
+    flowtuple_errno_t err;
+
+    CHECK(writer != NULL, return FLOWTUPLE_ERR_OK);
+
+    err = writer->errno;
+    if (err == FLOWTUPLE_ERR_OK && writer->in_interval) {
+        err = FLOWTUPLE_ERR_CORRUPT;
+    }
+
+    wandio_wdestroy(writer->iow);
+    for (size_t i = 0; i < writer->class_capacity; i++) {
+        FREE(writer->classes[i].buf);
+    }
+    FREE(writer->classes);
+    FREE(writer);
+    return err;
+}
+
+void flowtuple_writer_set_interval_length(flowtuple_writer_t *writer, uint16_t interval_length) {
+    CHECK(writer != NULL, return);
+    writer->interval_length = htons(interval_length);
+}
+
+uint64_t flowtuple_writer_get_tuple_count(flowtuple_writer_t *writer) {
+    CHECK(writer != NULL, return 0);
+    return writer->tuple_count;
+}
+
+flowtuple_errno_t flowtuple_writer_errno(flowtuple_writer_t *writer) {
+    CHECK(writer != NULL, return FLOWTUPLE_ERR_OK);
+    return writer->errno;
+}
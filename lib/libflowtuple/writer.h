@@ -0,0 +1,41 @@
+/*
+ *  writer.h
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stddef.h>
+#include <inttypes.h>
+
+#include "flowtuple.h"
+#include "fttypes.h"
+
+/* sizes of interval and trailer records, with their corsaro magic */
+#define FLOWTUPLE_INTERVAL_SIZE 14
+#define FLOWTUPLE_TRAILER_SIZE 48
+
+/* the records as written in a file, from values in network byte order,
+ * the header is sized when buf is NULL and interval_length 0 keeps its own */
+size_t _flowtuple_writer_pack_header(flowtuple_header_t *header, uint16_t interval_length, uint8_t *buf);
+void _flowtuple_writer_pack_interval(uint16_t number, uint32_t time, uint8_t *buf);
+void _flowtuple_writer_pack_trailer(flowtuple_trailer_t *trailer, uint8_t *buf);
+/* packs n tuples of host byte order columns */
+void _flowtuple_writer_pack_columns(const flowtuple_columns_t *cols, size_t n, uint32_t magic, uint8_t *buf);
+
+#endif
@@ -0,0 +1,154 @@
+/*
+ *  test_agg.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "testutil.h"
+
+/* exact sums of a group */
+typedef struct _test_group_t {
+    uint32_t key[FLOWTUPLE_FIELD_COUNT];
+    uint64_t packets;
+    uint64_t tuples;
+    int seen;
+} test_group_t;
+
+/* exact groups of one aggregation, sorted by key */
+typedef struct _test_groups_t {
+    uint32_t fields;
+    uint32_t ttl_width;
+    test_group_t *groups;
+    size_t count;
+} test_groups_t;
+
+static int _test_group_cmp(const void *a, const void *b) {
+    return memcmp(((const test_group_t*)a)->key, ((const test_group_t*)b)->key, sizeof(((test_group_t*)a)->key));
+}
+
+static void _test_groups_init(test_groups_t *groups, const test_file_t *file, uint32_t fields, uint32_t ttl_width) {
+    flowtuple_tuple_t tuple;
+    test_group_t *group;
+    size_t n = 0;
+
+    groups->fields = fields;
+    groups->ttl_width = ttl_width;
+    memset(groups->groups, 0, (size_t)file->intervals * file->tuples * sizeof(test_group_t));
+
+    /* a group per tuple, merged once sorted */
+    for (int i = 0; i < file->intervals; i++) {
+        for (size_t j = 0; j < file->tuples; j++, n++) {
+            test_tuple(file, i, j, &tuple);
+            group = &(groups->groups[n]);
+            group->key[FLOWTUPLE_FIELD_SRC_IP] = tuple.src_ip;
+            group->key[FLOWTUPLE_FIELD_DST_IP] = tuple.dst_ip;
+            group->key[FLOWTUPLE_FIELD_SRC_PORT] = tuple.src_port;
+            group->key[FLOWTUPLE_FIELD_DST_PORT] = tuple.dst_port;
+            group->key[FLOWTUPLE_FIELD_PROTO] = tuple.proto;
+            group->key[FLOWTUPLE_FIELD_TTL] = tuple.ttl - tuple.ttl % ttl_width;
+            group->key[FLOWTUPLE_FIELD_TCP_FLAGS] = tuple.tcp_flags;
+            group->key[FLOWTUPLE_FIELD_IP_LEN] = tuple.ip_len;
+            for (int k = 0; k < FLOWTUPLE_FIELD_COUNT; k++) {
+                if ((fields & FLOWTUPLE_FIELD_MASK(k)) == 0) {
+                    group->key[k] = 0;
+                }
+            }
+            group->packets = tuple.pkt_cnt;
+            group->tuples = 1;
+        }
+    }
+
+    qsort(groups->groups, n, sizeof(test_group_t), _test_group_cmp);
+    groups->count = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (groups->count > 0 && _test_group_cmp(&(groups->groups[groups->count - 1]), &(groups->groups[i])) == 0) {
+            groups->groups[groups->count - 1].packets += groups->groups[i].packets;
+            groups->groups[groups->count - 1].tuples++;
+        } else {
+            groups->groups[groups->count++] = groups->groups[i];
+        }
+    }
+}
+
+static void _test_check_group(const uint32_t *key, uint64_t packets, uint64_t tuples, void *args) {
+    test_groups_t *groups = args;
+    test_group_t *group;
+    test_group_t find;
+
+    memcpy(find.key, key, sizeof(find.key));
+    group = bsearch(&find, groups->groups, groups->count, sizeof(test_group_t), _test_group_cmp);
+    TEST_CHECK(group != NULL);
+    TEST_CHECK(group->seen == 0);
+    TEST_CHECK(group->packets == packets);
+    TEST_CHECK(group->tuples == tuples);
+    group->seen = 1;
+}
+
+/* aggregates a file and checks every group against the exact sums */
+static void _test_agg(const char *filename, const test_file_t *file, test_groups_t *groups, uint32_t fields,
+                      uint32_t ttl_width, size_t budget) {
+    flowtuple_handle_t *handle;
+    flowtuple_agg_t *agg;
+    flowtuple_errno_t err;
+
+    _test_groups_init(groups, file, fields, ttl_width);
+    TEST_CHECK((agg = flowtuple_agg_create(fields, budget)) != NULL);
+    TEST_CHECK(flowtuple_agg_set_spill_dir(agg, ".") == 0);
+    if (ttl_width > 1) {
+        TEST_CHECK(flowtuple_agg_set_bucket(agg, FLOWTUPLE_FIELD_TTL, ttl_width) == 0);
+    }
+
+    TEST_CHECK((handle = flowtuple_initialize(filename, &err)) != NULL);
+    TEST_CHECK(flowtuple_agg_read(agg, handle) == (long)file->intervals * (long)file->tuples);
+    TEST_CHECK(flowtuple_agg_finish(agg, _test_check_group, groups) == (long)groups->count);
+
+    /* finishing empties the aggregation */
+    TEST_CHECK(flowtuple_agg_finish(agg, _test_check_group, groups) == 0);
+
+    flowtuple_release(handle);
+    flowtuple_agg_free(agg);
+}
+
+int main(void) {
+    test_file_t file = {6, 1500000000, 6, 20000};
+    test_groups_t groups;
+
+    TEST_CHECK((groups.groups = malloc((size_t)file.intervals * file.tuples * sizeof(test_group_t))) != NULL);
+    TEST_CHECK(test_write_file("test_agg.ft", &file) == 0);
+
+    /* a few groups, held in memory */
+    _test_agg("test_agg.ft", &file, &groups,
+              FLOWTUPLE_FIELD_MASK(FLOWTUPLE_FIELD_PROTO) | FLOWTUPLE_FIELD_MASK(FLOWTUPLE_FIELD_DST_PORT), 1, 0);
+
+    /* buckets of values */
+    _test_agg("test_agg.ft", &file, &groups,
+              FLOWTUPLE_FIELD_MASK(FLOWTUPLE_FIELD_PROTO) | FLOWTUPLE_FIELD_MASK(FLOWTUPLE_FIELD_TTL), 16, 0);
+
+    /* many groups, with and without spilling them */
+    _test_agg("test_agg.ft", &file, &groups,
+              FLOWTUPLE_FIELD_MASK(FLOWTUPLE_FIELD_SRC_IP) | FLOWTUPLE_FIELD_MASK(FLOWTUPLE_FIELD_DST_PORT), 1, 0);
+    _test_agg("test_agg.ft", &file, &groups,
+              FLOWTUPLE_FIELD_MASK(FLOWTUPLE_FIELD_SRC_IP) | FLOWTUPLE_FIELD_MASK(FLOWTUPLE_FIELD_DST_PORT), 1, 16384);
+
+    /* grouping by every field at once is refused */
+    TEST_CHECK(flowtuple_agg_create((1u << FLOWTUPLE_FIELD_COUNT) - 1, 0) == NULL);
+
+    free(groups.groups);
+    remove("test_agg.ft");
+    return 0;
+}
@@ -0,0 +1,142 @@
+/*
+ *  test_alloc.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <wandio.h>
+
+#include "testutil.h"
+
+/* the allocator of glibc, which the functions below wrap to count calls */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *ptr);
+
+static volatile int counting;
+static volatile size_t allocations;
+
+void *malloc(size_t size) {
+    if (counting) {
+        allocations++;
+    }
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    if (counting) {
+        allocations++;
+    }
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    if (counting) {
+        allocations++;
+    }
+    return __libc_realloc(ptr, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) {
+    if (counting) {
+        allocations++;
+    }
+    return (*ptr = __libc_memalign(alignment, size)) != NULL ? 0 : ENOMEM;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    if (counting) {
+        allocations++;
+    }
+    return __libc_memalign(alignment, size);
+}
+
+void free(void *ptr) {
+    __libc_free(ptr);
+}
+
+/* reads a file record by record, counting allocations after the first record */
+static void _test_read(const char *filename, int lazy, flowtuple_filter_t *filter, uint64_t expected) {
+    flowtuple_handle_t *handle;
+    flowtuple_record_t *record;
+    flowtuple_errno_t err;
+    uint64_t tuples = 0;
+    int ret;
+
+    TEST_CHECK((handle = flowtuple_initialize(filename, &err)) != NULL);
+    flowtuple_handle_set_lazy(handle, lazy);
+    if (filter != NULL) {
+        TEST_CHECK(flowtuple_handle_set_filter(handle, filter) == 0);
+    }
+    TEST_CHECK((record = flowtuple_record_create()) != NULL);
+    TEST_CHECK(flowtuple_get_next_record(handle, record) == 1);
+    TEST_CHECK(flowtuple_record_get_type(record) == FLOWTUPLE_RECORD_TYPE_HEADER);
+
+    allocations = 0;
+    counting = 1;
+    while ((ret = flowtuple_get_next_record(handle, record)) > 0) {
+        if (flowtuple_record_get_type(record) == FLOWTUPLE_RECORD_TYPE_FLOWTUPLE_DATA) {
+            tuples++;
+        }
+    }
+    counting = 0;
+
+    if (allocations > 0) {
+        fprintf(stderr, "%s: %zu allocations after the first record\n", filename, (size_t)allocations);
+    }
+    TEST_CHECK(allocations == 0);
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(tuples == expected);
+
+    flowtuple_record_free(record);
+    flowtuple_release(handle);
+}
+
+int main(void) {
+    test_file_t file = {1, 1500000000, 8, 20000};
+    flowtuple_filter_t *filter;
+    flowtuple_tuple_t tuple;
+    uint64_t tcp = 0;
+
+    TEST_CHECK(test_write_file("test_alloc.ft", &file) == 0);
+    TEST_CHECK(test_copy_file("test_alloc.ft", "test_alloc.ft.gz", WANDIO_COMPRESS_ZLIB) == 0);
+
+    for (int i = 0; i < file.intervals; i++) {
+        for (size_t j = 0; j < file.tuples; j++) {
+            test_tuple(&file, i, j, &tuple);
+            tcp += tuple.proto == 6;
+        }
+    }
+    TEST_CHECK((filter = flowtuple_filter_create()) != NULL);
+    TEST_CHECK(flowtuple_filter_add_proto(filter, 6) == 0);
+
+    for (int lazy = 0; lazy < 2; lazy++) {
+        _test_read("test_alloc.ft", lazy, NULL, (uint64_t)file.intervals * file.tuples);
+        _test_read("test_alloc.ft", lazy, filter, tcp);
+        _test_read("test_alloc.ft.gz", lazy, NULL, (uint64_t)file.intervals * file.tuples);
+        _test_read("test_alloc.ft.gz", lazy, filter, tcp);
+    }
+
+    flowtuple_filter_free(filter);
+    remove("test_alloc.ft");
+    remove("test_alloc.ft.gz");
+    return 0;
+}
@@ -0,0 +1,166 @@
+/*
+ *  test_archive.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "testutil.h"
+
+/* hashes the records of a file read with some handle options */
+static uint64_t _test_hash(const char *filename, int lazy, uint8_t proto, uint32_t mask, uint64_t *tuples) {
+    flowtuple_handle_t *handle;
+    flowtuple_filter_t *filter;
+    flowtuple_errno_t err;
+    uint64_t hash;
+
+    TEST_CHECK((handle = flowtuple_initialize(filename, &err)) != NULL);
+    flowtuple_handle_set_lazy(handle, lazy);
+    flowtuple_handle_set_class_mask(handle, mask);
+    if (proto != 0) {
+        TEST_CHECK((filter = flowtuple_filter_create()) != NULL);
+        TEST_CHECK(flowtuple_filter_add_proto(filter, proto) == 0);
+        TEST_CHECK(flowtuple_handle_set_filter(handle, filter) == 0);
+        flowtuple_filter_free(filter);
+    }
+    hash = test_hash_handle(handle, tuples);
+    flowtuple_release(handle);
+    TEST_CHECK(hash != 0);
+    return hash;
+}
+
+/* checks that two files read back the same interval columns */
+static void _test_check_columns(const char *a, const char *b) {
+    flowtuple_interval_columns_t *x, *y;
+    const flowtuple_columns_t *cx, *cy;
+    flowtuple_handle_t *ha, *hb;
+    flowtuple_errno_t err;
+    size_t n;
+    int ret;
+
+    TEST_CHECK((ha = flowtuple_initialize(a, &err)) != NULL);
+    TEST_CHECK((hb = flowtuple_initialize(b, &err)) != NULL);
+    TEST_CHECK((x = flowtuple_interval_columns_create()) != NULL);
+    TEST_CHECK((y = flowtuple_interval_columns_create()) != NULL);
+    while ((ret = flowtuple_read_interval_columns(ha, x)) == 1) {
+        TEST_CHECK(flowtuple_read_interval_columns(hb, y) == 1);
+        TEST_CHECK((n = flowtuple_interval_columns_get_count(x)) == flowtuple_interval_columns_get_count(y));
+        TEST_CHECK(flowtuple_interval_columns_get_class_count(x) == flowtuple_interval_columns_get_class_count(y));
+        cx = flowtuple_interval_columns_get_columns(x);
+        cy = flowtuple_interval_columns_get_columns(y);
+        TEST_CHECK(memcmp(cx->src_ip, cy->src_ip, n * 4) == 0);
+        TEST_CHECK(memcmp(cx->dst_ip, cy->dst_ip, n * 4) == 0);
+        TEST_CHECK(memcmp(cx->src_port, cy->src_port, n * 2) == 0);
+        TEST_CHECK(memcmp(cx->dst_port, cy->dst_port, n * 2) == 0);
+        TEST_CHECK(memcmp(cx->proto, cy->proto, n) == 0);
+        TEST_CHECK(memcmp(cx->ttl, cy->ttl, n) == 0);
+        TEST_CHECK(memcmp(cx->tcp_flags, cy->tcp_flags, n) == 0);
+        TEST_CHECK(memcmp(cx->ip_len, cy->ip_len, n * 2) == 0);
+        TEST_CHECK(memcmp(cx->pkt_cnt, cy->pkt_cnt, n * 4) == 0);
+    }
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(flowtuple_read_interval_columns(hb, y) == 0);
+
+    flowtuple_interval_columns_free(x);
+    flowtuple_interval_columns_free(y);
+    flowtuple_release(ha);
+    flowtuple_release(hb);
+}
+
+/* checks the mapped chunks and statistics of an archive against the tuples they were made of */
+static void _test_check_mapped(const char *filename, const test_file_t *file) {
+    flowtuple_archive_t *archive;
+    flowtuple_columns_t cols;
+    flowtuple_tuple_t tuple;
+    flowtuple_errno_t err;
+    uint32_t min, max, lo, hi;
+    size_t first;
+    long n;
+
+    TEST_CHECK((archive = flowtuple_archive_open(filename, &err)) != NULL);
+    TEST_CHECK(flowtuple_archive_get_interval_count(archive) == (size_t)file->intervals);
+    for (int i = 0; i < file->intervals; i++) {
+        TEST_CHECK(flowtuple_archive_get_class_count(archive, i) == 2);
+        for (size_t j = 0; j < 2; j++) {
+            first = j * (file->tuples / 2);
+            TEST_CHECK((n = flowtuple_archive_get_columns(archive, i, j, &cols)) ==
+                       (long)(j == 0 ? file->tuples / 2 : file->tuples - file->tuples / 2));
+            lo = UINT32_MAX;
+            hi = 0;
+            for (long k = 0; k < n; k++) {
+                test_tuple(file, i, first + k, &tuple);
+                TEST_CHECK(cols.src_ip[k] == tuple.src_ip);
+                TEST_CHECK(cols.dst_ip[k] == tuple.dst_ip);
+                TEST_CHECK(cols.src_port[k] == tuple.src_port);
+                TEST_CHECK(cols.dst_port[k] == tuple.dst_port);
+                TEST_CHECK(cols.proto[k] == tuple.proto);
+                TEST_CHECK(cols.ttl[k] == tuple.ttl);
+                TEST_CHECK(cols.tcp_flags[k] == tuple.tcp_flags);
+                TEST_CHECK(cols.ip_len[k] == tuple.ip_len);
+                TEST_CHECK(cols.pkt_cnt[k] == tuple.pkt_cnt);
+                lo = tuple.dst_port < lo ? tuple.dst_port : lo;
+                hi = tuple.dst_port > hi ? tuple.dst_port : hi;
+            }
+            TEST_CHECK(flowtuple_archive_get_stats(archive, i, j, FLOWTUPLE_FIELD_DST_PORT, &min, &max) == 0);
+            TEST_CHECK(min == lo && max == hi);
+        }
+    }
+    TEST_CHECK(flowtuple_archive_get_columns(archive, file->intervals, 0, &cols) < 0);
+    TEST_CHECK(flowtuple_archive_get_class(archive, 0, 2) == NULL);
+    flowtuple_archive_close(archive);
+}
+
+int main(void) {
+    test_file_t file = {9, 1500000000, 10, 12000};
+    uint32_t backscatter = FLOWTUPLE_CLASS_MASK(FLOWTUPLE_CLASS_TYPE_BACKSCATTER);
+    flowtuple_handle_t *handle;
+    flowtuple_errno_t err;
+    uint64_t tuples, archived;
+
+    TEST_CHECK(test_write_file("test_archive.ft", &file) == 0);
+    TEST_CHECK((handle = flowtuple_initialize("test_archive.ft", &err)) != NULL);
+    TEST_CHECK(flowtuple_archive_write(handle, "test_archive.fta") == FLOWTUPLE_ERR_OK);
+    flowtuple_release(handle);
+
+    /* an archive reads back as the records it was made of, whatever the options */
+    for (int lazy = 0; lazy < 2; lazy++) {
+        TEST_CHECK(_test_hash("test_archive.fta", lazy, 0, FLOWTUPLE_CLASS_MASK_ALL, &archived) ==
+                   _test_hash("test_archive.ft", lazy, 0, FLOWTUPLE_CLASS_MASK_ALL, &tuples));
+        TEST_CHECK(archived == tuples && tuples == (uint64_t)file.intervals * file.tuples);
+        TEST_CHECK(_test_hash("test_archive.fta", lazy, 6, FLOWTUPLE_CLASS_MASK_ALL, &archived) ==
+                   _test_hash("test_archive.ft", lazy, 6, FLOWTUPLE_CLASS_MASK_ALL, &tuples));
+        TEST_CHECK(archived == tuples && tuples > 0);
+        TEST_CHECK(_test_hash("test_archive.fta", lazy, 17, backscatter, &archived) ==
+                   _test_hash("test_archive.ft", lazy, 17, backscatter, &tuples));
+        TEST_CHECK(archived == tuples && tuples > 0);
+    }
+    _test_check_columns("test_archive.ft", "test_archive.fta");
+    _test_check_mapped("test_archive.fta", &file);
+
+    /* options of the handle apply to what is archived */
+    TEST_CHECK((handle = flowtuple_initialize("test_archive.ft", &err)) != NULL);
+    flowtuple_handle_set_class_mask(handle, backscatter);
+    TEST_CHECK(flowtuple_archive_write(handle, "test_archive.fta") == FLOWTUPLE_ERR_OK);
+    flowtuple_release(handle);
+    TEST_CHECK(_test_hash("test_archive.fta", 0, 0, FLOWTUPLE_CLASS_MASK_ALL, &archived) ==
+               _test_hash("test_archive.ft", 0, 0, backscatter, &tuples));
+    TEST_CHECK(archived == tuples && tuples == (uint64_t)file.intervals * (file.tuples / 2));
+
+    remove("test_archive.ft");
+    remove("test_archive.fta");
+    return 0;
+}
@@ -0,0 +1,184 @@
+/*
+ *  test_batch.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "testutil.h"
+
+#define TEST_MAX 4096
+
+/* a record as read by flowtuple_get_next_record */
+typedef struct _test_ref_t {
+    flowtuple_record_type_t type;
+    uint32_t value;
+    uint32_t number;
+    flowtuple_tuple_t tuple;
+} test_ref_t;
+
+/* reads every record of a file, through a filter on proto if it is not 0 */
+static size_t _test_read_refs(const char *filename, uint8_t proto, test_ref_t *refs, size_t max) {
+    flowtuple_handle_t *handle;
+    flowtuple_record_t *record;
+    flowtuple_filter_t *filter;
+    flowtuple_data_t *data;
+    flowtuple_errno_t err;
+    test_ref_t *ref;
+    size_t n = 0;
+
+    TEST_CHECK((handle = flowtuple_initialize(filename, &err)) != NULL);
+    if (proto != 0) {
+        TEST_CHECK((filter = flowtuple_filter_create()) != NULL);
+        TEST_CHECK(flowtuple_filter_add_proto(filter, proto) == 0);
+        TEST_CHECK(flowtuple_handle_set_filter(handle, filter) == 0);
+        flowtuple_filter_free(filter);
+    }
+    TEST_CHECK((record = flowtuple_record_create()) != NULL);
+    while (flowtuple_get_next_record(handle, record) == 1) {
+        TEST_CHECK(n < max);
+        ref = &(refs[n++]);
+        ref->type = flowtuple_record_get_type(record);
+        ref->value = 0;
+        switch (ref->type) {
+            case FLOWTUPLE_RECORD_TYPE_INTERVAL:
+                ref->value = flowtuple_interval_get_time(flowtuple_record_get_interval(record));
+                break;
+            case FLOWTUPLE_RECORD_TYPE_FLOWTUPLE_CLASS:
+                ref->value = flowtuple_class_get_magic(flowtuple_record_get_class(record));
+                break;
+            case FLOWTUPLE_RECORD_TYPE_FLOWTUPLE_DATA:
+                data = flowtuple_record_get_data(record);
+                ref->value = flowtuple_class_get_magic(flowtuple_data_get_class_start(data));
+                ref->number = flowtuple_data_get_number(data);
+                ref->tuple.src_ip = flowtuple_data_get_src_ip(data);
+                ref->tuple.dst_ip = flowtuple_data_get_dest_ip(data);
+                ref->tuple.src_port = flowtuple_data_get_src_port(data);
+                ref->tuple.dst_port = flowtuple_data_get_dest_port(data);
+                ref->tuple.proto = flowtuple_data_get_protocol(data);
+                ref->tuple.ttl = flowtuple_data_get_ttl(data);
+                ref->tuple.tcp_flags = flowtuple_data_get_tcp_flags(data);
+                ref->tuple.ip_len = flowtuple_data_get_ip_len(data);
+                ref->tuple.pkt_cnt = flowtuple_data_get_packet_count(data);
+                ref->tuple.is_slash_eight = (uint8_t)flowtuple_data_is_slash_eight(data);
+                break;
+            default:
+                break;
+        }
+    }
+    TEST_CHECK(flowtuple_errno(handle) == FLOWTUPLE_ERR_OK || flowtuple_errno(handle) == FLOWTUPLE_ERR_FILE_EOF);
+    flowtuple_record_free(record);
+    flowtuple_release(handle);
+    return n;
+}
+
+/* reads a file in batches of at most max tuples, checking them against the records */
+static void _test_read_batches(const char *filename, uint8_t proto, long max, const test_ref_t *refs, size_t n) {
+    static flowtuple_tuple_t out[TEST_MAX];
+    flowtuple_handle_t *handle;
+    flowtuple_filter_t *filter;
+    flowtuple_batch_t batch;
+    flowtuple_errno_t err;
+    const test_ref_t *ref;
+    uint32_t next = 1;
+    size_t i = 0;
+    long ret;
+
+    TEST_CHECK((handle = flowtuple_initialize(filename, &err)) != NULL);
+    if (proto != 0) {
+        TEST_CHECK((filter = flowtuple_filter_create()) != NULL);
+        TEST_CHECK(flowtuple_filter_add_proto(filter, proto) == 0);
+        TEST_CHECK(flowtuple_handle_set_filter(handle, filter) == 0);
+        flowtuple_filter_free(filter);
+    }
+
+    while ((ret = flowtuple_read_batch(handle, out, max, &batch)) >= 0 && batch.type != FLOWTUPLE_RECORD_TYPE_NULL) {
+        if (ret == 0) {
+            /* a structural record, one per call */
+            TEST_CHECK(i < n);
+            ref = &(refs[i++]);
+            TEST_CHECK(batch.record != NULL);
+            TEST_CHECK(batch.type == ref->type);
+            TEST_CHECK(flowtuple_record_get_type(batch.record) == ref->type);
+            if (ref->type == FLOWTUPLE_RECORD_TYPE_INTERVAL) {
+                TEST_CHECK(flowtuple_interval_get_time(flowtuple_record_get_interval(batch.record)) == ref->value);
+            } else if (ref->type == FLOWTUPLE_RECORD_TYPE_FLOWTUPLE_CLASS) {
+                TEST_CHECK(flowtuple_class_get_magic(flowtuple_record_get_class(batch.record)) == ref->value);
+                next = 1;
+            }
+            continue;
+        }
+
+        TEST_CHECK(ret <= max);
+        TEST_CHECK(batch.type == FLOWTUPLE_RECORD_TYPE_FLOWTUPLE_DATA);
+        TEST_CHECK(batch.record == NULL);
+        TEST_CHECK(flowtuple_class_get_magic(batch.ftclass) == refs[i].value);
+
+        /* tuples are numbered from 1 within their class, and a class split over
+         * several batches carries on where the last one stopped */
+        TEST_CHECK(batch.number == refs[i].number);
+        TEST_CHECK(proto != 0 || batch.number == next);
+        next = batch.number + (uint32_t)ret;
+
+        for (long j = 0; j < ret; j++) {
+            TEST_CHECK(i < n);
+            ref = &(refs[i++]);
+            TEST_CHECK(ref->type == FLOWTUPLE_RECORD_TYPE_FLOWTUPLE_DATA);
+            TEST_CHECK(out[j].src_ip == ref->tuple.src_ip);
+            TEST_CHECK(out[j].dst_ip == ref->tuple.dst_ip);
+            TEST_CHECK(out[j].src_port == ref->tuple.src_port);
+            TEST_CHECK(out[j].dst_port == ref->tuple.dst_port);
+            TEST_CHECK(out[j].proto == ref->tuple.proto);
+            TEST_CHECK(out[j].ttl == ref->tuple.ttl);
+            TEST_CHECK(out[j].tcp_flags == ref->tuple.tcp_flags);
+            TEST_CHECK(out[j].ip_len == ref->tuple.ip_len);
+            TEST_CHECK(out[j].pkt_cnt == ref->tuple.pkt_cnt);
+            TEST_CHECK(out[j].is_slash_eight == ref->tuple.is_slash_eight);
+        }
+    }
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(i == n);
+
+    /* end of file stays the end of file */
+    TEST_CHECK(flowtuple_read_batch(handle, out, max, &batch) == 0);
+    TEST_CHECK(batch.type == FLOWTUPLE_RECORD_TYPE_NULL);
+    TEST_CHECK(flowtuple_read_batch(handle, out, 0, &batch) < 0);
+
+    flowtuple_release(handle);
+}
+
+int main(void) {
+    test_file_t file = {11, 1500000000, 4, 5000};
+    static const long maxes[] = {1, 3, 7, 1000, TEST_MAX};
+    static const uint8_t protos[] = {0, 6};
+    size_t size = (size_t)file.intervals * (file.tuples + 8) + 2;
+    test_ref_t *refs;
+    size_t n;
+
+    TEST_CHECK((refs = malloc(size * sizeof(test_ref_t))) != NULL);
+    TEST_CHECK(test_write_file("test_batch.ft", &file) == 0);
+
+    for (size_t p = 0; p < sizeof(protos); p++) {
+        n = _test_read_refs("test_batch.ft", protos[p], refs, size);
+        TEST_CHECK(n > (size_t)file.intervals * 4);
+        for (size_t m = 0; m < sizeof(maxes) / sizeof(maxes[0]); m++) {
+            _test_read_batches("test_batch.ft", protos[p], maxes[m], refs, n);
+        }
+    }
+
+    free(refs);
+    remove("test_batch.ft");
+    return 0;
+}
@@ -0,0 +1,130 @@
+/*
+ *  test_decode.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "decode.h"
+#include "testutil.h"
+
+#define TEST_MAX 1000
+#define TEST_SLACK 8
+
+typedef struct _test_columns_t {
+    uint32_t src_ip[TEST_MAX + TEST_SLACK], dst_ip[TEST_MAX + TEST_SLACK], pkt_cnt[TEST_MAX + TEST_SLACK];
+    uint16_t src_port[TEST_MAX + TEST_SLACK], dst_port[TEST_MAX + TEST_SLACK], ip_len[TEST_MAX + TEST_SLACK];
+    uint8_t proto[TEST_MAX + TEST_SLACK], ttl[TEST_MAX + TEST_SLACK], tcp_flags[TEST_MAX + TEST_SLACK];
+    flowtuple_columns_t cols;
+} test_columns_t;
+
+static void _test_columns_init(test_columns_t *c) {
+    memset(c, 0xa5, sizeof(*c));
+    c->cols.src_ip = c->src_ip;
+    c->cols.dst_ip = c->dst_ip;
+    c->cols.src_port = c->src_port;
+    c->cols.dst_port = c->dst_port;
+    c->cols.proto = c->proto;
+    c->cols.ttl = c->ttl;
+    c->cols.tcp_flags = c->tcp_flags;
+    c->cols.ip_len = c->ip_len;
+    c->cols.pkt_cnt = c->pkt_cnt;
+}
+
+/* checks that two decodes wrote the same n tuples, and left the rest untouched */
+static void _test_check_same(const test_columns_t *x, const test_columns_t *y) {
+    TEST_CHECK(memcmp(x->src_ip, y->src_ip, sizeof(x->src_ip)) == 0);
+    TEST_CHECK(memcmp(x->dst_ip, y->dst_ip, sizeof(x->dst_ip)) == 0);
+    TEST_CHECK(memcmp(x->src_port, y->src_port, sizeof(x->src_port)) == 0);
+    TEST_CHECK(memcmp(x->dst_port, y->dst_port, sizeof(x->dst_port)) == 0);
+    TEST_CHECK(memcmp(x->proto, y->proto, sizeof(x->proto)) == 0);
+    TEST_CHECK(memcmp(x->ttl, y->ttl, sizeof(x->ttl)) == 0);
+    TEST_CHECK(memcmp(x->tcp_flags, y->tcp_flags, sizeof(x->tcp_flags)) == 0);
+    TEST_CHECK(memcmp(x->ip_len, y->ip_len, sizeof(x->ip_len)) == 0);
+    TEST_CHECK(memcmp(x->pkt_cnt, y->pkt_cnt, sizeof(x->pkt_cnt)) == 0);
+}
+
+/* checks the first tuple of a scalar decode against its packed bytes */
+static void _test_check_first(const uint8_t *p, flowtuple_magic_t magic, uint8_t octet, const test_columns_t *c) {
+    const uint8_t *q = p + (magic == FLOWTUPLE_MAGIC_SIXT ? 7 : 8);
+
+    TEST_CHECK(c->src_ip[0] == ((uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3]));
+    if (magic == FLOWTUPLE_MAGIC_SIXT) {
+        TEST_CHECK(c->dst_ip[0] == ((uint32_t)octet << 24 | (uint32_t)p[4] << 16 | (uint32_t)p[5] << 8 | p[6]));
+    } else {
+        TEST_CHECK(c->dst_ip[0] == ((uint32_t)p[4] << 24 | (uint32_t)p[5] << 16 | (uint32_t)p[6] << 8 | p[7]));
+    }
+    TEST_CHECK(c->src_port[0] == (q[0] << 8 | q[1]));
+    TEST_CHECK(c->dst_port[0] == (q[2] << 8 | q[3]));
+    TEST_CHECK(c->proto[0] == q[4] && c->ttl[0] == q[5] && c->tcp_flags[0] == q[6]);
+    TEST_CHECK(c->ip_len[0] == (q[7] << 8 | q[8]));
+    TEST_CHECK(c->pkt_cnt[0] == ((uint32_t)q[9] << 24 | (uint32_t)q[10] << 16 | (uint32_t)q[11] << 8 | q[12]));
+}
+
+int main(void) {
+    static const flowtuple_decode_kernel_t kernels[] = {FLOWTUPLE_DECODE_SSE41, FLOWTUPLE_DECODE_AVX2,
+                                                        FLOWTUPLE_DECODE_BEST};
+    static const char *names[] = {"sse4.1", "avx2", "best"};
+    static const flowtuple_magic_t magics[] = {FLOWTUPLE_MAGIC_SIXT, FLOWTUPLE_MAGIC_SIXU};
+    static test_columns_t scalar, other;
+    static uint8_t buf[TEST_MAX * 21 + 16];
+    const uint8_t *p;
+    uint32_t h = 12345;
+    uint8_t octet;
+
+    for (size_t i = 0; i < sizeof(buf); i++) {
+        h = h * 1103515245 + 12345;
+        buf[i] = (uint8_t)(h >> 16);
+    }
+
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        _test_columns_init(&other);
+        if (_flowtuple_decode_columns_with(kernels[k], buf, 1, FLOWTUPLE_MAGIC_SIXU, 0, &(other.cols)) < 0) {
+            printf("%s not supported, skipped\n", names[k]);
+            continue;
+        }
+        for (size_t m = 0; m < 2; m++) {
+            /* every count around the vector widths, from unaligned starts */
+            for (size_t n = 0; n <= TEST_MAX; n = n < 40 ? n + 1 : n * 3 - 1) {
+                n = n > TEST_MAX ? TEST_MAX : n;
+                p = buf + 1 + n % 5;
+                octet = (uint8_t)(n * 7);
+                _test_columns_init(&scalar);
+                _test_columns_init(&other);
+                TEST_CHECK(_flowtuple_decode_columns_with(FLOWTUPLE_DECODE_SCALAR, p, n, magics[m], octet,
+                                                          &(scalar.cols)) == 0);
+                TEST_CHECK(_flowtuple_decode_columns_with(kernels[k], p, n, magics[m], octet, &(other.cols)) == 0);
+                if (n > 0) {
+                    _test_check_first(p, magics[m], octet, &scalar);
+                }
+                _test_check_same(&scalar, &other);
+                if (n == TEST_MAX) {
+                    break;
+                }
+            }
+        }
+    }
+
+    /* the public entry point takes the best kernel */
+    _test_columns_init(&scalar);
+    _test_columns_init(&other);
+    TEST_CHECK(_flowtuple_decode_columns_with(FLOWTUPLE_DECODE_SCALAR, buf, 77, FLOWTUPLE_MAGIC_SIXT, 10, &(scalar.cols)) == 0);
+    TEST_CHECK(flowtuple_decode_columns(buf, 77, FLOWTUPLE_MAGIC_SIXT, 10, &(other.cols)) == 0);
+    _test_check_same(&scalar, &other);
+    TEST_CHECK(flowtuple_decode_columns(buf, 77, 0, 10, &(other.cols)) < 0);
+    return 0;
+}
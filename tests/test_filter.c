@@ -0,0 +1,343 @@
+/*
+ *  test_filter.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "filter.h"
+#include "testutil.h"
+
+typedef struct _test_net_t {
+    uint32_t addr;
+    uint8_t prefix_len;
+} test_net_t;
+
+/* a filter, as it is given to the library and checked here */
+typedef struct _test_spec_t {
+    uint32_t preds;
+    uint8_t proto;
+    uint16_t src_port_lo, src_port_hi;
+    uint16_t dst_port_lo, dst_port_hi;
+    uint8_t tcp_flags_mask, tcp_flags_value;
+    uint8_t ttl_lo, ttl_hi;
+    uint16_t ip_len_lo, ip_len_hi;
+    test_net_t src_nets[8];
+    size_t src_net_count;
+    test_net_t dst_nets[8];
+    size_t dst_net_count;
+    uint8_t octet;
+} test_spec_t;
+
+static int _test_in_nets(const test_net_t *nets, size_t count, uint32_t ip) {
+    uint32_t mask;
+
+    for (size_t i = 0; i < count; i++) {
+        mask = nets[i].prefix_len == 0 ? 0 : ~(uint32_t)0 << (32 - nets[i].prefix_len);
+        if ((ip & mask) == (nets[i].addr & mask)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* whether a host byte order tuple passes a filter, /8 destinations taking its octet */
+static int _test_accepts(const test_spec_t *spec, const flowtuple_tuple_t *t) {
+    uint32_t dst = t->is_slash_eight ? (uint32_t)spec->octet << 24 | t->dst_ip : t->dst_ip;
+
+    return (!(spec->preds & FLOWTUPLE_FILTER_PROTO) || t->proto == spec->proto) &&
+           (!(spec->preds & FLOWTUPLE_FILTER_SRC_PORT) ||
+            (t->src_port >= spec->src_port_lo && t->src_port <= spec->src_port_hi)) &&
+           (!(spec->preds & FLOWTUPLE_FILTER_DST_PORT) ||
+            (t->dst_port >= spec->dst_port_lo && t->dst_port <= spec->dst_port_hi)) &&
+           (!(spec->preds & FLOWTUPLE_FILTER_TCP_FLAGS) ||
+            (t->tcp_flags & spec->tcp_flags_mask) == spec->tcp_flags_value) &&
+           (!(spec->preds & FLOWTUPLE_FILTER_TTL) || (t->ttl >= spec->ttl_lo && t->ttl <= spec->ttl_hi)) &&
+           (!(spec->preds & FLOWTUPLE_FILTER_IP_LEN) ||
+            (t->ip_len >= spec->ip_len_lo && t->ip_len <= spec->ip_len_hi)) &&
+           (!(spec->preds & FLOWTUPLE_FILTER_SRC_NET) ||
+            _test_in_nets(spec->src_nets, spec->src_net_count, t->src_ip)) &&
+           (!(spec->preds & FLOWTUPLE_FILTER_DST_NET) || _test_in_nets(spec->dst_nets, spec->dst_net_count, dst));
+}
+
+static flowtuple_filter_t *_test_filter_create(const test_spec_t *spec) {
+    flowtuple_filter_t *filter;
+
+    TEST_CHECK((filter = flowtuple_filter_create()) != NULL);
+    if (spec->preds & FLOWTUPLE_FILTER_PROTO) {
+        TEST_CHECK(flowtuple_filter_add_proto(filter, spec->proto) == 0);
+    }
+    if (spec->preds & FLOWTUPLE_FILTER_SRC_PORT) {
+        TEST_CHECK(flowtuple_filter_set_src_port(filter, spec->src_port_lo, spec->src_port_hi) == 0);
+    }
+    if (spec->preds & FLOWTUPLE_FILTER_DST_PORT) {
+        TEST_CHECK(flowtuple_filter_set_dst_port(filter, spec->dst_port_lo, spec->dst_port_hi) == 0);
+    }
+    if (spec->preds & FLOWTUPLE_FILTER_TCP_FLAGS) {
+        TEST_CHECK(flowtuple_filter_set_tcp_flags(filter, spec->tcp_flags_mask, spec->tcp_flags_value) == 0);
+    }
+    if (spec->preds & FLOWTUPLE_FILTER_TTL) {
+        TEST_CHECK(flowtuple_filter_set_ttl(filter, spec->ttl_lo, spec->ttl_hi) == 0);
+    }
+    if (spec->preds & FLOWTUPLE_FILTER_IP_LEN) {
+        TEST_CHECK(flowtuple_filter_set_ip_len(filter, spec->ip_len_lo, spec->ip_len_hi) == 0);
+    }
+    for (size_t i = 0; i < spec->src_net_count; i++) {
+        TEST_CHECK(flowtuple_filter_add_src_net(filter, spec->src_nets[i].addr, spec->src_nets[i].prefix_len) == 0);
+    }
+    for (size_t i = 0; i < spec->dst_net_count; i++) {
+        TEST_CHECK(flowtuple_filter_add_dst_net(filter, spec->dst_nets[i].addr, spec->dst_nets[i].prefix_len) == 0);
+    }
+    TEST_CHECK(flowtuple_filter_set_octet(filter, spec->octet) == 0);
+    return filter;
+}
+
+/* reads a file through a filter, checking that exactly the accepted tuples come back
+ * in order, returns their number */
+static uint64_t _test_check_filter(const char *filename, const test_file_t *file, const test_spec_t *spec) {
+    flowtuple_handle_t *handle;
+    flowtuple_record_t *record;
+    flowtuple_filter_t *filter;
+    flowtuple_data_t *data;
+    flowtuple_tuple_t tuple;
+    flowtuple_errno_t err;
+    uint64_t accepted = 0;
+    int interval = -1;
+    int in_interval = 0;
+    size_t i = 0;
+    int ret;
+
+    TEST_CHECK((handle = flowtuple_initialize(filename, &err)) != NULL);
+    filter = _test_filter_create(spec);
+    TEST_CHECK(flowtuple_handle_set_filter(handle, filter) == 0);
+    flowtuple_filter_free(filter);
+    TEST_CHECK((record = flowtuple_record_create()) != NULL);
+
+    while ((ret = flowtuple_get_next_record(handle, record)) == 1) {
+        if (flowtuple_record_get_type(record) == FLOWTUPLE_RECORD_TYPE_INTERVAL) {
+            if (!in_interval) {
+                interval++;
+                i = 0;
+            } else {
+                /* the tuples after the last accepted one were all rejected */
+                for (; i < file->tuples; i++) {
+                    test_tuple(file, interval, i, &tuple);
+                    TEST_CHECK(!_test_accepts(spec, &tuple));
+                }
+            }
+            in_interval = !in_interval;
+            continue;
+        }
+        if (flowtuple_record_get_type(record) != FLOWTUPLE_RECORD_TYPE_FLOWTUPLE_DATA) {
+            continue;
+        }
+
+        /* the tuples passed over were all rejected */
+        for (;;) {
+            TEST_CHECK(i < file->tuples);
+            test_tuple(file, interval, i++, &tuple);
+            if (_test_accepts(spec, &tuple)) {
+                break;
+            }
+        }
+        data = flowtuple_record_get_data(record);
+        TEST_CHECK(ntohl(flowtuple_data_get_src_ip(data)) == tuple.src_ip);
+        TEST_CHECK((tuple.is_slash_eight ? flowtuple_data_get_dest_ip(data) : ntohl(flowtuple_data_get_dest_ip(data))) ==
+                   tuple.dst_ip);
+        TEST_CHECK(ntohs(flowtuple_data_get_src_port(data)) == tuple.src_port);
+        TEST_CHECK(ntohs(flowtuple_data_get_dest_port(data)) == tuple.dst_port);
+        TEST_CHECK(ntohl(flowtuple_data_get_packet_count(data)) == tuple.pkt_cnt);
+        accepted++;
+    }
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(interval == file->intervals - 1 && !in_interval);
+
+    flowtuple_record_free(record);
+    flowtuple_release(handle);
+    return accepted;
+}
+
+/* checks compiled ranges are sorted and disjoint, and hold the same addresses as the nets */
+static void _test_check_compile(const test_net_t *nets, size_t count) {
+    flowtuple_net_t raw[8];
+    flowtuple_net_t *compiled;
+    uint32_t mask, ip;
+    size_t n, k;
+
+    for (size_t i = 0; i < count; i++) {
+        mask = nets[i].prefix_len == 0 ? 0 : ~(uint32_t)0 << (32 - nets[i].prefix_len);
+        raw[i].lo = nets[i].addr & mask;
+        raw[i].hi = raw[i].lo | ~mask;
+    }
+    TEST_CHECK((compiled = _flowtuple_filter_compile_nets(raw, count, &n)) != NULL);
+    TEST_CHECK(n >= 1 && n <= count);
+    for (size_t i = 0; i < n; i++) {
+        TEST_CHECK(compiled[i].lo <= compiled[i].hi);
+        /* merged ranges neither overlap nor touch */
+        TEST_CHECK(i == 0 || compiled[i].lo > compiled[i - 1].hi + 1);
+    }
+
+    /* both sides of every range edge */
+    for (size_t i = 0; i < count; i++) {
+        for (k = 0; k < 4; k++) {
+            ip = k == 0 ? raw[i].lo - 1 : k == 1 ? raw[i].lo : k == 2 ? raw[i].hi : raw[i].hi + 1;
+            TEST_CHECK(_flowtuple_filter_nets_match(compiled, n, ip) == _test_in_nets(nets, count, ip));
+        }
+    }
+    free(compiled);
+}
+
+/* checks which boxes of field values a filter can rule out */
+static void _test_check_may_match(void) {
+    static const test_spec_t dst_port = {.preds = FLOWTUPLE_FILTER_DST_PORT, .dst_port_lo = 80, .dst_port_hi = 445};
+    static const test_spec_t proto = {.preds = FLOWTUPLE_FILTER_PROTO, .proto = 6};
+    static const test_spec_t syn = {.preds = FLOWTUPLE_FILTER_TCP_FLAGS, .tcp_flags_mask = 0x12, .tcp_flags_value = 0x02};
+    static const test_spec_t ttl = {.preds = FLOWTUPLE_FILTER_TTL, .ttl_lo = 64, .ttl_hi = 128};
+    static const test_spec_t dst_net = {.preds = FLOWTUPLE_FILTER_DST_NET, .dst_nets = {{0x2c000000, 16}},
+                                        .dst_net_count = 1, .octet = 44};
+    flowtuple_filter_t *filter;
+    uint32_t min[FLOWTUPLE_FIELD_COUNT] = {0};
+    uint32_t max[FLOWTUPLE_FIELD_COUNT] = {UINT32_MAX, UINT32_MAX, 65535, 65535, 255, 255, 255, 65535};
+
+    filter = _test_filter_create(&dst_port);
+    TEST_CHECK(_flowtuple_filter_may_match(filter, min, max, 0) == 1);
+    min[FLOWTUPLE_FIELD_DST_PORT] = 1000;
+    TEST_CHECK(_flowtuple_filter_may_match(filter, min, max, 0) == 0);
+    min[FLOWTUPLE_FIELD_DST_PORT] = 445;
+    TEST_CHECK(_flowtuple_filter_may_match(filter, min, max, 0) == 1);
+    max[FLOWTUPLE_FIELD_DST_PORT] = min[FLOWTUPLE_FIELD_DST_PORT] = 22;
+    TEST_CHECK(_flowtuple_filter_may_match(filter, min, max, 0) == 0);
+    min[FLOWTUPLE_FIELD_DST_PORT] = 0;
+    max[FLOWTUPLE_FIELD_DST_PORT] = 65535;
+    flowtuple_filter_free(filter);
+
+    filter = _test_filter_create(&proto);
+    min[FLOWTUPLE_FIELD_PROTO] = 7;
+    max[FLOWTUPLE_FIELD_PROTO] = 16;
+    TEST_CHECK(_flowtuple_filter_may_match(filter, min, max, 0) == 0);
+    min[FLOWTUPLE_FIELD_PROTO] = 6;
+    TEST_CHECK(_flowtuple_filter_may_match(filter, min, max, 0) == 1);
+    min[FLOWTUPLE_FIELD_PROTO] = 0;
+    max[FLOWTUPLE_FIELD_PROTO] = 255;
+    flowtuple_filter_free(filter);
+
+    /* flags only rule a class out when they are all the same */
+    filter = _test_filter_create(&syn);
+    min[FLOWTUPLE_FIELD_TCP_FLAGS] = max[FLOWTUPLE_FIELD_TCP_FLAGS] = 0x12;
+    TEST_CHECK(_flowtuple_filter_may_match(filter, min, max, 0) == 0);
+    min[FLOWTUPLE_FIELD_TCP_FLAGS] = max[FLOWTUPLE_FIELD_TCP_FLAGS] = 0x03;
+    TEST_CHECK(_flowtuple_filter_may_match(filter, min, max, 0) == 1);
+    min[FLOWTUPLE_FIELD_TCP_FLAGS] = 0x10;
+    max[FLOWTUPLE_FIELD_TCP_FLAGS] = 0x12;
+    TEST_CHECK(_flowtuple_filter_may_match(filter, min, max, 0) == 1);
+    min[FLOWTUPLE_FIELD_TCP_FLAGS] = 0;
+    max[FLOWTUPLE_FIELD_TCP_FLAGS] = 255;
+    flowtuple_filter_free(filter);
+
+    filter = _test_filter_create(&ttl);
+    min[FLOWTUPLE_FIELD_TTL] = 129;
+    TEST_CHECK(_flowtuple_filter_may_match(filter, min, max, 0) == 0);
+    min[FLOWTUPLE_FIELD_TTL] = 0;
+    max[FLOWTUPLE_FIELD_TTL] = 63;
+    TEST_CHECK(_flowtuple_filter_may_match(filter, min, max, 0) == 0);
+    max[FLOWTUPLE_FIELD_TTL] = 64;
+    TEST_CHECK(_flowtuple_filter_may_match(filter, min, max, 0) == 1);
+    max[FLOWTUPLE_FIELD_TTL] = 255;
+    flowtuple_filter_free(filter);
+
+    /* /8 destinations are ranged with the octet of the filter */
+    filter = _test_filter_create(&dst_net);
+    max[FLOWTUPLE_FIELD_DST_IP] = 0xffffff;
+    TEST_CHECK(_flowtuple_filter_may_match(filter, min, max, 1) == 1);
+    TEST_CHECK(_flowtuple_filter_may_match(filter, min, max, 0) == 0);
+    min[FLOWTUPLE_FIELD_DST_IP] = 0x010000;
+    TEST_CHECK(_flowtuple_filter_may_match(filter, min, max, 1) == 0);
+    flowtuple_filter_free(filter);
+}
+
+int main(void) {
+    static const test_spec_t specs[] = {
+        {.preds = FLOWTUPLE_FILTER_SRC_PORT, .src_port_lo = 1000, .src_port_hi = 30000},
+        {.preds = FLOWTUPLE_FILTER_DST_PORT, .dst_port_lo = 80, .dst_port_hi = 445},
+        {.preds = FLOWTUPLE_FILTER_SRC_PORT | FLOWTUPLE_FILTER_DST_PORT,
+         .src_port_lo = 0, .src_port_hi = 32767, .dst_port_lo = 445, .dst_port_hi = 445},
+        {.preds = FLOWTUPLE_FILTER_TCP_FLAGS, .tcp_flags_mask = 0x12, .tcp_flags_value = 0x02},
+        {.preds = FLOWTUPLE_FILTER_TCP_FLAGS, .tcp_flags_mask = 0x3f, .tcp_flags_value = 0x3f},
+        {.preds = FLOWTUPLE_FILTER_PROTO | FLOWTUPLE_FILTER_TCP_FLAGS | FLOWTUPLE_FILTER_DST_PORT, .proto = 6,
+         .tcp_flags_mask = 0x10, .tcp_flags_value = 0, .dst_port_lo = 22, .dst_port_hi = 80},
+        {.preds = FLOWTUPLE_FILTER_TTL, .ttl_lo = 64, .ttl_hi = 128},
+        {.preds = FLOWTUPLE_FILTER_TTL | FLOWTUPLE_FILTER_IP_LEN, .ttl_lo = 200, .ttl_hi = 255,
+         .ip_len_lo = 40, .ip_len_hi = 100},
+        {.preds = FLOWTUPLE_FILTER_IP_LEN, .ip_len_lo = 1400, .ip_len_hi = 65535},
+        /* nested, duplicate and adjacent networks */
+        {.preds = FLOWTUPLE_FILTER_SRC_NET, .src_nets = {{0x0a000000, 24}, {0x0a000080, 25}, {0x0a000100, 24},
+                                                         {0x0a001000, 20}, {0x0a000000, 30}, {0x0a000000, 24}},
+         .src_net_count = 6},
+        {.preds = FLOWTUPLE_FILTER_SRC_NET, .src_nets = {{0xffffff00, 24}, {0x0a000400, 22}, {0xff000000, 8}},
+         .src_net_count = 3},
+        {.preds = FLOWTUPLE_FILTER_SRC_NET, .src_nets = {{0x0a000000, 8}, {0, 0}}, .src_net_count = 2},
+        /* /8 destinations with and without an octet */
+        {.preds = FLOWTUPLE_FILTER_DST_NET, .dst_nets = {{0x2c000000, 10}, {0x2c800000, 9}, {0x00000000, 2}},
+         .dst_net_count = 3, .octet = 44},
+        {.preds = FLOWTUPLE_FILTER_DST_NET, .dst_nets = {{0x00000000, 9}, {0x00400000, 10}}, .dst_net_count = 2},
+        {.preds = FLOWTUPLE_FILTER_DST_NET | FLOWTUPLE_FILTER_PROTO, .dst_nets = {{0x2d000000, 8}},
+         .dst_net_count = 1, .octet = 44, .proto = 17},
+    };
+    test_file_t file = {12, 1500000000, 3, 6000};
+    flowtuple_handle_t *handle;
+    flowtuple_filter_t *filter;
+    flowtuple_errno_t err;
+    uint64_t accepted, tuples, archived;
+    uint64_t hash;
+
+    TEST_CHECK(test_write_file("test_filter.ft", &file) == 0);
+    TEST_CHECK((handle = flowtuple_initialize("test_filter.ft", &err)) != NULL);
+    TEST_CHECK(flowtuple_archive_write(handle, "test_filter.fta") == FLOWTUPLE_ERR_OK);
+    flowtuple_release(handle);
+
+    for (size_t s = 0; s < sizeof(specs) / sizeof(specs[0]); s++) {
+        accepted = _test_check_filter("test_filter.ft", &file, &specs[s]);
+        TEST_CHECK(accepted <= (uint64_t)file.intervals * file.tuples);
+        TEST_CHECK(accepted > 0 || (specs[s].preds & FLOWTUPLE_FILTER_DST_NET));
+
+        /* an archive, whose classes may be jumped over, reads back the same */
+        TEST_CHECK((handle = flowtuple_initialize("test_filter.ft", &err)) != NULL);
+        filter = _test_filter_create(&specs[s]);
+        TEST_CHECK(flowtuple_handle_set_filter(handle, filter) == 0);
+        TEST_CHECK((hash = test_hash_handle(handle, &tuples)) != 0);
+        flowtuple_release(handle);
+        TEST_CHECK((handle = flowtuple_initialize("test_filter.fta", &err)) != NULL);
+        TEST_CHECK(flowtuple_handle_set_filter(handle, filter) == 0);
+        TEST_CHECK(test_hash_handle(handle, &archived) == hash);
+        TEST_CHECK(archived == tuples && tuples == accepted);
+        flowtuple_release(handle);
+        flowtuple_filter_free(filter);
+
+        if (specs[s].src_net_count > 0) {
+            _test_check_compile(specs[s].src_nets, specs[s].src_net_count);
+        }
+        if (specs[s].dst_net_count > 0) {
+            _test_check_compile(specs[s].dst_nets, specs[s].dst_net_count);
+        }
+    }
+    _test_check_may_match();
+
+    remove("test_filter.ft");
+    remove("test_filter.fta");
+    return 0;
+}
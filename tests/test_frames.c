@@ -0,0 +1,101 @@
+/*
+ *  test_frames.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <arpa/inet.h>
+
+#include <wandio.h>
+
+#include "testutil.h"
+
+static void _test_count_interval(flowtuple_interval_columns_t *ic, int thread, void *args) {
+    (void)ic;
+    (void)thread;
+    (*(long*)args)++;
+}
+
+/* seeks to every interval of a frame file, checking the interval it lands on */
+static void _test_check_seeks(const char *filename, const test_file_t *file) {
+    flowtuple_handle_t *handle;
+    flowtuple_record_t *record;
+    flowtuple_index_t *index;
+    flowtuple_errno_t err;
+
+    TEST_CHECK((index = flowtuple_index_build(filename, &err)) != NULL);
+    TEST_CHECK(flowtuple_index_get_interval_count(index) == (size_t)file->intervals);
+    TEST_CHECK((handle = flowtuple_initialize(filename, &err)) != NULL);
+    TEST_CHECK(flowtuple_handle_set_index(handle, index) == 0);
+    TEST_CHECK((record = flowtuple_record_create()) != NULL);
+
+    for (int i = file->intervals - 1; i >= 0; i -= 2) {
+        TEST_CHECK(flowtuple_seek_interval(handle, file->start + (uint32_t)i * TEST_INTERVAL_LENGTH) == 0);
+        TEST_CHECK(flowtuple_get_next_record(handle, record) == 1);
+        TEST_CHECK(flowtuple_record_get_type(record) == FLOWTUPLE_RECORD_TYPE_INTERVAL);
+        TEST_CHECK(ntohs(flowtuple_interval_get_number(flowtuple_record_get_interval(record))) == i);
+    }
+
+    flowtuple_record_free(record);
+    flowtuple_release(handle);
+    flowtuple_index_free(index);
+}
+
+int main(void) {
+    test_file_t file = {10, 1500000000, 16, 8000};
+    flowtuple_handle_t *handle;
+    flowtuple_index_t *index;
+    flowtuple_errno_t err, ret;
+    uint64_t hash, tuples, framed;
+    long intervals = 0;
+
+    TEST_CHECK(test_write_file("test_frames.ft", &file) == 0);
+    TEST_CHECK((hash = test_hash_file("test_frames.ft", &tuples)) != 0);
+
+    if ((ret = flowtuple_frames_write("test_frames.ft", NULL, "test_frames.ft.zst", 0)) == FLOWTUPLE_ERR_UNSUPPORTED) {
+        printf("built without zstd, skipped\n");
+        remove("test_frames.ft");
+        return 0;
+    }
+    TEST_CHECK(ret == FLOWTUPLE_ERR_OK);
+
+    /* a frame file reads back the same, straight through or pipelined */
+    TEST_CHECK(test_hash_file("test_frames.ft.zst", &framed) == hash);
+    TEST_CHECK(framed == tuples);
+    TEST_CHECK((handle = flowtuple_initialize("test_frames.ft.zst", &err)) != NULL);
+    TEST_CHECK(flowtuple_handle_set_pipeline(handle, 1) == 0);
+    TEST_CHECK(test_hash_handle(handle, &framed) == hash);
+    flowtuple_release(handle);
+
+    /* every interval is a frame of its own */
+    _test_check_seeks("test_frames.ft.zst", &file);
+    TEST_CHECK((handle = flowtuple_initialize("test_frames.ft.zst", &err)) != NULL);
+    TEST_CHECK(flowtuple_parallel_intervals(handle, 2, 1, _test_count_interval, &intervals) == file.intervals);
+    TEST_CHECK(intervals == file.intervals);
+    flowtuple_release(handle);
+
+    /* a gzip file re-encodes the same, with an index given */
+    TEST_CHECK(test_copy_file("test_frames.ft", "test_frames.ft.gz", WANDIO_COMPRESS_ZLIB) == 0);
+    TEST_CHECK((index = flowtuple_index_build("test_frames.ft.gz", &err)) != NULL);
+    TEST_CHECK(flowtuple_frames_write("test_frames.ft.gz", index, "test_frames.ft.zst", 3) == FLOWTUPLE_ERR_OK);
+    flowtuple_index_free(index);
+    TEST_CHECK(test_hash_file("test_frames.ft.zst", &framed) == hash);
+
+    remove("test_frames.ft");
+    remove("test_frames.ft.gz");
+    remove("test_frames.ft.zst");
+    return 0;
+}
@@ -0,0 +1,163 @@
+/*
+ *  test_gunzip.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+#include <unistd.h>
+
+#include <wandio.h>
+
+#include "testutil.h"
+#include "gunzip.h"
+
+#define TEST_MAX (16 << 20)
+
+/* reads what wandio makes of a file, returns its size and the result of the last read in last */
+static size_t _test_read_wandio(const char *filename, uint8_t *buf, int64_t *last) {
+    io_t *io;
+    size_t n = 0;
+    int64_t ret;
+
+    TEST_CHECK((io = wandio_create(filename)) != NULL);
+    while ((ret = wandio_read(io, buf + n, TEST_MAX - n < 65536 ? TEST_MAX - n : 65536)) > 0) {
+        n += (size_t)ret;
+        TEST_CHECK(n < TEST_MAX);
+    }
+    wandio_destroy(io);
+    *last = ret;
+    return n;
+}
+
+/* reads a file with libdeflate, chunk bytes at a time, returns its size and the result of the last read in last */
+static size_t _test_read_gunzip(const char *filename, uint8_t *buf, size_t chunk, int64_t *last) {
+    flowtuple_gunzip_t *gz;
+    size_t n = 0;
+    int64_t ret;
+
+    TEST_CHECK((gz = _flowtuple_gunzip_open(filename)) != NULL);
+    while ((ret = _flowtuple_gunzip_read(gz, buf + n, TEST_MAX - n < chunk ? TEST_MAX - n : chunk)) > 0) {
+        n += (size_t)ret;
+        TEST_CHECK(n < TEST_MAX);
+    }
+    /* the end, or an error, stays put */
+    TEST_CHECK(_flowtuple_gunzip_read(gz, buf + n, chunk) == ret);
+    _flowtuple_gunzip_close(gz);
+    *last = ret;
+    return n;
+}
+
+/* checks that libdeflate reads a file as wandio does, byte for byte, returns its size */
+static size_t _test_check_read(const char *filename, uint8_t *ref, uint8_t *buf, int truncated) {
+    static const size_t chunks[] = {1, 4093, 1 << 20, TEST_MAX};
+    int64_t last, expected;
+    size_t n, m;
+
+    n = _test_read_wandio(filename, ref, &expected);
+    TEST_CHECK(n > 0);
+    TEST_CHECK(truncated ? expected <= 0 : expected == 0);
+    for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+        /* a byte at a time only for the truncated file, for time */
+        if (chunks[c] == 1 && !truncated) {
+            continue;
+        }
+        m = _test_read_gunzip(filename, buf, chunks[c], &last);
+        TEST_CHECK(m == n);
+        TEST_CHECK(memcmp(buf, ref, n) == 0);
+        TEST_CHECK(last == (truncated ? -1 : 0));
+    }
+    return n;
+}
+
+/* seeks back and forth through a file, checking what is read after each seek */
+static void _test_check_seeks(const char *filename, const uint8_t *ref, size_t n) {
+    static uint8_t buf[4096];
+    const uint64_t offsets[] = {n, n - 1, n / 2 + 7, n / 3 + 7, n / 3 + 6, 0, n * 3 / 4, n / 5, 1, n - 4096};
+    flowtuple_gunzip_t *gz;
+    size_t len;
+
+    TEST_CHECK((gz = _flowtuple_gunzip_open(filename)) != NULL);
+    for (size_t i = 0; i < sizeof(offsets) / sizeof(offsets[0]); i++) {
+        TEST_CHECK(_flowtuple_gunzip_seek(gz, offsets[i]) == 0);
+        len = n - offsets[i] < sizeof(buf) ? n - offsets[i] : sizeof(buf);
+        TEST_CHECK(_flowtuple_gunzip_read(gz, buf, sizeof(buf)) == (int64_t)len);
+        TEST_CHECK(memcmp(buf, ref + offsets[i], len) == 0);
+    }
+    TEST_CHECK(_flowtuple_gunzip_seek(gz, n + 1) < 0);
+
+    /* a failed seek past the end leaves the file readable from anywhere before it */
+    TEST_CHECK(_flowtuple_gunzip_seek(gz, 5) == 0);
+    TEST_CHECK(_flowtuple_gunzip_read(gz, buf, sizeof(buf)) == sizeof(buf));
+    TEST_CHECK(memcmp(buf, ref + 5, sizeof(buf)) == 0);
+    _flowtuple_gunzip_close(gz);
+}
+
+int main(void) {
+    test_file_t file = {18, 1500000000, 6, 40000};
+    uint8_t *plain, *ref, *buf;
+    int64_t last;
+    size_t n;
+    long size;
+    FILE *f;
+
+    if (!_flowtuple_gunzip_is_available()) {
+        printf("built without libdeflate, skipped\n");
+        return 0;
+    }
+
+    TEST_CHECK((plain = malloc(TEST_MAX)) != NULL);
+    TEST_CHECK((ref = malloc(TEST_MAX)) != NULL);
+    TEST_CHECK((buf = malloc(TEST_MAX)) != NULL);
+    TEST_CHECK(test_write_file("test_gunzip.ft", &file) == 0);
+    TEST_CHECK((n = _test_read_wandio("test_gunzip.ft", plain, &last)) > (3 << 20));
+
+    /* several members, each bigger than the buffer it is first given, with and without padding */
+    TEST_CHECK(test_gzip_file("test_gunzip.ft", "test_gunzip.ft.gz", 1, 0) == 0);
+    TEST_CHECK(_test_check_read("test_gunzip.ft.gz", ref, buf, 0) == n);
+    TEST_CHECK(memcmp(ref, plain, n) == 0);
+    TEST_CHECK(test_gzip_file("test_gunzip.ft", "test_gunzip.ft.gz", 3, 0) == 0);
+    TEST_CHECK(_test_check_read("test_gunzip.ft.gz", ref, buf, 0) == n);
+    TEST_CHECK(memcmp(ref, plain, n) == 0);
+    _test_check_seeks("test_gunzip.ft.gz", plain, n);
+    TEST_CHECK(test_gzip_file("test_gunzip.ft", "test_gunzip.ft.gz", 3, 4096) == 0);
+    TEST_CHECK(_test_check_read("test_gunzip.ft.gz", ref, buf, 0) == n);
+    TEST_CHECK(memcmp(ref, plain, n) == 0);
+    _test_check_seeks("test_gunzip.ft.gz", plain, n);
+
+    /* a last member cut short gives the bytes before the cut, then an error; the last
+     * four bytes are taken for the size of the member, so the cut is moved to where
+     * they are not too big for it, the file being left to wandio otherwise */
+    TEST_CHECK(test_gzip_file("test_gunzip.ft", "test_gunzip.ft.gz", 3, 0) == 0);
+    TEST_CHECK((f = fopen("test_gunzip.ft.gz", "rb")) != NULL);
+    TEST_CHECK(fseek(f, 0, SEEK_END) == 0 && (size = ftell(f)) > 0);
+    TEST_CHECK(fseek(f, 0, SEEK_SET) == 0 && fread(buf, 1, (size_t)size, f) == (size_t)size);
+    fclose(f);
+    size -= size / 6;
+    while (buf[size - 1] > 0) {
+        size--;
+    }
+    TEST_CHECK(truncate("test_gunzip.ft.gz", size) == 0);
+    TEST_CHECK(_test_check_read("test_gunzip.ft.gz", ref, buf, 1) < n);
+    TEST_CHECK(memcmp(ref, plain, n * 2 / 3) == 0);
+
+    free(plain);
+    free(ref);
+    free(buf);
+    remove("test_gunzip.ft");
+    remove("test_gunzip.ft.gz");
+    return 0;
+}
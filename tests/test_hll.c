@@ -0,0 +1,164 @@
+/*
+ *  test_hll.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "testutil.h"
+
+#define TEST_PRECISION 14
+#define TEST_SKETCH_SIZE ((1 << FLOWTUPLE_HLL_MAX_PRECISION) + 64)
+
+static int _test_key_cmp(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+/* exact number of distinct keys of a file */
+static size_t _test_distinct(const test_file_t *file, flowtuple_hll_key_t key) {
+    size_t n = (size_t)file->intervals * file->tuples;
+    flowtuple_tuple_t tuple;
+    uint64_t *keys;
+    size_t distinct = 0;
+
+    TEST_CHECK((keys = malloc(n * sizeof(uint64_t))) != NULL);
+    for (int i = 0; i < file->intervals; i++) {
+        for (size_t j = 0; j < file->tuples; j++) {
+            test_tuple(file, i, j, &tuple);
+            switch (key) {
+                case FLOWTUPLE_HLL_SRC_IP:
+                    keys[i * file->tuples + j] = tuple.src_ip;
+                    break;
+                case FLOWTUPLE_HLL_DST_IP:
+                    keys[i * file->tuples + j] = tuple.dst_ip;
+                    break;
+                default:
+                    keys[i * file->tuples + j] = ((uint64_t)tuple.src_ip << 16) | tuple.dst_port;
+                    break;
+            }
+        }
+    }
+
+    qsort(keys, n, sizeof(uint64_t), _test_key_cmp);
+    for (size_t i = 0; i < n; i++) {
+        distinct += i == 0 || keys[i] != keys[i - 1];
+    }
+    free(keys);
+    return distinct;
+}
+
+/* checks that two sketches hold the same registers */
+static void _test_check_equal(flowtuple_hll_t *a, flowtuple_hll_t *b) {
+    static uint8_t x[TEST_SKETCH_SIZE], y[TEST_SKETCH_SIZE];
+    size_t len;
+
+    TEST_CHECK((len = flowtuple_hll_serialize(a, x, sizeof(x))) <= sizeof(x));
+    TEST_CHECK(flowtuple_hll_serialize(b, y, sizeof(y)) == len);
+    TEST_CHECK(memcmp(x, y, len) == 0);
+    TEST_CHECK(flowtuple_hll_estimate(a) == flowtuple_hll_estimate(b));
+}
+
+static void _test_key(const char *filename, const test_file_t *file, flowtuple_hll_key_t key) {
+    static uint8_t buf[TEST_SKETCH_SIZE];
+    flowtuple_hll_t *direct, *merged, *interval, *records, *loaded;
+    flowtuple_interval_columns_t *ic;
+    flowtuple_handle_t *handle;
+    flowtuple_record_t *record;
+    flowtuple_errno_t err;
+    size_t distinct, len;
+    double estimate;
+
+    TEST_CHECK((direct = flowtuple_hll_create(key, TEST_PRECISION)) != NULL);
+    TEST_CHECK((merged = flowtuple_hll_create(key, TEST_PRECISION)) != NULL);
+    TEST_CHECK((interval = flowtuple_hll_create(key, TEST_PRECISION)) != NULL);
+    TEST_CHECK((records = flowtuple_hll_create(key, TEST_PRECISION)) != NULL);
+    TEST_CHECK((ic = flowtuple_interval_columns_create()) != NULL);
+
+    /* a sketch of the whole file, and one merged from a sketch per interval and class */
+    TEST_CHECK((handle = flowtuple_initialize(filename, &err)) != NULL);
+    while (flowtuple_read_interval_columns(handle, ic) == 1) {
+        flowtuple_hll_add_columns(direct, flowtuple_interval_columns_get_columns(ic),
+                                  flowtuple_interval_columns_get_count(ic));
+        flowtuple_hll_reset(interval);
+        flowtuple_hll_add_interval(interval, ic, FLOWTUPLE_CLASS_TYPE_BACKSCATTER);
+        TEST_CHECK(flowtuple_hll_merge(merged, interval) == 0);
+        flowtuple_hll_reset(interval);
+        flowtuple_hll_add_interval(interval, ic, FLOWTUPLE_CLASS_TYPE_OTHER);
+        TEST_CHECK(flowtuple_hll_merge(merged, interval) == 0);
+    }
+    TEST_CHECK(flowtuple_errno(handle) == FLOWTUPLE_ERR_OK || flowtuple_errno(handle) == FLOWTUPLE_ERR_FILE_EOF);
+    _test_check_equal(direct, merged);
+
+    /* data records are keyed as their columns are */
+    TEST_CHECK(flowtuple_reopen(handle, filename) == 0);
+    TEST_CHECK((record = flowtuple_record_create()) != NULL);
+    while (flowtuple_get_next_record(handle, record) == 1) {
+        if (flowtuple_record_get_type(record) == FLOWTUPLE_RECORD_TYPE_FLOWTUPLE_DATA) {
+            flowtuple_hll_add_data(records, flowtuple_record_get_data(record));
+        }
+    }
+    _test_check_equal(direct, records);
+
+    /* within five standard errors of the exact count */
+    distinct = _test_distinct(file, key);
+    estimate = flowtuple_hll_estimate(direct);
+    TEST_CHECK(fabs(estimate - (double)distinct) <= 5 * 1.04 / sqrt(1 << TEST_PRECISION) * (double)distinct);
+
+    /* a serialized sketch loads back the same, a truncated one does not load */
+    TEST_CHECK((len = flowtuple_hll_serialize(direct, buf, sizeof(buf))) <= sizeof(buf));
+    TEST_CHECK(flowtuple_hll_serialize(direct, buf, 1) == len);
+    TEST_CHECK((loaded = flowtuple_hll_deserialize(buf, len)) != NULL);
+    _test_check_equal(direct, loaded);
+    TEST_CHECK(flowtuple_hll_deserialize(buf, len - 1) == NULL);
+    flowtuple_hll_free(loaded);
+
+    flowtuple_record_free(record);
+    flowtuple_release(handle);
+    flowtuple_interval_columns_free(ic);
+    flowtuple_hll_free(direct);
+    flowtuple_hll_free(merged);
+    flowtuple_hll_free(interval);
+    flowtuple_hll_free(records);
+}
+
+int main(void) {
+    test_file_t file = {7, 1500000000, 20, 10000};
+    flowtuple_hll_t *a, *b;
+
+    TEST_CHECK(test_write_file("test_hll.ft", &file) == 0);
+
+    _test_key("test_hll.ft", &file, FLOWTUPLE_HLL_SRC_IP);
+    _test_key("test_hll.ft", &file, FLOWTUPLE_HLL_DST_IP);
+    _test_key("test_hll.ft", &file, FLOWTUPLE_HLL_SRC_IP_DST_PORT);
+
+    /* sketches only merge with sketches of the same key and precision */
+    TEST_CHECK(flowtuple_hll_create(FLOWTUPLE_HLL_SRC_IP, FLOWTUPLE_HLL_MIN_PRECISION - 1) == NULL);
+    TEST_CHECK(flowtuple_hll_create(FLOWTUPLE_HLL_SRC_IP, FLOWTUPLE_HLL_MAX_PRECISION + 1) == NULL);
+    TEST_CHECK((a = flowtuple_hll_create(FLOWTUPLE_HLL_SRC_IP, TEST_PRECISION)) != NULL);
+    TEST_CHECK((b = flowtuple_hll_create(FLOWTUPLE_HLL_SRC_IP, TEST_PRECISION + 1)) != NULL);
+    TEST_CHECK(flowtuple_hll_merge(a, b) < 0);
+    flowtuple_hll_free(b);
+    TEST_CHECK((b = flowtuple_hll_create(FLOWTUPLE_HLL_DST_IP, TEST_PRECISION)) != NULL);
+    TEST_CHECK(flowtuple_hll_merge(a, b) < 0);
+    flowtuple_hll_free(a);
+    flowtuple_hll_free(b);
+
+    remove("test_hll.ft");
+    return 0;
+}
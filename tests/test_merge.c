@@ -0,0 +1,123 @@
+/*
+ *  test_merge.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <arpa/inet.h>
+
+#include <wandio.h>
+
+#include "testutil.h"
+
+#define TEST_INPUTS 3
+
+/* checks an interval read by the merge against the one it was generated from,
+ * keeping only the tuples of proto if it is not 0 */
+static void _test_check_interval(flowtuple_interval_columns_t *ic, const test_file_t *file, int interval,
+                                 uint8_t proto) {
+    const flowtuple_columns_t *cols = flowtuple_interval_columns_get_columns(ic);
+    flowtuple_tuple_t tuple;
+    size_t n = 0;
+
+    TEST_CHECK(ntohs(flowtuple_interval_get_number(flowtuple_interval_columns_get_interval(ic))) == interval);
+    TEST_CHECK(flowtuple_interval_columns_get_class_count(ic) == 2);
+    for (size_t i = 0; i < file->tuples; i++) {
+        test_tuple(file, interval, i, &tuple);
+        if (proto != 0 && tuple.proto != proto) {
+            continue;
+        }
+        TEST_CHECK(n < flowtuple_interval_columns_get_count(ic));
+        TEST_CHECK(cols->src_ip[n] == tuple.src_ip);
+        TEST_CHECK(cols->dst_ip[n] == tuple.dst_ip);
+        TEST_CHECK(cols->src_port[n] == tuple.src_port);
+        TEST_CHECK(cols->dst_port[n] == tuple.dst_port);
+        TEST_CHECK(cols->proto[n] == tuple.proto);
+        TEST_CHECK(cols->ttl[n] == tuple.ttl);
+        TEST_CHECK(cols->tcp_flags[n] == tuple.tcp_flags);
+        TEST_CHECK(cols->ip_len[n] == tuple.ip_len);
+        TEST_CHECK(cols->pkt_cnt[n] == tuple.pkt_cnt);
+        n++;
+    }
+    TEST_CHECK(n == flowtuple_interval_columns_get_count(ic));
+}
+
+int main(void) {
+    /* overlapping inputs, the last one ending before the others start */
+    test_file_t files[TEST_INPUTS] = {
+        {3, 1500000000, 10, 3000},
+        {4, 1500000000 + 2 * TEST_INTERVAL_LENGTH, 10, 2000},
+        {5, 1500000000 - 5 * TEST_INTERVAL_LENGTH, 4, 1000},
+    };
+    const char *paths[TEST_INPUTS] = {"test_merge_0.ft", "test_merge_1.ft.gz", "test_merge_2.ft"};
+    int next[TEST_INPUTS] = {0};
+    flowtuple_interval_columns_t *ic;
+    flowtuple_filter_t *filter;
+    flowtuple_merge_t *merge;
+    flowtuple_errno_t err;
+    uint32_t time, expected_time;
+    size_t source, expected;
+    int intervals = 0;
+
+    TEST_CHECK(test_write_file(paths[0], &files[0]) == 0);
+    TEST_CHECK(test_write_file("test_merge_1.ft", &files[1]) == 0);
+    TEST_CHECK(test_copy_file("test_merge_1.ft", paths[1], WANDIO_COMPRESS_ZLIB) == 0);
+    TEST_CHECK(test_write_file(paths[2], &files[2]) == 0);
+
+    TEST_CHECK((merge = flowtuple_merge_create(paths, TEST_INPUTS, &err)) != NULL);
+    TEST_CHECK(flowtuple_merge_get_count(merge) == TEST_INPUTS);
+
+    /* options set on an input apply to what the merge reads from it */
+    TEST_CHECK((filter = flowtuple_filter_create()) != NULL);
+    TEST_CHECK(flowtuple_filter_add_proto(filter, 17) == 0);
+    TEST_CHECK(flowtuple_handle_set_filter(flowtuple_merge_get_handle(merge, 1), filter) == 0);
+    flowtuple_filter_free(filter);
+
+    while (flowtuple_merge_next(merge, &ic, &source) == 1) {
+        /* the earliest interval left, the first input winning ties */
+        expected = TEST_INPUTS;
+        expected_time = 0;
+        for (size_t i = 0; i < TEST_INPUTS; i++) {
+            if (next[i] < files[i].intervals) {
+                time = files[i].start + (uint32_t)next[i] * TEST_INTERVAL_LENGTH;
+                if (expected == TEST_INPUTS || time < expected_time) {
+                    expected = i;
+                    expected_time = time;
+                }
+            }
+        }
+        TEST_CHECK(source == expected);
+        TEST_CHECK(ntohl(flowtuple_interval_get_time(flowtuple_interval_columns_get_interval(ic))) == expected_time);
+        _test_check_interval(ic, &files[source], next[source], source == 1 ? 17 : 0);
+        next[source]++;
+        intervals++;
+    }
+
+    TEST_CHECK(flowtuple_merge_errno(merge) == FLOWTUPLE_ERR_OK);
+    TEST_CHECK(intervals == files[0].intervals + files[1].intervals + files[2].intervals);
+    flowtuple_merge_free(merge);
+
+    /* an input that cannot be opened fails the merge */
+    paths[2] = "test_merge_missing.ft";
+    TEST_CHECK(flowtuple_merge_create(paths, TEST_INPUTS, &err) == NULL);
+    TEST_CHECK(err != FLOWTUPLE_ERR_OK);
+
+    remove("test_merge_0.ft");
+    remove("test_merge_1.ft");
+    remove("test_merge_1.ft.gz");
+    remove("test_merge_2.ft");
+    return 0;
+}
@@ -0,0 +1,348 @@
+/*
+ *  test_parallel.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+#include <wandio.h>
+
+#include "testutil.h"
+
+#define TEST_MAX_INTERVALS 64
+
+/* what is read of one interval */
+typedef struct _test_summary_t {
+    uint32_t time;
+    size_t count;
+    size_t classes;
+    uint64_t hash;
+    int seen;
+} test_summary_t;
+
+/* summaries of a parallel read, filled by its callbacks */
+typedef struct _test_parallel_t {
+    test_summary_t sums[TEST_MAX_INTERVALS];
+    pthread_mutex_t lock;
+    int ordered;
+    int nthreads;
+    int active;
+    long calls;
+} test_parallel_t;
+
+static uint64_t _test_fnv(uint64_t hash, const void *buf, size_t len) {
+    const uint8_t *p = buf;
+
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ p[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static void _test_summarize(flowtuple_interval_columns_t *ic, test_summary_t *sum) {
+    const flowtuple_columns_t *cols = flowtuple_interval_columns_get_columns(ic);
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t n;
+
+    sum->time = ntohl(flowtuple_interval_get_time(flowtuple_interval_columns_get_interval(ic)));
+    sum->count = n = flowtuple_interval_columns_get_count(ic);
+    sum->classes = flowtuple_interval_columns_get_class_count(ic);
+    hash = _test_fnv(hash, cols->src_ip, n * 4);
+    hash = _test_fnv(hash, cols->dst_ip, n * 4);
+    hash = _test_fnv(hash, cols->src_port, n * 2);
+    hash = _test_fnv(hash, cols->dst_port, n * 2);
+    hash = _test_fnv(hash, cols->proto, n);
+    hash = _test_fnv(hash, cols->ttl, n);
+    hash = _test_fnv(hash, cols->tcp_flags, n);
+    hash = _test_fnv(hash, cols->ip_len, n * 2);
+    sum->hash = _test_fnv(hash, cols->pkt_cnt, n * 4);
+    sum->seen = 1;
+}
+
+static void _test_interval(flowtuple_interval_columns_t *ic, int thread, void *args) {
+    test_parallel_t *par = args;
+    uint16_t number = ntohs(flowtuple_interval_get_number(flowtuple_interval_columns_get_interval(ic)));
+    test_summary_t sum;
+
+    TEST_CHECK(thread >= 0 && thread < par->nthreads);
+    TEST_CHECK(number < TEST_MAX_INTERVALS);
+
+    pthread_mutex_lock(&(par->lock));
+    par->active++;
+    /* ordered callbacks come one at a time, in interval order */
+    TEST_CHECK(!par->ordered || (par->active == 1 && par->calls == number));
+    pthread_mutex_unlock(&(par->lock));
+
+    _test_summarize(ic, &sum);
+
+    pthread_mutex_lock(&(par->lock));
+    TEST_CHECK(!par->sums[number].seen);
+    par->sums[number] = sum;
+    par->calls++;
+    par->active--;
+    pthread_mutex_unlock(&(par->lock));
+}
+
+/* opens a file, with a filter on proto if it is not 0 and an index if one is given */
+static flowtuple_handle_t *_test_open(const char *filename, uint8_t proto, flowtuple_index_t *index) {
+    flowtuple_handle_t *handle;
+    flowtuple_filter_t *filter;
+    flowtuple_errno_t err;
+
+    TEST_CHECK((handle = flowtuple_initialize(filename, &err)) != NULL);
+    if (proto != 0) {
+        TEST_CHECK((filter = flowtuple_filter_create()) != NULL);
+        TEST_CHECK(flowtuple_filter_add_proto(filter, proto) == 0);
+        TEST_CHECK(flowtuple_handle_set_filter(handle, filter) == 0);
+        flowtuple_filter_free(filter);
+    }
+    if (index != NULL) {
+        TEST_CHECK(flowtuple_handle_set_index(handle, index) == 0);
+    }
+    return handle;
+}
+
+/* reads the intervals of a file one after the other, returns their number */
+static long _test_read_serial(const char *filename, uint8_t proto, test_summary_t *sums) {
+    flowtuple_interval_columns_t *ic;
+    flowtuple_handle_t *handle;
+    long n = 0;
+    int ret;
+
+    handle = _test_open(filename, proto, NULL);
+    TEST_CHECK((ic = flowtuple_interval_columns_create()) != NULL);
+    memset(sums, 0, TEST_MAX_INTERVALS * sizeof(test_summary_t));
+    while ((ret = flowtuple_read_interval_columns(handle, ic)) == 1) {
+        TEST_CHECK(n < TEST_MAX_INTERVALS);
+        _test_summarize(ic, &(sums[n++]));
+    }
+    TEST_CHECK(ret == 0);
+    flowtuple_interval_columns_free(ic);
+    flowtuple_release(handle);
+    return n;
+}
+
+/* reads a file in parallel, checking every interval is called back once and
+ * reads the same as serially */
+static void _test_check_parallel(flowtuple_handle_t *handle, int nthreads, int ordered,
+                                 const test_summary_t *serial, long count) {
+    static test_parallel_t par;
+    uint64_t tuples = 0;
+
+    memset(&par, 0, sizeof(par));
+    pthread_mutex_init(&(par.lock), NULL);
+    par.ordered = ordered;
+    par.nthreads = nthreads;
+
+    TEST_CHECK(flowtuple_parallel_intervals(handle, nthreads, ordered, _test_interval, &par) == count);
+    TEST_CHECK(par.calls == count && par.active == 0);
+    for (long i = 0; i < count; i++) {
+        TEST_CHECK(par.sums[i].seen);
+        TEST_CHECK(par.sums[i].time == serial[i].time);
+        TEST_CHECK(par.sums[i].count == serial[i].count);
+        TEST_CHECK(par.sums[i].classes == serial[i].classes);
+        TEST_CHECK(par.sums[i].hash == serial[i].hash);
+        tuples += par.sums[i].count;
+    }
+    TEST_CHECK(tuples > 0);
+    pthread_mutex_destroy(&(par.lock));
+}
+
+/* reads a file with every number of threads and both deliveries, the handle
+ * being left where it was */
+static void _test_check_file(const char *filename, uint8_t proto, flowtuple_index_t *index, long intervals) {
+    static test_summary_t serial[TEST_MAX_INTERVALS];
+    static const int threads[] = {1, 2, 3, 5};
+    flowtuple_handle_t *handle;
+    uint64_t hash, tuples, after;
+
+    TEST_CHECK(_test_read_serial(filename, proto, serial) == intervals);
+    handle = _test_open(filename, proto, NULL);
+    TEST_CHECK((hash = test_hash_handle(handle, &tuples)) != 0);
+    flowtuple_release(handle);
+
+    for (int ordered = 0; ordered < 2; ordered++) {
+        for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+            handle = _test_open(filename, proto, index);
+            _test_check_parallel(handle, threads[t], ordered, serial, intervals);
+            TEST_CHECK(test_hash_handle(handle, &after) == hash);
+            TEST_CHECK(after == tuples);
+            flowtuple_release(handle);
+        }
+    }
+}
+
+/* what a loop reads, summed so that it does not depend on the order of records */
+typedef struct _test_loop_t {
+    uint64_t records[FLOWTUPLE_RECORD_TYPE_FLOWTUPLE_DATA + 1];
+    uint64_t sum;
+    uint64_t packets;
+    int inits;
+    int merges;
+} test_loop_t;
+
+static void _test_loop_record(flowtuple_record_t *record, void *state) {
+    test_loop_t *loop = state;
+    flowtuple_record_type_t type = flowtuple_record_get_type(record);
+    flowtuple_interval_t *interval;
+    flowtuple_data_t *data;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    uint32_t v[10];
+
+    TEST_CHECK(type <= FLOWTUPLE_RECORD_TYPE_FLOWTUPLE_DATA);
+    loop->records[type]++;
+    memset(v, 0, sizeof(v));
+    if (type == FLOWTUPLE_RECORD_TYPE_INTERVAL) {
+        interval = flowtuple_record_get_interval(record);
+        v[0] = flowtuple_interval_get_number(interval);
+        v[1] = flowtuple_interval_get_time(interval);
+    } else if (type == FLOWTUPLE_RECORD_TYPE_FLOWTUPLE_DATA) {
+        data = flowtuple_record_get_data(record);
+        v[0] = flowtuple_data_get_number(data);
+        v[1] = flowtuple_data_get_src_ip(data);
+        v[2] = flowtuple_data_get_dest_ip(data);
+        v[3] = flowtuple_data_get_src_port(data);
+        v[4] = flowtuple_data_get_dest_port(data);
+        v[5] = flowtuple_data_get_protocol(data);
+        v[6] = flowtuple_data_get_ttl(data);
+        v[7] = flowtuple_data_get_tcp_flags(data);
+        v[8] = flowtuple_data_get_ip_len(data);
+        v[9] = flowtuple_data_get_packet_count(data);
+        loop->packets += ntohl(v[9]);
+    }
+    loop->sum += _test_fnv(hash, v, sizeof(v));
+}
+
+static void *_test_loop_init(void *args) {
+    test_loop_t *loop;
+
+    ((test_loop_t*)args)->inits++;
+    TEST_CHECK((loop = calloc(1, sizeof(test_loop_t))) != NULL);
+    return loop;
+}
+
+static void _test_loop_merge(void *args, void *state) {
+    test_loop_t *total = args;
+    test_loop_t *loop = state;
+
+    for (int t = 0; t <= FLOWTUPLE_RECORD_TYPE_FLOWTUPLE_DATA; t++) {
+        total->records[t] += loop->records[t];
+    }
+    total->sum += loop->sum;
+    total->packets += loop->packets;
+    total->merges++;
+    free(loop);
+}
+
+/* reads files with flowtuple_parallel_loop, with and without worker states,
+ * checking it reads what a serial pass over them does */
+static void _test_check_loop(const char **paths, size_t n) {
+    static const int threads[] = {1, 3};
+    flowtuple_handle_t *handle;
+    flowtuple_record_t *record;
+    flowtuple_errno_t err;
+    test_loop_t serial, loop;
+    long records = 0;
+    int ret;
+
+    memset(&serial, 0, sizeof(serial));
+    TEST_CHECK((record = flowtuple_record_create()) != NULL);
+    for (size_t f = 0; f < n; f++) {
+        TEST_CHECK((handle = flowtuple_initialize(paths[f], &err)) != NULL);
+        while ((ret = flowtuple_get_next_record(handle, record)) == 1) {
+            _test_loop_record(record, &serial);
+            records++;
+        }
+        TEST_CHECK(ret == 0);
+        flowtuple_release(handle);
+    }
+    flowtuple_record_free(record);
+    TEST_CHECK(serial.records[FLOWTUPLE_RECORD_TYPE_HEADER] == n);
+    TEST_CHECK(serial.records[FLOWTUPLE_RECORD_TYPE_TRAILER] == n);
+
+    for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+        /* every worker aggregates into a state of its own, merged at the end */
+        memset(&loop, 0, sizeof(loop));
+        TEST_CHECK(flowtuple_parallel_loop(paths, n, threads[t], _test_loop_init, _test_loop_record,
+                                           _test_loop_merge, &loop, &err) == records);
+        TEST_CHECK(err == FLOWTUPLE_ERR_OK);
+        TEST_CHECK(loop.inits == threads[t] && loop.merges == threads[t]);
+        TEST_CHECK(memcmp(loop.records, serial.records, sizeof(loop.records)) == 0);
+        TEST_CHECK(loop.sum == serial.sum && loop.packets == serial.packets);
+
+        /* without init, a single worker reads into args and nothing is merged */
+        memset(&loop, 0, sizeof(loop));
+        TEST_CHECK(flowtuple_parallel_loop(paths, n, threads[t], NULL, _test_loop_record,
+                                           _test_loop_merge, &loop, &err) == records);
+        TEST_CHECK(err == FLOWTUPLE_ERR_OK);
+        TEST_CHECK(loop.inits == 0 && loop.merges == 0);
+        TEST_CHECK(memcmp(loop.records, serial.records, sizeof(loop.records)) == 0);
+        TEST_CHECK(loop.sum == serial.sum && loop.packets == serial.packets);
+    }
+}
+
+int main(void) {
+    test_file_t file = {13, 1500000000, 17, 3000};
+    test_file_t large = {14, 1500000000, 23, 40000};
+    const char *paths[] = {"test_parallel.ft.gz", "test_parallel_0.ft", "test_parallel_1.ft", "test_parallel_2.ft"};
+    flowtuple_index_t *index;
+    flowtuple_errno_t err;
+    test_loop_t loop;
+
+    /* a plain file is split by scanning it for interval boundaries */
+    TEST_CHECK(test_write_file("test_parallel.ft", &file) == 0);
+    _test_check_file("test_parallel.ft", 0, NULL, file.intervals);
+    _test_check_file("test_parallel.ft", 6, NULL, file.intervals);
+
+    /* a gzip file with an index is split after its inflate checkpoints, into
+     * ranges of several intervals that do not divide evenly between threads */
+    TEST_CHECK(test_write_file("test_parallel.ft", &large) == 0);
+    TEST_CHECK(test_copy_file("test_parallel.ft", "test_parallel.ft.gz", WANDIO_COMPRESS_ZLIB) == 0);
+    TEST_CHECK((index = flowtuple_index_build("test_parallel.ft.gz", &err)) != NULL);
+    TEST_CHECK(flowtuple_index_get_checkpoint_count(index) >= 3);
+    TEST_CHECK(flowtuple_index_get_interval_count(index) >= 3 * flowtuple_index_get_checkpoint_count(index));
+    _test_check_file("test_parallel.ft.gz", 0, index, large.intervals);
+
+    /* a loop over several files, the gzip file and one plain file with sidecar
+     * indexes so that they are split into ranges */
+    TEST_CHECK(flowtuple_index_save(index, "test_parallel.ft.gz.idx") == 0);
+    flowtuple_index_free(index);
+    for (int f = 0; f < 3; f++) {
+        file.seed = 20 + (uint32_t)f;
+        file.intervals = 4 + f * 3;
+        TEST_CHECK(test_write_file(paths[f + 1], &file) == 0);
+    }
+    TEST_CHECK((index = flowtuple_index_build(paths[2], &err)) != NULL);
+    TEST_CHECK(flowtuple_index_save(index, "test_parallel_1.ft.idx") == 0);
+    flowtuple_index_free(index);
+    _test_check_loop(paths, 4);
+    _test_check_loop(paths + 1, 3);
+    TEST_CHECK(flowtuple_parallel_loop(paths, 0, 3, _test_loop_init, _test_loop_record, _test_loop_merge,
+                                       &loop, &err) == 0);
+    TEST_CHECK(err == FLOWTUPLE_ERR_OK);
+
+    remove("test_parallel.ft");
+    remove("test_parallel.ft.gz");
+    remove("test_parallel.ft.gz.idx");
+    for (int f = 0; f < 3; f++) {
+        remove(paths[f + 1]);
+    }
+    remove("test_parallel_1.ft.idx");
+    return 0;
+}
@@ -0,0 +1,90 @@
+/*
+ *  test_pipeline.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <wandio.h>
+
+#include "testutil.h"
+
+/* hashes a file read with a pipeline and with libdeflate on or off (gunzip
+ * -1 leaves the default), after reading into it when skip is set */
+static uint64_t _test_hash(const char *filename, int pipeline, int gunzip, int skip, uint64_t *tuples) {
+    flowtuple_handle_t *handle;
+    flowtuple_record_t *record;
+    flowtuple_errno_t err;
+    uint64_t hash;
+
+    TEST_CHECK((handle = flowtuple_initialize(filename, &err)) != NULL);
+    if (gunzip >= 0 && flowtuple_handle_set_gunzip(handle, gunzip) < 0) {
+        /* only without libdeflate */
+        TEST_CHECK(gunzip == 1 && flowtuple_errno(handle) == FLOWTUPLE_ERR_UNSUPPORTED);
+        flowtuple_release(handle);
+        return 0;
+    }
+    if (skip) {
+        TEST_CHECK((record = flowtuple_record_create()) != NULL);
+        for (int i = 0; i < 100; i++) {
+            TEST_CHECK(flowtuple_get_next_record(handle, record) == 1);
+        }
+        flowtuple_record_free(record);
+    }
+    /* changing the mode starts the file over */
+    TEST_CHECK(flowtuple_handle_set_pipeline(handle, pipeline) == 0);
+    hash = test_hash_handle(handle, tuples);
+    flowtuple_release(handle);
+    TEST_CHECK(hash != 0);
+    return hash;
+}
+
+/* checks that a file reads the same pipelined or not, and as the file it was made of */
+static void _test_check_pipeline(const char *filename, uint64_t hash, uint64_t tuples) {
+    uint64_t plain, piped, n, m;
+
+    for (int gunzip = -1; gunzip < 2; gunzip++) {
+        if ((plain = _test_hash(filename, 0, gunzip, 0, &n)) == 0) {
+            continue;
+        }
+        TEST_CHECK(plain == hash && n == tuples);
+        for (int skip = 0; skip < 2; skip++) {
+            TEST_CHECK((piped = _test_hash(filename, 1, gunzip, skip, &m)) == plain);
+            TEST_CHECK(m == n);
+        }
+    }
+}
+
+int main(void) {
+    test_file_t file = {15, 1500000000, 9, 20000};
+    uint64_t hash, tuples;
+
+    TEST_CHECK(test_write_file("test_pipeline.ft", &file) == 0);
+    TEST_CHECK((hash = test_hash_file("test_pipeline.ft", &tuples)) != 0);
+    TEST_CHECK(tuples == (uint64_t)file.intervals * file.tuples);
+
+    _test_check_pipeline("test_pipeline.ft", hash, tuples);
+
+    TEST_CHECK(test_copy_file("test_pipeline.ft", "test_pipeline.ft.gz", WANDIO_COMPRESS_ZLIB) == 0);
+    _test_check_pipeline("test_pipeline.ft.gz", hash, tuples);
+
+    /* members that split records, and zeros after the last one */
+    TEST_CHECK(test_gzip_file("test_pipeline.ft", "test_pipeline.ft.gz", 5, 4096) == 0);
+    _test_check_pipeline("test_pipeline.ft.gz", hash, tuples);
+
+    remove("test_pipeline.ft");
+    remove("test_pipeline.ft.gz");
+    return 0;
+}
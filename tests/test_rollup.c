@@ -0,0 +1,243 @@
+/*
+ *  test_rollup.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+#include <endian.h>
+#include <arpa/inet.h>
+
+#include <wandio.h>
+
+#include "testutil.h"
+
+#define TEST_MAX_BUCKETS 16
+
+/* a tuple without its packet count, and the packets of all tuples like it */
+typedef struct _test_group_t {
+    uint64_t key[3];
+    uint64_t packets;
+} test_group_t;
+
+static void _test_key(uint64_t *key, int s8, uint32_t src_ip, uint32_t dst_ip, uint16_t src_port, uint16_t dst_port,
+                      uint8_t proto, uint8_t ttl, uint8_t tcp_flags, uint16_t ip_len) {
+    key[0] = (uint64_t)src_ip << 32 | dst_ip;
+    key[1] = (uint64_t)src_port << 48 | (uint64_t)dst_port << 32 | (uint64_t)ip_len << 16 | (uint64_t)proto << 8 | ttl;
+    key[2] = (uint64_t)(s8 != 0) << 8 | tcp_flags;
+}
+
+static int _test_group_cmp(const void *a, const void *b) {
+    const test_group_t *x = a;
+    const test_group_t *y = b;
+
+    for (int i = 0; i < 3; i++) {
+        if (x->key[i] != y->key[i]) {
+            return x->key[i] < y->key[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+/* sorts groups and sums the packets of equal ones, returns how many are left */
+static size_t _test_combine(test_group_t *groups, size_t n) {
+    size_t m = 0;
+
+    qsort(groups, n, sizeof(test_group_t), _test_group_cmp);
+    for (size_t i = 0; i < n; i++) {
+        if (m > 0 && _test_group_cmp(&groups[m - 1], &groups[i]) == 0) {
+            groups[m - 1].packets += groups[i].packets;
+        } else {
+            groups[m++] = groups[i];
+        }
+    }
+    return m;
+}
+
+/* counts the tuples of every interval of files starting in bucket, exactly */
+static size_t _test_recount(const test_file_t *files, int nfiles, uint32_t bucket, uint16_t length,
+                            test_group_t *groups) {
+    flowtuple_tuple_t t;
+    uint32_t time;
+    size_t n = 0;
+
+    for (int f = 0; f < nfiles; f++) {
+        for (int i = 0; i < files[f].intervals; i++) {
+            time = files[f].start + (uint32_t)i * TEST_INTERVAL_LENGTH;
+            if (time - time % length != bucket) {
+                continue;
+            }
+            for (size_t j = 0; j < files[f].tuples; j++) {
+                test_tuple(&files[f], i, j, &t);
+                _test_key(groups[n].key, t.is_slash_eight, t.src_ip, t.dst_ip, t.src_port, t.dst_port, t.proto,
+                          t.ttl, t.tcp_flags, t.ip_len);
+                groups[n++].packets = t.pkt_cnt;
+            }
+        }
+    }
+    return _test_combine(groups, n);
+}
+
+/* rolls files up into intervals of length, checking what is read back against an exact recount,
+ * returns the number of tuples rolled up */
+static uint64_t _test_check_rollup(const char **paths, const test_file_t *files, int nfiles, uint16_t length) {
+    flowtuple_interval_columns_t *ic;
+    const flowtuple_columns_t *cols;
+    flowtuple_handle_t *handle;
+    flowtuple_writer_t *writer;
+    flowtuple_rollup_t *rollup;
+    flowtuple_record_t *record;
+    flowtuple_trailer_t *trailer = NULL;
+    flowtuple_interval_t *interval;
+    flowtuple_errno_t err;
+    test_group_t *expected, *got;
+    uint32_t starts[TEST_MAX_BUCKETS], ends[TEST_MAX_BUCKETS];
+    uint32_t first, last;
+    uint64_t packets = 0, runtime = 0, tuples = 0, read = 0;
+    size_t total = 0, n, m, k;
+    int intervals = 0, is_start = 1, s8, ret;
+    long added;
+
+    for (int f = 0; f < nfiles; f++) {
+        total += (size_t)files[f].intervals * files[f].tuples;
+    }
+    TEST_CHECK((expected = malloc(total * sizeof(test_group_t))) != NULL);
+    TEST_CHECK((got = malloc(total * sizeof(test_group_t))) != NULL);
+
+    TEST_CHECK((writer = flowtuple_writer_create("test_rollup.ft", WANDIO_COMPRESS_NONE, 0, &err)) != NULL);
+    TEST_CHECK((rollup = flowtuple_rollup_create(writer, length)) != NULL);
+    for (int f = 0; f < nfiles; f++) {
+        TEST_CHECK((handle = flowtuple_initialize(paths[f], &err)) != NULL);
+        TEST_CHECK((added = flowtuple_rollup_read(rollup, handle)) == (long)(files[f].intervals * files[f].tuples));
+        read += (uint64_t)added;
+        flowtuple_release(handle);
+    }
+    TEST_CHECK(flowtuple_rollup_finish(rollup) == 0);
+    TEST_CHECK(flowtuple_rollup_errno(rollup) == FLOWTUPLE_ERR_OK);
+    TEST_CHECK(flowtuple_writer_close(writer) == FLOWTUPLE_ERR_OK);
+
+    /* the header takes the new length, the trailer sums those of the files */
+    TEST_CHECK((handle = flowtuple_initialize("test_rollup.ft", &err)) != NULL);
+    TEST_CHECK((record = flowtuple_record_create()) != NULL);
+    while ((ret = flowtuple_get_next_record(handle, record)) == 1) {
+        switch (flowtuple_record_get_type(record)) {
+            case FLOWTUPLE_RECORD_TYPE_HEADER:
+                TEST_CHECK(ntohs(flowtuple_header_get_interval_length(flowtuple_record_get_header(record))) == length);
+                TEST_CHECK(ntohl(flowtuple_header_get_local_init_time(flowtuple_record_get_header(record))) ==
+                           files[0].start);
+                break;
+            case FLOWTUPLE_RECORD_TYPE_INTERVAL:
+                interval = flowtuple_record_get_interval(record);
+                TEST_CHECK(intervals < TEST_MAX_BUCKETS);
+                TEST_CHECK(ntohs(flowtuple_interval_get_number(interval)) == intervals);
+                if (is_start) {
+                    starts[intervals] = ntohl(flowtuple_interval_get_time(interval));
+                } else {
+                    ends[intervals++] = ntohl(flowtuple_interval_get_time(interval));
+                }
+                is_start = !is_start;
+                break;
+            case FLOWTUPLE_RECORD_TYPE_TRAILER:
+                trailer = flowtuple_record_get_trailer(record);
+                for (int f = 0; f < nfiles; f++) {
+                    packets += (uint64_t)files[f].intervals * files[f].tuples * 3;
+                    runtime += (uint64_t)files[f].intervals * TEST_INTERVAL_LENGTH;
+                }
+                first = files[0].start;
+                last = files[nfiles - 1].start + (uint32_t)files[nfiles - 1].intervals * TEST_INTERVAL_LENGTH;
+                TEST_CHECK(be64toh(flowtuple_trailer_get_packet_count(trailer)) == packets);
+                TEST_CHECK(be64toh(flowtuple_trailer_get_accepted_count(trailer)) == packets / 3 * 2);
+                TEST_CHECK(be64toh(flowtuple_trailer_get_dropped_count(trailer)) == 0);
+                TEST_CHECK(ntohl(flowtuple_trailer_get_first_packet_time(trailer)) == first);
+                TEST_CHECK(ntohl(flowtuple_trailer_get_last_packet_time(trailer)) == last - 1);
+                TEST_CHECK(ntohl(flowtuple_trailer_get_local_final_time(trailer)) == last);
+                TEST_CHECK(ntohl(flowtuple_trailer_get_runtime(trailer)) == runtime);
+                break;
+            default:
+                break;
+        }
+    }
+    TEST_CHECK(ret == 0 && trailer != NULL);
+    flowtuple_record_free(record);
+    flowtuple_release(handle);
+    TEST_CHECK((uint64_t)intervals == flowtuple_rollup_get_interval_count(rollup));
+
+    /* every interval lies within one multiple of length, starting on it unless it is the first */
+    for (int i = 0; i < intervals; i++) {
+        TEST_CHECK(starts[i] / length == ends[i] / length);
+        TEST_CHECK(i == 0 || starts[i] % length == 0);
+        TEST_CHECK(i == 0 || starts[i] / length > starts[i - 1] / length);
+    }
+    TEST_CHECK(starts[0] == files[0].start);
+
+    /* and holds the tuples of the intervals it was made of, packets summed */
+    TEST_CHECK((handle = flowtuple_initialize("test_rollup.ft", &err)) != NULL);
+    TEST_CHECK((ic = flowtuple_interval_columns_create()) != NULL);
+    for (int i = 0; i < intervals; i++) {
+        TEST_CHECK(flowtuple_read_interval_columns(handle, ic) == 1);
+        cols = flowtuple_interval_columns_get_columns(ic);
+        n = 0;
+        for (size_t c = 0; c < flowtuple_interval_columns_get_class_count(ic); c++) {
+            k = flowtuple_interval_columns_get_class_offset(ic, c);
+            m = k + (c + 1 < flowtuple_interval_columns_get_class_count(ic) ?
+                     flowtuple_interval_columns_get_class_offset(ic, c + 1) - k : flowtuple_interval_columns_get_count(ic) - k);
+            s8 = flowtuple_class_get_magic(flowtuple_interval_columns_get_class(ic, c)) == FLOWTUPLE_MAGIC_SIXT;
+            for (; k < m; k++, n++) {
+                TEST_CHECK(n < total);
+                _test_key(got[n].key, s8, cols->src_ip[k], cols->dst_ip[k], cols->src_port[k],
+                          cols->dst_port[k], cols->proto[k], cols->ttl[k], cols->tcp_flags[k], cols->ip_len[k]);
+                got[n].packets = cols->pkt_cnt[k];
+            }
+        }
+        /* tuples are unique within an interval */
+        TEST_CHECK(_test_combine(got, n) == n);
+        TEST_CHECK(_test_recount(files, nfiles, starts[i] - starts[i] % length, length, expected) == n);
+        TEST_CHECK(memcmp(got, expected, n * sizeof(test_group_t)) == 0);
+        tuples += n;
+    }
+    TEST_CHECK(flowtuple_read_interval_columns(handle, ic) == 0);
+    TEST_CHECK(tuples == flowtuple_rollup_get_tuple_count(rollup));
+    TEST_CHECK(tuples <= read);
+    flowtuple_interval_columns_free(ic);
+    flowtuple_release(handle);
+
+    flowtuple_rollup_free(rollup);
+    free(expected);
+    free(got);
+    return tuples;
+}
+
+int main(void) {
+    /* the second file carries on where the first stopped, with the same tuples interval by
+     * interval, so those sharing a roll-up of 900 seconds are combined but not those of 300 */
+    test_file_t files[2] = {{17, 1499999520, 6, 3000}, {17, 1499999880, 7, 3000}};
+    const char *paths[2] = {"test_rollup_0.ft", "test_rollup_1.ft"};
+    uint64_t total = (uint64_t)(files[0].intervals + files[1].intervals) * 3000;
+
+    for (int f = 0; f < 2; f++) {
+        TEST_CHECK(test_write_file(paths[f], &files[f]) == 0);
+    }
+    TEST_CHECK(_test_check_rollup(paths, files, 1, 300) == (uint64_t)files[0].intervals * 3000);
+    TEST_CHECK(_test_check_rollup(paths, files, 2, 300) == total);
+    TEST_CHECK(_test_check_rollup(paths, files, 2, 900) == total - (uint64_t)files[0].intervals * 3000);
+    TEST_CHECK(_test_check_rollup(paths, files, 2, 60) == total);
+
+    for (int f = 0; f < 2; f++) {
+        remove(paths[f]);
+    }
+    remove("test_rollup.ft");
+    return 0;
+}
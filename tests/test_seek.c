@@ -0,0 +1,137 @@
+/*
+ *  test_seek.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <arpa/inet.h>
+
+#include <wandio.h>
+
+#include "testutil.h"
+
+/* checks a data record against the tuple it was generated from */
+static void _test_check_data(flowtuple_data_t *data, const flowtuple_tuple_t *tuple) {
+    TEST_CHECK(flowtuple_data_is_slash_eight(data) == tuple->is_slash_eight);
+    TEST_CHECK(ntohl(flowtuple_data_get_src_ip(data)) == tuple->src_ip);
+    if (tuple->is_slash_eight) {
+        TEST_CHECK(flowtuple_data_get_dest_ip(data) == tuple->dst_ip);
+    } else {
+        TEST_CHECK(ntohl(flowtuple_data_get_dest_ip(data)) == tuple->dst_ip);
+    }
+    TEST_CHECK(ntohs(flowtuple_data_get_src_port(data)) == tuple->src_port);
+    TEST_CHECK(ntohs(flowtuple_data_get_dest_port(data)) == tuple->dst_port);
+    TEST_CHECK(flowtuple_data_get_protocol(data) == tuple->proto);
+    TEST_CHECK(flowtuple_data_get_ttl(data) == tuple->ttl);
+    TEST_CHECK(flowtuple_data_get_tcp_flags(data) == tuple->tcp_flags);
+    TEST_CHECK(ntohs(flowtuple_data_get_ip_len(data)) == tuple->ip_len);
+    TEST_CHECK(ntohl(flowtuple_data_get_packet_count(data)) == tuple->pkt_cnt);
+}
+
+/* seeks to a time and reads the interval the seek lands on */
+static void _test_seek(flowtuple_handle_t *handle, flowtuple_record_t *record, const test_file_t *file,
+                       uint32_t time, int expected) {
+    flowtuple_tuple_t tuple;
+    size_t tuples = 0;
+
+    TEST_CHECK(flowtuple_seek_interval(handle, time) == 0);
+    TEST_CHECK(flowtuple_get_next_record(handle, record) == 1);
+    TEST_CHECK(flowtuple_record_get_type(record) == FLOWTUPLE_RECORD_TYPE_INTERVAL);
+    TEST_CHECK(ntohs(flowtuple_interval_get_number(flowtuple_record_get_interval(record))) == expected);
+    TEST_CHECK(ntohl(flowtuple_interval_get_time(flowtuple_record_get_interval(record))) ==
+               file->start + (uint32_t)expected * TEST_INTERVAL_LENGTH);
+
+    while (flowtuple_get_next_record(handle, record) == 1 &&
+           flowtuple_record_get_type(record) != FLOWTUPLE_RECORD_TYPE_INTERVAL) {
+        if (flowtuple_record_get_type(record) == FLOWTUPLE_RECORD_TYPE_FLOWTUPLE_DATA) {
+            test_tuple(file, expected, tuples++, &tuple);
+            _test_check_data(flowtuple_record_get_data(record), &tuple);
+        }
+    }
+    TEST_CHECK(flowtuple_record_get_type(record) == FLOWTUPLE_RECORD_TYPE_INTERVAL);
+    TEST_CHECK(tuples == file->tuples);
+}
+
+static void _test_file(const char *filename, const test_file_t *file, int gzip) {
+    flowtuple_index_t *index, *loaded;
+    flowtuple_handle_t *handle;
+    flowtuple_record_t *record;
+    flowtuple_errno_t err;
+    char sidecar[64];
+
+    TEST_CHECK((index = flowtuple_index_build(filename, &err)) != NULL);
+    TEST_CHECK(flowtuple_index_get_interval_count(index) == (size_t)file->intervals);
+    for (int i = 0; i < file->intervals; i++) {
+        TEST_CHECK(ntohl(flowtuple_interval_get_time(flowtuple_index_get_interval(index, i))) ==
+                   file->start + (uint32_t)i * TEST_INTERVAL_LENGTH);
+        TEST_CHECK(flowtuple_index_get_class_count(index, i) == 2);
+        TEST_CHECK(flowtuple_index_get_class_offset(index, i, 0) > flowtuple_index_get_interval_offset(index, i));
+    }
+    TEST_CHECK(gzip ? flowtuple_index_get_checkpoint_count(index) > 0 : flowtuple_index_get_checkpoint_count(index) == 0);
+
+    /* a sidecar loads back to the same index */
+    snprintf(sidecar, sizeof(sidecar), "%s.idx", filename);
+    TEST_CHECK(flowtuple_index_save(index, sidecar) == 0);
+    TEST_CHECK((loaded = flowtuple_index_load(sidecar, &err)) != NULL);
+    TEST_CHECK(flowtuple_index_get_interval_count(loaded) == flowtuple_index_get_interval_count(index));
+    TEST_CHECK(flowtuple_index_get_checkpoint_count(loaded) == flowtuple_index_get_checkpoint_count(index));
+    for (int i = 0; i < file->intervals; i++) {
+        TEST_CHECK(flowtuple_index_get_interval_offset(loaded, i) == flowtuple_index_get_interval_offset(index, i));
+        TEST_CHECK(flowtuple_index_get_class_offset(loaded, i, 1) == flowtuple_index_get_class_offset(index, i, 1));
+    }
+    flowtuple_index_free(index);
+
+    TEST_CHECK((handle = flowtuple_initialize(filename, &err)) != NULL);
+    TEST_CHECK((record = flowtuple_record_create()) != NULL);
+    TEST_CHECK(flowtuple_seek_interval(handle, file->start) < 0);
+    TEST_CHECK(flowtuple_handle_set_index(handle, loaded) == 0);
+
+    /* backwards, forwards, within an interval and out of range */
+    for (int i = file->intervals - 1; i >= 0; i -= 3) {
+        _test_seek(handle, record, file, file->start + (uint32_t)i * TEST_INTERVAL_LENGTH, i);
+    }
+    for (int i = 0; i < file->intervals; i += 5) {
+        _test_seek(handle, record, file, file->start + (uint32_t)i * TEST_INTERVAL_LENGTH + 30, i);
+    }
+    _test_seek(handle, record, file, file->start - 1, 0);
+    _test_seek(handle, record, file, file->start + 1000000, file->intervals - 1);
+
+    /* reading on after a seek reaches the trailer */
+    _test_seek(handle, record, file, file->start, 0);
+    while (flowtuple_get_next_record(handle, record) == 1 &&
+           flowtuple_record_get_type(record) != FLOWTUPLE_RECORD_TYPE_TRAILER) {
+    }
+    TEST_CHECK(flowtuple_record_get_type(record) == FLOWTUPLE_RECORD_TYPE_TRAILER);
+
+    flowtuple_record_free(record);
+    flowtuple_release(handle);
+    flowtuple_index_free(loaded);
+    remove(sidecar);
+}
+
+int main(void) {
+    test_file_t file = {2, 1500000000, 40, 10000};
+
+    TEST_CHECK(test_write_file("test_seek.ft", &file) == 0);
+    TEST_CHECK(test_copy_file("test_seek.ft", "test_seek.ft.gz", WANDIO_COMPRESS_ZLIB) == 0);
+
+    _test_file("test_seek.ft", &file, 0);
+    _test_file("test_seek.ft.gz", &file, 1);
+
+    remove("test_seek.ft");
+    remove("test_seek.ft.gz");
+    return 0;
+}
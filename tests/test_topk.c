@@ -0,0 +1,264 @@
+/*
+ *  test_topk.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "testutil.h"
+
+#define TEST_IPS 4000
+#define TEST_PORTS 8
+#define TEST_TUPLES 200000
+#define TEST_BLOCK 1000
+#define TEST_CAPACITY 64
+
+static const uint16_t test_ports[TEST_PORTS] = {22, 23, 80, 443, 445, 1433, 3389, 8080};
+
+/* exact weights of a stream, by source, destination port and both */
+typedef struct _test_exact_t {
+    uint64_t by_ip[TEST_IPS];
+    uint64_t by_port[TEST_PORTS];
+    uint64_t by_both[TEST_IPS][TEST_PORTS];
+    uint64_t total;
+} test_exact_t;
+
+static uint32_t _test_next(uint32_t *state) {
+    *state = *state * 1103515245 + 12345;
+    return *state >> 8;
+}
+
+/* adds a skewed stream to a sketch per key and to exact counts, a few
+ * sources and ports taking most of the weight */
+static void _test_add_stream(uint32_t seed, size_t tuples, flowtuple_topk_t **sketches, test_exact_t *exact) {
+    static uint32_t src_ip[TEST_BLOCK], dst_ip[TEST_BLOCK], pkt_cnt[TEST_BLOCK];
+    static uint16_t src_port[TEST_BLOCK], dst_port[TEST_BLOCK], ip_len[TEST_BLOCK];
+    static uint8_t proto[TEST_BLOCK], ttl[TEST_BLOCK], tcp_flags[TEST_BLOCK];
+    flowtuple_columns_t cols = {src_ip, dst_ip, src_port, dst_port, proto, ttl, tcp_flags, ip_len, pkt_cnt};
+    uint32_t state = seed;
+    size_t ip, port, n;
+
+    memset(dst_ip, 0, sizeof(dst_ip));
+    for (size_t i = 0; i < tuples; i += n) {
+        n = tuples - i < TEST_BLOCK ? tuples - i : TEST_BLOCK;
+        for (size_t j = 0; j < n; j++) {
+            ip = _test_next(&state) % 10 < 3 ? seed % 7 + _test_next(&state) % 5 : _test_next(&state) % TEST_IPS;
+            port = _test_next(&state) % 4 == 0 ? _test_next(&state) % TEST_PORTS : seed % 3;
+            src_ip[j] = 0x0a000000u + (uint32_t)ip;
+            dst_port[j] = test_ports[port];
+            pkt_cnt[j] = 1 + _test_next(&state) % 10;
+            exact->by_ip[ip] += pkt_cnt[j];
+            exact->by_port[port] += pkt_cnt[j];
+            exact->by_both[ip][port] += pkt_cnt[j];
+            exact->total += pkt_cnt[j];
+        }
+        for (int k = 0; k < 3; k++) {
+            flowtuple_topk_add_columns(sketches[k], &cols, n);
+        }
+    }
+}
+
+static size_t _test_port_index(uint16_t port) {
+    for (size_t p = 0; p < TEST_PORTS; p++) {
+        if (test_ports[p] == port) {
+            return p;
+        }
+    }
+    TEST_CHECK(0);
+    return 0;
+}
+
+/* true weight of the key of an item */
+static uint64_t _test_weight(flowtuple_topk_key_t key, const flowtuple_topk_item_t *item, const test_exact_t *exact) {
+    size_t ip = item->src_ip - 0x0a000000u;
+
+    switch (key) {
+        case FLOWTUPLE_TOPK_SRC_IP:
+            TEST_CHECK(item->dst_port == 0 && ip < TEST_IPS);
+            return exact->by_ip[ip];
+        case FLOWTUPLE_TOPK_DST_PORT:
+            TEST_CHECK(item->src_ip == 0);
+            return exact->by_port[_test_port_index(item->dst_port)];
+        default:
+            TEST_CHECK(ip < TEST_IPS);
+            return exact->by_both[ip][_test_port_index(item->dst_port)];
+    }
+}
+
+/* whether a key is among the items */
+static int _test_find(const flowtuple_topk_item_t *items, size_t n, uint32_t src_ip, uint16_t dst_port) {
+    for (size_t i = 0; i < n; i++) {
+        if (items[i].src_ip == src_ip && items[i].dst_port == dst_port) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* checks the Space-Saving guarantees of a sketch against the exact weights */
+static void _test_check_bounds(flowtuple_topk_t *topk, flowtuple_topk_key_t key, const test_exact_t *exact) {
+    static flowtuple_topk_item_t items[TEST_CAPACITY];
+    uint64_t total = flowtuple_topk_get_total(topk);
+    uint64_t heavy = total / TEST_CAPACITY;
+    uint64_t weight;
+    size_t n, heavies = 0;
+
+    TEST_CHECK(total == exact->total);
+    n = flowtuple_topk_get(topk, items, TEST_CAPACITY);
+    TEST_CHECK(n > 0 && n <= TEST_CAPACITY);
+    for (size_t i = 0; i < n; i++) {
+        weight = _test_weight(key, &items[i], exact);
+        TEST_CHECK(items[i].count >= weight);
+        TEST_CHECK(items[i].count - items[i].error <= weight);
+        TEST_CHECK(items[i].error <= heavy);
+        TEST_CHECK(i == 0 || items[i].count <= items[i - 1].count);
+    }
+
+    /* every key heavier than W / capacity is among the items */
+    for (size_t ip = 0; ip < TEST_IPS; ip++) {
+        for (size_t p = 0; p < TEST_PORTS; p++) {
+            if (key == FLOWTUPLE_TOPK_SRC_IP_DST_PORT && exact->by_both[ip][p] > heavy) {
+                TEST_CHECK(_test_find(items, n, 0x0a000000u + (uint32_t)ip, test_ports[p]));
+                heavies++;
+            }
+        }
+        if (key == FLOWTUPLE_TOPK_SRC_IP && exact->by_ip[ip] > heavy) {
+            TEST_CHECK(_test_find(items, n, 0x0a000000u + (uint32_t)ip, 0));
+            heavies++;
+        }
+    }
+    for (size_t p = 0; key == FLOWTUPLE_TOPK_DST_PORT && p < TEST_PORTS; p++) {
+        if (exact->by_port[p] > heavy) {
+            TEST_CHECK(_test_find(items, n, 0, test_ports[p]));
+            heavies++;
+        }
+    }
+    TEST_CHECK(heavies > 0);
+}
+
+static void _test_add_exact(test_exact_t *dst, const test_exact_t *src) {
+    for (size_t ip = 0; ip < TEST_IPS; ip++) {
+        dst->by_ip[ip] += src->by_ip[ip];
+        for (size_t p = 0; p < TEST_PORTS; p++) {
+            dst->by_both[ip][p] += src->by_both[ip][p];
+        }
+    }
+    for (size_t p = 0; p < TEST_PORTS; p++) {
+        dst->by_port[p] += src->by_port[p];
+    }
+    dst->total += src->total;
+}
+
+/* checks that data records and columns of a file make the same sketch */
+static void _test_check_data(void) {
+    test_file_t file = {16, 1500000000, 2, 5000};
+    static flowtuple_topk_item_t x[TEST_CAPACITY], y[TEST_CAPACITY];
+    static uint32_t src_ip[TEST_BLOCK], dst_ip[TEST_BLOCK], pkt_cnt[TEST_BLOCK];
+    static uint16_t src_port[TEST_BLOCK], dst_port[TEST_BLOCK], ip_len[TEST_BLOCK];
+    static uint8_t proto[TEST_BLOCK], ttl[TEST_BLOCK], tcp_flags[TEST_BLOCK];
+    flowtuple_columns_t cols = {src_ip, dst_ip, src_port, dst_port, proto, ttl, tcp_flags, ip_len, pkt_cnt};
+    flowtuple_topk_t *a, *b;
+    flowtuple_handle_t *handle;
+    flowtuple_record_t *record;
+    flowtuple_batch_t batch;
+    flowtuple_errno_t err;
+    size_t n;
+    long ret;
+
+    TEST_CHECK(test_write_file("test_topk.ft", &file) == 0);
+    TEST_CHECK((a = flowtuple_topk_create(FLOWTUPLE_TOPK_SRC_IP_DST_PORT, TEST_CAPACITY)) != NULL);
+    TEST_CHECK((b = flowtuple_topk_create(FLOWTUPLE_TOPK_SRC_IP_DST_PORT, TEST_CAPACITY)) != NULL);
+
+    TEST_CHECK((handle = flowtuple_initialize("test_topk.ft", &err)) != NULL);
+    TEST_CHECK((record = flowtuple_record_create()) != NULL);
+    while (flowtuple_get_next_record(handle, record) == 1) {
+        if (flowtuple_record_get_type(record) == FLOWTUPLE_RECORD_TYPE_FLOWTUPLE_DATA) {
+            flowtuple_topk_add_data(a, flowtuple_record_get_data(record));
+        }
+    }
+    flowtuple_record_free(record);
+    flowtuple_release(handle);
+
+    TEST_CHECK((handle = flowtuple_initialize("test_topk.ft", &err)) != NULL);
+    while ((ret = flowtuple_read_columns(handle, &cols, TEST_BLOCK, &batch)) >= 0 &&
+           batch.type != FLOWTUPLE_RECORD_TYPE_NULL) {
+        flowtuple_topk_add_columns(b, &cols, (size_t)ret);
+    }
+    TEST_CHECK(ret == 0);
+    flowtuple_release(handle);
+
+    TEST_CHECK(flowtuple_topk_get_total(a) == flowtuple_topk_get_total(b));
+    TEST_CHECK((n = flowtuple_topk_get(a, x, TEST_CAPACITY)) == flowtuple_topk_get(b, y, TEST_CAPACITY));
+    for (size_t i = 0; i < n; i++) {
+        TEST_CHECK(x[i].src_ip == y[i].src_ip && x[i].dst_port == y[i].dst_port);
+        TEST_CHECK(x[i].count == y[i].count && x[i].error == y[i].error);
+    }
+
+    flowtuple_topk_free(a);
+    flowtuple_topk_free(b);
+    remove("test_topk.ft");
+}
+
+int main(void) {
+    static const flowtuple_topk_key_t keys[] = {FLOWTUPLE_TOPK_SRC_IP, FLOWTUPLE_TOPK_DST_PORT,
+                                                FLOWTUPLE_TOPK_SRC_IP_DST_PORT};
+    static test_exact_t a, b;
+    flowtuple_topk_t *x[3], *y[3];
+    flowtuple_topk_t *other;
+    uint64_t total;
+
+    for (int k = 0; k < 3; k++) {
+        TEST_CHECK((x[k] = flowtuple_topk_create(keys[k], TEST_CAPACITY)) != NULL);
+        TEST_CHECK((y[k] = flowtuple_topk_create(keys[k], TEST_CAPACITY)) != NULL);
+    }
+    TEST_CHECK(flowtuple_topk_create(FLOWTUPLE_TOPK_SRC_IP, 0) == NULL);
+
+    /* two streams with different heavy hitters */
+    _test_add_stream(1, TEST_TUPLES, x, &a);
+    _test_add_stream(4, TEST_TUPLES / 2, y, &b);
+    for (int k = 0; k < 3; k++) {
+        _test_check_bounds(x[k], keys[k], &a);
+        _test_check_bounds(y[k], keys[k], &b);
+    }
+
+    /* a merge keeps the bounds for the weight of both, the merged sketch is left alone */
+    _test_add_exact(&a, &b);
+    for (int k = 0; k < 3; k++) {
+        total = flowtuple_topk_get_total(y[k]);
+        TEST_CHECK(flowtuple_topk_merge(x[k], y[k]) == 0);
+        TEST_CHECK(flowtuple_topk_get_total(y[k]) == total);
+        _test_check_bounds(x[k], keys[k], &a);
+        _test_check_bounds(y[k], keys[k], &b);
+    }
+
+    /* sketches of other keys or capacities do not merge */
+    TEST_CHECK(flowtuple_topk_merge(x[0], y[1]) < 0);
+    TEST_CHECK((other = flowtuple_topk_create(FLOWTUPLE_TOPK_SRC_IP, TEST_CAPACITY / 2)) != NULL);
+    TEST_CHECK(flowtuple_topk_merge(x[0], other) < 0);
+    flowtuple_topk_free(other);
+
+    /* a reset sketch starts over */
+    flowtuple_topk_reset(x[0]);
+    TEST_CHECK(flowtuple_topk_get_total(x[0]) == 0);
+
+    for (int k = 0; k < 3; k++) {
+        flowtuple_topk_free(x[k]);
+        flowtuple_topk_free(y[k]);
+    }
+    _test_check_data();
+    return 0;
+}
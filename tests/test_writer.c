@@ -0,0 +1,136 @@
+/*
+ *  test_writer.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+
+#include <wandio.h>
+
+#include "testutil.h"
+
+#define TEST_BATCH 1000
+
+/* checks that two files hold the same bytes */
+static void _test_check_same(const char *a, const char *b) {
+    static uint8_t x[65536], y[65536];
+    FILE *fa, *fb;
+    size_t n;
+
+    TEST_CHECK((fa = fopen(a, "rb")) != NULL);
+    TEST_CHECK((fb = fopen(b, "rb")) != NULL);
+    do {
+        n = fread(x, 1, sizeof(x), fa);
+        TEST_CHECK(fread(y, 1, sizeof(y), fb) == n);
+        TEST_CHECK(memcmp(x, y, n) == 0);
+    } while (n > 0);
+    fclose(fa);
+    fclose(fb);
+}
+
+/* copies a file with lazy records, which are written without decoding */
+static void _test_copy_lazy(const char *filename, const char *output) {
+    flowtuple_handle_t *handle;
+    flowtuple_writer_t *writer;
+    flowtuple_record_t *record;
+    flowtuple_errno_t err;
+    int ret;
+
+    TEST_CHECK((handle = flowtuple_initialize(filename, &err)) != NULL);
+    TEST_CHECK((writer = flowtuple_writer_create(output, WANDIO_COMPRESS_NONE, 0, &err)) != NULL);
+    TEST_CHECK((record = flowtuple_record_create()) != NULL);
+    flowtuple_handle_set_lazy(handle, 1);
+    while ((ret = flowtuple_get_next_record(handle, record)) == 1) {
+        TEST_CHECK(flowtuple_writer_write_record(writer, record) == 0);
+    }
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(flowtuple_writer_close(writer) == FLOWTUPLE_ERR_OK);
+    flowtuple_record_free(record);
+    flowtuple_release(handle);
+}
+
+/* copies a file with columns, and records for everything but tuples */
+static void _test_copy_columns(const char *filename, const char *output, uint64_t tuples) {
+    static uint32_t src_ip[TEST_BATCH], dst_ip[TEST_BATCH], pkt_cnt[TEST_BATCH];
+    static uint16_t src_port[TEST_BATCH], dst_port[TEST_BATCH], ip_len[TEST_BATCH];
+    static uint8_t proto[TEST_BATCH], ttl[TEST_BATCH], tcp_flags[TEST_BATCH];
+    flowtuple_columns_t cols = {src_ip, dst_ip, src_port, dst_port, proto, ttl, tcp_flags, ip_len, pkt_cnt};
+    flowtuple_handle_t *handle;
+    flowtuple_writer_t *writer;
+    flowtuple_batch_t batch;
+    flowtuple_errno_t err;
+    long n;
+
+    TEST_CHECK((handle = flowtuple_initialize(filename, &err)) != NULL);
+    TEST_CHECK((writer = flowtuple_writer_create(output, WANDIO_COMPRESS_NONE, 0, &err)) != NULL);
+    while ((n = flowtuple_read_columns(handle, &cols, TEST_BATCH, &batch)) >= 0 &&
+           batch.type != FLOWTUPLE_RECORD_TYPE_NULL) {
+        if (n > 0) {
+            TEST_CHECK(flowtuple_writer_write_columns(writer, flowtuple_class_get_magic(batch.ftclass),
+                                                      flowtuple_class_get_class_type(batch.ftclass), &cols, n) == 0);
+        } else {
+            TEST_CHECK(flowtuple_writer_write_record(writer, batch.record) == 0);
+        }
+    }
+    TEST_CHECK(n == 0);
+    TEST_CHECK(flowtuple_writer_get_tuple_count(writer) == tuples);
+    TEST_CHECK(flowtuple_writer_close(writer) == FLOWTUPLE_ERR_OK);
+    flowtuple_release(handle);
+}
+
+int main(void) {
+    test_file_t file = {8, 1500000000, 12, 15000};
+    flowtuple_writer_t *writer;
+    flowtuple_errno_t err;
+    uint64_t hash, tuples, copied;
+
+    TEST_CHECK(test_write_file("test_writer.ft", &file) == 0);
+    TEST_CHECK((hash = test_hash_file("test_writer.ft", &tuples)) != 0);
+    TEST_CHECK(tuples == (uint64_t)file.intervals * file.tuples);
+
+    /* records, lazy records and columns all copy to the same bytes */
+    TEST_CHECK(test_copy_file("test_writer.ft", "test_writer_copy.ft", WANDIO_COMPRESS_NONE) == 0);
+    _test_check_same("test_writer.ft", "test_writer_copy.ft");
+    _test_copy_lazy("test_writer.ft", "test_writer_copy.ft");
+    _test_check_same("test_writer.ft", "test_writer_copy.ft");
+    _test_copy_columns("test_writer.ft", "test_writer_copy.ft", tuples);
+    _test_check_same("test_writer.ft", "test_writer_copy.ft");
+
+    /* and through gzip and back */
+    TEST_CHECK(test_copy_file("test_writer.ft", "test_writer_copy.ft.gz", WANDIO_COMPRESS_ZLIB) == 0);
+    TEST_CHECK(test_hash_file("test_writer_copy.ft.gz", &copied) == hash);
+    TEST_CHECK(copied == tuples);
+    TEST_CHECK(test_copy_file("test_writer_copy.ft.gz", "test_writer_copy.ft", WANDIO_COMPRESS_NONE) == 0);
+    _test_check_same("test_writer.ft", "test_writer_copy.ft");
+
+    /* intervals are started and ended in turn, an error sticks */
+    TEST_CHECK((writer = flowtuple_writer_create("test_writer_copy.ft", WANDIO_COMPRESS_NONE, 0, &err)) != NULL);
+    TEST_CHECK(flowtuple_writer_end_interval(writer, 1500000000) < 0);
+    TEST_CHECK(flowtuple_writer_errno(writer) != FLOWTUPLE_ERR_OK);
+    TEST_CHECK(flowtuple_writer_start_interval(writer, 0, 1500000000) < 0);
+    TEST_CHECK(flowtuple_writer_close(writer) != FLOWTUPLE_ERR_OK);
+
+    TEST_CHECK((writer = flowtuple_writer_create("test_writer_copy.ft", WANDIO_COMPRESS_NONE, 0, &err)) != NULL);
+    TEST_CHECK(flowtuple_writer_start_interval(writer, 0, 1500000000) == 0);
+    TEST_CHECK(flowtuple_writer_start_interval(writer, 1, 1500000060) < 0);
+    TEST_CHECK(flowtuple_writer_close(writer) != FLOWTUPLE_ERR_OK);
+
+    remove("test_writer.ft");
+    remove("test_writer_copy.ft");
+    remove("test_writer_copy.ft.gz");
+    return 0;
+}
@@ -0,0 +1,352 @@
+/*
+ *  testutil.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <string.h>
+
+#include <wandio.h>
+#include <zlib.h>
+
+#include "testutil.h"
+
+#define TEST_BLOCK 4096
+
+static const uint16_t test_ports[] = {22, 23, 80, 443, 445, 1433, 3389, 8080};
+static const uint8_t test_protos[] = {1, 6, 17};
+
+/* splitmix64, so that every tuple can be made on its own */
+static uint64_t _test_mix(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+void test_tuple(const test_file_t *file, int interval, size_t i, flowtuple_tuple_t *tuple) {
+    uint64_t h = _test_mix(((uint64_t)file->seed << 40) ^ ((uint64_t)interval << 24) ^ i);
+    uint64_t g = _test_mix(h);
+
+    tuple->is_slash_eight = i < file->tuples / 2;
+    tuple->src_ip = 0x0a000000u + (uint32_t)(h % 5000);
+    tuple->dst_ip = tuple->is_slash_eight ? (uint32_t)(h >> 16) & 0xffffffu : (uint32_t)(h >> 16);
+    tuple->src_port = (uint16_t)(g >> 48);
+    tuple->dst_port = test_ports[(g >> 8) % 8];
+    tuple->proto = test_protos[(g >> 16) % 3];
+    tuple->ttl = (uint8_t)(g >> 24);
+    tuple->tcp_flags = (uint8_t)(g >> 32) & 0x3f;
+    tuple->ip_len = (uint16_t)(40 + (g >> 40) % 1460);
+    tuple->pkt_cnt = 1 + (uint32_t)(h >> 56) % 10;
+}
+
+static void _test_put16(uint8_t *buf, uint16_t v) {
+    buf[0] = (uint8_t)(v >> 8);
+    buf[1] = (uint8_t)v;
+}
+
+static void _test_put32(uint8_t *buf, uint32_t v) {
+    _test_put16(buf, (uint16_t)(v >> 16));
+    _test_put16(buf + 2, (uint16_t)v);
+}
+
+static void _test_put64(uint8_t *buf, uint64_t v) {
+    _test_put32(buf, (uint32_t)(v >> 32));
+    _test_put32(buf + 4, (uint32_t)v);
+}
+
+/* writes the intervals of file with a writer */
+static int _test_write_intervals(const char *filename, const test_file_t *file) {
+    static uint32_t src_ip[TEST_BLOCK], dst_ip[TEST_BLOCK], pkt_cnt[TEST_BLOCK];
+    static uint16_t src_port[TEST_BLOCK], dst_port[TEST_BLOCK], ip_len[TEST_BLOCK];
+    static uint8_t proto[TEST_BLOCK], ttl[TEST_BLOCK], tcp_flags[TEST_BLOCK];
+    flowtuple_columns_t cols = {src_ip, dst_ip, src_port, dst_port, proto, ttl, tcp_flags, ip_len, pkt_cnt};
+    flowtuple_tuple_t tuple;
+    flowtuple_writer_t *writer;
+    flowtuple_errno_t err;
+    uint32_t time;
+    size_t n;
+
+    if ((writer = flowtuple_writer_create(filename, WANDIO_COMPRESS_NONE, 0, &err)) == NULL) {
+        return -1;
+    }
+
+    for (int i = 0; i < file->intervals; i++) {
+        time = file->start + (uint32_t)i * TEST_INTERVAL_LENGTH;
+        flowtuple_writer_start_interval(writer, (uint16_t)i, time);
+        for (size_t j = 0; j < file->tuples; j += n) {
+            /* a block never straddles the two classes */
+            n = 0;
+            do {
+                test_tuple(file, i, j + n, &tuple);
+                src_ip[n] = tuple.src_ip;
+                dst_ip[n] = tuple.dst_ip;
+                src_port[n] = tuple.src_port;
+                dst_port[n] = tuple.dst_port;
+                proto[n] = tuple.proto;
+                ttl[n] = tuple.ttl;
+                tcp_flags[n] = tuple.tcp_flags;
+                ip_len[n] = tuple.ip_len;
+                pkt_cnt[n] = tuple.pkt_cnt;
+                n++;
+            } while (n < TEST_BLOCK && j + n < file->tuples && j + n != file->tuples / 2);
+
+            if (tuple.is_slash_eight) {
+                flowtuple_writer_write_columns(writer, FLOWTUPLE_MAGIC_SIXT, FLOWTUPLE_CLASS_TYPE_BACKSCATTER, &cols, n);
+            } else {
+                flowtuple_writer_write_columns(writer, FLOWTUPLE_MAGIC_SIXU, FLOWTUPLE_CLASS_TYPE_OTHER, &cols, n);
+            }
+        }
+        flowtuple_writer_end_interval(writer, time + TEST_INTERVAL_LENGTH - 1);
+    }
+    return flowtuple_writer_close(writer) == FLOWTUPLE_ERR_OK ? 0 : -1;
+}
+
+int test_write_file(const char *filename, const test_file_t *file) {
+    static const char traceuri[] = "test";
+    uint8_t buf[TEST_BLOCK];
+    uint32_t end = file->start + (uint32_t)file->intervals * TEST_INTERVAL_LENGTH;
+    char *body;
+    FILE *in = NULL, *out = NULL;
+    size_t n;
+    int ret = -1;
+
+    /* the writer makes the intervals, the header and trailer are packed here */
+    if ((body = malloc(strlen(filename) + 6)) == NULL) {
+        return -1;
+    }
+    sprintf(body, "%s.body", filename);
+    if (_test_write_intervals(body, file) < 0 || (in = fopen(body, "rb")) == NULL ||
+        (out = fopen(filename, "wb")) == NULL) {
+        goto done;
+    }
+
+    memcpy(buf, "EDGRHEAD", 8);
+    buf[8] = 2;
+    buf[9] = 0;
+    _test_put32(buf + 10, file->start);
+    _test_put16(buf + 14, TEST_INTERVAL_LENGTH);
+    _test_put16(buf + 16, sizeof(traceuri) - 1);
+    memcpy(buf + 18, traceuri, sizeof(traceuri) - 1);
+    _test_put16(buf + 17 + sizeof(traceuri), 1);
+    _test_put32(buf + 19 + sizeof(traceuri), 0x2b);
+    if (fwrite(buf, 1, 23 + sizeof(traceuri), out) != 23 + sizeof(traceuri)) {
+        goto done;
+    }
+
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        if (fwrite(buf, 1, n, out) != n) {
+            goto done;
+        }
+    }
+
+    memcpy(buf, "EDGRFOOT", 8);
+    _test_put64(buf + 8, (uint64_t)file->intervals * file->tuples * 3);
+    _test_put64(buf + 16, (uint64_t)file->intervals * file->tuples * 2);
+    _test_put64(buf + 24, 0);
+    _test_put32(buf + 32, file->start);
+    _test_put32(buf + 36, end - 1);
+    _test_put32(buf + 40, end);
+    _test_put32(buf + 44, end - file->start);
+    if (fwrite(buf, 1, 48, out) == 48) {
+        ret = 0;
+    }
+
+    done:
+    if (in != NULL) {
+        fclose(in);
+    }
+    if (out != NULL && fclose(out) != 0) {
+        ret = -1;
+    }
+    remove(body);
+    free(body);
+    return ret;
+}
+
+int test_copy_file(const char *filename, const char *output, int compress_type) {
+    flowtuple_handle_t *handle;
+    flowtuple_writer_t *writer;
+    flowtuple_record_t *record;
+    flowtuple_errno_t err;
+    int ret;
+
+    if ((handle = flowtuple_initialize(filename, &err)) == NULL) {
+        return -1;
+    }
+    if ((writer = flowtuple_writer_create(output, compress_type, 6, &err)) == NULL) {
+        flowtuple_release(handle);
+        return -1;
+    }
+
+    record = flowtuple_record_create();
+    while ((ret = flowtuple_get_next_record(handle, record)) > 0) {
+        if (flowtuple_writer_write_record(writer, record) < 0) {
+            ret = -1;
+            break;
+        }
+    }
+
+    flowtuple_record_free(record);
+    if (flowtuple_writer_close(writer) != FLOWTUPLE_ERR_OK) {
+        ret = -1;
+    }
+    flowtuple_release(handle);
+    return ret;
+}
+
+/* compresses len bytes of buf as one gzip member appended to out */
+static int _test_gzip_member(FILE *out, const uint8_t *buf, size_t len) {
+    static uint8_t chunk[TEST_BLOCK];
+    z_stream strm;
+    size_t n;
+    int ret;
+
+    memset(&strm, 0, sizeof(strm));
+    if (deflateInit2(&strm, 6, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return -1;
+    }
+    strm.next_in = (Bytef*)buf;
+    strm.avail_in = (uInt)len;
+    do {
+        strm.next_out = chunk;
+        strm.avail_out = sizeof(chunk);
+        ret = deflate(&strm, Z_FINISH);
+        n = sizeof(chunk) - strm.avail_out;
+        if (ret == Z_STREAM_ERROR || fwrite(chunk, 1, n, out) != n) {
+            deflateEnd(&strm);
+            return -1;
+        }
+    } while (ret != Z_STREAM_END);
+    deflateEnd(&strm);
+    return 0;
+}
+
+int test_gzip_file(const char *filename, const char *output, int members, size_t padding) {
+    uint8_t *buf = NULL;
+    FILE *in = NULL, *out = NULL;
+    size_t size, start, end;
+    long len;
+    int ret = -1;
+
+    if ((in = fopen(filename, "rb")) == NULL || fseek(in, 0, SEEK_END) != 0 || (len = ftell(in)) <= 0 ||
+        fseek(in, 0, SEEK_SET) != 0 || (buf = malloc((size_t)len + padding)) == NULL ||
+        fread(buf, 1, (size_t)len, in) != (size_t)len || (out = fopen(output, "wb")) == NULL) {
+        goto done;
+    }
+
+    /* members split the stream at odd offsets, not at records */
+    size = (size_t)len;
+    for (int i = 0; i < members; i++) {
+        start = size * (size_t)i / (size_t)members + (i > 0 ? 7 : 0);
+        end = i + 1 < members ? size * (size_t)(i + 1) / (size_t)members + 7 : size;
+        if (_test_gzip_member(out, buf + start, end - start) < 0) {
+            goto done;
+        }
+    }
+    memset(buf + size, 0, padding);
+    if (fwrite(buf + size, 1, padding, out) == padding) {
+        ret = 0;
+    }
+
+    done:
+    if (in != NULL) {
+        fclose(in);
+    }
+    if (out != NULL && fclose(out) != 0) {
+        ret = -1;
+    }
+    free(buf);
+    return ret;
+}
+
+/* FNV-1a over the values of a record */
+static uint64_t _test_hash(uint64_t hash, uint64_t v) {
+    for (int i = 0; i < 8; i++, v >>= 8) {
+        hash = (hash ^ (v & 0xff)) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+uint64_t test_hash_handle(flowtuple_handle_t *handle, uint64_t *tuples) {
+    flowtuple_record_t *record = flowtuple_record_create();
+    flowtuple_header_t *header;
+    flowtuple_trailer_t *trailer;
+    flowtuple_interval_t *interval;
+    flowtuple_class_t *ftclass;
+    flowtuple_data_t *data;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    int ret;
+
+    *tuples = 0;
+    while ((ret = flowtuple_get_next_record(handle, record)) > 0) {
+        hash = _test_hash(hash, flowtuple_record_get_type(record));
+        switch (flowtuple_record_get_type(record)) {
+            case FLOWTUPLE_RECORD_TYPE_HEADER:
+                header = flowtuple_record_get_header(record);
+                hash = _test_hash(hash, flowtuple_header_get_local_init_time(header));
+                hash = _test_hash(hash, flowtuple_header_get_interval_length(header));
+                hash = _test_hash(hash, flowtuple_header_get_plugin_count(header));
+                break;
+            case FLOWTUPLE_RECORD_TYPE_TRAILER:
+                trailer = flowtuple_record_get_trailer(record);
+                hash = _test_hash(hash, flowtuple_trailer_get_packet_count(trailer));
+                hash = _test_hash(hash, flowtuple_trailer_get_runtime(trailer));
+                break;
+            case FLOWTUPLE_RECORD_TYPE_INTERVAL:
+                interval = flowtuple_record_get_interval(record);
+                hash = _test_hash(hash, flowtuple_interval_get_number(interval));
+                hash = _test_hash(hash, flowtuple_interval_get_time(interval));
+                break;
+            case FLOWTUPLE_RECORD_TYPE_FLOWTUPLE_CLASS:
+                ftclass = flowtuple_record_get_class(record);
+                hash = _test_hash(hash, flowtuple_class_get_magic(ftclass));
+                hash = _test_hash(hash, flowtuple_class_get_class_type(ftclass));
+                break;
+            case FLOWTUPLE_RECORD_TYPE_FLOWTUPLE_DATA:
+                data = flowtuple_record_get_data(record);
+                hash = _test_hash(hash, flowtuple_data_get_number(data));
+                hash = _test_hash(hash, flowtuple_data_get_src_ip(data));
+                hash = _test_hash(hash, flowtuple_data_get_dest_ip(data));
+                hash = _test_hash(hash, flowtuple_data_get_src_port(data));
+                hash = _test_hash(hash, flowtuple_data_get_dest_port(data));
+                hash = _test_hash(hash, flowtuple_data_get_protocol(data));
+                hash = _test_hash(hash, flowtuple_data_get_ttl(data));
+                hash = _test_hash(hash, flowtuple_data_get_tcp_flags(data));
+                hash = _test_hash(hash, flowtuple_data_get_ip_len(data));
+                hash = _test_hash(hash, flowtuple_data_get_packet_count(data));
+                (*tuples)++;
+                break;
+            default:
+                break;
+        }
+    }
+    flowtuple_record_free(record);
+    return ret < 0 ? 0 : hash;
+}
+
+uint64_t test_hash_file(const char *filename, uint64_t *tuples) {
+    flowtuple_handle_t *handle;
+    flowtuple_errno_t err;
+    uint64_t hash;
+
+    if ((handle = flowtuple_initialize(filename, &err)) == NULL) {
+        return 0;
+    }
+    hash = test_hash_handle(handle, tuples);
+    flowtuple_release(handle);
+    return hash;
+}
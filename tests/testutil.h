@@ -0,0 +1,69 @@
+/*
+ *  testutil.h
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef TESTUTIL_H
+#define TESTUTIL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <flowtuple.h>
+
+/* fails the test, naming the condition that did not hold */
+#define TEST_CHECK(cond)                                                                \
+    do {                                                                                \
+        if (!(cond)) {                                                                  \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            exit(1);                                                                    \
+        }                                                                               \
+    } while (0)
+
+/* interval length written in the headers of generated files */
+#define TEST_INTERVAL_LENGTH 60
+
+/* tuples generated for each interval, spread over two classes */
+typedef struct _test_file_t {
+    uint32_t seed;
+    uint32_t start;
+    int intervals;
+    size_t tuples;
+} test_file_t;
+
+/* tuple i of an interval, in host byte order, SIXT tuples coming first */
+void test_tuple(const test_file_t *file, int interval, size_t i, flowtuple_tuple_t *tuple);
+
+/* writes an uncompressed file of a header, the intervals of file and a
+ * trailer, as corsaro would, returns 0 on success */
+int test_write_file(const char *filename, const test_file_t *file);
+
+/* copies every record of a file with a writer, returns 0 on success */
+int test_copy_file(const char *filename, const char *output, int compress_type);
+
+/* compresses a file into members gzip members, split at offsets that are not
+ * record boundaries, followed by padding zero bytes, returns 0 on success */
+int test_gzip_file(const char *filename, const char *output, int members, size_t padding);
+
+/* hashes every record read from an open handle, counting the tuples,
+ * 0 on a read error */
+uint64_t test_hash_handle(flowtuple_handle_t *handle, uint64_t *tuples);
+
+/* hashes every record of a file, 0 if it cannot be opened */
+uint64_t test_hash_file(const char *filename, uint64_t *tuples);
+
+#endif /* TESTUTIL_H */
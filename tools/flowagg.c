@@ -0,0 +1,149 @@
+/*
+ *  flowagg.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <flowtuple.h>
+
+static const char *field_names[FLOWTUPLE_FIELD_COUNT] = {
+    "src_ip", "dst_ip", "src_port", "dst_port", "proto", "ttl", "tcp_flags", "ip_len"
+};
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-k field[/width],...] [-m megabytes] [-d spill_dir] filename...\n", name);
+    fprintf(stderr, "fields: src_ip dst_ip src_port dst_port proto ttl tcp_flags ip_len, proto by default\n");
+    exit(-1);
+}
+
+/* parses the group by fields, returns their mask and fills in bucket widths */
+static uint32_t parse_fields(char *spec, uint32_t *widths) {
+    uint32_t fields = 0;
+    char *name;
+    char *slash;
+    int f;
+
+    for (name = strtok(spec, ","); name != NULL; name = strtok(NULL, ",")) {
+        if ((slash = strchr(name, '/')) != NULL) {
+            *slash = '\0';
+        }
+        for (f = 0; f < FLOWTUPLE_FIELD_COUNT && strcmp(name, field_names[f]) != 0; f++);
+        if (f == FLOWTUPLE_FIELD_COUNT) {
+            return 0;
+        }
+        fields |= FLOWTUPLE_FIELD_MASK(f);
+        widths[f] = slash != NULL ? (uint32_t)strtoul(slash + 1, NULL, 10) : 1;
+    }
+    return fields;
+}
+
+static void print_group(const uint32_t *key, uint64_t packets, uint64_t tuples, void *args) {
+    uint32_t fields = *(uint32_t*)args;
+
+    for (int f = 0; f < FLOWTUPLE_FIELD_COUNT; f++) {
+        if (!(fields & FLOWTUPLE_FIELD_MASK(f))) {
+            continue;
+        }
+        if (f == FLOWTUPLE_FIELD_SRC_IP || f == FLOWTUPLE_FIELD_DST_IP) {
+            printf("%u.%u.%u.%u,", key[f] >> 24, (key[f] >> 16) & 0xff, (key[f] >> 8) & 0xff, key[f] & 0xff);
+        } else {
+            printf("%u,", key[f]);
+        }
+    }
+    printf("%llu,%llu\n", (unsigned long long)packets, (unsigned long long)tuples);
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t widths[FLOWTUPLE_FIELD_COUNT];
+    char spec[] = "proto";
+    char *fields_arg = spec;
+    flowtuple_errno_t err = FLOWTUPLE_ERR_OK;
+    flowtuple_handle_t *handle;
+    flowtuple_agg_t *agg;
+    const char *dir = NULL;
+    size_t budget = 0;
+    uint32_t fields;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "k:m:d:")) != -1) {
+        switch (opt) {
+            case 'k':
+                fields_arg = optarg;
+                break;
+            case 'm':
+                budget = (size_t)strtoul(optarg, NULL, 10) << 20;
+                break;
+            case 'd':
+                dir = optarg;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+    }
+
+    if ((fields = parse_fields(fields_arg, widths)) == 0) {
+        usage(argv[0]);
+    }
+    if ((agg = flowtuple_agg_create(fields, budget)) == NULL) {
+        fprintf(stderr, "error: cannot group by all fields at once\n");
+        exit(-1);
+    }
+    for (int f = 0; f < FLOWTUPLE_FIELD_COUNT; f++) {
+        if ((fields & FLOWTUPLE_FIELD_MASK(f)) && flowtuple_agg_set_bucket(agg, (flowtuple_field_t)f, widths[f]) < 0) {
+            usage(argv[0]);
+        }
+    }
+    flowtuple_agg_set_spill_dir(agg, dir);
+
+    for (int i = optind; i < argc && err == FLOWTUPLE_ERR_OK; i++) {
+        if ((handle = flowtuple_initialize(argv[i], &err)) == NULL) {
+            break;
+        }
+        if (flowtuple_agg_read(agg, handle) < 0) {
+            err = flowtuple_errno(handle) != FLOWTUPLE_ERR_OK ? flowtuple_errno(handle) : FLOWTUPLE_ERR_MEM;
+        }
+        flowtuple_release(handle);
+    }
+    if (err != FLOWTUPLE_ERR_OK) {
+        fprintf(stderr, "error: %s\n", flowtuple_strerr(err));
+        flowtuple_agg_free(agg);
+        exit(err);
+    }
+
+    for (int f = 0; f < FLOWTUPLE_FIELD_COUNT; f++) {
+        if (fields & FLOWTUPLE_FIELD_MASK(f)) {
+            printf("%s,", field_names[f]);
+        }
+    }
+    printf("packets,tuples\n");
+
+    if (flowtuple_agg_finish(agg, print_group, &fields) < 0) {
+        fprintf(stderr, "error: could not read back spilled groups\n");
+        flowtuple_agg_free(agg);
+        exit(-1);
+    }
+
+    flowtuple_agg_free(agg);
+    return 0;
+}
@@ -0,0 +1,61 @@
+/*
+ *  flowarchive.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <flowtuple.h>
+
+int main(int argc, char *argv[]) {
+    flowtuple_errno_t err = FLOWTUPLE_ERR_OK;
+    flowtuple_handle_t *handle;
+    flowtuple_archive_t *archive;
+    uint64_t classes = 0;
+    size_t intervals;
+
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s filename archive\n", argv[0]);
+        exit(-1);
+    }
+
+    if ((handle = flowtuple_initialize(argv[1], &err)) == NULL) {
+        fprintf(stderr, "error: %s: %s\n", argv[1], flowtuple_strerr(err));
+        exit(err);
+    }
+    err = flowtuple_archive_write(handle, argv[2]);
+    flowtuple_release(handle);
+    if (err != FLOWTUPLE_ERR_OK) {
+        fprintf(stderr, "error: %s: %s\n", argv[2], flowtuple_strerr(err));
+        exit(err);
+    }
+
+    /* opened again to check it */
+    if ((archive = flowtuple_archive_open(argv[2], &err)) == NULL) {
+        fprintf(stderr, "error: %s: %s\n", argv[2], flowtuple_strerr(err));
+        exit(err);
+    }
+    intervals = flowtuple_archive_get_interval_count(archive);
+    for (size_t i = 0; i < intervals; i++) {
+        classes += flowtuple_archive_get_class_count(archive, i);
+    }
+    fprintf(stderr, "%llu intervals and %llu classes archived\n", (unsigned long long)intervals,
+            (unsigned long long)classes);
+    flowtuple_archive_close(archive);
+    return 0;
+}
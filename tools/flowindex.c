@@ -0,0 +1,70 @@
+/*
+ *  flowindex.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <flowtuple.h>
+
+int main(int argc, char *argv[]) {
+    flowtuple_errno_t err;
+    flowtuple_index_t *index;
+    char *sidecar;
+    size_t classes = 0;
+
+    if (argc != 2 && argc != 3) {
+        fprintf(stderr, "usage: %s filename [sidecar]\n", argv[0]);
+        exit(-1);
+    }
+
+    /* the sidecar sits next to the file by default */
+    if (argc == 3) {
+        sidecar = strdup(argv[2]);
+    } else if ((sidecar = malloc(strlen(argv[1]) + 5)) != NULL) {
+        sprintf(sidecar, "%s.idx", argv[1]);
+    }
+    if (sidecar == NULL) {
+        fprintf(stderr, "error: %s\n", flowtuple_strerr(FLOWTUPLE_ERR_MEM));
+        exit(FLOWTUPLE_ERR_MEM);
+    }
+
+    if ((index = flowtuple_index_build(argv[1], &err)) == NULL) {
+        fprintf(stderr, "error: %s\n", flowtuple_strerr(err));
+        free(sidecar);
+        exit(err);
+    }
+
+    if (flowtuple_index_save(index, sidecar) < 0) {
+        fprintf(stderr, "error: could not write %s\n", sidecar);
+        flowtuple_index_free(index);
+        free(sidecar);
+        exit(-1);
+    }
+
+    for (size_t i = 0; i < flowtuple_index_get_interval_count(index); i++) {
+        classes += flowtuple_index_get_class_count(index, i);
+    }
+    printf("%zu intervals, %zu classes, %zu checkpoints\n", flowtuple_index_get_interval_count(index),
+           classes, flowtuple_index_get_checkpoint_count(index));
+
+    flowtuple_index_free(index);
+    free(sidecar);
+    return 0;
+}
@@ -57,6 +57,8 @@ int main(int argc, char *argv[]) {
 
     handle = flowtuple_initialize(argv[1], &err);
 
+    /* only protocol and packet count are needed */
+    flowtuple_handle_set_lazy(handle, 1);
     flowtuple_loop(handle, -1, process_record, (void*)counts);
 
     err = err == FLOWTUPLE_ERR_OK ? flowtuple_errno(handle) : err;
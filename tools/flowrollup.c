@@ -0,0 +1,103 @@
+/*
+ *  flowrollup.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <wandio.h>
+#include <flowtuple.h>
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-l seconds] [-z level] -o output filename...\n", name);
+    fprintf(stderr, "rolls up consecutive files into intervals of 3600 seconds by default, gzip level 0 writes uncompressed\n");
+    exit(-1);
+}
+
+int main(int argc, char *argv[]) {
+    flowtuple_errno_t err = FLOWTUPLE_ERR_OK;
+    flowtuple_handle_t *handle;
+    flowtuple_writer_t *writer;
+    flowtuple_rollup_t *rollup;
+    const char *output = NULL;
+    unsigned long length = 3600;
+    long level = 6;
+    uint64_t tuples = 0;
+    long n;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "l:z:o:")) != -1) {
+        switch (opt) {
+            case 'l':
+                length = strtoul(optarg, NULL, 10);
+                break;
+            case 'z':
+                level = strtol(optarg, NULL, 10);
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    /* the header has 16 bits for the interval length */
+    if (optind >= argc || output == NULL || length == 0 || length > UINT16_MAX || level < 0 || level > 9) {
+        usage(argv[0]);
+    }
+
+    if ((writer = flowtuple_writer_create(output, level > 0 ? WANDIO_COMPRESS_ZLIB : WANDIO_COMPRESS_NONE,
+                                          (int)level, &err)) == NULL) {
+        fprintf(stderr, "error: %s: %s\n", output, flowtuple_strerr(err));
+        exit(err);
+    }
+    if ((rollup = flowtuple_rollup_create(writer, (uint16_t)length)) == NULL) {
+        fprintf(stderr, "error: %s\n", flowtuple_strerr(FLOWTUPLE_ERR_MEM));
+        flowtuple_writer_close(writer);
+        exit(FLOWTUPLE_ERR_MEM);
+    }
+
+    for (int i = optind; i < argc && err == FLOWTUPLE_ERR_OK; i++) {
+        if ((handle = flowtuple_initialize(argv[i], &err)) == NULL) {
+            fprintf(stderr, "error: %s: %s\n", argv[i], flowtuple_strerr(err));
+            break;
+        }
+        if ((n = flowtuple_rollup_read(rollup, handle)) < 0) {
+            err = flowtuple_rollup_errno(rollup);
+            fprintf(stderr, "error: %s: %s\n", argv[i], flowtuple_strerr(err));
+        }
+        tuples += n > 0 ? (uint64_t)n : 0;
+        flowtuple_release(handle);
+    }
+
+    if (err == FLOWTUPLE_ERR_OK && flowtuple_rollup_finish(rollup) < 0) {
+        err = flowtuple_rollup_errno(rollup);
+        fprintf(stderr, "error: %s: %s\n", output, flowtuple_strerr(err));
+    }
+    fprintf(stderr, "%llu tuples rolled up into %llu tuples in %llu intervals\n", (unsigned long long)tuples,
+            (unsigned long long)flowtuple_rollup_get_tuple_count(rollup),
+            (unsigned long long)flowtuple_rollup_get_interval_count(rollup));
+    flowtuple_rollup_free(rollup);
+
+    if (flowtuple_writer_close(writer) != FLOWTUPLE_ERR_OK && err == FLOWTUPLE_ERR_OK) {
+        err = FLOWTUPLE_ERR_FILE_WRITE;
+        fprintf(stderr, "error: %s: %s\n", output, flowtuple_strerr(err));
+    }
+    return err;
+}
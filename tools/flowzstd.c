@@ -0,0 +1,53 @@
+/*
+ *  flowzstd.c
+ *
+ *  Copyright (c) 2018 Merit Network, Inc.
+ *  Copyright (c) 2012 The Regents of the University of California.
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <flowtuple.h>
+
+int main(int argc, char *argv[]) {
+    flowtuple_errno_t err;
+    int level = 3;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "z:")) != -1) {
+        switch (opt) {
+        case 'z':
+            level = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-z level] filename output\n", argv[0]);
+            exit(-1);
+        }
+    }
+
+    if (argc - optind != 2) {
+        fprintf(stderr, "usage: %s [-z level] filename output\n", argv[0]);
+        exit(-1);
+    }
+
+    /* a frame per interval, so readers can seek and decompress in parallel */
+    if ((err = flowtuple_frames_write(argv[optind], NULL, argv[optind + 1], level)) != FLOWTUPLE_ERR_OK) {
+        fprintf(stderr, "error: %s: %s\n", argv[optind + 1], flowtuple_strerr(err));
+        exit(err);
+    }
+    return 0;
+}